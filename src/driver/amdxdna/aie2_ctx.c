@@ -21,6 +21,37 @@ bool force_cmdlist;
 module_param(force_cmdlist, bool, 0600);
 MODULE_PARM_DESC(force_cmdlist, "Force use command list (Default false)");
 
+uint job_deadline_factor = 10;
+module_param(job_deadline_factor, uint, 0444);
+MODULE_PARM_DESC(job_deadline_factor,
+		 "Job deadline as multiple of QoS latency/exec time, default 10; 0 - No deadline");
+
+bool aie2_oversubscribe;
+module_param(aie2_oversubscribe, bool, 0600);
+MODULE_PARM_DESC(aie2_oversubscribe,
+		 "Time slice columns among contexts when all columns are taken (Default false)");
+
+uint timeslice_ms = 100;
+module_param(timeslice_ms, uint, 0600);
+MODULE_PARM_DESC(timeslice_ms, "Time slice quantum of oversubscribed contexts in ms, default 100");
+
+uint timeslice_policy;
+module_param(timeslice_policy, uint, 0600);
+MODULE_PARM_DESC(timeslice_policy,
+		 "Time slice policy: 0 - Round robin (Default); 1 - QoS priority first");
+
+uint hwctx_park_ms;
+module_param(hwctx_park_ms, uint, 0600);
+MODULE_PARM_DESC(hwctx_park_ms,
+		 "Park a context after it is idle for this many ms, default 0 - Never park");
+
+#define AIE2_JOB_DEADLINE_MIN_MS	500
+#define AIE2_JOB_DEADLINE_MAX_MS	60000
+
+#define AIE2_TS_POLICY_RR		0
+#define AIE2_TS_POLICY_PRIORITY		1
+#define AIE2_TS_RETRY_MS		10
+
 static void aie2_job_release(struct kref *ref)
 {
 	struct amdxdna_sched_job *job;
@@ -52,17 +83,24 @@ static void aie2_hwctx_stop(struct amdxdna_dev *xdna, struct amdxdna_hwctx *hwct
 	XDNA_DBG(xdna, "Stopped %s", hwctx->name);
 }
 
-static int aie2_hwctx_restart(struct amdxdna_dev *xdna, struct amdxdna_hwctx *hwctx)
+/*
+ * Bring a stopped context back. With create_ctx false, the firmware context
+ * has already been created by the solver load action.
+ */
+static int __aie2_hwctx_restart(struct amdxdna_dev *xdna, struct amdxdna_hwctx *hwctx,
+				bool create_ctx)
 {
 	struct amdxdna_gem_obj *heap = hwctx->priv->heap;
 	int ret;
 
 	WARN_ONCE(hwctx->status != HWCTX_STATE_STOP, "hwctx should be in stop state");
 
-	ret = aie2_create_context(xdna->dev_handle, hwctx);
-	if (ret) {
-		XDNA_ERR(xdna, "Create hwctx failed, ret %d", ret);
-		goto out;
+	if (create_ctx) {
+		ret = aie2_create_context(xdna->dev_handle, hwctx);
+		if (ret) {
+			XDNA_ERR(xdna, "Create hwctx failed, ret %d", ret);
+			goto out;
+		}
 	}
 
 	ret = aie2_map_host_buf(xdna->dev_handle, hwctx->fw_ctx_id,
@@ -113,6 +151,11 @@ out:
 	return ret;
 }
 
+static int aie2_hwctx_restart(struct amdxdna_dev *xdna, struct amdxdna_hwctx *hwctx)
+{
+	return __aie2_hwctx_restart(xdna, hwctx, true);
+}
+
 static const char *
 aie2_fence_state2str(struct dma_fence *fence)
 {
@@ -144,7 +187,7 @@ aie2_hwctx_dump(struct amdxdna_dev *xdna, struct amdxdna_hwctx *hwctx)
 	mutex_unlock(&hwctx->priv->io_lock);
 }
 
-void aie2_dump_ctx(struct amdxdna_client *client)
+void aie2_dump_ctx(struct amdxdna_client *client, u32 col_map)
 {
 	struct amdxdna_dev *xdna = client->xdna;
 	struct amdxdna_hwctx *hwctx;
@@ -152,12 +195,16 @@ void aie2_dump_ctx(struct amdxdna_client *client)
 
 	drm_WARN_ON(&xdna->ddev, !mutex_is_locked(&xdna->dev_lock));
 	mutex_lock(&client->hwctx_lock);
-	amdxdna_for_each_hwctx(client, hwctx_id, hwctx)
+	amdxdna_for_each_hwctx(client, hwctx_id, hwctx) {
+		if (!(amdxdna_hwctx_col_map(hwctx) & col_map))
+			continue;
+
 		aie2_hwctx_dump(xdna, hwctx);
+	}
 	mutex_unlock(&client->hwctx_lock);
 }
 
-void aie2_stop_ctx(struct amdxdna_client *client)
+void aie2_stop_ctx(struct amdxdna_client *client, u32 col_map)
 {
 	struct amdxdna_dev *xdna = client->xdna;
 	struct amdxdna_hwctx *hwctx;
@@ -166,7 +213,8 @@ void aie2_stop_ctx(struct amdxdna_client *client)
 	drm_WARN_ON(&xdna->ddev, !mutex_is_locked(&xdna->dev_lock));
 	mutex_lock(&client->hwctx_lock);
 	amdxdna_for_each_hwctx(client, hwctx_id, hwctx) {
-		if (hwctx->status == HWCTX_STATE_INIT)
+		if (hwctx->status == HWCTX_STATE_INIT ||
+		    !(amdxdna_hwctx_col_map(hwctx) & col_map))
 			continue;
 
 		aie2_hwctx_stop(xdna, hwctx, NULL);
@@ -174,7 +222,7 @@ void aie2_stop_ctx(struct amdxdna_client *client)
 	mutex_unlock(&client->hwctx_lock);
 }
 
-void aie2_restart_ctx(struct amdxdna_client *client)
+void aie2_restart_ctx(struct amdxdna_client *client, u32 col_map)
 {
 	struct amdxdna_dev *xdna = client->xdna;
 	struct amdxdna_hwctx *hwctx;
@@ -184,7 +232,8 @@ void aie2_restart_ctx(struct amdxdna_client *client)
 	drm_WARN_ON(&xdna->ddev, !mutex_is_locked(&xdna->dev_lock));
 	mutex_lock(&client->hwctx_lock);
 	amdxdna_for_each_hwctx(client, hwctx_id, hwctx) {
-		if (hwctx->status != HWCTX_STATE_STOP)
+		if (hwctx->status != HWCTX_STATE_STOP || hwctx->priv->ts_waiting ||
+		    !(amdxdna_hwctx_col_map(hwctx) & col_map))
 			continue;
 
 		XDNA_DBG(xdna, "Resetting %s", hwctx->name);
@@ -198,6 +247,89 @@ void aie2_restart_ctx(struct amdxdna_client *client)
 	mutex_unlock(&client->hwctx_lock);
 }
 
+int aie2_simulate_hang(struct amdxdna_dev *xdna, u32 col_map)
+{
+#if KERNEL_VERSION(6, 8, 0) <= LINUX_VERSION_CODE
+	struct amdxdna_client *client;
+	struct amdxdna_hwctx *hwctx;
+	unsigned long hwctx_id;
+
+	mutex_lock(&xdna->dev_lock);
+	list_for_each_entry(client, &xdna->client_list, node) {
+		mutex_lock(&client->hwctx_lock);
+		amdxdna_for_each_hwctx(client, hwctx_id, hwctx) {
+			if (hwctx->status != HWCTX_STATE_READY ||
+			    !(amdxdna_hwctx_col_map(hwctx) & col_map))
+				continue;
+
+			/* Jobs are queued but not run until the context is restarted */
+			drm_sched_wqueue_stop(&hwctx->priv->sched);
+			XDNA_INFO(xdna, "Simulated hang on %s", hwctx->name);
+		}
+		mutex_unlock(&client->hwctx_lock);
+	}
+	mutex_unlock(&xdna->dev_lock);
+
+	return 0;
+#else
+	return -EOPNOTSUPP;
+#endif
+}
+
+static bool aie2_ts_has_work(struct amdxdna_hwctx *hwctx)
+{
+	return READ_ONCE(hwctx->submitted) != READ_ONCE(hwctx->completed);
+}
+
+static void aie2_ts_kick(struct amdxdna_dev_hdl *ndev)
+{
+	if (!list_empty(&ndev->ts_wait_list))
+		queue_delayed_work(system_wq, &ndev->ts_work, 0);
+}
+
+static bool aie2_ts_can_wait(struct amdxdna_hwctx *hwctx)
+{
+	if (!aie2_oversubscribe)
+		return false;
+#ifdef AMDXDNA_DEVEL
+	/* PDIs are registered to firmware at CU config time */
+	if (priv_load)
+		return false;
+#endif
+	return true;
+}
+
+static void aie2_ts_undrain(struct amdxdna_hwctx *hwctx)
+{
+	struct amdxdna_dev_hdl *ndev = hwctx->client->xdna->dev_handle;
+
+	if (ndev->ts_draining != hwctx)
+		return;
+
+	ndev->ts_draining = NULL;
+	/* A stopped context starts its scheduler on restart */
+	if (hwctx->status == HWCTX_STATE_READY)
+		drm_sched_wqueue_start(&hwctx->priv->sched);
+}
+
+/*
+ * The victim of a swap stops sending jobs to the device and is swapped out
+ * once the jobs already there are done. Jobs queued meanwhile run in its next
+ * time slice. The time slice worker polls for this rather than waiting with
+ * dev_lock held.
+ */
+static bool aie2_ts_drain(struct amdxdna_hwctx *hwctx)
+{
+	struct amdxdna_dev_hdl *ndev = hwctx->client->xdna->dev_handle;
+
+	if (ndev->ts_draining && ndev->ts_draining != hwctx)
+		aie2_ts_undrain(ndev->ts_draining);
+
+	ndev->ts_draining = hwctx;
+	drm_sched_wqueue_stop(&hwctx->priv->sched);
+	return !atomic_read(&hwctx->busy_depth);
+}
+
 static void aie2_hwctx_wait_for_idle(struct amdxdna_hwctx *hwctx)
 {
 	struct dma_fence *fence;
@@ -220,6 +352,11 @@ void aie2_hwctx_suspend(struct amdxdna_hwctx *hwctx)
 	 * and abort all commands.
 	 */
 	drm_WARN_ON(&xdna->ddev, !mutex_is_locked(&xdna->dev_lock));
+	/* A waiting context has nothing on the device to suspend */
+	if (hwctx->priv->ts_waiting)
+		return;
+
+	aie2_ts_undrain(hwctx);
 	aie2_hwctx_wait_for_idle(hwctx);
 	aie2_hwctx_stop(xdna, hwctx, NULL);
 }
@@ -227,6 +364,9 @@ void aie2_hwctx_suspend(struct amdxdna_hwctx *hwctx)
 void aie2_hwctx_resume(struct amdxdna_hwctx *hwctx)
 {
 	struct amdxdna_dev *xdna = hwctx->client->xdna;
+	struct aie2_park_stats *stats;
+	ktime_t start;
+	u64 elapsed;
 	int err;
 
 	/*
@@ -235,10 +375,175 @@ void aie2_hwctx_resume(struct amdxdna_hwctx *hwctx)
 	 * mailbox channel, error will return.
 	 */
 	drm_WARN_ON(&xdna->ddev, !mutex_is_locked(&xdna->dev_lock));
+	if (hwctx->priv->ts_waiting) {
+		aie2_ts_kick(xdna->dev_handle);
+		return;
+	}
+
+	start = ktime_get();
 	err = aie2_hwctx_restart(xdna, hwctx);
 	if (err)
 		XDNA_WARN(xdna, "Failed to resume %s status %d err %d",
 			  hwctx->name, hwctx->status, err);
+
+	elapsed = ktime_to_ns(ktime_sub(ktime_get(), start));
+	stats = &xdna->dev_handle->park_stats;
+	stats->restarts++;
+	stats->restart_ns += elapsed;
+	stats->restart_max_ns = max(stats->restart_max_ns, elapsed);
+}
+
+/*
+ * Parking marks a context that stays idle as idle to the solver, so its clock
+ * request no longer holds the device up. Firmware has no per context suspend,
+ * the firmware context, its PDI registration and host buffer mapping are all
+ * kept. Unparking puts the request back. Either may change the DPM level,
+ * which sends SMU messages, so unpark runs from aie2_hwctx_unpark_work() and
+ * the submit path only queues it. Until it runs, jobs of an unparking context
+ * run at the clock the other contexts hold the device at.
+ */
+static void aie2_hwctx_park(struct amdxdna_hwctx *hwctx)
+{
+	struct amdxdna_dev *xdna = hwctx->client->xdna;
+	struct amdxdna_hwctx_priv *priv = hwctx->priv;
+	int ret;
+
+	/* Pairs with smp_mb() in aie2_cmd_submit() */
+	WRITE_ONCE(priv->parked, true);
+	smp_mb();
+	if (aie2_ts_has_work(hwctx)) {
+		WRITE_ONCE(priv->parked, false);
+		return;
+	}
+
+	ret = xrs_set_idle(xdna->xrs_hdl, (uintptr_t)hwctx, true);
+	if (ret) {
+		XDNA_DBG(xdna, "Park %s failed, ret %d", hwctx->name, ret);
+		WRITE_ONCE(priv->parked, false);
+		return;
+	}
+
+	xdna->dev_handle->park_stats.parks++;
+	XDNA_DBG(xdna, "%s parked", hwctx->name);
+}
+
+static void aie2_hwctx_unpark(struct amdxdna_hwctx *hwctx)
+{
+	struct amdxdna_dev *xdna = hwctx->client->xdna;
+	struct amdxdna_hwctx_priv *priv = hwctx->priv;
+	struct aie2_park_stats *stats;
+	ktime_t start;
+	u64 elapsed;
+	int ret;
+
+	drm_WARN_ON(&xdna->ddev, !mutex_is_locked(&xdna->dev_lock));
+	if (!priv->parked)
+		return;
+
+	start = ktime_get();
+	ret = xrs_set_idle(xdna->xrs_hdl, (uintptr_t)hwctx, false);
+	if (ret)
+		XDNA_WARN(xdna, "Unpark %s failed, ret %d", hwctx->name, ret);
+	WRITE_ONCE(priv->parked, false);
+
+	elapsed = ktime_to_ns(ktime_sub(ktime_get(), start));
+	stats = &xdna->dev_handle->park_stats;
+	stats->unparks++;
+	stats->unpark_ns += elapsed;
+	stats->unpark_max_ns = max(stats->unpark_max_ns, elapsed);
+	XDNA_DBG(xdna, "%s unparked in %lld ns", hwctx->name, elapsed);
+}
+
+static void aie2_hwctx_unpark_work(struct work_struct *work)
+{
+	struct amdxdna_hwctx_priv *priv;
+	struct amdxdna_hwctx *hwctx;
+	struct amdxdna_dev *xdna;
+
+	priv = container_of(work, struct amdxdna_hwctx_priv, unpark_work);
+	hwctx = priv->hwctx;
+	xdna = hwctx->client->xdna;
+
+	mutex_lock(&xdna->dev_lock);
+	aie2_hwctx_unpark(hwctx);
+	mutex_unlock(&xdna->dev_lock);
+}
+
+static void aie2_hwctx_park_work(struct work_struct *work)
+{
+	struct amdxdna_hwctx_priv *priv;
+	struct amdxdna_hwctx *hwctx;
+	struct amdxdna_dev *xdna;
+
+	priv = container_of(to_delayed_work(work), struct amdxdna_hwctx_priv, park_work);
+	hwctx = priv->hwctx;
+	xdna = hwctx->client->xdna;
+
+	mutex_lock(&xdna->dev_lock);
+
+	if (hwctx->status == HWCTX_STATE_READY && !priv->parked && !priv->ts_waiting)
+		aie2_hwctx_park(hwctx);
+
+	mutex_unlock(&xdna->dev_lock);
+}
+
+static void aie2_busy_start(struct amdxdna_sched_job *job)
+{
+	job->start_time = ktime_get();
+	amdxdna_hwctx_busy_start(job->hwctx, job->start_time);
+}
+
+static void aie2_busy_end(struct amdxdna_sched_job *job, bool done)
+{
+	struct amdxdna_hwctx *hwctx = job->hwctx;
+	struct amdxdna_dev_hdl *ndev = hwctx->client->xdna->dev_handle;
+
+	amdxdna_hwctx_busy_end(hwctx, job->start_time, ktime_get(),
+			       READ_ONCE(ndev->hclk_freq), done);
+}
+
+/*
+ * Busy time of each partition since last call, indexed by start column, and
+ * latency of the jobs completed since last call. Contexts sharing a partition
+ * are added up, so a shared partition can go above 100%. Latency counts the
+ * time jobs spent on the device, failed ones included.
+ */
+void aie2_sample_busy(struct amdxdna_dev *xdna, u64 *part_busy_ns, u32 ncols,
+		      u64 *lat_sum_us, u32 *lat_cnt)
+{
+	struct amdxdna_hwctx_priv *priv;
+	struct amdxdna_client *client;
+	struct amdxdna_hwctx *hwctx;
+	unsigned long hwctx_id;
+	u64 busy, depth, jobs;
+
+	drm_WARN_ON(&xdna->ddev, !mutex_is_locked(&xdna->dev_lock));
+	*lat_sum_us = 0;
+	*lat_cnt = 0;
+	list_for_each_entry(client, &xdna->client_list, node) {
+		mutex_lock(&client->hwctx_lock);
+		amdxdna_for_each_hwctx(client, hwctx_id, hwctx) {
+			priv = hwctx->priv;
+			if (!priv)
+				continue;
+
+			/* Lock free reads may lag for a moment, never go back */
+			busy = amdxdna_hwctx_busy_ns(hwctx, ktime_get());
+			if (busy > priv->busy_sampled) {
+				if (hwctx->start_col < ncols)
+					part_busy_ns[hwctx->start_col] += busy - priv->busy_sampled;
+				priv->busy_sampled = busy;
+			}
+
+			depth = atomic64_read(&hwctx->usage.depth_ns);
+			jobs = atomic64_read(&hwctx->usage.jobs);
+			*lat_sum_us += div_u64(depth - priv->depth_sampled, NSEC_PER_USEC);
+			*lat_cnt += jobs - priv->jobs_sampled;
+			priv->depth_sampled = depth;
+			priv->jobs_sampled = jobs;
+		}
+		mutex_unlock(&client->hwctx_lock);
+	}
 }
 
 static void
@@ -248,10 +553,11 @@ aie2_sched_notify(struct amdxdna_sched_job *job)
 	struct dma_fence *fence = job->fence;
 	int idx;
 
-#ifdef AMDXDNA_DRM_USAGE
-	amdxdna_update_stats(hwctx->client, ktime_get(), false);
-#endif
+	aie2_busy_end(job, true);
 	hwctx->completed++;
+	if (hwctx_park_ms && hwctx->completed == READ_ONCE(hwctx->submitted))
+		mod_delayed_work(system_wq, &hwctx->priv->park_work,
+				 msecs_to_jiffies(hwctx_park_ms));
 	trace_xdna_job(&job->base, hwctx->name, "signaling fence", job->seq, job->opcode);
 	dma_fence_signal(fence);
 	idx = get_job_idx(job->seq);
@@ -390,6 +696,7 @@ aie2_sched_job_run(struct drm_sched_job *sched_job)
 
 	kref_get(&job->refcnt);
 	fence = dma_fence_get(job->fence);
+	aie2_busy_start(job);
 
 	switch (job->opcode) {
 	case OP_SYNC_BO:
@@ -414,19 +721,59 @@ aie2_sched_job_run(struct drm_sched_job *sched_job)
 
 out:
 	if (ret) {
+		aie2_busy_end(job, false);
 		dma_fence_put(job->fence);
 		aie2_job_put(job);
 		mmput(job->mm);
 		fence = ERR_PTR(ret);
 	}
-#ifdef AMDXDNA_DRM_USAGE
-	else
-		amdxdna_update_stats(hwctx->client, ktime_get(), true);
-#endif
 
 	return fence;
 }
 
+/* Leave the job on the pending list, scheduler re-arms its timeout */
+static enum drm_gpu_sched_stat
+aie2_sched_job_keep_pending(struct drm_sched_job *sched_job)
+{
+#if KERNEL_VERSION(6, 17, 0) <= LINUX_VERSION_CODE
+	return DRM_GPU_SCHED_STAT_NO_HANG;
+#else
+	spin_lock(&sched_job->sched->job_list_lock);
+	list_add(&sched_job->list, &sched_job->sched->pending_list);
+	spin_unlock(&sched_job->sched->job_list_lock);
+	return DRM_GPU_SCHED_STAT_NOMINAL;
+#endif
+}
+
+static enum drm_gpu_sched_stat
+aie2_sched_job_timedout(struct drm_sched_job *sched_job)
+{
+	struct amdxdna_sched_job *job = drm_job_to_xdna_job(sched_job);
+	struct amdxdna_hwctx *hwctx = job->hwctx;
+	struct amdxdna_dev *xdna = hwctx->client->xdna;
+
+	/* Scheduler timeout only polls, each job has its own deadline */
+	if (!job->deadline_ms ||
+	    ktime_ms_delta(ktime_get(), job->start_time) < job->deadline_ms)
+		return aie2_sched_job_keep_pending(sched_job);
+
+	trace_xdna_job(sched_job, hwctx->name, "job timedout", job->seq, job->opcode);
+	XDNA_WARN(xdna, "%s job seq %lld opcode %d missed deadline %d ms",
+		  hwctx->name, job->seq, job->opcode, job->deadline_ms);
+
+	/*
+	 * Recovery needs dev_lock, which cannot be taken here since context
+	 * destroy holds it while waiting for this handler. Hand the context
+	 * over to TDR worker and keep the job pending.
+	 */
+	hwctx->tdr_stalled_seq = job->seq;
+	WRITE_ONCE(hwctx->tdr_timedout, true);
+	if (!amdxdna_tdr_request(&xdna->tdr))
+		XDNA_WARN(xdna, "TDR not started, %s is not recovered", hwctx->name);
+
+	return aie2_sched_job_keep_pending(sched_job);
+}
+
 static void aie2_sched_job_free(struct drm_sched_job *sched_job)
 {
 	struct amdxdna_sched_job *job = drm_job_to_xdna_job(sched_job);
@@ -442,9 +789,35 @@ static void aie2_sched_job_free(struct drm_sched_job *sched_job)
 
 const struct drm_sched_backend_ops sched_ops = {
 	.run_job = aie2_sched_job_run,
+	.timedout_job = aie2_sched_job_timedout,
 	.free_job = aie2_sched_job_free,
 };
 
+/*
+ * Job deadline in ms, derived from the QoS of the context when the job is
+ * armed. QoS latency and frame execution time are in ms. Without QoS, jobs
+ * have no deadline and hang is detected by TDR polling only.
+ */
+static u32 aie2_job_deadline_ms(struct amdxdna_hwctx *hwctx)
+{
+	u32 ms = max(READ_ONCE(hwctx->qos.latency), READ_ONCE(hwctx->qos.frame_exec_time));
+
+	if (!ms || !job_deadline_factor)
+		return 0;
+
+	return clamp_t(u64, (u64)ms * job_deadline_factor,
+		       AIE2_JOB_DEADLINE_MIN_MS, AIE2_JOB_DEADLINE_MAX_MS);
+}
+
+/* Scheduler timeout is how often the deadline of the running job is checked */
+static long aie2_hwctx_sched_timeout(void)
+{
+	if (!job_deadline_factor)
+		return MAX_SCHEDULE_TIMEOUT;
+
+	return msecs_to_jiffies(AIE2_JOB_DEADLINE_MIN_MS);
+}
+
 static int aie2_hwctx_col_list(struct amdxdna_hwctx *hwctx)
 {
 	struct amdxdna_dev *xdna = hwctx->client->xdna;
@@ -527,6 +900,16 @@ skip_list_cal:
 	return 0;
 }
 
+static void aie2_fill_rqos(const struct amdxdna_qos_info *qos, struct aie_qos *rqos)
+{
+	rqos->gops = qos->gops;
+	rqos->fps = qos->fps;
+	rqos->dma_bw = qos->dma_bandwidth;
+	rqos->latency = qos->latency;
+	rqos->exec_time = qos->frame_exec_time;
+	rqos->priority = qos->priority;
+}
+
 static int aie2_alloc_resource(struct amdxdna_hwctx *hwctx)
 {
 	struct amdxdna_dev *xdna = hwctx->client->xdna;
@@ -542,17 +925,14 @@ static int aie2_alloc_resource(struct amdxdna_hwctx *hwctx)
 	xrs_req->cdo.ncols = hwctx->num_col;
 	xrs_req->cdo.qos_cap.opc = hwctx->max_opc;
 
-	xrs_req->rqos.gops = hwctx->qos.gops;
-	xrs_req->rqos.fps = hwctx->qos.fps;
-	xrs_req->rqos.dma_bw = hwctx->qos.dma_bandwidth;
-	xrs_req->rqos.latency = hwctx->qos.latency;
-	xrs_req->rqos.exec_time = hwctx->qos.frame_exec_time;
-	xrs_req->rqos.priority = hwctx->qos.priority;
+	aie2_fill_rqos(&hwctx->qos, &xrs_req->rqos);
 
 	xrs_req->rid = (uintptr_t)hwctx;
 
 	ret = xrs_allocate_resource(xdna->xrs_hdl, xrs_req, hwctx);
-	if (ret)
+	if (ret == -ENODEV && aie2_oversubscribe)
+		XDNA_DBG(xdna, "No AIE resource for %s", hwctx->name);
+	else if (ret)
 		XDNA_ERR(xdna, "Allocate AIE resource failed, ret %d", ret);
 
 	kfree(xrs_req);
@@ -562,8 +942,18 @@ static int aie2_alloc_resource(struct amdxdna_hwctx *hwctx)
 static void aie2_release_resource(struct amdxdna_hwctx *hwctx)
 {
 	struct amdxdna_dev *xdna = hwctx->client->xdna;
+	struct amdxdna_hwctx_priv *priv = hwctx->priv;
 	int ret;
 
+	/* A waiting context holds no columns */
+	if (priv->ts_waiting) {
+		list_del_init(&priv->ts_node);
+		priv->ts_waiting = false;
+		return;
+	}
+
+	/* The solver forgets the idle mark along with the resource */
+	priv->parked = false;
 	ret = xrs_release_resource(xdna->xrs_hdl, (uintptr_t)hwctx);
 	if (ret)
 		XDNA_ERR(xdna, "Release AIE resource failed, ret %d", ret);
@@ -663,6 +1053,12 @@ int aie2_hwctx_init(struct amdxdna_hwctx *hwctx)
 
 	sched = &priv->sched;
 	mutex_init(&priv->io_lock);
+	spin_lock_init(&priv->busy_lock);
+	priv->hwctx = hwctx;
+	INIT_DELAYED_WORK(&priv->park_work, aie2_hwctx_park_work);
+	INIT_WORK(&priv->unpark_work, aie2_hwctx_unpark_work);
+	INIT_LIST_HEAD(&priv->ts_node);
+	priv->ts_since = ktime_get();
 
 	fs_reclaim_acquire(GFP_KERNEL);
 	might_lock(&priv->io_lock);
@@ -677,7 +1073,7 @@ int aie2_hwctx_init(struct amdxdna_hwctx *hwctx)
 		goto free_cmd_bufs;
 	}
 	ret = drm_sched_init(sched, &sched_ops, priv->submit_wq, DRM_SCHED_PRIORITY_COUNT,
-			     HWCTX_MAX_CMDS, 0, MAX_SCHEDULE_TIMEOUT,
+			     HWCTX_MAX_CMDS, 0, aie2_hwctx_sched_timeout(),
 			     NULL, NULL, hwctx->name, xdna->ddev.dev);
 	if (ret) {
 		XDNA_ERR(xdna, "Failed to init DRM scheduler. ret %d", ret);
@@ -697,7 +1093,21 @@ int aie2_hwctx_init(struct amdxdna_hwctx *hwctx)
 		goto free_entity;
 	}
 
+	ndev = xdna->dev_handle;
 	ret = aie2_alloc_resource(hwctx);
+	if (ret == -ENODEV && aie2_ts_can_wait(hwctx)) {
+		/*
+		 * Columns and firmware context are given by the time slice
+		 * worker. Until then jobs are queued but not run.
+		 */
+		hwctx->fw_ctx_id = -1;
+		hwctx->start_col = hwctx->col_list[0];
+		drm_sched_wqueue_stop(sched);
+		priv->ts_waiting = true;
+		list_add_tail(&priv->ts_node, &ndev->ts_wait_list);
+		XDNA_DBG(xdna, "%s waits for %d columns", hwctx->name, hwctx->num_col);
+		goto create_syncobj;
+	}
 	if (ret) {
 		XDNA_ERR(xdna, "Alloc hw resource failed, ret %d", ret);
 		goto free_col_list;
@@ -720,15 +1130,18 @@ skip:
 		goto release_resource;
 	}
 
+create_syncobj:
 	ret = aie2_ctx_syncobj_create(hwctx);
 	if (ret) {
 		XDNA_ERR(xdna, "Create syncobj failed, ret %d", ret);
 		goto release_resource;
 	}
 	hwctx->status = HWCTX_STATE_INIT;
-	ndev = xdna->dev_handle;
 	ndev->hwctx_num++;
+	aie2_snap_invalidate(ndev);
 	init_waitqueue_head(&priv->status_wq);
+	if (priv->ts_waiting)
+		aie2_ts_kick(ndev);
 
 	XDNA_DBG(xdna, "hwctx %s init completed", hwctx->name);
 
@@ -755,6 +1168,7 @@ put_heap:
 	drm_gem_object_put(to_gobj(heap));
 free_priv:
 	kfree(priv);
+	hwctx->priv = NULL;
 	return ret;
 }
 
@@ -767,10 +1181,14 @@ void aie2_hwctx_fini(struct amdxdna_hwctx *hwctx)
 	xdna = hwctx->client->xdna;
 	ndev = xdna->dev_handle;
 	ndev->hwctx_num--;
+	aie2_snap_invalidate(ndev);
+	aie2_ts_undrain(hwctx);
 	drm_sched_wqueue_stop(&hwctx->priv->sched);
 
 	/* Now, scheduler will not send command to device. */
 	aie2_release_resource(hwctx);
+	/* Freed columns may be given to a waiting context */
+	aie2_ts_kick(ndev);
 
 	/*
 	 * All submitted commands are aborted.
@@ -781,6 +1199,16 @@ void aie2_hwctx_fini(struct amdxdna_hwctx *hwctx)
 
 	wait_event(hwctx->priv->status_wq,
 		   atomic_read(&hwctx->job_submit_cnt) == atomic_read(&hwctx->job_free_cnt));
+
+	/*
+	 * No job is left to queue park or unpark work again. They take dev_lock,
+	 * so they are cancelled without holding it, see
+	 * aie2_error_async_events_free().
+	 */
+	mutex_unlock(&xdna->dev_lock);
+	cancel_delayed_work_sync(&hwctx->priv->park_work);
+	cancel_work_sync(&hwctx->priv->unpark_work);
+	mutex_lock(&xdna->dev_lock);
 	drm_sched_entity_destroy(&hwctx->priv->entity);
 	drm_sched_fini(&hwctx->priv->sched);
 	destroy_workqueue(hwctx->priv->submit_wq);
@@ -831,6 +1259,14 @@ static int aie2_hwctx_cu_config(struct amdxdna_hwctx *hwctx, void *buf, u32 size
 	if (!hwctx->cus)
 		return -ENOMEM;
 
+	if (hwctx->priv->ts_waiting) {
+		/* Configured to firmware when the context gets its columns */
+		XDNA_DBG(xdna, "%s waits for columns, defer CU config", hwctx->name);
+		wmb(); /* To avoid locking in command submit when check status */
+		hwctx->status = HWCTX_STATE_STOP;
+		return 0;
+	}
+
 #ifdef AMDXDNA_DEVEL
 	if (priv_load) {
 		ret = aie2_register_pdis(hwctx);
@@ -938,6 +1374,32 @@ static int aie2_hwctx_detach_debug_bo(struct amdxdna_hwctx *hwctx, u32 bo_hdl)
 	return ret;
 }
 
+static int aie2_hwctx_qos_config(struct amdxdna_hwctx *hwctx, void *buf, u32 size)
+{
+	struct amdxdna_dev *xdna = hwctx->client->xdna;
+	struct amdxdna_qos_info *qos = buf;
+	struct aie_qos rqos;
+	int ret;
+
+	if (size < sizeof(*qos)) {
+		XDNA_ERR(xdna, "QoS config size %d too small", size);
+		return -EINVAL;
+	}
+
+	aie2_fill_rqos(qos, &rqos);
+	ret = xrs_update_qos(xdna->xrs_hdl, (uintptr_t)hwctx, &rqos);
+	/* Not holding resource now, the new QoS applies on next allocation */
+	if (ret && ret != -ENODEV) {
+		XDNA_ERR(xdna, "Update QoS for %s failed, ret %d", hwctx->name, ret);
+		return ret;
+	}
+
+	hwctx->qos = *qos;
+	XDNA_DBG(xdna, "Updated QoS for %s, gops %d fps %d latency %d",
+		 hwctx->name, qos->gops, qos->fps, qos->latency);
+	return 0;
+}
+
 int aie2_hwctx_config(struct amdxdna_hwctx *hwctx, u32 type, u64 value, void *buf, u32 size)
 {
 	struct amdxdna_dev *xdna = hwctx->client->xdna;
@@ -950,83 +1412,179 @@ int aie2_hwctx_config(struct amdxdna_hwctx *hwctx, u32 type, u64 value, void *bu
 		return aie2_hwctx_attach_debug_bo(hwctx, (u32)value);
 	case DRM_AMDXDNA_HWCTX_REMOVE_DBG_BUF:
 		return aie2_hwctx_detach_debug_bo(hwctx, (u32)value);
+	case DRM_AMDXDNA_HWCTX_CONFIG_QOS:
+		return aie2_hwctx_qos_config(hwctx, buf, size);
 	default:
 		XDNA_DBG(xdna, "Not supported type %d", type);
 		return -EOPNOTSUPP;
 	}
 }
 
-static int aie2_populate_range(struct amdxdna_gem_obj *abo)
+/* Caller must hold abo->mem.notifier_lock */
+static void aie2_update_map_invalid(struct amdxdna_gem_obj *abo)
 {
-	struct amdxdna_dev *xdna = to_xdna_dev(to_gobj(abo)->dev);
 	struct amdxdna_umap *mapp;
-	unsigned long timeout;
-	struct mm_struct *mm;
-	bool found;
-	int ret;
 
-	timeout = jiffies + msecs_to_jiffies(HMM_RANGE_DEFAULT_TIMEOUT);
-again:
-	found = false;
-	down_write(&xdna->notifier_lock);
 	list_for_each_entry(mapp, &abo->mem.umap_list, node) {
-		if (mapp->invalid) {
-			found = true;
-			break;
-		}
+		if (mapp->invalid)
+			return;
 	}
+	WRITE_ONCE(abo->mem.map_invalid, false);
+}
 
-	if (!found) {
-		abo->mem.map_invalid = false;
-		up_write(&xdna->notifier_lock);
-		return 0;
-	}
-	kref_get(&mapp->refcnt);
-	up_write(&xdna->notifier_lock);
+/*
+ * Fault in only the invalidated sub-range of one umap. The hmm_pfns array of
+ * the umap covers the whole range, use the slice for the sub-range.
+ */
+static int aie2_populate_umap(struct amdxdna_umap *mapp, unsigned long timeout)
+{
+	struct amdxdna_gem_obj *abo = mapp->abo;
+	struct amdxdna_dev *xdna = to_xdna_dev(to_gobj(abo)->dev);
+	struct aie2_hmm_stats *stats = &xdna->dev_handle->hmm_stats;
+	struct hmm_range range;
+	struct mm_struct *mm;
+	int ret;
 
-	XDNA_DBG(xdna, "populate memory range %lx %lx",
-		 mapp->vma->vm_start, mapp->vma->vm_end);
 	mm = mapp->notifier.mm;
-	if (!mmget_not_zero(mm)) {
-		amdxdna_umap_put(mapp);
+	if (!mmget_not_zero(mm))
 		return -EFAULT;
+
+again:
+	range = mapp->range;
+	/*
+	 * Sample the sequence before the sub-range. An invalidation after this
+	 * point, which may widen the sub-range, fails the retry check below.
+	 */
+	range.notifier_seq = mmu_interval_read_begin(&mapp->notifier);
+	spin_lock(&abo->mem.notifier_lock);
+	if (!mapp->invalid) {
+		spin_unlock(&abo->mem.notifier_lock);
+		ret = 0;
+		goto put_mm;
 	}
+	range.start = mapp->invalid_start;
+	range.end = mapp->invalid_end;
+	spin_unlock(&abo->mem.notifier_lock);
+	range.hmm_pfns += (range.start - mapp->range.start) >> PAGE_SHIFT;
 
-	mapp->range.notifier_seq = mmu_interval_read_begin(&mapp->notifier);
+	XDNA_DBG(xdna, "populate memory range %lx %lx", range.start, range.end);
 	mmap_read_lock(mm);
-	ret = hmm_range_fault(&mapp->range);
+	ret = hmm_range_fault(&range);
 	mmap_read_unlock(mm);
 	if (ret) {
-		if (time_after(jiffies, timeout)) {
-			ret = -ETIME;
-			goto put_mm;
-		}
-
-		if (ret == -EBUSY) {
-			amdxdna_umap_put(mapp);
+		if (ret == -EBUSY && !time_after(jiffies, timeout)) {
+			atomic64_inc(&stats->fault_retries);
 			goto again;
 		}
-
+		if (ret == -EBUSY)
+			ret = -ETIME;
 		goto put_mm;
 	}
 
-	down_write(&xdna->notifier_lock);
-	if (mmu_interval_read_retry(&mapp->notifier, mapp->range.notifier_seq)) {
-		up_write(&xdna->notifier_lock);
-		amdxdna_umap_put(mapp);
+	spin_lock(&abo->mem.notifier_lock);
+	if (mmu_interval_read_retry(&mapp->notifier, range.notifier_seq)) {
+		spin_unlock(&abo->mem.notifier_lock);
+		if (time_after(jiffies, timeout)) {
+			ret = -ETIME;
+			goto put_mm;
+		}
+		atomic64_inc(&stats->fault_retries);
 		goto again;
 	}
 	mapp->invalid = false;
-	up_write(&xdna->notifier_lock);
-	amdxdna_umap_put(mapp);
-	goto again;
+	aie2_update_map_invalid(abo);
+	spin_unlock(&abo->mem.notifier_lock);
+
+	atomic64_inc(&stats->ranges_faulted);
+	atomic64_add((range.end - range.start) >> PAGE_SHIFT, &stats->pages_faulted);
 
 put_mm:
-	amdxdna_umap_put(mapp);
 	mmput(mm);
 	return ret;
 }
 
+static void aie2_job_validate_end(struct amdxdna_sched_job *job, u32 cnt)
+{
+	struct amdxdna_dev *xdna = job->hwctx->client->xdna;
+	u32 i;
+
+	for (i = 0; i < cnt; i++)
+		amdxdna_gem_validate_end(to_xdna_obj(job->bos[i].obj));
+	lock_map_release(&xdna->submit_lockdep_map);
+}
+
+/* On success, aie2_job_validate_end() must be called once the job is pushed */
+static bool aie2_job_validate_begin(struct amdxdna_sched_job *job)
+{
+	struct amdxdna_dev *xdna = job->hwctx->client->xdna;
+	u32 i;
+
+	lock_map_acquire(&xdna->submit_lockdep_map);
+	for (i = 0; i < job->bo_cnt; i++) {
+		if (!amdxdna_gem_validate_begin(to_xdna_obj(job->bos[i].obj))) {
+			aie2_job_validate_end(job, i);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+#define AIE2_POPULATE_BATCH	16
+/*
+ * Revalidate all invalid ranges of all BOs in the job. Invalid umaps are
+ * collected in batches with one pass over the job BOs, then faulted in
+ * without holding any notifier lock.
+ */
+static int aie2_populate_job_ranges(struct amdxdna_sched_job *job, unsigned long timeout)
+{
+	struct amdxdna_umap *umaps[AIE2_POPULATE_BATCH];
+	struct amdxdna_gem_obj *abo;
+	struct amdxdna_umap *mapp;
+	int cnt, ret = 0;
+	int i;
+
+again:
+	cnt = 0;
+	for (i = 0; i < job->bo_cnt && cnt < AIE2_POPULATE_BATCH; i++) {
+		abo = to_xdna_obj(job->bos[i].obj);
+		if (!READ_ONCE(abo->mem.map_invalid))
+			continue;
+
+		spin_lock(&abo->mem.notifier_lock);
+		list_for_each_entry(mapp, &abo->mem.umap_list, node) {
+			if (!mapp->invalid || !kref_get_unless_zero(&mapp->refcnt))
+				continue;
+			umaps[cnt++] = mapp;
+			if (cnt == AIE2_POPULATE_BATCH)
+				break;
+		}
+		spin_unlock(&abo->mem.notifier_lock);
+	}
+
+	if (!cnt) {
+		/* The invalid umaps might be unmapped already */
+		for (i = 0; i < job->bo_cnt; i++) {
+			abo = to_xdna_obj(job->bos[i].obj);
+			spin_lock(&abo->mem.notifier_lock);
+			if (abo->mem.map_invalid)
+				aie2_update_map_invalid(abo);
+			spin_unlock(&abo->mem.notifier_lock);
+		}
+		return 0;
+	}
+
+	for (i = 0; i < cnt; i++) {
+		if (!ret)
+			ret = aie2_populate_umap(umaps[i], timeout);
+		amdxdna_umap_put(umaps[i]);
+	}
+	if (ret)
+		return ret;
+
+	goto again;
+}
+
 static int aie2_add_job_dependency(struct amdxdna_sched_job *job, u32 *syncobj_hdls,
 				   u64 *syncobj_points, u32 syncobj_cnt)
 {
@@ -1055,7 +1613,6 @@ int aie2_cmd_submit(struct amdxdna_hwctx *hwctx, struct amdxdna_sched_job *job,
 	struct amdxdna_dev *xdna = hwctx->client->xdna;
 	struct ww_acquire_ctx acquire_ctx;
 	struct dma_fence_chain *chain;
-	struct amdxdna_gem_obj *abo;
 	unsigned long timeout = 0;
 	int ret, i;
 
@@ -1100,28 +1657,27 @@ retry:
 		}
 	}
 
-	down_read(&xdna->notifier_lock);
-	for (i = 0; i < job->bo_cnt; i++) {
-		abo = to_xdna_obj(job->bos[i].obj);
-		if (abo->mem.map_invalid) {
-			up_read(&xdna->notifier_lock);
-			amdxdna_unlock_objects(job, &acquire_ctx);
-			if (!timeout) {
-				timeout = jiffies +
-					msecs_to_jiffies(HMM_RANGE_DEFAULT_TIMEOUT);
-			} else if (time_after(jiffies, timeout)) {
-				ret = -ETIME;
-				goto cleanup_job;
-			}
+	if (!aie2_job_validate_begin(job)) {
+		amdxdna_unlock_objects(job, &acquire_ctx);
+		if (!timeout) {
+			timeout = jiffies +
+				msecs_to_jiffies(HMM_RANGE_DEFAULT_TIMEOUT);
+		} else if (time_after(jiffies, timeout)) {
+			ret = -ETIME;
+			goto cleanup_job;
+		}
 
-			ret = aie2_populate_range(abo);
-			if (ret)
-				goto cleanup_job;
-			goto retry;
+		atomic64_inc(&xdna->dev_handle->hmm_stats.submit_retries);
+		ret = aie2_populate_job_ranges(job, timeout);
+		if (ret) {
+			XDNA_ERR(xdna, "Populate ranges failed, ret %d", ret);
+			goto cleanup_job;
 		}
+		goto retry;
 	}
 
 	mutex_lock(&hwctx->priv->io_lock);
+	job->deadline_ms = aie2_job_deadline_ms(hwctx);
 	drm_sched_job_arm(&job->base);
 	job->out_fence = dma_fence_get(&job->base.s_fence->finished);
 	for (i = 0; i < job->bo_cnt; i++)
@@ -1134,9 +1690,17 @@ retry:
 	drm_syncobj_add_point(hwctx->priv->syncobj, chain, job->out_fence, *seq);
 	mutex_unlock(&hwctx->priv->io_lock);
 
-	up_read(&xdna->notifier_lock);
+	aie2_job_validate_end(job, job->bo_cnt);
 	amdxdna_unlock_objects(job, &acquire_ctx);
 
+	/*
+	 * Restoring the clock request takes dev_lock and may talk to SMU, keep
+	 * both off the submit path. Pairs with smp_mb() in aie2_hwctx_park().
+	 */
+	smp_mb();
+	if (READ_ONCE(hwctx->priv->parked))
+		queue_work(system_highpri_wq, &hwctx->priv->unpark_work);
+
 	aie2_job_put(job);
 
 	return 0;
@@ -1210,6 +1774,7 @@ int aie2_xrs_load_hwctx(struct amdxdna_hwctx *hwctx, struct xrs_action_load *act
 
 	hwctx->start_col = action->part.start_col;
 	hwctx->num_col = action->part.ncols;
+	aie2_snap_invalidate(xdna->dev_handle);
 	ret = aie2_create_context(xdna->dev_handle, hwctx);
 	if (ret)
 		XDNA_ERR(xdna, "create context failed, ret %d", ret);
@@ -1230,3 +1795,306 @@ int aie2_xrs_unload_hwctx(struct amdxdna_hwctx *hwctx)
 
 	return ret;
 }
+
+int aie2_xrs_migrate_hwctx(struct amdxdna_hwctx *hwctx, struct xrs_action_load *action)
+{
+	struct amdxdna_dev *xdna = hwctx->client->xdna;
+	u32 old_col = hwctx->start_col;
+	bool busy;
+	int ret;
+
+	drm_WARN_ON(&xdna->ddev, !mutex_is_locked(&xdna->dev_lock));
+	if (hwctx->status != HWCTX_STATE_READY || hwctx->priv->ts_waiting ||
+	    xdna->dev_handle->ts_draining == hwctx)
+		return -EBUSY;
+
+	/*
+	 * Stop the scheduler first, so jobs submitted from now on are only
+	 * queued and run after restart on the new columns. A job that could
+	 * already reach the device was counted in submitted under io_lock.
+	 */
+	drm_sched_wqueue_stop(&hwctx->priv->sched);
+	mutex_lock(&hwctx->priv->io_lock);
+	busy = hwctx->submitted != READ_ONCE(hwctx->completed);
+	mutex_unlock(&hwctx->priv->io_lock);
+	if (busy) {
+		drm_sched_wqueue_start(&hwctx->priv->sched);
+		return -EBUSY;
+	}
+
+	aie2_hwctx_stop(xdna, hwctx, NULL);
+	hwctx->start_col = action->part.start_col;
+	aie2_snap_invalidate(xdna->dev_handle);
+	ret = aie2_hwctx_restart(xdna, hwctx);
+	if (!ret) {
+		XDNA_DBG(xdna, "Moved %s from col %d to %d", hwctx->name,
+			 old_col, hwctx->start_col);
+		return 0;
+	}
+
+	XDNA_ERR(xdna, "Move %s to col %d failed, ret %d", hwctx->name,
+		 hwctx->start_col, ret);
+	aie2_hwctx_stop(xdna, hwctx, NULL);
+	hwctx->start_col = old_col;
+	if (aie2_hwctx_restart(xdna, hwctx))
+		XDNA_ERR(xdna, "Restore %s at col %d failed", hwctx->name, old_col);
+	return ret;
+}
+
+#define AIE2_LOAD_WINDOW_MS	1000
+#define AIE2_LOAD_PER_PENDING	10
+
+/*
+ * Load of a context is the busy percent over the last window of at least
+ * AIE2_LOAD_WINDOW_MS, plus AIE2_LOAD_PER_PENDING for each job in flight.
+ * The window rolls over when load is asked, so it covers the time since the
+ * previous ask.
+ */
+u32 aie2_xrs_hwctx_load(struct amdxdna_hwctx *hwctx)
+{
+	struct amdxdna_hwctx_priv *priv = hwctx->priv;
+	ktime_t now, elapsed;
+	unsigned long flags;
+	u64 pending, busy;
+	u32 pct;
+
+	now = ktime_get();
+	busy = amdxdna_hwctx_busy_ns(hwctx, now);
+	spin_lock_irqsave(&priv->busy_lock, flags);
+	elapsed = ktime_sub(now, priv->load_win_start);
+	if (ktime_to_ms(elapsed) >= AIE2_LOAD_WINDOW_MS) {
+		priv->load_pct = busy > priv->load_win_busy ?
+			min_t(u64, 100, div64_u64((busy - priv->load_win_busy) * 100,
+						  ktime_to_ns(elapsed))) : 0;
+		priv->load_win_start = now;
+		priv->load_win_busy = max(busy, priv->load_win_busy);
+	}
+	pct = priv->load_pct;
+	spin_unlock_irqrestore(&priv->busy_lock, flags);
+
+	pending = hwctx->submitted - READ_ONCE(hwctx->completed);
+	return pct + AIE2_LOAD_PER_PENDING * min_t(u64, pending, HWCTX_MAX_CMDS);
+}
+
+/*
+ * Waiting contexts that have CUs configured and jobs queued compete for
+ * columns. Round robin takes them in wait order, evicted contexts go to the
+ * tail. Priority policy takes the lowest QoS priority value first.
+ */
+static struct amdxdna_hwctx *aie2_ts_next_waiter(struct amdxdna_dev_hdl *ndev)
+{
+	struct amdxdna_hwctx *hwctx, *next = NULL;
+	struct amdxdna_hwctx_priv *priv;
+
+	list_for_each_entry(priv, &ndev->ts_wait_list, ts_node) {
+		hwctx = priv->hwctx;
+		if (priv->ts_tried || hwctx->status != HWCTX_STATE_STOP ||
+		    !aie2_ts_has_work(hwctx))
+			continue;
+
+		if (timeslice_policy != AIE2_TS_POLICY_PRIORITY)
+			return hwctx;
+
+		if (!next || hwctx->qos.priority < next->qos.priority)
+			next = hwctx;
+	}
+
+	return next;
+}
+
+static bool aie2_ts_can_evict(struct amdxdna_hwctx *hwctx, struct amdxdna_hwctx *waiter,
+			      ktime_t now)
+{
+	struct amdxdna_hwctx_priv *priv = hwctx->priv;
+	u32 i;
+
+	if (!priv || priv->ts_waiting || hwctx->status != HWCTX_STATE_READY)
+		return false;
+
+	if (hwctx->num_col != waiter->num_col)
+		return false;
+
+	/* Keep the columns for at least one quantum */
+	if (ktime_before(now, ktime_add_ms(priv->ts_since, max(timeslice_ms, 1U))))
+		return false;
+
+	if (timeslice_policy == AIE2_TS_POLICY_PRIORITY &&
+	    hwctx->qos.priority < waiter->qos.priority)
+		return false;
+
+	for (i = 0; i < waiter->col_list_len; i++) {
+		if (waiter->col_list[i] == hwctx->start_col)
+			return true;
+	}
+
+	return false;
+}
+
+/* Prefer idle contexts, then lower priority, then the longest resident */
+static bool aie2_ts_better_victim(struct amdxdna_hwctx *a, struct amdxdna_hwctx *b)
+{
+	bool a_busy = aie2_ts_has_work(a);
+	bool b_busy = aie2_ts_has_work(b);
+
+	if (a_busy != b_busy)
+		return !a_busy;
+
+	if (timeslice_policy == AIE2_TS_POLICY_PRIORITY &&
+	    a->qos.priority != b->qos.priority)
+		return a->qos.priority > b->qos.priority;
+
+	return ktime_before(a->priv->ts_since, b->priv->ts_since);
+}
+
+static struct amdxdna_hwctx *
+aie2_ts_pick_victim(struct amdxdna_dev_hdl *ndev, struct amdxdna_hwctx *waiter)
+{
+	struct amdxdna_hwctx *hwctx, *victim = NULL;
+	struct amdxdna_dev *xdna = ndev->xdna;
+	struct amdxdna_client *client;
+	unsigned long hwctx_id;
+	ktime_t now;
+
+	now = ktime_get();
+	list_for_each_entry(client, &xdna->client_list, node) {
+		mutex_lock(&client->hwctx_lock);
+		amdxdna_for_each_hwctx(client, hwctx_id, hwctx) {
+			if (!aie2_ts_can_evict(hwctx, waiter, now))
+				continue;
+
+			if (!victim || aie2_ts_better_victim(hwctx, victim))
+				victim = hwctx;
+		}
+		mutex_unlock(&client->hwctx_lock);
+	}
+
+	return victim;
+}
+
+/* Give the columns back and wait for another time slice */
+static void aie2_ts_requeue(struct amdxdna_hwctx *hwctx)
+{
+	struct amdxdna_dev_hdl *ndev = hwctx->client->xdna->dev_handle;
+	struct amdxdna_hwctx_priv *priv = hwctx->priv;
+
+	aie2_release_resource(hwctx);
+	priv->ts_waiting = true;
+	priv->ts_tried = true;
+	list_add_tail(&priv->ts_node, &ndev->ts_wait_list);
+}
+
+/* Called after aie2_alloc_resource() gave the context its columns */
+static int aie2_ts_swap_in(struct amdxdna_hwctx *hwctx)
+{
+	struct amdxdna_dev *xdna = hwctx->client->xdna;
+	struct amdxdna_hwctx_priv *priv = hwctx->priv;
+	int ret;
+
+	list_del_init(&priv->ts_node);
+	priv->ts_waiting = false;
+	priv->ts_since = ktime_get();
+	ret = __aie2_hwctx_restart(xdna, hwctx, false);
+	if (!ret) {
+		XDNA_DBG(xdna, "%s runs on col %d", hwctx->name, hwctx->start_col);
+		return 0;
+	}
+
+	XDNA_WARN(xdna, "Failed to start %s on col %d, ret %d",
+		  hwctx->name, hwctx->start_col, ret);
+	aie2_hwctx_stop(xdna, hwctx, NULL);
+	aie2_ts_requeue(hwctx);
+	return ret;
+}
+
+/*
+ * The context is drained rather than preempted in the middle of a job, see
+ * aie2_ts_drain(). Firmware preemption, when enabled, still applies within
+ * its own partition.
+ */
+static void aie2_ts_swap_out(struct amdxdna_hwctx *hwctx)
+{
+	struct amdxdna_dev_hdl *ndev = hwctx->client->xdna->dev_handle;
+
+	ndev->ts_draining = NULL;
+	aie2_hwctx_stop(ndev->xdna, hwctx, NULL);
+	aie2_ts_requeue(hwctx);
+	XDNA_DBG(ndev->xdna, "%s gave up col %d", hwctx->name, hwctx->start_col);
+}
+
+/* Returns true when a victim is still draining and the worker should retry soon */
+static bool aie2_ts_schedule(struct amdxdna_dev_hdl *ndev)
+{
+	struct amdxdna_hwctx *waiter, *victim;
+	struct amdxdna_hwctx_priv *priv;
+
+	list_for_each_entry(priv, &ndev->ts_wait_list, ts_node)
+		priv->ts_tried = false;
+
+	while ((waiter = aie2_ts_next_waiter(ndev))) {
+		waiter->priv->ts_tried = true;
+		if (!aie2_alloc_resource(waiter)) {
+			aie2_ts_swap_in(waiter);
+			continue;
+		}
+
+		victim = aie2_ts_pick_victim(ndev, waiter);
+		if (!victim)
+			continue;
+
+		if (!aie2_ts_drain(victim))
+			return true;
+
+		aie2_ts_swap_out(victim);
+		if (!aie2_alloc_resource(waiter) && !aie2_ts_swap_in(waiter)) {
+			ndev->ts_swaps++;
+			continue;
+		}
+
+		XDNA_WARN(ndev->xdna, "%s did not start in col %d of %s",
+			  waiter->name, victim->start_col, victim->name);
+		if (!aie2_alloc_resource(victim))
+			aie2_ts_swap_in(victim);
+	}
+
+	/* Nobody needs the columns of the victim any more */
+	if (ndev->ts_draining)
+		aie2_ts_undrain(ndev->ts_draining);
+	return false;
+}
+
+static void aie2_ts_work(struct work_struct *work)
+{
+	struct amdxdna_dev_hdl *ndev;
+	struct amdxdna_dev *xdna;
+
+	ndev = container_of(to_delayed_work(work), struct amdxdna_dev_hdl, ts_work);
+	xdna = ndev->xdna;
+
+	mutex_lock(&xdna->dev_lock);
+
+	/* Kicked again by aie2_hwctx_resume() */
+	if (ndev->dev_status < AIE2_DEV_START)
+		goto unlock;
+
+	if (aie2_ts_schedule(ndev))
+		queue_delayed_work(system_wq, &ndev->ts_work,
+				   msecs_to_jiffies(AIE2_TS_RETRY_MS));
+	else if (!list_empty(&ndev->ts_wait_list))
+		queue_delayed_work(system_wq, &ndev->ts_work,
+				   msecs_to_jiffies(max(timeslice_ms, 1U)));
+
+unlock:
+	mutex_unlock(&xdna->dev_lock);
+}
+
+void aie2_ts_init(struct amdxdna_dev_hdl *ndev)
+{
+	INIT_LIST_HEAD(&ndev->ts_wait_list);
+	INIT_DELAYED_WORK(&ndev->ts_work, aie2_ts_work);
+}
+
+/* Called without dev_lock, the worker takes it */
+void aie2_ts_fini(struct amdxdna_dev_hdl *ndev)
+{
+	cancel_delayed_work_sync(&ndev->ts_work);
+}
@@ -10,11 +10,13 @@
 #include <linux/vmalloc.h>
 #include <linux/completion.h>
 #include <linux/pm_runtime.h>
+#include <linux/sizes.h>
 #include <drm/drm_debugfs.h>
 #include <drm/drm_cache.h>
 
 #include "aie2_msg_priv.h"
 #include "aie2_pci.h"
+#include "aie2_solver.h"
 
 #if defined(CONFIG_DEBUG_FS)
 #define SIZE            31
@@ -227,6 +229,8 @@ static ssize_t aie2_dpm_level_set(struct file *file, const char __user *ptr,
 	}
 
 	mutex_lock(&ndev->xdna->dev_lock);
+	/* Manual setting overrides a pending demotion */
+	ndev->dpm_demote_pending = false;
 	ndev->dft_dpm_level = val;
 	if (ndev->pw_mode != POWER_MODE_DEFAULT)
 		val = ndev->dpm_level;
@@ -423,7 +427,7 @@ static int aie2_dbgfs_nputest_show(struct seq_file *m, void *unused)
 {
 	seq_puts(m, "nputest usage:\n");
 	seq_puts(m, "\techo id [args] > <debugfs_path>/dri/<render_id>/nputest\n");
-	seq_puts(m, "\t\tid - test case id (1 - 2), bad id will be ignore\n");
+	seq_puts(m, "\t\tid - test case id (1 - 3), bad id will be ignore\n");
 	seq_puts(m, "\t\targs - arguments for test case, optional\n");
 	seq_puts(m, "\n");
 	seq_puts(m, "test case 1 usage:\n");
@@ -435,6 +439,10 @@ static int aie2_dbgfs_nputest_show(struct seq_file *m, void *unused)
 	seq_puts(m, "\t\tresp_len - response length in words (1 - 28)\n");
 	seq_puts(m, "\t\tpattern - data to fill message and response\n");
 	seq_puts(m, "\t\tcnt - send cnt messages without wait, optional (default 1)\n");
+	seq_puts(m, "\n");
+	seq_puts(m, "test case 3 usage:\n");
+	seq_puts(m, "\techo 3 > <nputest file>\n");
+	seq_puts(m, "\t\tfirmware self test\n");
 
 	return 0;
 }
@@ -463,6 +471,7 @@ seq_printf(m, "%ld:%s\n", _name, #_name)
 	drm_ioctl_id_seq_print(DRM_IOCTL_AMDXDNA_SYNC_BO);
 	drm_ioctl_id_seq_print(DRM_IOCTL_AMDXDNA_EXEC_CMD);
 	drm_ioctl_id_seq_print(DRM_IOCTL_AMDXDNA_WAIT_CMD);
+	drm_ioctl_id_seq_print(DRM_IOCTL_AMDXDNA_SYNC_BO_VEC);
 	drm_ioctl_id_seq_print(DRM_IOCTL_AMDXDNA_GET_INFO);
 	drm_ioctl_id_seq_print(DRM_IOCTL_AMDXDNA_SET_STATE);
 
@@ -490,6 +499,159 @@ static int aie2_msg_queue_show(struct seq_file *m, void *unused)
 
 AIE2_DBGFS_FOPS(msg_queue, aie2_msg_queue_show, NULL);
 
+static int aie2_mailbox_stats_show(struct seq_file *m, void *unused)
+{
+	struct amdxdna_dev_hdl *ndev = m->private;
+
+	return xdna_mailbox_stats_show(ndev->mbox, m);
+}
+
+AIE2_DBGFS_FOPS(mailbox_stats, aie2_mailbox_stats_show, NULL);
+
+static ssize_t aie2_simulate_hang_write(struct file *file, const char __user *ptr,
+					size_t len, loff_t *off)
+{
+	struct amdxdna_dev_hdl *ndev = file_to_ndev_rw(file);
+	u32 col_map;
+	int ret;
+
+	ret = kstrtouint_from_user(ptr, len, 0, &col_map);
+	if (ret) {
+		XDNA_ERR(ndev->xdna, "Invalid column bitmap");
+		return ret;
+	}
+
+	ret = aie2_simulate_hang(ndev->xdna, col_map);
+	if (ret) {
+		XDNA_ERR(ndev->xdna, "Simulate hang on columns 0x%x failed, ret %d", col_map, ret);
+		return ret;
+	}
+	return len;
+}
+
+static int aie2_simulate_hang_show(struct seq_file *m, void *unused)
+{
+	return 0;
+}
+
+AIE2_DBGFS_FOPS(simulate_hang, aie2_simulate_hang_show, aie2_simulate_hang_write);
+
+static int aie2_hmm_stats_show(struct seq_file *m, void *unused)
+{
+	struct amdxdna_dev_hdl *ndev = m->private;
+	struct aie2_hmm_stats *stats = &ndev->hmm_stats;
+
+	seq_printf(m, "submit_retries %lld\n", atomic64_read(&stats->submit_retries));
+	seq_printf(m, "fault_retries %lld\n", atomic64_read(&stats->fault_retries));
+	seq_printf(m, "ranges_faulted %lld\n", atomic64_read(&stats->ranges_faulted));
+	seq_printf(m, "pages_faulted %lld\n", atomic64_read(&stats->pages_faulted));
+	return 0;
+}
+
+AIE2_DBGFS_FOPS(hmm_stats, aie2_hmm_stats_show, NULL);
+
+static int aie2_dpm_gov_show(struct seq_file *m, void *unused)
+{
+	struct amdxdna_dev_hdl *ndev = m->private;
+	struct aie2_dpm_gov *gov = &ndev->gov;
+	struct aie2_gov_sample *sample;
+	u32 i, idx;
+
+	mutex_lock(&ndev->xdna->dev_lock);
+	seq_printf(m, "active %d\n", ndev->pw_mode == POWER_MODE_DYNAMIC);
+	seq_printf(m, "level %d floor %d max %d\n", gov->level, ndev->dft_dpm_level,
+		   ndev->max_dpm_level);
+	seq_puts(m, "util latency_us level\n");
+	for (i = 0; i < gov->hist_cnt; i++) {
+		idx = (gov->hist_idx + AIE2_GOV_HIST_NUM - gov->hist_cnt + i) % AIE2_GOV_HIST_NUM;
+		sample = &gov->hist[idx];
+		seq_printf(m, "%d %d %d\n", sample->util, sample->latency_us, sample->level);
+	}
+	mutex_unlock(&ndev->xdna->dev_lock);
+	return 0;
+}
+
+AIE2_DBGFS_FOPS(dpm_gov, aie2_dpm_gov_show, NULL);
+
+static int aie2_partition_load_show(struct seq_file *m, void *unused)
+{
+	struct amdxdna_dev_hdl *ndev = m->private;
+	struct xrs_partition_info *info;
+	int i, num;
+
+	info = kcalloc(XRS_MAX_COL, sizeof(*info), GFP_KERNEL);
+	if (!info)
+		return -ENOMEM;
+
+	mutex_lock(&ndev->xdna->dev_lock);
+	num = xrs_get_partitions(ndev->xdna->xrs_hdl, info, XRS_MAX_COL);
+	mutex_unlock(&ndev->xdna->dev_lock);
+
+	seq_puts(m, "start_col ncols nshared load\n");
+	for (i = 0; i < num; i++)
+		seq_printf(m, "%d %d %d %d\n", info[i].start_col, info[i].ncols,
+			   info[i].nshared, info[i].load);
+
+	kfree(info);
+	return 0;
+}
+
+AIE2_DBGFS_FOPS(partition_load, aie2_partition_load_show, NULL);
+
+static int aie2_timeslice_show(struct seq_file *m, void *unused)
+{
+	struct amdxdna_dev_hdl *ndev = m->private;
+	struct amdxdna_hwctx_priv *priv;
+	struct amdxdna_hwctx *hwctx;
+
+	mutex_lock(&ndev->xdna->dev_lock);
+	seq_printf(m, "swaps %lld\n", ndev->ts_swaps);
+	seq_puts(m, "waiting ncols priority pending\n");
+	list_for_each_entry(priv, &ndev->ts_wait_list, ts_node) {
+		hwctx = priv->hwctx;
+		seq_printf(m, "%s %d %d %lld\n", hwctx->name, hwctx->num_col,
+			   hwctx->qos.priority, hwctx->submitted - hwctx->completed);
+	}
+	mutex_unlock(&ndev->xdna->dev_lock);
+
+	return 0;
+}
+
+AIE2_DBGFS_FOPS(timeslice, aie2_timeslice_show, NULL);
+
+static int aie2_hwctx_park_show(struct seq_file *m, void *unused)
+{
+	struct amdxdna_dev_hdl *ndev = m->private;
+	struct aie2_park_stats stats;
+
+	mutex_lock(&ndev->xdna->dev_lock);
+	stats = ndev->park_stats;
+	mutex_unlock(&ndev->xdna->dev_lock);
+
+	seq_printf(m, "parks %lld\n", stats.parks);
+	seq_printf(m, "unparks %lld avg_ns %lld max_ns %lld\n", stats.unparks,
+		   stats.unparks ? div64_u64(stats.unpark_ns, stats.unparks) : 0,
+		   stats.unpark_max_ns);
+	seq_printf(m, "restarts %lld avg_ns %lld max_ns %lld\n", stats.restarts,
+		   stats.restarts ? div64_u64(stats.restart_ns, stats.restarts) : 0,
+		   stats.restart_max_ns);
+	return 0;
+}
+
+AIE2_DBGFS_FOPS(hwctx_park, aie2_hwctx_park_show, NULL);
+
+static int aie2_snapshot_show(struct seq_file *m, void *unused)
+{
+	struct amdxdna_dev_hdl *ndev = m->private;
+
+	mutex_lock(&ndev->xdna->dev_lock);
+	aie2_snap_stats(ndev, m);
+	mutex_unlock(&ndev->xdna->dev_lock);
+	return 0;
+}
+
+AIE2_DBGFS_FOPS(snapshot, aie2_snapshot_show, NULL);
+
 static int aie2_telemetry(struct seq_file *m, u32 type)
 {
 	struct amdxdna_dev_hdl *ndev = m->private;
@@ -562,12 +724,20 @@ const struct {
 } aie2_dbgfs_files[] = {
 	AIE2_DBGFS_FILE(nputest, 0600),
 	AIE2_DBGFS_FILE(pasid, 0600),
+	AIE2_DBGFS_FILE(simulate_hang, 0600),
 	AIE2_DBGFS_FILE(state, 0600),
 	AIE2_DBGFS_FILE(powerstate, 0600),
 	AIE2_DBGFS_FILE(dpm_level, 0600),
+	AIE2_DBGFS_FILE(dpm_gov, 0400),
+	AIE2_DBGFS_FILE(partition_load, 0400),
+	AIE2_DBGFS_FILE(timeslice, 0400),
+	AIE2_DBGFS_FILE(hwctx_park, 0400),
+	AIE2_DBGFS_FILE(snapshot, 0400),
 	AIE2_DBGFS_FILE(ringbuf, 0400),
 	AIE2_DBGFS_FILE(msg_queue, 0400),
+	AIE2_DBGFS_FILE(mailbox_stats, 0400),
 	AIE2_DBGFS_FILE(ioctl_id, 0400),
+	AIE2_DBGFS_FILE(hmm_stats, 0400),
 	AIE2_DBGFS_FILE(telemetry_disabled, 0400),
 	AIE2_DBGFS_FILE(telemetry_health, 0400),
 	AIE2_DBGFS_FILE(telemetry_error_info, 0400),
@@ -10,6 +10,10 @@
 #include "aie2_msg_priv.h"
 #include "aie2_pci.h"
 
+bool aie_error_recover;
+module_param(aie_error_recover, bool, 0644);
+MODULE_PARM_DESC(aie_error_recover, "Recover hardware contexts on columns reporting AIE error (Default false)");
+
 struct async_event {
 	struct amdxdna_dev_hdl		*ndev;
 	struct async_event_msg_resp	resp;
@@ -262,6 +266,12 @@ static void aie2_error_worker(struct work_struct *err_work)
 		return;
 	}
 
+	/* Only the contexts on the faulty columns are reset */
+	if (aie_error_recover) {
+		XDNA_WARN(xdna, "Recovering columns 0x%x", err_col);
+		aie2_recover(xdna, err_col, false);
+	}
+
 	mutex_lock(&xdna->dev_lock);
 	/* Re-sent this event to firmware */
 	if (aie2_error_event_send(e))
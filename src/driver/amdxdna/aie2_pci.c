@@ -34,6 +34,10 @@ MODULE_PARM_DESC(aie2_control_flags,
 		 " Bit " __stringify(AIE2_BIT_BYPASS_SET_FREQ) ": Bypass set freq,"
 		 " Bit " __stringify(AIE2_BIT_BYPASS_FW_LOAD) ": Bypass FW loading");
 
+bool aie2_partition_compaction;
+module_param(aie2_partition_compaction, bool, 0400);
+MODULE_PARM_DESC(aie2_partition_compaction, "Move idle contexts to make room for new ones (Default false)");
+
 bool disable_fine_preemption = false;
 module_param(disable_fine_preemption, bool, 0600);
 MODULE_PARM_DESC(disable_fine_preemption, "Disable fine grain preemption");
@@ -326,17 +330,15 @@ static int aie2_xrs_set_dft_dpm_level(struct drm_device *ddev, u32 dpm_level)
 	drm_WARN_ON(&xdna->ddev, !mutex_is_locked(&xdna->dev_lock));
 
 	ndev = xdna->dev_handle;
-	ndev->dft_dpm_level = dpm_level;
-	if (ndev->pw_mode != POWER_MODE_DEFAULT || ndev->dpm_level == dpm_level)
-		return 0;
-
-	return ndev->priv->hw_ops.set_dpm(ndev, dpm_level);
+	return aie2_pm_set_dft_dpm_level(ndev, dpm_level);
 }
 
 static struct xrs_action_ops aie2_xrs_actions = {
 	.load_hwctx = aie2_xrs_load_hwctx,
 	.unload_hwctx = aie2_xrs_unload_hwctx,
 	.set_dft_dpm_level = aie2_xrs_set_dft_dpm_level,
+	.migrate_hwctx = aie2_xrs_migrate_hwctx,
+	.hwctx_load = aie2_xrs_hwctx_load,
 };
 
 static void aie2_hw_stop(struct amdxdna_dev *xdna)
@@ -485,6 +487,9 @@ static int aie2_init(struct amdxdna_dev *xdna)
 
 	ndev->priv = xdna->dev_info->dev_priv;
 	ndev->xdna = xdna;
+	aie2_pm_early_init(ndev);
+	aie2_ts_init(ndev);
+	aie2_snap_init(ndev);
 
 	ret = request_firmware(&fw, ndev->priv->fw_path, &pdev->dev);
 	if (ret) {
@@ -592,6 +597,9 @@ skip_pasid:
 	for (i = 0; i < xrs_cfg.clk_list.num_levels; i++)
 		xrs_cfg.clk_list.cu_clk_list[i] = ndev->priv->dpm_clk_tbl[i].hclk;
 	xrs_cfg.sys_eff_factor = 1;
+	xrs_cfg.flags = XRS_FLAG_BEST_FIT;
+	if (aie2_partition_compaction)
+		xrs_cfg.flags |= XRS_FLAG_COMPACT;
 	xrs_cfg.ddev = &xdna->ddev;
 	xrs_cfg.actions = &aie2_xrs_actions;
 	xrs_cfg.total_col = ndev->total_col;
@@ -644,8 +652,15 @@ static void aie2_fini(struct amdxdna_dev *xdna)
 	struct pci_dev *pdev = to_pci_dev(xdna->ddev.dev);
 	struct amdxdna_dev_hdl *ndev = xdna->dev_handle;
 
+	/* Workers take dev_lock, stop them before taking it */
+	aie2_snap_fini(ndev);
+	aie2_ts_fini(ndev);
+	aie2_pm_fini(ndev);
+
+	mutex_lock(&xdna->dev_lock);
 	aie2_hw_stop(xdna);
 	aie2_error_async_events_free(ndev);
+	mutex_unlock(&xdna->dev_lock);
 #ifdef AMDXDNA_DEVEL
 	if (iommu_mode != AMDXDNA_IOMMU_PASID)
 		goto skip_pasid;
@@ -657,20 +672,24 @@ skip_pasid:
 	pci_free_irq_vectors(pdev);
 }
 
-static void aie2_recover(struct amdxdna_dev *xdna, bool dump_only)
+/*
+ * Recover hardware contexts which use any column in col_map. Contexts on
+ * other columns keep running.
+ */
+void aie2_recover(struct amdxdna_dev *xdna, u32 col_map, bool dump_only)
 {
 	struct amdxdna_client *client;
 
 	mutex_lock(&xdna->dev_lock);
 	if (dump_only) {
 		list_for_each_entry(client, &xdna->client_list, node)
-			aie2_dump_ctx(client);
+			aie2_dump_ctx(client, col_map);
 	} else {
 		list_for_each_entry(client, &xdna->client_list, node)
-			aie2_stop_ctx(client);
-		/* The AIE will reset after all hardware contexts are destroyed */
+			aie2_stop_ctx(client, col_map);
+		/* The columns will reset after all hardware contexts on them are destroyed */
 		list_for_each_entry(client, &xdna->client_list, node)
-			aie2_restart_ctx(client);
+			aie2_restart_ctx(client, col_map);
 	}
 	mutex_unlock(&xdna->dev_lock);
 }
@@ -831,6 +850,15 @@ static int aie2_get_clock_metadata(struct amdxdna_client *client,
 	return ret;
 }
 
+void aie2_fill_sensor(struct amdxdna_dev_hdl *ndev, struct amdxdna_drm_query_sensor *sensor)
+{
+	sensor->type = AMDXDNA_SENSOR_TYPE_POWER;
+	sensor->input = 1234; /* TODO: query the device and get the power data */
+	sensor->unitm = -3; /* in milliwatts */
+	snprintf(sensor->label, sizeof(sensor->label), "Total Power");
+	snprintf(sensor->units, sizeof(sensor->units), "mW");
+}
+
 static int aie2_get_sensors(struct amdxdna_client *client,
 			    struct amdxdna_drm_get_info *args)
 {
@@ -841,11 +869,7 @@ static int aie2_get_sensors(struct amdxdna_client *client,
 	if (!sensor)
 		return -ENOMEM;
 
-	sensor->type = AMDXDNA_SENSOR_TYPE_POWER;
-	sensor->input = 1234; /* TODO: query the device and get the power data */
-	sensor->unitm = -3; /* in milliwatts */
-	snprintf(sensor->label, sizeof(sensor->label), "Total Power");
-	snprintf(sensor->units, sizeof(sensor->units), "mW");
+	aie2_fill_sensor(client->xdna->dev_handle, sensor);
 
 	if (copy_to_user(u64_to_user_ptr(args->buffer), sensor, sizeof(*sensor)))
 		ret = -EFAULT;
@@ -854,16 +878,48 @@ static int aie2_get_sensors(struct amdxdna_client *client,
 	return ret;
 }
 
-static int aie2_get_hwctx_status(struct amdxdna_client *client,
-				 struct amdxdna_drm_get_info *args)
+void aie2_fill_hwctx_status(struct amdxdna_hwctx *hwctx, struct amdxdna_drm_query_hwctx *tmp)
+{
+	tmp->pid = hwctx->client->pid;
+	tmp->context_id = hwctx->id;
+	tmp->start_col = hwctx->start_col;
+	tmp->num_col = hwctx->num_col;
+	tmp->command_submissions = hwctx->submitted;
+	tmp->command_completions = hwctx->completed;
+	tmp->migrations = 0;
+	tmp->preemptions = 0;
+	tmp->errors = 0;
+}
+
+static void aie2_fill_hwctx_status_entry(struct amdxdna_hwctx *hwctx, void *entry)
+{
+	aie2_fill_hwctx_status(hwctx, entry);
+}
+
+static void aie2_fill_hwctx_usage(struct amdxdna_hwctx *hwctx, void *entry)
+{
+	struct amdxdna_drm_query_hwctx_usage *tmp = entry;
+
+	tmp->pid = hwctx->client->pid;
+	tmp->context_id = hwctx->id;
+	tmp->busy_ns = amdxdna_hwctx_busy_ns(hwctx, ktime_get());
+	tmp->queue_depth_ns = atomic64_read(&hwctx->usage.depth_ns);
+	tmp->cycles = atomic64_read(&hwctx->usage.cycles);
+	tmp->jobs = atomic64_read(&hwctx->usage.jobs);
+}
+
+/* Copy out an array with one entry of entry_size bytes per context */
+static int aie2_get_hwctx_array(struct amdxdna_client *client,
+				struct amdxdna_drm_get_info *args, u32 entry_size,
+				void (*fill)(struct amdxdna_hwctx *hwctx, void *entry))
 {
-	struct amdxdna_drm_query_hwctx __user *buf;
 	struct amdxdna_dev *xdna = client->xdna;
-	struct amdxdna_drm_query_hwctx *tmp;
 	struct amdxdna_client *tmp_client;
 	struct amdxdna_hwctx *hwctx;
 	unsigned long hwctx_id;
 	bool overflow = false;
+	void __user *buf;
+	void *tmp;
 	u32 req_bytes = 0;
 	u32 hw_i = 0;
 	int ret = 0;
@@ -871,7 +927,7 @@ static int aie2_get_hwctx_status(struct amdxdna_client *client,
 
 	drm_WARN_ON(&xdna->ddev, !mutex_is_locked(&xdna->dev_lock));
 
-	tmp = kzalloc(sizeof(*tmp), GFP_KERNEL);
+	tmp = kzalloc(entry_size, GFP_KERNEL);
 	if (!tmp)
 		return -ENOMEM;
 
@@ -879,24 +935,17 @@ static int aie2_get_hwctx_status(struct amdxdna_client *client,
 	list_for_each_entry(tmp_client, &xdna->client_list, node) {
 		idx = srcu_read_lock(&tmp_client->hwctx_srcu);
 		amdxdna_for_each_hwctx(tmp_client, hwctx_id, hwctx) {
-			req_bytes += sizeof(*tmp);
+			req_bytes += entry_size;
 			if (args->buffer_size < req_bytes) {
 				/* Continue iterating to get the required size */
 				overflow = true;
 				continue;
 			}
 
-			tmp->pid = tmp_client->pid;
-			tmp->context_id = hwctx->id;
-			tmp->start_col = hwctx->start_col;
-			tmp->num_col = hwctx->num_col;
-			tmp->command_submissions = hwctx->submitted;
-			tmp->command_completions = hwctx->completed;
-			tmp->migrations = 0;
-			tmp->preemptions = 0;
-			tmp->errors = 0;
-
-			if (copy_to_user(&buf[hw_i], tmp, sizeof(*tmp))) {
+			memset(tmp, 0, entry_size);
+			fill(hwctx, tmp);
+
+			if (copy_to_user(buf + hw_i * entry_size, tmp, entry_size)) {
 				ret = -EFAULT;
 				srcu_read_unlock(&tmp_client->hwctx_srcu, idx);
 				goto out;
@@ -918,6 +967,20 @@ out:
 	return ret;
 }
 
+static int aie2_get_hwctx_status(struct amdxdna_client *client,
+				 struct amdxdna_drm_get_info *args)
+{
+	return aie2_get_hwctx_array(client, args, sizeof(struct amdxdna_drm_query_hwctx),
+				    aie2_fill_hwctx_status_entry);
+}
+
+static int aie2_get_hwctx_usage(struct amdxdna_client *client,
+				struct amdxdna_drm_get_info *args)
+{
+	return aie2_get_hwctx_array(client, args, sizeof(struct amdxdna_drm_query_hwctx_usage),
+				    aie2_fill_hwctx_usage);
+}
+
 static int aie2_get_telemetry(struct amdxdna_client *client,
 			      struct amdxdna_drm_get_info *args)
 {
@@ -1031,6 +1094,9 @@ static int aie2_get_info(struct amdxdna_client *client, struct amdxdna_drm_get_i
 	case DRM_AMDXDNA_GET_FORCE_PREEMPT_STATE:
 		ret = aie2_get_force_preempt_state(client, args);
 		break;
+	case DRM_AMDXDNA_QUERY_HW_CONTEXT_USAGE:
+		ret = aie2_get_hwctx_usage(client, args);
+		break;
 	default:
 		XDNA_ERR(xdna, "Not supported request parameter %u", args->param);
 		ret = -EOPNOTSUPP;
@@ -1059,7 +1125,7 @@ static int aie2_set_power_mode(struct amdxdna_client *client, struct amdxdna_drm
 	}
 
 	power_mode = power_state.power_mode;
-	if (power_mode > POWER_MODE_TURBO) {
+	if (power_mode > POWER_MODE_DYNAMIC) {
 		XDNA_ERR(xdna, "Invalid power mode %d", power_mode);
 		return -EINVAL;
 	}
@@ -1131,6 +1197,7 @@ const struct amdxdna_dev_ops aie2_ops = {
 	.resume			= aie2_hw_start,
 	.suspend		= aie2_hw_stop,
 	.get_aie_info		= aie2_get_info,
+	.get_aie_info_cached	= aie2_get_info_cached,
 	.set_aie_state		= aie2_set_state,
 	.hwctx_init		= aie2_hwctx_init,
 	.hwctx_fini		= aie2_hwctx_fini,
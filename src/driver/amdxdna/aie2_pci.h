@@ -201,6 +201,26 @@ struct amdxdna_hwctx_priv {
 	struct drm_syncobj		*syncobj;
 
 	wait_queue_head_t		status_wq;
+
+	/* Context usage last seen by the DPM governor, under dev_lock */
+	u64				busy_sampled;
+	u64				depth_sampled;
+	u64				jobs_sampled;
+	/* Busy percent over last load window, see aie2_xrs_hwctx_load() */
+	spinlock_t			busy_lock; /* protect load window */
+	ktime_t				load_win_start;
+	u64				load_win_busy;
+	u32				load_pct;
+	/* Time slicing of oversubscribed columns, see aie2_ts_work() */
+	struct amdxdna_hwctx		*hwctx;
+	struct list_head		ts_node;
+	ktime_t				ts_since;
+	bool				ts_waiting;
+	bool				ts_tried;
+	/* Idle parking, see aie2_hwctx_park() */
+	struct delayed_work		park_work;
+	struct work_struct		unpark_work;
+	bool				parked;
 };
 
 enum aie2_dev_status {
@@ -215,6 +235,44 @@ enum aie2_power_state {
 };
 
 struct async_events;
+struct aie2_snapshot;
+struct seq_file;
+
+/* Updated with dev_lock held */
+struct aie2_park_stats {
+	u64				parks;
+	u64				unparks;
+	u64				unpark_ns;
+	u64				unpark_max_ns;
+	u64				restarts;
+	u64				restart_ns;
+	u64				restart_max_ns;
+};
+
+struct aie2_hmm_stats {
+	atomic64_t			submit_retries; /* submit revalidated BOs */
+	atomic64_t			fault_retries; /* range changed during fault */
+	atomic64_t			ranges_faulted;
+	atomic64_t			pages_faulted;
+};
+
+#define AIE2_GOV_HIST_NUM		32
+
+struct aie2_gov_sample {
+	u32				util; /* busiest partition, in percent */
+	u32				latency_us; /* average, 0 if no job done */
+	u32				level; /* DPM level picked */
+};
+
+struct aie2_dpm_gov {
+	struct delayed_work		work;
+	ktime_t				last_sample;
+	u32				level;
+	u32				low_cnt; /* consecutive samples below down_pct */
+	u32				hist_idx;
+	u32				hist_cnt;
+	struct aie2_gov_sample		hist[AIE2_GOV_HIST_NUM];
+};
 
 struct amdxdna_dev_hdl {
 	struct amdxdna_dev		*xdna;
@@ -244,6 +302,11 @@ struct amdxdna_dev_hdl {
 	u32				npuclk_freq;
 	u32				hclk_freq;
 	bool				force_preempt_enabled;
+	/* Deferred lowering of dft_dpm_level, see aie2_pm_set_dft_dpm_level() */
+	struct delayed_work		dpm_demote_work;
+	u32				dpm_demote_level;
+	bool				dpm_demote_pending;
+	struct aie2_dpm_gov		gov;
 
 	/* Mailbox and the management channel */
 	struct mailbox			*mbox;
@@ -252,6 +315,29 @@ struct amdxdna_dev_hdl {
 
 	u32				dev_status;
 	u32				hwctx_num;
+	/* Contexts waiting for columns when oversubscribed */
+	struct list_head		ts_wait_list;
+	struct delayed_work		ts_work;
+	/* Victim whose jobs on the device are draining, see aie2_ts_drain() */
+	struct amdxdna_hwctx		*ts_draining;
+	u64				ts_swaps;
+
+	struct aie2_hmm_stats		hmm_stats;
+	struct aie2_park_stats		park_stats;
+
+	/* Cached GET_INFO data served without dev_lock, see aie2_snapshot.c */
+	struct aie2_snapshot __rcu	*snap;
+	struct delayed_work		snap_work;
+	u64				snap_gen;
+	unsigned long			snap_read;
+	unsigned long			snap_tel_want;
+	u32				snap_tel_size;
+	void				*snap_buf;
+	u32				snap_buf_size;
+	dma_addr_t			snap_dma_addr;
+	u64				snap_refreshes;
+	atomic64_t			snap_hits;
+	atomic64_t			snap_misses;
 };
 
 #define DEFINE_BAR_OFFSET(reg_name, bar, reg_addr) \
@@ -307,6 +393,7 @@ extern const struct rt_config npu4_default_rt_cfg[];
 extern uint aie2_control_flags;
 extern const struct amdxdna_dev_ops aie2_ops;
 int aie2_check_protocol(struct amdxdna_dev_hdl *ndev, u32 fw_major, u32 fw_minor);
+void aie2_recover(struct amdxdna_dev *xdna, u32 col_map, bool dump_only);
 
 /* aie2_smu.c */
 int aie2_smu_start(struct amdxdna_dev_hdl *ndev);
@@ -322,12 +409,22 @@ int aie2_smu_get_power_state(struct amdxdna_dev_hdl *ndev);
 /* aie2_pm.c */
 int aie2_pm_init(struct amdxdna_dev_hdl *ndev);
 int aie2_pm_set_mode(struct amdxdna_dev_hdl *ndev, enum amdxdna_power_mode_type target);
+int aie2_pm_set_dft_dpm_level(struct amdxdna_dev_hdl *ndev, u32 dpm_level);
+void aie2_pm_early_init(struct amdxdna_dev_hdl *ndev);
+void aie2_pm_fini(struct amdxdna_dev_hdl *ndev);
 
 static inline bool aie2_pm_is_turbo(struct amdxdna_dev_hdl *ndev)
 {
 	return ndev->pw_mode == POWER_MODE_TURBO;
 }
 
+/* aie2_snapshot.c */
+void aie2_snap_init(struct amdxdna_dev_hdl *ndev);
+void aie2_snap_fini(struct amdxdna_dev_hdl *ndev);
+void aie2_snap_invalidate(struct amdxdna_dev_hdl *ndev);
+void aie2_snap_stats(struct amdxdna_dev_hdl *ndev, struct seq_file *m);
+int aie2_get_info_cached(struct amdxdna_client *client, struct amdxdna_drm_get_info *args);
+
 /* aie2_psp.c */
 struct psp_device *aie2m_psp_create(struct device *dev, struct psp_config *conf);
 int aie2_psp_start(struct psp_device *psp);
@@ -342,6 +439,10 @@ void aie2_error_async_events_free(struct amdxdna_dev_hdl *ndev);
 int aie2_error_async_events_send(struct amdxdna_dev_hdl *ndev);
 int aie2_error_async_msg_thread(void *data);
 
+/* aie2_pci.c */
+void aie2_fill_sensor(struct amdxdna_dev_hdl *ndev, struct amdxdna_drm_query_sensor *sensor);
+void aie2_fill_hwctx_status(struct amdxdna_hwctx *hwctx, struct amdxdna_drm_query_hwctx *tmp);
+
 /* aie2_message.c */
 int aie2_suspend_fw(struct amdxdna_dev_hdl *ndev);
 int aie2_resume_fw(struct amdxdna_dev_hdl *ndev);
@@ -393,10 +494,17 @@ int aie2_cmd_submit(struct amdxdna_hwctx *hwctx, struct amdxdna_sched_job *job,
 int aie2_cmd_wait(struct amdxdna_hwctx *hwctx, u64 seq, u32 timeout);
 struct dma_fence *aie2_cmd_get_out_fence(struct amdxdna_hwctx *hwctx, u64 seq);
 void aie2_hmm_invalidate(struct amdxdna_gem_obj *abo, unsigned long cur_seq);
-void aie2_stop_ctx(struct amdxdna_client *client);
-void aie2_dump_ctx(struct amdxdna_client *client);
-void aie2_restart_ctx(struct amdxdna_client *client);
+void aie2_stop_ctx(struct amdxdna_client *client, u32 col_map);
+void aie2_dump_ctx(struct amdxdna_client *client, u32 col_map);
+void aie2_restart_ctx(struct amdxdna_client *client, u32 col_map);
+int aie2_simulate_hang(struct amdxdna_dev *xdna, u32 col_map);
+void aie2_sample_busy(struct amdxdna_dev *xdna, u64 *part_busy_ns, u32 ncols,
+		      u64 *lat_sum_us, u32 *lat_cnt);
 int aie2_xrs_load_hwctx(struct amdxdna_hwctx *hwctx, struct xrs_action_load *action);
 int aie2_xrs_unload_hwctx(struct amdxdna_hwctx *hwctx);
+int aie2_xrs_migrate_hwctx(struct amdxdna_hwctx *hwctx, struct xrs_action_load *action);
+u32 aie2_xrs_hwctx_load(struct amdxdna_hwctx *hwctx);
+void aie2_ts_init(struct amdxdna_dev_hdl *ndev);
+void aie2_ts_fini(struct amdxdna_dev_hdl *ndev);
 
 #endif /* _AIE2_PCI_H_ */
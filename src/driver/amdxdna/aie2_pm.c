@@ -3,11 +3,41 @@
  * Copyright (C) 2024, Advanced Micro Devices, Inc.
  */
 
+#include <linux/math64.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+
 #include "aie2_pci.h"
 
 #define AIE2_CLK_GATING_ENABLE	1
 #define AIE2_CLK_GATING_DISABLE	0
 
+static uint dpm_demote_delay_ms = 1000;
+module_param(dpm_demote_delay_ms, uint, 0644);
+MODULE_PARM_DESC(dpm_demote_delay_ms, "Delay before lowering default DPM level, 0 to lower immediately (Default 1000)");
+
+#define AIE2_GOV_MIN_SAMPLE_MS		10
+
+static uint dpm_gov_sample_ms = 100;
+module_param(dpm_gov_sample_ms, uint, 0644);
+MODULE_PARM_DESC(dpm_gov_sample_ms, "Dynamic power mode sampling period (Default 100)");
+
+static uint dpm_gov_up_pct = 80;
+module_param(dpm_gov_up_pct, uint, 0644);
+MODULE_PARM_DESC(dpm_gov_up_pct, "Dynamic power mode, raise DPM level at this utilization (Default 80)");
+
+static uint dpm_gov_down_pct = 30;
+module_param(dpm_gov_down_pct, uint, 0644);
+MODULE_PARM_DESC(dpm_gov_down_pct, "Dynamic power mode, lower DPM level below this utilization (Default 30)");
+
+static uint dpm_gov_down_hold = 5;
+module_param(dpm_gov_down_hold, uint, 0644);
+MODULE_PARM_DESC(dpm_gov_down_hold, "Dynamic power mode, samples below down_pct before lowering (Default 5)");
+
+static uint dpm_gov_latency_us;
+module_param(dpm_gov_latency_us, uint, 0644);
+MODULE_PARM_DESC(dpm_gov_latency_us, "Dynamic power mode, raise DPM level if average job latency is above, 0 to disable (Default 0)");
+
 static int aie2_pm_set_clk_gating(struct amdxdna_dev_hdl *ndev, u32 val)
 {
 	int ret;
@@ -20,12 +50,117 @@ static int aie2_pm_set_clk_gating(struct amdxdna_dev_hdl *ndev, u32 val)
 	return 0;
 }
 
+static u32 aie2_gov_sample_ms(void)
+{
+	return max_t(u32, dpm_gov_sample_ms, AIE2_GOV_MIN_SAMPLE_MS);
+}
+
+/*
+ * Governor policy. Go up one level as soon as the busiest partition is above
+ * dpm_gov_up_pct or the latency target is missed. Go down one level only after
+ * dpm_gov_down_hold samples in a row below dpm_gov_down_pct. Never go below
+ * @floor, which is the level the QoS of the opened contexts asks for.
+ */
+static u32 aie2_gov_next_level(u32 level, u32 *low_cnt, u32 floor, u32 max_level,
+			       u32 util, u32 latency_us)
+{
+	bool slo_miss = dpm_gov_latency_us && latency_us > dpm_gov_latency_us;
+
+	if (util >= dpm_gov_up_pct || slo_miss) {
+		*low_cnt = 0;
+		if (level < max_level)
+			level++;
+	} else if (util < dpm_gov_down_pct) {
+		if (++(*low_cnt) >= dpm_gov_down_hold) {
+			*low_cnt = 0;
+			if (level)
+				level--;
+		}
+	} else {
+		*low_cnt = 0;
+	}
+
+	return clamp(level, floor, max_level);
+}
+
+static void aie2_pm_gov_start(struct amdxdna_dev_hdl *ndev)
+{
+	struct aie2_dpm_gov *gov = &ndev->gov;
+	u64 lat_sum_us;
+	u32 lat_cnt;
+
+	/* Drop busy time accumulated before the governor takes over */
+	aie2_sample_busy(ndev->xdna, NULL, 0, &lat_sum_us, &lat_cnt);
+	gov->level = ndev->dpm_level;
+	gov->low_cnt = 0;
+	gov->last_sample = ktime_get();
+	mod_delayed_work(system_wq, &gov->work, msecs_to_jiffies(aie2_gov_sample_ms()));
+}
+
+static void aie2_pm_gov_work(struct work_struct *work)
+{
+	struct aie2_dpm_gov *gov = container_of(to_delayed_work(work), struct aie2_dpm_gov, work);
+	struct amdxdna_dev_hdl *ndev = container_of(gov, struct amdxdna_dev_hdl, gov);
+	struct amdxdna_dev *xdna = ndev->xdna;
+	u64 *part_busy_ns, lat_sum_us, period_ns, busy_ns = 0;
+	struct aie2_gov_sample *sample;
+	u32 util, lat_cnt, lat_us, level, i;
+	ktime_t now;
+	int ret;
+
+	mutex_lock(&xdna->dev_lock);
+
+	/* aie2_pm_init() restarts the governor on resume */
+	if (ndev->pw_mode != POWER_MODE_DYNAMIC || ndev->dev_status < AIE2_DEV_START)
+		goto unlock;
+
+	part_busy_ns = kcalloc(ndev->total_col, sizeof(*part_busy_ns), GFP_KERNEL);
+	if (!part_busy_ns)
+		goto requeue;
+
+	aie2_sample_busy(xdna, part_busy_ns, ndev->total_col, &lat_sum_us, &lat_cnt);
+	for (i = 0; i < ndev->total_col; i++)
+		busy_ns = max(busy_ns, part_busy_ns[i]);
+	kfree(part_busy_ns);
+
+	now = ktime_get();
+	period_ns = ktime_to_ns(ktime_sub(now, gov->last_sample));
+	gov->last_sample = now;
+
+	util = period_ns ? min_t(u64, div64_u64(busy_ns * 100, period_ns), 100) : 0;
+	lat_us = lat_cnt ? div64_u64(lat_sum_us, lat_cnt) : 0;
+	level = aie2_gov_next_level(gov->level, &gov->low_cnt, ndev->dft_dpm_level,
+				    ndev->max_dpm_level, util, lat_us);
+	if (level != ndev->dpm_level) {
+		ret = ndev->priv->hw_ops.set_dpm(ndev, level);
+		if (ret) {
+			XDNA_WARN(xdna, "Governor set DPM level %d failed, ret %d", level, ret);
+			level = ndev->dpm_level;
+		}
+	}
+	gov->level = level;
+
+	sample = &gov->hist[gov->hist_idx];
+	sample->util = util;
+	sample->latency_us = lat_us;
+	sample->level = level;
+	gov->hist_idx = (gov->hist_idx + 1) % AIE2_GOV_HIST_NUM;
+	gov->hist_cnt = min(gov->hist_cnt + 1, AIE2_GOV_HIST_NUM);
+
+requeue:
+	queue_delayed_work(system_wq, &gov->work, msecs_to_jiffies(aie2_gov_sample_ms()));
+unlock:
+	mutex_unlock(&xdna->dev_lock);
+}
+
 int aie2_pm_init(struct amdxdna_dev_hdl *ndev)
 {
 	int ret;
 
 	if (ndev->dev_status != AIE2_DEV_UNINIT) {
-		/* Resume device */
+		/* Resume device, pick up any demotion done while suspended */
+		if (ndev->pw_mode == POWER_MODE_DEFAULT)
+			ndev->dpm_level = ndev->dft_dpm_level;
 		ret = ndev->priv->hw_ops.set_dpm(ndev, ndev->dpm_level);
 		if (ret)
 			return ret;
@@ -34,6 +169,8 @@ int aie2_pm_init(struct amdxdna_dev_hdl *ndev)
 		if (ret)
 			return ret;
 
+		if (ndev->pw_mode == POWER_MODE_DYNAMIC)
+			aie2_pm_gov_start(ndev);
 		return 0;
 	}
 
@@ -81,6 +218,7 @@ int aie2_pm_set_mode(struct amdxdna_dev_hdl *ndev, enum amdxdna_power_mode_type
 		dpm_level = ndev->max_dpm_level;
 		break;
 	case POWER_MODE_DEFAULT:
+	case POWER_MODE_DYNAMIC:
 		clk_gating = AIE2_CLK_GATING_ENABLE;
 		dpm_level = ndev->dft_dpm_level;
 		break;
@@ -97,6 +235,98 @@ int aie2_pm_set_mode(struct amdxdna_dev_hdl *ndev, enum amdxdna_power_mode_type
 		return ret;
 
 	ndev->pw_mode = target;
+	if (target == POWER_MODE_DYNAMIC)
+		aie2_pm_gov_start(ndev);
 
 	return 0;
 }
+
+static int aie2_pm_apply_dft_dpm_level(struct amdxdna_dev_hdl *ndev, u32 dpm_level)
+{
+	ndev->dft_dpm_level = dpm_level;
+	if (ndev->pw_mode == POWER_MODE_DYNAMIC) {
+		/* The level is the governor floor, only raise it here */
+		if (ndev->dpm_level >= dpm_level)
+			return 0;
+
+		ndev->gov.level = dpm_level;
+		return ndev->priv->hw_ops.set_dpm(ndev, dpm_level);
+	}
+
+	if (ndev->pw_mode != POWER_MODE_DEFAULT || ndev->dpm_level == dpm_level)
+		return 0;
+
+	return ndev->priv->hw_ops.set_dpm(ndev, dpm_level);
+}
+
+static void aie2_pm_dpm_demote_work(struct work_struct *work)
+{
+	struct amdxdna_dev_hdl *ndev;
+	struct amdxdna_dev *xdna;
+	int ret;
+
+	ndev = container_of(to_delayed_work(work), struct amdxdna_dev_hdl, dpm_demote_work);
+	xdna = ndev->xdna;
+
+	mutex_lock(&xdna->dev_lock);
+
+	if (!ndev->dpm_demote_pending)
+		goto unlock;
+
+	ndev->dpm_demote_pending = false;
+	if (ndev->dev_status < AIE2_DEV_START) {
+		/* Applied by aie2_pm_init() on resume */
+		ndev->dft_dpm_level = ndev->dpm_demote_level;
+		goto unlock;
+	}
+
+	ret = aie2_pm_apply_dft_dpm_level(ndev, ndev->dpm_demote_level);
+	if (ret)
+		XDNA_WARN(xdna, "Lower DPM level to %d failed, ret %d", ndev->dpm_demote_level, ret);
+	else
+		XDNA_DBG(xdna, "Lowered default DPM level to %d", ndev->dpm_demote_level);
+
+unlock:
+	mutex_unlock(&xdna->dev_lock);
+}
+
+/*
+ * Raising the default DPM level is done right away. Lowering it is deferred
+ * until the lower level has been requested for dpm_demote_delay_ms, so that
+ * contexts coming and going do not thrash the clocks.
+ */
+int aie2_pm_set_dft_dpm_level(struct amdxdna_dev_hdl *ndev, u32 dpm_level)
+{
+	struct amdxdna_dev *xdna = ndev->xdna;
+
+	drm_WARN_ON(&xdna->ddev, !mutex_is_locked(&xdna->dev_lock));
+
+	if (dpm_level >= ndev->dft_dpm_level || !dpm_demote_delay_ms) {
+		ndev->dpm_demote_pending = false;
+		return aie2_pm_apply_dft_dpm_level(ndev, dpm_level);
+	}
+
+	ndev->dpm_demote_level = dpm_level;
+	ndev->dpm_demote_pending = true;
+	mod_delayed_work(system_wq, &ndev->dpm_demote_work,
+			 msecs_to_jiffies(dpm_demote_delay_ms));
+	return 0;
+}
+
+void aie2_pm_early_init(struct amdxdna_dev_hdl *ndev)
+{
+	INIT_DELAYED_WORK(&ndev->dpm_demote_work, aie2_pm_dpm_demote_work);
+	INIT_DELAYED_WORK(&ndev->gov.work, aie2_pm_gov_work);
+}
+
+/* Called without dev_lock, the workers take it */
+void aie2_pm_fini(struct amdxdna_dev_hdl *ndev)
+{
+	cancel_delayed_work_sync(&ndev->dpm_demote_work);
+	cancel_delayed_work_sync(&ndev->gov.work);
+	ndev->dpm_demote_pending = false;
+}
+
+#ifdef AMDXDNA_KUNIT
+#include "tests/aie2_pm_test.c"
+#endif
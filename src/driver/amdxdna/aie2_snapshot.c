@@ -0,0 +1,394 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2024, Advanced Micro Devices, Inc.
+ */
+
+#include <linux/pm_runtime.h>
+#include <linux/rcupdate.h>
+#include <linux/refcount.h>
+#include <linux/seq_file.h>
+#include <linux/sizes.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/workqueue.h>
+#include <drm/drm_cache.h>
+
+#include "aie2_pci.h"
+#include "aie2_msg_priv.h"
+
+/*
+ * Sensor, context status and telemetry queries are answered from a snapshot
+ * that a worker refreshes every telemetry_cache_ms while somebody is polling.
+ * Readers take a reference under RCU and copy out without dev_lock and without
+ * talking to firmware. Anything the snapshot cannot answer (no snapshot yet,
+ * telemetry type not cached yet, contexts created or destroyed since the last
+ * refresh) goes to the locked path and asks the worker for a refresh.
+ */
+static uint telemetry_cache_ms = 100;
+module_param(telemetry_cache_ms, uint, 0644);
+MODULE_PARM_DESC(telemetry_cache_ms, "Refresh period of cached sensor/context/telemetry data, 0 to disable (Default 100)");
+
+/* Stop refreshing after this many periods without a reader */
+#define AIE2_SNAP_IDLE_PERIODS	10
+/* Larger telemetry reads always go to firmware */
+#define AIE2_SNAP_TEL_MAX_SIZE	SZ_64K
+
+struct aie2_snapshot {
+	refcount_t			ref;
+	struct rcu_head			rcu;
+	u64				gen;
+	ktime_t				time;
+	struct amdxdna_drm_query_sensor	sensor;
+	unsigned long			tel_valid;
+	/* Includes the major and minor words in front of firmware data */
+	u32				tel_size;
+	void				*telemetry[MAX_TELEMETRY_TYPE];
+	u32				num_hwctx;
+	struct amdxdna_drm_query_hwctx	hwctx[];
+};
+
+static void aie2_snap_free_rcu(struct rcu_head *rcu)
+{
+	struct aie2_snapshot *snap = container_of(rcu, struct aie2_snapshot, rcu);
+	int i;
+
+	for (i = 0; i < MAX_TELEMETRY_TYPE; i++)
+		kfree(snap->telemetry[i]);
+	kfree(snap);
+}
+
+static void aie2_snap_put(struct aie2_snapshot *snap)
+{
+	if (refcount_dec_and_test(&snap->ref))
+		call_rcu(&snap->rcu, aie2_snap_free_rcu);
+}
+
+static struct aie2_snapshot *aie2_snap_get(struct amdxdna_dev_hdl *ndev)
+{
+	struct aie2_snapshot *snap;
+
+	rcu_read_lock();
+	snap = rcu_dereference(ndev->snap);
+	if (snap && !refcount_inc_not_zero(&snap->ref))
+		snap = NULL;
+	rcu_read_unlock();
+
+	return snap;
+}
+
+static void aie2_snap_publish(struct amdxdna_dev_hdl *ndev, struct aie2_snapshot *snap)
+{
+	struct aie2_snapshot *old;
+
+	old = rcu_replace_pointer(ndev->snap, snap, lockdep_is_held(&ndev->xdna->dev_lock));
+	if (old)
+		aie2_snap_put(old);
+}
+
+/* The DMA buffer grows to the largest telemetry size readers asked for */
+static int aie2_snap_buf_reserve(struct amdxdna_dev_hdl *ndev, u32 size)
+{
+	struct device *dev = ndev->xdna->ddev.dev;
+
+	if (ndev->snap_buf_size >= size)
+		return 0;
+
+	if (ndev->snap_buf)
+		dma_free_noncoherent(dev, ndev->snap_buf_size, ndev->snap_buf,
+				     ndev->snap_dma_addr, DMA_FROM_DEVICE);
+	ndev->snap_buf_size = 0;
+	ndev->snap_buf = dma_alloc_noncoherent(dev, size, &ndev->snap_dma_addr,
+					       DMA_FROM_DEVICE, GFP_KERNEL);
+	if (!ndev->snap_buf)
+		return -ENOMEM;
+
+	ndev->snap_buf_size = size;
+	return 0;
+}
+
+static void aie2_snap_telemetry(struct amdxdna_dev_hdl *ndev, struct aie2_snapshot *snap)
+{
+	struct amdxdna_dev *xdna = ndev->xdna;
+	struct device *dev = xdna->ddev.dev;
+	struct aie_version ver;
+	unsigned long type;
+	u32 size;
+	int ret;
+
+	size = READ_ONCE(ndev->snap_tel_size);
+	if (!size || !ndev->snap_tel_want || aie2_snap_buf_reserve(ndev, size))
+		return;
+
+	/* Do not wake up the device just to refresh the cache */
+	ret = pm_runtime_get_if_in_use(dev);
+	if (!ret)
+		return;
+
+	for_each_set_bit(type, &ndev->snap_tel_want, MAX_TELEMETRY_TYPE) {
+		snap->telemetry[type] = kmalloc(size, GFP_KERNEL);
+		if (!snap->telemetry[type])
+			break;
+
+		memset(ndev->snap_buf, 0, size);
+		drm_clflush_virt_range(ndev->snap_buf, size); /* device can access */
+		/* The first two words of the buffer is reserved for major and minor */
+		if (aie2_query_telemetry(ndev, type, ndev->snap_dma_addr + sizeof(u64),
+					 size - sizeof(u64), &ver)) {
+			XDNA_DBG(xdna, "Telemetry type %ld not cached", type);
+			kfree(snap->telemetry[type]);
+			snap->telemetry[type] = NULL;
+			clear_bit(type, &ndev->snap_tel_want);
+			continue;
+		}
+
+		((u32 *)ndev->snap_buf)[0] = ver.major;
+		((u32 *)ndev->snap_buf)[1] = ver.minor;
+		memcpy(snap->telemetry[type], ndev->snap_buf, size);
+		__set_bit(type, &snap->tel_valid);
+	}
+	snap->tel_size = size;
+
+	if (ret > 0) {
+		pm_runtime_mark_last_busy(dev);
+		pm_runtime_put_autosuspend(dev);
+	}
+}
+
+static void aie2_snap_refresh(struct amdxdna_dev_hdl *ndev)
+{
+	struct amdxdna_dev *xdna = ndev->xdna;
+	struct aie2_snapshot *snap;
+	struct amdxdna_client *client;
+	struct amdxdna_hwctx *hwctx;
+	unsigned long hwctx_id;
+	u32 num = 0;
+	int idx;
+
+	drm_WARN_ON(&xdna->ddev, !mutex_is_locked(&xdna->dev_lock));
+
+	list_for_each_entry(client, &xdna->client_list, node) {
+		idx = srcu_read_lock(&client->hwctx_srcu);
+		amdxdna_for_each_hwctx(client, hwctx_id, hwctx)
+			num++;
+		srcu_read_unlock(&client->hwctx_srcu, idx);
+	}
+
+	snap = kzalloc(struct_size(snap, hwctx, num), GFP_KERNEL);
+	if (!snap)
+		return;
+
+	refcount_set(&snap->ref, 1);
+	snap->gen = ndev->snap_gen;
+	snap->time = ktime_get();
+	aie2_fill_sensor(ndev, &snap->sensor);
+
+	/* Contexts may be added without dev_lock, do not go over the count */
+	list_for_each_entry(client, &xdna->client_list, node) {
+		idx = srcu_read_lock(&client->hwctx_srcu);
+		amdxdna_for_each_hwctx(client, hwctx_id, hwctx) {
+			if (snap->num_hwctx == num)
+				break;
+			aie2_fill_hwctx_status(hwctx, &snap->hwctx[snap->num_hwctx++]);
+		}
+		srcu_read_unlock(&client->hwctx_srcu, idx);
+	}
+
+	aie2_snap_telemetry(ndev, snap);
+
+	aie2_snap_publish(ndev, snap);
+	ndev->snap_refreshes++;
+}
+
+static void aie2_snap_work(struct work_struct *work)
+{
+	struct amdxdna_dev_hdl *ndev;
+	struct amdxdna_dev *xdna;
+	unsigned long idle;
+	u32 period;
+
+	ndev = container_of(to_delayed_work(work), struct amdxdna_dev_hdl, snap_work);
+	xdna = ndev->xdna;
+
+	mutex_lock(&xdna->dev_lock);
+
+	/* The next reader asks for a refresh again */
+	if (ndev->dev_status < AIE2_DEV_START)
+		goto unlock;
+
+	period = READ_ONCE(telemetry_cache_ms);
+	idle = READ_ONCE(ndev->snap_read) + msecs_to_jiffies(period * AIE2_SNAP_IDLE_PERIODS);
+	if (!period || time_after(jiffies, idle)) {
+		/* Nobody is polling, do not hand out old data later */
+		aie2_snap_publish(ndev, NULL);
+		ndev->snap_tel_want = 0;
+		WRITE_ONCE(ndev->snap_tel_size, 0);
+		goto unlock;
+	}
+
+	aie2_snap_refresh(ndev);
+	queue_delayed_work(system_wq, &ndev->snap_work, msecs_to_jiffies(period));
+
+unlock:
+	mutex_unlock(&xdna->dev_lock);
+}
+
+/* Telemetry of all types is cached at the largest size asked for */
+static void aie2_snap_want_telemetry(struct amdxdna_dev_hdl *ndev, u32 type, u32 size)
+{
+	size = max_t(u32, PAGE_ALIGN(size), PAGE_SIZE);
+	if (size > READ_ONCE(ndev->snap_tel_size))
+		WRITE_ONCE(ndev->snap_tel_size, size);
+	set_bit(type, &ndev->snap_tel_want);
+}
+
+static void aie2_snap_miss(struct amdxdna_dev_hdl *ndev)
+{
+	atomic64_inc(&ndev->snap_misses);
+	queue_delayed_work(system_wq, &ndev->snap_work, 0);
+}
+
+static int aie2_snap_get_hwctx_status(struct amdxdna_client *client,
+				      struct amdxdna_drm_get_info *args,
+				      struct aie2_snapshot *snap)
+{
+	struct amdxdna_drm_query_hwctx __user *buf = u64_to_user_ptr(args->buffer);
+	u32 req_bytes = snap->num_hwctx * sizeof(*buf);
+	u32 num = min(args->buffer_size / (u32)sizeof(*buf), snap->num_hwctx);
+	int ret = 0;
+
+	if (copy_to_user(buf, snap->hwctx, num * sizeof(*buf))) {
+		ret = -EFAULT;
+	} else if (args->buffer_size < req_bytes) {
+		XDNA_ERR(client->xdna, "Invalid buffer size. Given: %u Need: %u.",
+			 args->buffer_size, req_bytes);
+		ret = -EINVAL;
+	}
+
+	args->buffer_size = req_bytes;
+	return ret;
+}
+
+int aie2_get_info_cached(struct amdxdna_client *client, struct amdxdna_drm_get_info *args)
+{
+	struct amdxdna_dev *xdna = client->xdna;
+	struct amdxdna_dev_hdl *ndev = xdna->dev_handle;
+	struct aie2_snapshot *snap;
+	u32 type = 0;
+	int ret, idx;
+
+	if (!READ_ONCE(telemetry_cache_ms))
+		return -EAGAIN;
+
+	switch (args->param) {
+	case DRM_AMDXDNA_QUERY_SENSORS:
+	case DRM_AMDXDNA_QUERY_HW_CONTEXTS:
+		break;
+	case DRM_AMDXDNA_QUERY_TELEMETRY:
+		if (args->buffer_size > AIE2_SNAP_TEL_MAX_SIZE)
+			return -EAGAIN;
+		if (copy_from_user(&type, u64_to_user_ptr(args->buffer), sizeof(type)))
+			return -EAGAIN;
+		if (type >= MAX_TELEMETRY_TYPE)
+			return -EAGAIN;
+		break;
+	default:
+		return -EAGAIN;
+	}
+
+	if (!drm_dev_enter(&xdna->ddev, &idx))
+		return -ENODEV;
+
+	WRITE_ONCE(ndev->snap_read, jiffies);
+	snap = aie2_snap_get(ndev);
+	if (!snap) {
+		ret = -EAGAIN;
+		goto miss;
+	}
+
+	switch (args->param) {
+	case DRM_AMDXDNA_QUERY_SENSORS:
+		ret = copy_to_user(u64_to_user_ptr(args->buffer), &snap->sensor,
+				   sizeof(snap->sensor)) ? -EFAULT : 0;
+		break;
+	case DRM_AMDXDNA_QUERY_HW_CONTEXTS:
+		if (snap->gen != READ_ONCE(ndev->snap_gen)) {
+			ret = -EAGAIN;
+			break;
+		}
+		ret = aie2_snap_get_hwctx_status(client, args, snap);
+		break;
+	case DRM_AMDXDNA_QUERY_TELEMETRY:
+		if (!test_bit(type, &snap->tel_valid) || args->buffer_size > snap->tel_size) {
+			ret = -EAGAIN;
+			break;
+		}
+		ret = copy_to_user(u64_to_user_ptr(args->buffer), snap->telemetry[type],
+				   args->buffer_size) ? -EFAULT : 0;
+		break;
+	}
+	aie2_snap_put(snap);
+	if (ret == -EAGAIN)
+		goto miss;
+
+	atomic64_inc(&ndev->snap_hits);
+	drm_dev_exit(idx);
+	return ret;
+
+miss:
+	if (args->param == DRM_AMDXDNA_QUERY_TELEMETRY)
+		aie2_snap_want_telemetry(ndev, type, args->buffer_size);
+	aie2_snap_miss(ndev);
+	drm_dev_exit(idx);
+	return ret;
+}
+
+void aie2_snap_stats(struct amdxdna_dev_hdl *ndev, struct seq_file *m)
+{
+	struct aie2_snapshot *snap;
+
+	seq_printf(m, "period_ms %u\n", READ_ONCE(telemetry_cache_ms));
+	seq_printf(m, "hits %lld misses %lld refreshes %lld\n",
+		   atomic64_read(&ndev->snap_hits), atomic64_read(&ndev->snap_misses),
+		   ndev->snap_refreshes);
+	seq_printf(m, "telemetry_types 0x%lx size %u\n", ndev->snap_tel_want,
+		   READ_ONCE(ndev->snap_tel_size));
+
+	snap = aie2_snap_get(ndev);
+	if (!snap) {
+		seq_puts(m, "snapshot none\n");
+		return;
+	}
+	seq_printf(m, "snapshot age_us %lld hwctx %u telemetry 0x%lx%s\n",
+		   ktime_us_delta(ktime_get(), snap->time), snap->num_hwctx, snap->tel_valid,
+		   snap->gen != ndev->snap_gen ? " stale" : "");
+	aie2_snap_put(snap);
+}
+
+/* Contexts were created, destroyed or moved, context status in the snapshot is stale */
+void aie2_snap_invalidate(struct amdxdna_dev_hdl *ndev)
+{
+	WRITE_ONCE(ndev->snap_gen, ndev->snap_gen + 1);
+}
+
+void aie2_snap_init(struct amdxdna_dev_hdl *ndev)
+{
+	INIT_DELAYED_WORK(&ndev->snap_work, aie2_snap_work);
+}
+
+/* Called without dev_lock, the worker takes it */
+void aie2_snap_fini(struct amdxdna_dev_hdl *ndev)
+{
+	struct amdxdna_dev *xdna = ndev->xdna;
+
+	cancel_delayed_work_sync(&ndev->snap_work);
+	mutex_lock(&xdna->dev_lock);
+	aie2_snap_publish(ndev, NULL);
+	mutex_unlock(&xdna->dev_lock);
+	if (ndev->snap_buf)
+		dma_free_noncoherent(xdna->ddev.dev, ndev->snap_buf_size, ndev->snap_buf,
+				     ndev->snap_dma_addr, DMA_FROM_DEVICE);
+	ndev->snap_buf = NULL;
+	ndev->snap_buf_size = 0;
+	/* Snapshots replaced earlier may still be waiting for a grace period */
+	rcu_barrier();
+}
@@ -26,6 +26,8 @@ struct solver_node {
 	struct partition_node	*pt_node;
 	struct amdxdna_hwctx	*hwctx;
 	u32			dpm_level;
+	u32			opc;		/* operations per cycle */
+	bool			idle;		/* Not counted for DPM level */
 	u32			cols_len;
 	u32			start_cols[] __counted_by(cols_len);
 };
@@ -109,36 +111,45 @@ static bool is_valid_qos_dpm_params(struct aie_qos *rqos)
 	return false;
 }
 
-static int set_dpm_level(struct solver_state *xrs, struct alloc_requests *req, u32 *dpm_level)
+/*
+ * calc_dpm_level() - Lowest DPM level that meets the QoS request, given the
+ * operations per cycle of the partition.
+ */
+static u32 calc_dpm_level(struct solver_state *xrs, struct aie_qos *rqos, u32 opc)
 {
-	struct solver_rgroup *rgp = &xrs->rgp;
-	struct cdo_parts *cdop = &req->cdo;
-	struct aie_qos *rqos = &req->rqos;
 	u32 freq, max_dpm_level, level;
-	struct solver_node *node;
 
 	max_dpm_level = xrs->cfg.clk_list.num_levels - 1;
 	/* If no QoS parameters are passed, set it to the max DPM level */
-	if (!is_valid_qos_dpm_params(rqos)) {
-		level = max_dpm_level;
-		goto set_dpm;
-	}
+	if (!is_valid_qos_dpm_params(rqos))
+		return max_dpm_level;
 
 	/* Find one CDO group that meet the GOPs requirement. */
 	for (level = 0; level < max_dpm_level; level++) {
 		freq = xrs->cfg.clk_list.cu_clk_list[level];
-		if (!qos_meet(xrs, rqos, cdop->qos_cap.opc * freq / 1000))
+		if (!qos_meet(xrs, rqos, opc * freq / 1000))
 			break;
 	}
 
-	/* set the dpm level which fits all the sessions */
-	list_for_each_entry(node, &rgp->node_list, list) {
-		if (node->dpm_level > level)
+	return level;
+}
+
+/*
+ * set_dpm_level() - Set the dpm level which fits all the sessions. This is
+ * re-evaluated whenever a session is added, released or changes its QoS, so
+ * the level goes down as well as up. The action callback decides how fast a
+ * lower level takes effect.
+ */
+static int set_dpm_level(struct solver_state *xrs)
+{
+	struct solver_node *node;
+	u32 level = 0;
+
+	list_for_each_entry(node, &xrs->rgp.node_list, list) {
+		if (!node->idle && node->dpm_level > level)
 			level = node->dpm_level;
 	}
 
-set_dpm:
-	*dpm_level = level;
 	return xrs->cfg.actions->set_dft_dpm_level(xrs->cfg.ddev, level);
 }
 
@@ -180,22 +191,73 @@ static void remove_solver_node(struct solver_rgroup *rgp,
 	kfree(node);
 }
 
+static bool cols_free(struct solver_state *xrs, const unsigned long *resbit,
+		      u32 col, u32 ncols)
+{
+	if (col + ncols > xrs->cfg.total_col)
+		return false;
+
+	return find_next_bit(resbit, col + ncols, col) >= col + ncols;
+}
+
+/* Length of the run of free columns which contains @col */
+static u32 free_run_len(struct solver_state *xrs, const unsigned long *resbit, u32 col)
+{
+	u32 start, end;
+
+	start = find_last_bit(resbit, col);
+	start = (start == col) ? 0 : start + 1;
+	end = find_next_bit(resbit, xrs->cfg.total_col, col);
+
+	return end - start;
+}
+
+/*
+ * find_free_col() - Pick a start column from @start_cols for @ncols columns.
+ *
+ * First fit takes the first start column that fits. Best fit takes the one
+ * in the smallest run of free columns, so that big holes are kept for big
+ * requests. Ties go to the earlier one in @start_cols.
+ */
+static int find_free_col(struct solver_state *xrs, const u32 *start_cols, u32 cols_len,
+			 u32 ncols, const unsigned long *resbit, u32 *found)
+{
+	u32 col, run, best_run = U32_MAX;
+	u32 i;
+
+	for (i = 0; i < cols_len; i++) {
+		col = start_cols[i];
+		if (!cols_free(xrs, resbit, col, ncols))
+			continue;
+
+		if (!(xrs->cfg.flags & XRS_FLAG_BEST_FIT)) {
+			*found = col;
+			return 0;
+		}
+
+		run = free_run_len(xrs, resbit, col);
+		if (run < best_run) {
+			best_run = run;
+			*found = col;
+		}
+	}
+
+	return (best_run == U32_MAX) ? -ENODEV : 0;
+}
+
 static int get_free_partition(struct solver_state *xrs,
 			      struct solver_node *snode,
 			      struct alloc_requests *req)
 {
 	struct partition_node *pt_node;
 	u32 ncols = req->cdo.ncols;
-	u32 col, i;
-
-	for (i = 0; i < snode->cols_len; i++) {
-		col = snode->start_cols[i];
-		if (find_next_bit(xrs->rgp.resbit, XRS_MAX_COL, col) >= col + ncols)
-			break;
-	}
+	u32 col;
+	int ret;
 
-	if (i == snode->cols_len)
-		return -ENODEV;
+	ret = find_free_col(xrs, snode->start_cols, snode->cols_len, ncols,
+			    xrs->rgp.resbit, &col);
+	if (ret)
+		return ret;
 
 	pt_node = kzalloc(sizeof(*pt_node), GFP_KERNEL);
 	if (!pt_node)
@@ -219,35 +281,184 @@ static int get_free_partition(struct solver_state *xrs,
 	return 0;
 }
 
+static struct solver_node *pt_owner(struct solver_state *xrs,
+				     struct partition_node *pt_node)
+{
+	struct solver_node *node;
+
+	list_for_each_entry(node, &xrs->rgp.node_list, list) {
+		if (node->pt_node == pt_node)
+			return node;
+	}
+
+	return NULL;
+}
+
+/* Sum of the load of the contexts sharing the partition */
+static u32 partition_load(struct solver_state *xrs, struct partition_node *pt_node)
+{
+	struct solver_node *node;
+	u32 load = 0;
+
+	if (!xrs->cfg.actions->hwctx_load)
+		return 0;
+
+	list_for_each_entry(node, &xrs->rgp.node_list, list) {
+		if (node->pt_node == pt_node)
+			load += xrs->cfg.actions->hwctx_load(node->hwctx);
+	}
+
+	return load;
+}
+
+static int migrate_partition(struct solver_state *xrs, struct solver_node *node,
+			     struct partition_node *pt_node, u32 new_col)
+{
+	struct xrs_action_load action;
+	u32 old_col = pt_node->start_col;
+	int ret;
+
+	action.rid = node->rid;
+	action.part.start_col = new_col;
+	action.part.ncols = pt_node->ncols;
+	ret = xrs->cfg.actions->migrate_hwctx(node->hwctx, &action);
+	if (ret)
+		return ret;
+
+	bitmap_clear(xrs->rgp.resbit, old_col, pt_node->ncols);
+	bitmap_set(xrs->rgp.resbit, new_col, pt_node->ncols);
+	pt_node->start_col = new_col;
+	drm_dbg(xrs->cfg.ddev, "rid %lld moved from col %d to %d\n", node->rid, old_col, new_col);
+
+	return 0;
+}
+
+/*
+ * plan_compaction() - Move the partitions overlapping [col, col + ncols) out
+ * of the way. Only partitions with a single context can move, to a place the
+ * context's own start column list allows.
+ *
+ * With @exec false, only check it is possible. Each move is done on its own,
+ * so a failure in the middle leaves a consistent, if less compact, state.
+ *
+ * Return: number of columns moved, or negative error number.
+ */
+static int plan_compaction(struct solver_state *xrs, u32 col, u32 ncols, bool exec)
+{
+	struct partition_node *pt_node;
+	DECLARE_BITMAP(map, XRS_MAX_COL);
+	struct solver_node *node;
+	u32 new_col;
+	int ret, cost = 0;
+
+	bitmap_copy(map, xrs->rgp.resbit, XRS_MAX_COL);
+	list_for_each_entry(pt_node, &xrs->rgp.pt_node_list, list) {
+		if (pt_node->start_col + pt_node->ncols <= col ||
+		    pt_node->start_col >= col + ncols)
+			continue;
+
+		if (pt_node->exclusive || pt_node->nshared != 1)
+			return -EBUSY;
+
+		node = pt_owner(xrs, pt_node);
+		if (!node)
+			return -EBUSY;
+
+		/* Its own columns outside the window can be reused */
+		bitmap_clear(map, pt_node->start_col, pt_node->ncols);
+		bitmap_set(map, col, ncols);
+		ret = find_free_col(xrs, node->start_cols, node->cols_len, pt_node->ncols,
+				    map, &new_col);
+		if (ret)
+			return ret;
+
+		bitmap_set(map, new_col, pt_node->ncols);
+		cost += pt_node->ncols;
+
+		if (exec) {
+			ret = migrate_partition(xrs, node, pt_node, new_col);
+			if (ret)
+				return ret;
+		}
+	}
+
+	return cost;
+}
+
+/*
+ * compact_partitions() - Make room for a request by moving idle contexts,
+ * picking the start column which needs the fewest columns moved.
+ */
+static int compact_partitions(struct solver_state *xrs, struct solver_node *snode,
+			      struct alloc_requests *req)
+{
+	u32 ncols = req->cdo.ncols;
+	int cost, best_cost = INT_MAX;
+	u32 i, col, best_col = 0;
+	int ret;
+
+	if (!(xrs->cfg.flags & XRS_FLAG_COMPACT) || !xrs->cfg.actions->migrate_hwctx)
+		return -EOPNOTSUPP;
+
+	for (i = 0; i < snode->cols_len; i++) {
+		col = snode->start_cols[i];
+		if (col + ncols > xrs->cfg.total_col)
+			continue;
+
+		cost = plan_compaction(xrs, col, ncols, false);
+		if (cost >= 0 && cost < best_cost) {
+			best_cost = cost;
+			best_col = col;
+		}
+	}
+
+	if (best_cost == INT_MAX)
+		return -ENODEV;
+
+	ret = plan_compaction(xrs, best_col, ncols, true);
+	return (ret < 0) ? ret : 0;
+}
+
 static int allocate_partition(struct solver_state *xrs,
 			      struct solver_node *snode,
 			      struct alloc_requests *req)
 {
 	struct partition_node *pt_node, *rpt_node = NULL;
+	u32 load, rload = 0;
 	int idx, ret;
 
 	ret = get_free_partition(xrs, snode, req);
 	if (!ret)
 		return ret;
 
-	/* try to get a share-able partition */
-	list_for_each_entry(pt_node, &xrs->rgp.pt_node_list, list) {
-		if (pt_node->exclusive)
-			continue;
+	if (!compact_partitions(xrs, snode, req)) {
+		ret = get_free_partition(xrs, snode, req);
+		if (!ret)
+			return ret;
+	}
 
-		if (rpt_node && pt_node->nshared >= rpt_node->nshared)
+	/*
+	 * try to get a share-able partition, the least loaded one. Sharer
+	 * count breaks the tie, which is all there is without load callback.
+	 */
+	list_for_each_entry(pt_node, &xrs->rgp.pt_node_list, list) {
+		if (pt_node->exclusive || req->cdo.ncols != pt_node->ncols)
 			continue;
 
 		for (idx = 0; idx < snode->cols_len; idx++) {
-			if (snode->start_cols[idx] != pt_node->start_col)
-				continue;
+			if (snode->start_cols[idx] == pt_node->start_col)
+				break;
+		}
+		if (idx == snode->cols_len)
+			continue;
 
-			if (req->cdo.ncols != pt_node->ncols)
-				continue;
+		load = partition_load(xrs, pt_node);
+		if (rpt_node && (load > rload ||
+				 (load == rload && pt_node->nshared >= rpt_node->nshared)))
+			continue;
 
-			rpt_node = pt_node;
-			break;
-		}
+		rpt_node = pt_node;
+		rload = load;
 	}
 
 	if (!rpt_node)
@@ -301,7 +512,6 @@ int xrs_allocate_resource(void *hdl, struct alloc_requests *req, struct amdxdna_
 	struct xrs_action_load load_act;
 	struct solver_node *snode;
 	struct solver_state *xrs;
-	u32 dpm_level;
 	int ret;
 
 	xrs = (struct solver_state *)hdl;
@@ -326,11 +536,12 @@ int xrs_allocate_resource(void *hdl, struct alloc_requests *req, struct amdxdna_
 	if (ret)
 		goto free_node;
 
-	ret = set_dpm_level(xrs, req, &dpm_level);
+	snode->opc = req->cdo.qos_cap.opc;
+	snode->dpm_level = calc_dpm_level(xrs, &req->rqos, snode->opc);
+	ret = set_dpm_level(xrs);
 	if (ret)
 		goto free_node;
 
-	snode->dpm_level = dpm_level;
 	snode->hwctx = hwctx;
 
 	drm_dbg(xrs->cfg.ddev, "start col %d ncols %d\n",
@@ -358,23 +569,104 @@ int xrs_release_resource(void *hdl, u64 rid)
 	xrs->cfg.actions->unload_hwctx(node->hwctx);
 	remove_solver_node(&xrs->rgp, node);
 
+	/* Resource is released anyway, a failure here is not fatal */
+	if (set_dpm_level(xrs))
+		drm_err(xrs->cfg.ddev, "set dpm level failed");
+
 	return 0;
 }
 
-void *xrsm_init(struct init_config *cfg)
+int xrs_update_qos(void *hdl, u64 rid, struct aie_qos *rqos)
 {
-	struct solver_rgroup *rgp;
-	struct solver_state *xrs;
+	struct solver_state *xrs = hdl;
+	struct solver_node *node;
+	u32 cu_clk_freq, old_level;
+	int ret;
 
-	xrs = drmm_kzalloc(cfg->ddev, sizeof(*xrs), GFP_KERNEL);
-	if (!xrs)
-		return NULL;
+	node = rg_search_node(&xrs->rgp, rid);
+	if (!node)
+		return -ENODEV;
+
+	cu_clk_freq = xrs->cfg.clk_list.cu_clk_list[xrs->cfg.clk_list.num_levels - 1];
+	if (qos_meet(xrs, rqos, node->opc * cu_clk_freq / 1000)) {
+		drm_dbg(xrs->cfg.ddev, "rid %lld QoS can not be met", rid);
+		return -EINVAL;
+	}
+
+	old_level = node->dpm_level;
+	node->dpm_level = calc_dpm_level(xrs, rqos, node->opc);
+	ret = set_dpm_level(xrs);
+	if (ret)
+		node->dpm_level = old_level;
+
+	return ret;
+}
+
+int xrs_set_idle(void *hdl, u64 rid, bool idle)
+{
+	struct solver_state *xrs = hdl;
+	struct solver_node *node;
+	int ret;
+
+	node = rg_search_node(&xrs->rgp, rid);
+	if (!node)
+		return -ENODEV;
+
+	if (node->idle == idle)
+		return 0;
+
+	node->idle = idle;
+	ret = set_dpm_level(xrs);
+	if (ret)
+		node->idle = !idle;
+
+	return ret;
+}
+
+static void xrs_state_init(struct solver_state *xrs, struct init_config *cfg)
+{
+	struct solver_rgroup *rgp;
 
 	memcpy(&xrs->cfg, cfg, sizeof(*cfg));
 
 	rgp = &xrs->rgp;
 	INIT_LIST_HEAD(&rgp->node_list);
 	INIT_LIST_HEAD(&rgp->pt_node_list);
+}
+
+int xrs_get_partitions(void *hdl, struct xrs_partition_info *info, u32 num)
+{
+	struct solver_state *xrs = hdl;
+	struct partition_node *pt_node;
+	u32 i = 0;
+
+	list_for_each_entry(pt_node, &xrs->rgp.pt_node_list, list) {
+		if (i == num)
+			break;
+
+		info[i].start_col = pt_node->start_col;
+		info[i].ncols = pt_node->ncols;
+		info[i].nshared = pt_node->nshared;
+		info[i].load = partition_load(xrs, pt_node);
+		i++;
+	}
+
+	return i;
+}
+
+void *xrsm_init(struct init_config *cfg)
+{
+	struct solver_state *xrs;
+
+	xrs = drmm_kzalloc(cfg->ddev, sizeof(*xrs), GFP_KERNEL);
+	if (!xrs)
+		return NULL;
+
+	xrs_state_init(xrs, cfg);
 
 	return xrs;
 }
+
+#ifdef AMDXDNA_KUNIT
+#include "tests/aie2_solver_test.c"
+#endif
@@ -6,6 +6,7 @@
 #ifndef _AIE2_SOLVER_H
 #define _AIE2_SOLVER_H
 
+#include <linux/bits.h>
 #include <linux/types.h>
 
 #include "aie2_pci.h"
@@ -84,8 +85,15 @@ struct xrs_action_ops {
 	int (*load_hwctx)(struct amdxdna_hwctx *hwctx, struct xrs_action_load *action);
 	int (*unload_hwctx)(struct amdxdna_hwctx *hwctx);
 	int (*set_dft_dpm_level)(struct drm_device *ddev, u32 level);
+	/* Optional, move an idle context to action->part. -EBUSY if not idle */
+	int (*migrate_hwctx)(struct amdxdna_hwctx *hwctx, struct xrs_action_load *action);
+	/* Optional, recent load of a context, used to pick a partition to share */
+	u32 (*hwctx_load)(struct amdxdna_hwctx *hwctx);
 };
 
+#define XRS_FLAG_BEST_FIT	BIT(0)	/* Best fit instead of first fit */
+#define XRS_FLAG_COMPACT	BIT(1)	/* Move idle contexts to make room */
+
 /*
  * Structure used to describe information for solver during initialization.
  */
@@ -94,6 +102,7 @@ struct init_config {
 	u32			sys_eff_factor; /* system efficiency factor */
 	u32			latency_adj;    /* latency adjustment in ms */
 	struct clk_list_info	clk_list;       /* List of frequencies available in system */
+	u32			flags;		/* XRS_FLAG_* */
 	struct drm_device	*ddev;
 	struct xrs_action_ops	*actions;
 };
@@ -136,4 +145,51 @@ int xrs_allocate_resource(void *hdl, struct alloc_requests *req, struct amdxdna_
  * @rid:	The Request ID to identify the requesting context
  */
 int xrs_release_resource(void *hdl, u64 rid);
+
+struct xrs_partition_info {
+	u32	start_col;
+	u32	ncols;
+	u32	nshared;
+	u32	load;		/* Sum of hwctx_load() of the sharers */
+};
+
+/*
+ * xrs_get_partitions() - Get the allocated partitions.
+ *
+ * @hdl:	Resource solver handle obtained from xrs_init()
+ * @info:	Array to fill
+ * @num:	Number of entries in @info
+ *
+ * Return:	Number of entries filled.
+ */
+int xrs_get_partitions(void *hdl, struct xrs_partition_info *info, u32 num);
+
+/*
+ * xrs_update_qos() - Update the QoS requirement of an allocated context and
+ *                    re-evaluate the DPM level.
+ *
+ * @hdl:	Resource solver handle obtained from xrs_init()
+ * @rid:	The Request ID to identify the requesting context
+ * @rqos:	The new QoS requirement
+ *
+ * Return:	0 when successful.
+ *		-ENODEV if no resource is allocated for @rid.
+ *		Or standard error number when failing
+ */
+int xrs_update_qos(void *hdl, u64 rid, struct aie_qos *rqos);
+
+/*
+ * xrs_set_idle() - Mark an allocated context idle or busy. Idle contexts
+ *                  keep their columns but do not count for the DPM level.
+ *
+ * @hdl:	Resource solver handle obtained from xrs_init()
+ * @rid:	The Request ID to identify the requesting context
+ * @idle:	True to mark idle, false to mark busy
+ *
+ * Return:	0 when successful.
+ *		-ENODEV if no resource is allocated for @rid.
+ *		Or standard error number when failing
+ */
+int xrs_set_idle(void *hdl, u64 rid, bool idle);
+
 #endif /* _AIE2_SOLVER_H */
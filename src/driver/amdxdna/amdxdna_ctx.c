@@ -82,6 +82,74 @@ void amdxdna_hwctx_resume(struct amdxdna_client *client)
 	mutex_unlock(&client->hwctx_lock);
 }
 
+/*
+ * Busy accounting without locks. A job moves busy_depth up when it is sent
+ * to the device and down when it is done. busy_start is only written when
+ * busy_depth goes from 0 to 1 and is cleared when it drops back to 0, so the
+ * job which ends a busy period reads the start of that very period. Readers
+ * do not look at busy_depth, they add the running period if busy_start is
+ * set. Around a busy period boundary a reader may briefly see a bit less
+ * than the final value.
+ *
+ * Finished busy periods are added to the context and its client, the client
+ * keeps the usage of contexts after they are destroyed.
+ */
+void amdxdna_hwctx_busy_start(struct amdxdna_hwctx *hwctx, ktime_t now)
+{
+	if (atomic_inc_return(&hwctx->busy_depth) == 1)
+		atomic64_set(&hwctx->busy_start, ktime_to_ns(now));
+}
+
+void amdxdna_hwctx_busy_end(struct amdxdna_hwctx *hwctx, ktime_t start, ktime_t now,
+			    u32 clk_mhz, bool done)
+{
+	struct amdxdna_usage *cu = &hwctx->client->usage;
+	struct amdxdna_usage *u = &hwctx->usage;
+	s64 depth_ns = ktime_to_ns(ktime_sub(now, start));
+	s64 busy_start, busy_ns, cycles;
+
+	atomic64_add(depth_ns, &u->depth_ns);
+	atomic64_add(depth_ns, &cu->depth_ns);
+	if (done) {
+		atomic64_inc(&u->jobs);
+		atomic64_inc(&cu->jobs);
+	}
+
+	busy_start = atomic64_read(&hwctx->busy_start);
+	if (!atomic_dec_and_test(&hwctx->busy_depth))
+		return;
+
+	if (!busy_start)
+		return;
+
+	/* A new period may have started already, leave its start alone */
+	atomic64_cmpxchg(&hwctx->busy_start, busy_start, 0);
+	busy_ns = ktime_to_ns(now) - busy_start;
+	if (busy_ns <= 0)
+		return;
+
+	cycles = div_u64((u64)busy_ns * clk_mhz, NSEC_PER_USEC);
+	atomic64_add(busy_ns, &u->busy_ns);
+	atomic64_add(busy_ns, &cu->busy_ns);
+	atomic64_add(cycles, &u->cycles);
+	atomic64_add(cycles, &cu->cycles);
+}
+
+/* Time into the busy period in progress, 0 when idle */
+u64 amdxdna_hwctx_busy_running_ns(struct amdxdna_hwctx *hwctx, ktime_t now)
+{
+	s64 busy_start = atomic64_read(&hwctx->busy_start);
+
+	if (!busy_start || ktime_to_ns(now) <= busy_start)
+		return 0;
+	return ktime_to_ns(now) - busy_start;
+}
+
+u64 amdxdna_hwctx_busy_ns(struct amdxdna_hwctx *hwctx, ktime_t now)
+{
+	return atomic64_read(&hwctx->usage.busy_ns) + amdxdna_hwctx_busy_running_ns(hwctx, now);
+}
+
 static void amdxdna_hwctx_destroy_rcu(struct amdxdna_hwctx *hwctx,
 				      struct srcu_struct *ss)
 {
@@ -131,6 +199,10 @@ int amdxdna_drm_create_hwctx_ioctl(struct drm_device *dev, void *data, struct dr
 	if (args->ext || args->ext_flags)
 		return -EINVAL;
 
+	ret = amdxdna_rpm_wait(client);
+	if (ret)
+		return ret;
+
 	if (!drm_dev_enter(dev, &idx))
 		return -ENODEV;
 
@@ -248,9 +320,10 @@ int amdxdna_drm_config_hwctx_ioctl(struct drm_device *dev, void *data, struct dr
 
 	switch (args->param_type) {
 	case DRM_AMDXDNA_HWCTX_CONFIG_CU:
+	case DRM_AMDXDNA_HWCTX_CONFIG_QOS:
 		/* For those types that param_val is pointer */
 		if (buf_size > PAGE_SIZE) {
-			XDNA_ERR(xdna, "Config CU param buffer too large");
+			XDNA_ERR(xdna, "Config param buffer too large");
 			return -E2BIG;
 		}
 
@@ -759,3 +832,7 @@ int amdxdna_drm_wait_cmd_ioctl(struct drm_device *dev, void *data, struct drm_fi
 
 	return ret;
 }
+
+#ifdef AMDXDNA_KUNIT
+#include "tests/amdxdna_ctx_test.c"
+#endif
@@ -89,6 +89,24 @@ struct amdxdna_cmd {
 	u32 data[];
 };
 
+/*
+ * struct amdxdna_usage - NPU usage counters
+ * Plain atomics, cheap enough to stay on in production.
+ *
+ * @busy_ns: Time with at least one job on the device, up to the end of the
+ *	     last busy period
+ * @depth_ns: Time integral of jobs on the device, over elapsed time it gives
+ *	      the average queue depth
+ * @jobs: Jobs completed
+ * @cycles: Busy time in NPU clock cycles, at the clock of each busy period end
+ */
+struct amdxdna_usage {
+	atomic64_t			busy_ns;
+	atomic64_t			depth_ns;
+	atomic64_t			jobs;
+	atomic64_t			cycles;
+};
+
 struct amdxdna_hwctx {
 	struct amdxdna_client		*client;
 	struct amdxdna_hwctx_priv	*priv;
@@ -139,11 +157,21 @@ struct amdxdna_hwctx {
 	u64				completed ____cacheline_aligned_in_smp;
 	/* For TDR worker to keep last completed. low frequency update */
 	u64				tdr_last_completed;
+	/* Set by job timeout handler, TDR worker recovers the context */
+	bool				tdr_timedout;
+	/* Sequence number of the job which missed its deadline */
+	u64				tdr_stalled_seq;
 	/* For command completion notification. */
 	u32				syncobj_hdl;
 
 	atomic_t			job_submit_cnt;
 	atomic_t			job_free_cnt;
+
+	/* Usage of this context, see amdxdna_hwctx_busy_start() */
+	struct amdxdna_usage		usage;
+	atomic_t			busy_depth;
+	/* Start of current busy period in ns, 0 when idle */
+	atomic64_t			busy_start;
 };
 
 #define drm_job_to_xdna_job(j) \
@@ -165,6 +193,9 @@ struct amdxdna_sched_job {
 	struct dma_fence	*out_fence;
 	bool			job_done;
 	u64			seq;
+	ktime_t			start_time;
+	/* Deadline from start_time, 0 if none */
+	u32			deadline_ms;
 #define OP_USER			0
 #define OP_SYNC_BO		1
 #define OP_REG_DEBUG_BO		2
@@ -259,6 +290,12 @@ void amdxdna_hwctx_remove_all(struct amdxdna_client *client);
 void amdxdna_hwctx_suspend(struct amdxdna_client *client);
 void amdxdna_hwctx_resume(struct amdxdna_client *client);
 
+void amdxdna_hwctx_busy_start(struct amdxdna_hwctx *hwctx, ktime_t now);
+void amdxdna_hwctx_busy_end(struct amdxdna_hwctx *hwctx, ktime_t start, ktime_t now,
+			    u32 clk_mhz, bool done);
+u64 amdxdna_hwctx_busy_running_ns(struct amdxdna_hwctx *hwctx, ktime_t now);
+u64 amdxdna_hwctx_busy_ns(struct amdxdna_hwctx *hwctx, ktime_t now);
+
 int amdxdna_lock_objects(struct amdxdna_sched_job *job, struct ww_acquire_ctx *ctx);
 void amdxdna_unlock_objects(struct amdxdna_sched_job *job, struct ww_acquire_ctx *ctx);
 int amdxdna_cmd_submit(struct amdxdna_client *client, u32 opcode,
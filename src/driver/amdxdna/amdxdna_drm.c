@@ -17,17 +17,55 @@
 #define CREATE_TRACE_POINTS
 #include "amdxdna_trace.h"
 
+static void amdxdna_rpm_account_wait(struct amdxdna_dev *xdna, ktime_t start)
+{
+	struct amdxdna_rpm_stats *stats = &xdna->rpm_stats;
+	u64 elapsed;
+
+	elapsed = ktime_to_ns(ktime_sub(ktime_get(), start));
+	spin_lock(&stats->lock);
+	stats->waits++;
+	stats->wait_ns += elapsed;
+	stats->wait_max_ns = max(stats->wait_max_ns, elapsed);
+	spin_unlock(&stats->lock);
+}
+
+/*
+ * Opening the device does not resume it, so that user space can prepare
+ * buffers while it comes up, see amdxdna_drm_resume_ioctl(). Ioctls which
+ * need the hardware call this before touching it.
+ */
+int amdxdna_rpm_wait(struct amdxdna_client *client)
+{
+	struct amdxdna_dev *xdna = client->xdna;
+	ktime_t start;
+	int ret;
+
+	if (!READ_ONCE(client->rpm_pending))
+		return 0;
+
+	start = ktime_get();
+	ret = pm_runtime_resume(xdna->ddev.dev);
+	if (ret < 0) {
+		XDNA_ERR(xdna, "Runtime resume failed, ret %d", ret);
+		return ret;
+	}
+
+	/* Already active, nothing was waited for */
+	if (!ret)
+		amdxdna_rpm_account_wait(xdna, start);
+	WRITE_ONCE(client->rpm_pending, false);
+	return 0;
+}
+
 static int amdxdna_drm_open(struct drm_device *ddev, struct drm_file *filp)
 {
 	struct amdxdna_dev *xdna = to_xdna_dev(ddev);
 	struct amdxdna_client *client;
 	int ret;
 
-	ret = pm_runtime_resume_and_get(ddev->dev);
-	if (ret) {
-		XDNA_ERR(xdna, "Failed to get rpm, ret %d", ret);
-		return ret;
-	}
+	/* Keeps the device from suspending, resumed by amdxdna_rpm_wait() */
+	pm_runtime_get_noresume(ddev->dev);
 
 	client = kzalloc(sizeof(*client), GFP_KERNEL);
 	if (!client) {
@@ -37,6 +75,7 @@ static int amdxdna_drm_open(struct drm_device *ddev, struct drm_file *filp)
 
 	client->pid = pid_nr(filp->pid);
 	client->xdna = xdna;
+	client->rpm_pending = true;
 
 #ifdef AMDXDNA_DEVEL
 	if (iommu_mode != AMDXDNA_IOMMU_PASID)
@@ -66,11 +105,6 @@ skip_sva_bind:
 	list_add_tail(&client->node, &xdna->client_list);
 	mutex_unlock(&xdna->dev_lock);
 
-	spin_lock_init(&client->stats.lock);
-	client->stats.job_depth = 0;
-	client->stats.busy_time = ns_to_ktime(0);
-	client->stats.start_time = ns_to_ktime(0);
-
 	filp->driver_priv = client;
 	client->filp = filp;
 
@@ -171,6 +205,16 @@ static int amdxdna_drm_get_info_ioctl(struct drm_device *dev, void *data, struct
 	if (!xdna->dev_info->ops->get_aie_info)
 		return -EOPNOTSUPP;
 
+	if (xdna->dev_info->ops->get_aie_info_cached) {
+		ret = xdna->dev_info->ops->get_aie_info_cached(client, args);
+		if (ret != -EAGAIN)
+			return ret;
+	}
+
+	ret = amdxdna_rpm_wait(client);
+	if (ret)
+		return ret;
+
 	XDNA_DBG(xdna, "Request parameter %u", args->param);
 	mutex_lock(&xdna->dev_lock);
 	ret = xdna->dev_info->ops->get_aie_info(client, args);
@@ -188,6 +232,10 @@ static int amdxdna_drm_set_state_ioctl(struct drm_device *dev, void *data, struc
 	if (!xdna->dev_info->ops->set_aie_state)
 		return -EOPNOTSUPP;
 
+	ret = amdxdna_rpm_wait(client);
+	if (ret)
+		return ret;
+
 	XDNA_DBG(xdna, "Request parameter %u", args->param);
 	mutex_lock(&xdna->dev_lock);
 	ret = xdna->dev_info->ops->set_aie_state(client, args);
@@ -196,6 +244,34 @@ static int amdxdna_drm_set_state_ioctl(struct drm_device *dev, void *data, struc
 	return ret;
 }
 
+static int amdxdna_drm_resume_ioctl(struct drm_device *dev, void *data, struct drm_file *filp)
+{
+	struct amdxdna_client *client = filp->driver_priv;
+	struct amdxdna_dev *xdna = to_xdna_dev(dev);
+	struct amdxdna_drm_resume *args = data;
+	int ret;
+
+	if (args->pad || args->flags & ~AMDXDNA_RESUME_ASYNC)
+		return -EINVAL;
+
+	if (!(args->flags & AMDXDNA_RESUME_ASYNC))
+		return amdxdna_rpm_wait(client);
+
+	if (!READ_ONCE(client->rpm_pending))
+		return 0;
+
+	ret = pm_request_resume(dev->dev);
+	if (ret < 0 && ret != -EINPROGRESS) {
+		XDNA_ERR(xdna, "Failed to request rpm, ret %d", ret);
+		return ret;
+	}
+
+	spin_lock(&xdna->rpm_stats.lock);
+	xdna->rpm_stats.async_resumes++;
+	spin_unlock(&xdna->rpm_stats.lock);
+	return 0;
+}
+
 static const struct drm_ioctl_desc amdxdna_drm_ioctls[] = {
 	/* Context */
 	DRM_IOCTL_DEF_DRV(AMDXDNA_CREATE_HWCTX, amdxdna_drm_create_hwctx_ioctl, 0),
@@ -205,48 +281,40 @@ static const struct drm_ioctl_desc amdxdna_drm_ioctls[] = {
 	DRM_IOCTL_DEF_DRV(AMDXDNA_CREATE_BO, amdxdna_drm_create_bo_ioctl, 0),
 	DRM_IOCTL_DEF_DRV(AMDXDNA_GET_BO_INFO, amdxdna_drm_get_bo_info_ioctl, 0),
 	DRM_IOCTL_DEF_DRV(AMDXDNA_SYNC_BO, amdxdna_drm_sync_bo_ioctl, 0),
+	DRM_IOCTL_DEF_DRV(AMDXDNA_SYNC_BO_VEC, amdxdna_drm_sync_bo_vec_ioctl, 0),
 	/* Exectuion */
 	DRM_IOCTL_DEF_DRV(AMDXDNA_EXEC_CMD, amdxdna_drm_submit_cmd_ioctl, 0),
 	DRM_IOCTL_DEF_DRV(AMDXDNA_WAIT_CMD, amdxdna_drm_wait_cmd_ioctl, 0),
 	/* AIE hardware */
 	DRM_IOCTL_DEF_DRV(AMDXDNA_GET_INFO, amdxdna_drm_get_info_ioctl, 0),
 	DRM_IOCTL_DEF_DRV(AMDXDNA_SET_STATE, amdxdna_drm_set_state_ioctl, DRM_ROOT_ONLY),
+	DRM_IOCTL_DEF_DRV(AMDXDNA_RESUME, amdxdna_drm_resume_ioctl, 0),
 };
 
-void amdxdna_update_stats(struct amdxdna_client *client, ktime_t time, bool start)
-{
-	unsigned long flags;
-
-	spin_lock_irqsave(&client->stats.lock, flags);
-	if (start) {
-		client->stats.job_depth++;
-		if (client->stats.job_depth == 1)
-			client->stats.start_time = time;
-	} else {
-		client->stats.job_depth--;
-		if (client->stats.job_depth == 0)
-			client->stats.busy_time =
-				ktime_add(client->stats.busy_time,
-					  ktime_sub(time, client->stats.start_time));
-	}
-	spin_unlock_irqrestore(&client->stats.lock, flags);
-}
-
 static void amdxdna_show_fdinfo(struct drm_printer *p, struct drm_file *filp)
 {
 	struct amdxdna_client *client = filp->driver_priv;
 	const char *engine_npu_name = "npu-amdxdna";
-	unsigned long flags;
+	struct amdxdna_hwctx *hwctx;
+	unsigned long hwctx_id;
+	ktime_t now = ktime_get();
 	u64 busy_ns;
+	int idx;
 
-	spin_lock_irqsave(&client->stats.lock, flags);
-	busy_ns = ktime_to_ns(client->stats.busy_time);
-	if (client->stats.job_depth > 0)
-		busy_ns += ktime_to_ns(ktime_sub(ktime_get(), client->stats.start_time));
-	spin_unlock_irqrestore(&client->stats.lock, flags);
+	/* Client total covers finished busy periods, add the running ones */
+	busy_ns = atomic64_read(&client->usage.busy_ns);
+	idx = srcu_read_lock(&client->hwctx_srcu);
+	amdxdna_for_each_hwctx(client, hwctx_id, hwctx)
+		busy_ns += amdxdna_hwctx_busy_running_ns(hwctx, now);
+	srcu_read_unlock(&client->hwctx_srcu, idx);
 
 	/* see Documentation/gpu/drm-usage-stats.rst */
 	drm_printf(p, "drm-engine-%s:\t%llu ns\n", engine_npu_name, busy_ns);
+	drm_printf(p, "drm-cycles-%s:\t%llu\n", engine_npu_name,
+		   (u64)atomic64_read(&client->usage.cycles));
+	drm_printf(p, "amdxdna-jobs:\t%llu\n", (u64)atomic64_read(&client->usage.jobs));
+	drm_printf(p, "amdxdna-queue-depth:\t%llu ns\n",
+		   (u64)atomic64_read(&client->usage.depth_ns));
 
 	drm_show_memory_stats(p, filp);
 }
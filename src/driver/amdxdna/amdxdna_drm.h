@@ -47,8 +47,9 @@ struct amdxdna_dev_priv;
  */
 struct amdxdna_dev_ops {
 	int (*init)(struct amdxdna_dev *xdna);
+	/* Called without dev_lock */
 	void (*fini)(struct amdxdna_dev *xdna);
-	void (*recover)(struct amdxdna_dev *xdna, bool dump_only);
+	void (*recover)(struct amdxdna_dev *xdna, u32 col_map, bool dump_only);
 	int (*resume)(struct amdxdna_dev *xdna);
 	void (*suspend)(struct amdxdna_dev *xdna);
 	int (*mmap)(struct amdxdna_dev *xdna, struct vm_area_struct *vma);
@@ -65,6 +66,8 @@ struct amdxdna_dev_ops {
 			  u32 *syncobj_hdls, u64 *syncobj_points, u32 syncobj_cnt, u64 *seq);
 	int (*cmd_wait)(struct amdxdna_hwctx *hwctx, u64 seq, u32 timeout);
 	int (*get_aie_info)(struct amdxdna_client *client, struct amdxdna_drm_get_info *args);
+	/* Optional, called without dev_lock. -EAGAIN falls back to get_aie_info */
+	int (*get_aie_info_cached)(struct amdxdna_client *client, struct amdxdna_drm_get_info *args);
 	int (*set_aie_state)(struct amdxdna_client *client, struct amdxdna_drm_set_state *args);
 	struct dma_fence *(*cmd_get_out_fence)(struct amdxdna_hwctx *hwctx, u64 seq);
 };
@@ -110,6 +113,32 @@ struct amdxdna_fw_ver {
 	u32 build;
 };
 
+#define AMDXDNA_RPM_IDLE_BUCKETS	5
+
+/*
+ * struct amdxdna_rpm_stats - Runtime PM statistics, shown by sysfs rpm_stats
+ *
+ * @resume_ns: time spent in runtime resume callback
+ * @async_resumes: runtime resumes started early by DRM_IOCTL_AMDXDNA_RESUME
+ * @wait_ns: time clients were blocked on runtime resume
+ * @suspend_time: when the device was last runtime suspended
+ * @idle_hist: time spent suspended, bucket i counts [10^i, 10^(i+1)) ms
+ *	       with the first and last bucket open ended
+ */
+struct amdxdna_rpm_stats {
+	spinlock_t			lock; /* protect rpm stats */
+	u64				suspends;
+	u64				resumes;
+	u64				resume_ns;
+	u64				resume_max_ns;
+	u64				async_resumes;
+	u64				waits;
+	u64				wait_ns;
+	u64				wait_max_ns;
+	ktime_t				suspend_time;
+	u64				idle_hist[AMDXDNA_RPM_IDLE_BUCKETS];
+};
+
 struct amdxdna_dev {
 	struct drm_device		ddev;
 	struct amdxdna_dev_hdl		*dev_handle;
@@ -123,15 +152,12 @@ struct amdxdna_dev {
 #ifdef AMDXDNA_DEVEL
 	struct ida			pdi_ida;
 #endif
-	struct rw_semaphore		notifier_lock; /* for mmu notifier*/
+	wait_queue_head_t		notifier_waitq; /* mmu notifier waits for submissions */
+	/* Lockdep view of the submit_cnt wait, see amdxdna_gem_validate_begin() */
+	struct lockdep_map		submit_lockdep_map;
 	struct workqueue_struct		*notifier_wq;
-};
-
-struct amdxdna_stats {
-	spinlock_t			lock; /* protect stats */
-	u32				job_depth;
-	ktime_t				busy_time;
-	ktime_t				start_time;
+	struct vfsmount			*gemfs; /* tmpfs w/ huge page, optional */
+	struct amdxdna_rpm_stats	rpm_stats;
 };
 
 /*
@@ -149,7 +175,8 @@ struct amdxdna_stats {
  * @dev_heap: Shared device heap memory
  * @sva: iommu SVA handle
  * @pasid: PASID
- * @stats: record npu usage stats
+ * @usage: NPU usage of all contexts, destroyed ones included
+ * @rpm_pending: device not known to be resumed for this client yet
  */
 struct amdxdna_client {
 	struct list_head		node;
@@ -169,7 +196,8 @@ struct amdxdna_client {
 	struct iommu_sva		*sva;
 	int				pasid;
 
-	struct amdxdna_stats		stats;
+	struct amdxdna_usage		usage;
+	bool				rpm_pending;
 };
 
 #define amdxdna_for_each_hwctx(client, hwctx_id, entry)		\
@@ -177,6 +205,6 @@ struct amdxdna_client {
 #define amdxdna_no_hwctx(client)				\
 	xa_empty(&(client)->hwctx_xa)
 
-void amdxdna_update_stats(struct amdxdna_client *client, ktime_t time, bool start);
+int amdxdna_rpm_wait(struct amdxdna_client *client);
 
 #endif /* _AMDXDNA_DRM_H_ */
@@ -6,9 +6,13 @@
 #include "drm_local/amdxdna_accel.h"
 #include <linux/dma-buf.h>
 #include <linux/dma-direct.h>
+#include <linux/fs.h>
 #include <linux/iosys-map.h>
+#include <linux/mount.h>
 #include <linux/pagemap.h>
 #include <linux/pfn.h>
+#include <linux/sched/mm.h>
+#include <linux/uaccess.h>
 #include <linux/version.h>
 #include <linux/vmalloc.h>
 #include <drm/drm_cache.h>
@@ -20,6 +24,12 @@
 #include "amdxdna_devel.h"
 #endif
 
+#ifdef AMDXDNA_KUNIT
+#include <kunit/static_stub.h>
+#else
+#define KUNIT_STATIC_STUB_REDIRECT(real_fn_name, args...)
+#endif
+
 #define XDNA_MAX_CMD_BO_SIZE	SZ_32K
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(6, 13, 0)
@@ -75,20 +85,43 @@ static bool amdxdna_hmm_invalidate(struct mmu_interval_notifier *mni,
 
 	xdna = to_xdna_dev(to_gobj(abo)->dev);
 	XDNA_DBG(xdna, "Invalidating range 0x%lx, 0x%lx, type %d",
-		 mapp->vma->vm_start, mapp->vma->vm_end, abo->type);
+		 mapp->range.start, mapp->range.end, abo->type);
 
 	if (!mmu_notifier_range_blockable(range))
 		return false;
 
-	down_write(&xdna->notifier_lock);
-	abo->mem.map_invalid = true;
-	mapp->invalid = true;
+	spin_lock(&abo->mem.notifier_lock);
+	write_seqcount_begin(&abo->mem.notifier_seq);
+	WRITE_ONCE(abo->mem.map_invalid, true);
+	if (!mapp->invalid) {
+		mapp->invalid_start = max(range->start, mapp->range.start);
+		mapp->invalid_end = min(range->end, mapp->range.end);
+		mapp->invalid = true;
+	} else {
+		mapp->invalid_start = max(min(range->start, mapp->invalid_start),
+					  mapp->range.start);
+		mapp->invalid_end = min(max(range->end, mapp->invalid_end),
+					mapp->range.end);
+	}
 	mmu_interval_set_seq(&mapp->notifier, cur_seq);
-	up_write(&xdna->notifier_lock);
+	write_seqcount_end(&abo->mem.notifier_seq);
+	spin_unlock(&abo->mem.notifier_lock);
+
+	/*
+	 * A submission which validated this BO before the sequence bump above
+	 * has not added its fence yet. Wait for it, so that the fence wait in
+	 * hmm_invalidate() covers that job. Pairs with the barrier in
+	 * amdxdna_gem_validate_begin().
+	 */
+	smp_mb();
+	lock_map_acquire(&xdna->submit_lockdep_map);
+	lock_map_release(&xdna->submit_lockdep_map);
+	wait_event(xdna->notifier_waitq, !atomic_read(&abo->mem.submit_cnt));
 
 	xdna->dev_info->ops->hmm_invalidate(abo, cur_seq);
 
-	if (range->event == MMU_NOTIFY_UNMAP)
+	/* User pointer BO owns the notifier until the BO is freed */
+	if (range->event == MMU_NOTIFY_UNMAP && !is_userptr_bo(abo))
 		queue_work(xdna->notifier_wq, &mapp->hmm_unreg_work);
 
 	return true;
@@ -104,29 +137,29 @@ static void amdxdna_hmm_unregister(struct amdxdna_gem_obj *abo,
 	struct amdxdna_dev *xdna = to_xdna_dev(to_gobj(abo)->dev);
 	struct amdxdna_umap *mapp;
 
-	down_read(&xdna->notifier_lock);
+	spin_lock(&abo->mem.notifier_lock);
 	list_for_each_entry(mapp, &abo->mem.umap_list, node) {
 		if (mapp->vma == vma) {
 			queue_work(xdna->notifier_wq, &mapp->hmm_unreg_work);
 			break;
 		}
 	}
-	up_read(&xdna->notifier_lock);
+	spin_unlock(&abo->mem.notifier_lock);
 }
 
 static void amdxdna_umap_release(struct kref *ref)
 {
 	struct amdxdna_umap *mapp = container_of(ref, struct amdxdna_umap, refcnt);
-	struct amdxdna_dev *xdna;
+	struct amdxdna_gem_obj *abo = mapp->abo;
 
 	mmu_interval_notifier_remove(&mapp->notifier);
 
-	xdna = to_xdna_dev(to_gobj(mapp->abo)->dev);
-	down_write(&xdna->notifier_lock);
+	spin_lock(&abo->mem.notifier_lock);
 	list_del(&mapp->node);
-	up_write(&xdna->notifier_lock);
+	spin_unlock(&abo->mem.notifier_lock);
 
-	drm_gem_object_put(to_gobj(mapp->abo));
+	if (!is_userptr_bo(mapp->abo))
+		drm_gem_object_put(to_gobj(mapp->abo));
 	kvfree(mapp->range.hmm_pfns);
 	kfree(mapp);
 }
@@ -136,6 +169,42 @@ void amdxdna_umap_put(struct amdxdna_umap *mapp)
 	kref_put(&mapp->refcnt, amdxdna_umap_release);
 }
 
+/*
+ * Lockless check that the user mapping of a BO is valid for submission.
+ * On success, mmu notifier invalidation of this BO is held off until
+ * amdxdna_gem_validate_end() is called, which must happen after the job
+ * fence is added to the BO reservation object.
+ *
+ * Invalidation, which runs in reclaim, waits for the window in between.
+ * Callers hold xdna->submit_lockdep_map over it so lockdep catches memory
+ * allocations and locks in the window that reclaim may depend on.
+ */
+bool amdxdna_gem_validate_begin(struct amdxdna_gem_obj *abo)
+{
+	unsigned int seq;
+
+	seq = read_seqcount_begin(&abo->mem.notifier_seq);
+	if (READ_ONCE(abo->mem.map_invalid))
+		return false;
+
+	atomic_inc(&abo->mem.submit_cnt);
+	/* Pairs with the barrier in amdxdna_hmm_invalidate() */
+	smp_mb__after_atomic();
+	if (!read_seqcount_retry(&abo->mem.notifier_seq, seq))
+		return true;
+
+	amdxdna_gem_validate_end(abo);
+	return false;
+}
+
+void amdxdna_gem_validate_end(struct amdxdna_gem_obj *abo)
+{
+	struct amdxdna_dev *xdna = to_xdna_dev(to_gobj(abo)->dev);
+
+	if (atomic_dec_and_test(&abo->mem.submit_cnt))
+		wake_up_all(&xdna->notifier_waitq);
+}
+
 static void amdxdna_hmm_unreg_work(struct work_struct *work)
 {
 	struct amdxdna_umap *mapp = container_of(work, struct amdxdna_umap,
@@ -144,31 +213,60 @@ static void amdxdna_hmm_unreg_work(struct work_struct *work)
 	amdxdna_umap_put(mapp);
 }
 
-static int amdxdna_hmm_register(struct amdxdna_gem_obj *abo,
-				struct vm_area_struct *vma)
+static struct amdxdna_umap *
+amdxdna_umap_alloc(struct amdxdna_gem_obj *abo, unsigned long addr,
+		   unsigned long len)
 {
-	struct amdxdna_dev *xdna = to_xdna_dev(to_gobj(abo)->dev);
-	unsigned long len = vma->vm_end - vma->vm_start;
-	unsigned long addr = vma->vm_start;
 	struct amdxdna_umap *mapp;
 	u32 nr_pages;
-	int ret;
-
-	if (!xdna->dev_info->ops->hmm_invalidate)
-		return 0;
 
 	mapp = kzalloc(sizeof(*mapp), GFP_KERNEL);
 	if (!mapp)
-		return -ENOMEM;
+		return ERR_PTR(-ENOMEM);
 
 	nr_pages = (PAGE_ALIGN(addr + len) - (addr & PAGE_MASK)) >> PAGE_SHIFT;
 	mapp->range.hmm_pfns = kvcalloc(nr_pages, sizeof(*mapp->range.hmm_pfns),
 					GFP_KERNEL);
 	if (!mapp->range.hmm_pfns) {
-		ret = -ENOMEM;
-		goto free_map;
+		kfree(mapp);
+		return ERR_PTR(-ENOMEM);
 	}
 
+	mapp->range.notifier = &mapp->notifier;
+	mapp->range.start = addr;
+	mapp->range.end = addr + len;
+	mapp->range.default_flags = HMM_PFN_REQ_FAULT;
+	mapp->invalid_start = addr;
+	mapp->invalid_end = addr + len;
+	mapp->abo = abo;
+	kref_init(&mapp->refcnt);
+	INIT_WORK(&mapp->hmm_unreg_work, amdxdna_hmm_unreg_work);
+
+	return mapp;
+}
+
+static void amdxdna_umap_free(struct amdxdna_umap *mapp)
+{
+	kvfree(mapp->range.hmm_pfns);
+	kfree(mapp);
+}
+
+static int amdxdna_hmm_register(struct amdxdna_gem_obj *abo,
+				struct vm_area_struct *vma)
+{
+	struct amdxdna_dev *xdna = to_xdna_dev(to_gobj(abo)->dev);
+	unsigned long len = vma->vm_end - vma->vm_start;
+	unsigned long addr = vma->vm_start;
+	struct amdxdna_umap *mapp;
+	int ret;
+
+	if (!xdna->dev_info->ops->hmm_invalidate)
+		return 0;
+
+	mapp = amdxdna_umap_alloc(abo, addr, len);
+	if (IS_ERR(mapp))
+		return PTR_ERR(mapp);
+
 	ret = mmu_interval_notifier_insert_locked(&mapp->notifier,
 						  current->mm,
 						  addr,
@@ -176,35 +274,23 @@ static int amdxdna_hmm_register(struct amdxdna_gem_obj *abo,
 						  &amdxdna_hmm_ops);
 	if (ret) {
 		XDNA_ERR(xdna, "Insert mmu notifier failed, ret %d", ret);
-		goto free_pfns;
+		amdxdna_umap_free(mapp);
+		return ret;
 	}
 
-	mapp->range.notifier = &mapp->notifier;
-	mapp->range.start = vma->vm_start;
-	mapp->range.end = vma->vm_end;
-	mapp->range.default_flags = HMM_PFN_REQ_FAULT;
 	mapp->vma = vma;
-	mapp->abo = abo;
-	kref_init(&mapp->refcnt);
 	drm_gem_object_get(to_gobj(abo));
 
 	if (abo->mem.userptr == AMDXDNA_INVALID_ADDR)
 		abo->mem.userptr = addr;
-	INIT_WORK(&mapp->hmm_unreg_work, amdxdna_hmm_unreg_work);
 	if (is_import_bo(abo) && vma->vm_file && vma->vm_file->f_mapping)
 		mapping_set_unevictable(vma->vm_file->f_mapping);
 
-	down_write(&xdna->notifier_lock);
+	spin_lock(&abo->mem.notifier_lock);
 	list_add_tail(&mapp->node, &abo->mem.umap_list);
-	up_write(&xdna->notifier_lock);
+	spin_unlock(&abo->mem.notifier_lock);
 
 	return 0;
-
-free_pfns:
-	kvfree(mapp->range.hmm_pfns);
-free_map:
-	kfree(mapp);
-	return ret;
 }
 
 static void amdxdna_gem_obj_free(struct drm_gem_object *gobj)
@@ -416,6 +502,9 @@ amdxdna_gem_create_obj(struct drm_device *dev, size_t size)
 	abo->mem.dev_addr = AMDXDNA_INVALID_ADDR;
 	abo->mem.size = size;
 	INIT_LIST_HEAD(&abo->mem.umap_list);
+	spin_lock_init(&abo->mem.notifier_lock);
+	seqcount_spinlock_init(&abo->mem.notifier_seq, &abo->mem.notifier_lock);
+	atomic_set(&abo->mem.submit_cnt, 0);
 
 	return abo;
 }
@@ -489,6 +578,62 @@ fail_detach:
 	return ERR_PTR(ret);
 }
 
+void amdxdna_gemfs_init(struct amdxdna_dev *xdna)
+{
+	char huge_opt[] = "huge=within_size";
+	struct file_system_type *type;
+	struct vfsmount *gemfs;
+
+	/* drm_gem_shmem_create_with_mnt() is only there from 6.13 */
+	if (!IS_ENABLED(CONFIG_TRANSPARENT_HUGEPAGE) ||
+	    KERNEL_VERSION(6, 13, 0) > LINUX_VERSION_CODE)
+		return;
+
+	type = get_fs_type("tmpfs");
+	if (!type)
+		goto no_thp;
+
+	gemfs = vfs_kern_mount(type, SB_KERNMOUNT, type->name, huge_opt);
+	if (IS_ERR(gemfs))
+		goto no_thp;
+
+	xdna->gemfs = gemfs;
+	return;
+
+no_thp:
+	XDNA_INFO(xdna, "Huge page BO is not available, use normal pages");
+}
+
+void amdxdna_gemfs_fini(struct amdxdna_dev *xdna)
+{
+	if (!xdna->gemfs)
+		return;
+
+	kern_unmount(xdna->gemfs);
+	xdna->gemfs = NULL;
+}
+
+static struct drm_gem_shmem_object *
+amdxdna_gem_shmem_create(struct drm_device *dev, size_t size, u64 flags)
+{
+#if KERNEL_VERSION(6, 13, 0) <= LINUX_VERSION_CODE
+	struct amdxdna_dev *xdna = to_xdna_dev(dev);
+	struct drm_gem_shmem_object *shmem;
+
+	if (!(flags & AMDXDNA_BO_FLAGS_HUGE_PAGE) || !xdna->gemfs)
+		return drm_gem_shmem_create(dev, size);
+
+	shmem = drm_gem_shmem_create_with_mnt(dev, size, xdna->gemfs);
+	if (!IS_ERR(shmem))
+		return shmem;
+
+	/* Huge page is a hint. Try again with normal pages. */
+	XDNA_DBG(xdna, "Huge page BO size 0x%lx failed, ret %ld",
+		 size, PTR_ERR(shmem));
+#endif
+	return drm_gem_shmem_create(dev, size);
+}
+
 static struct amdxdna_gem_obj *
 amdxdna_drm_alloc_shmem(struct drm_device *dev,
 			struct amdxdna_drm_create_bo *args,
@@ -498,7 +643,7 @@ amdxdna_drm_alloc_shmem(struct drm_device *dev,
 	struct drm_gem_shmem_object *shmem;
 	struct amdxdna_gem_obj *abo;
 
-	shmem = drm_gem_shmem_create(dev, args->size);
+	shmem = amdxdna_gem_shmem_create(dev, args->size, args->flags);
 	if (IS_ERR(shmem))
 		return ERR_CAST(shmem);
 
@@ -683,6 +828,120 @@ release_obj:
 	return ERR_PTR(ret);
 }
 
+static void amdxdna_gem_userptr_free(struct drm_gem_object *gobj)
+{
+	struct amdxdna_dev *xdna = to_xdna_dev(gobj->dev);
+	struct amdxdna_gem_obj *abo = to_xdna_obj(gobj);
+	struct amdxdna_umap *mapp;
+
+	XDNA_DBG(xdna, "Userptr BO 0x%llx size 0x%lx", abo->mem.userptr, abo->mem.size);
+	mapp = list_first_entry_or_null(&abo->mem.umap_list, struct amdxdna_umap, node);
+	if (mapp)
+		amdxdna_umap_put(mapp);
+
+	drm_gem_object_release(gobj);
+	mutex_destroy(&abo->lock);
+	kfree(abo);
+}
+
+static struct dma_buf *amdxdna_gem_userptr_export(struct drm_gem_object *gobj, int flags)
+{
+	return ERR_PTR(-EOPNOTSUPP);
+}
+
+static const struct drm_gem_object_funcs amdxdna_gem_userptr_funcs = {
+	.free = amdxdna_gem_userptr_free,
+	.export = amdxdna_gem_userptr_export,
+};
+
+/*
+ * User pointer BO wraps existing application memory. The pages are not
+ * pinned. The mmu interval notifier marks the BO invalid when the pages
+ * are moved or released and the command submission faults them in again
+ * before the device can access them.
+ */
+static struct amdxdna_gem_obj *
+amdxdna_drm_create_userptr_bo(struct drm_device *dev,
+			      struct amdxdna_drm_create_bo *args,
+			      struct drm_file *filp)
+{
+	struct amdxdna_client *client = filp->driver_priv;
+	struct amdxdna_dev *xdna = to_xdna_dev(dev);
+	unsigned long addr = args->vaddr;
+	size_t size = args->size;
+	struct vm_area_struct *vma;
+	struct amdxdna_gem_obj *abo;
+	struct amdxdna_umap *mapp;
+	int ret;
+
+	if (!xdna->dev_info->ops->hmm_invalidate)
+		return ERR_PTR(-EOPNOTSUPP);
+
+#ifdef AMDXDNA_DEVEL
+	if (iommu_mode != AMDXDNA_IOMMU_PASID) {
+		XDNA_DBG(xdna, "Userptr BO requires PASID");
+		return ERR_PTR(-EOPNOTSUPP);
+	}
+#endif
+
+	if (!PAGE_ALIGNED(addr) || !PAGE_ALIGNED(size) ||
+	    !access_ok(u64_to_user_ptr(addr), size)) {
+		XDNA_DBG(xdna, "Invalid userptr 0x%lx size 0x%lx", addr, size);
+		return ERR_PTR(-EINVAL);
+	}
+
+	mmap_read_lock(current->mm);
+	vma = vma_lookup(current->mm, addr);
+	if (!vma || vma->vm_end < addr + size ||
+	    (vma->vm_flags & (VM_IO | VM_PFNMAP)))
+		vma = NULL;
+	mmap_read_unlock(current->mm);
+	if (!vma) {
+		XDNA_DBG(xdna, "Userptr 0x%lx size 0x%lx is not in one vma", addr, size);
+		return ERR_PTR(-EINVAL);
+	}
+
+	abo = amdxdna_gem_create_obj(dev, size);
+	if (IS_ERR(abo))
+		return abo;
+
+	to_gobj(abo)->funcs = &amdxdna_gem_userptr_funcs;
+	abo->type = AMDXDNA_BO_SHMEM;
+	abo->client = client;
+	abo->flags = BO_USERPTR;
+	abo->mem.userptr = addr;
+	drm_gem_private_object_init(dev, to_gobj(abo), size);
+
+	mapp = amdxdna_umap_alloc(abo, addr, size);
+	if (IS_ERR(mapp)) {
+		ret = PTR_ERR(mapp);
+		goto release_obj;
+	}
+
+	ret = mmu_interval_notifier_insert(&mapp->notifier, current->mm,
+					   addr, size, &amdxdna_hmm_ops);
+	if (ret) {
+		XDNA_ERR(xdna, "Insert mmu notifier failed, ret %d", ret);
+		amdxdna_umap_free(mapp);
+		goto release_obj;
+	}
+
+	/* Pages are faulted in by the first command using this BO */
+	spin_lock(&abo->mem.notifier_lock);
+	mapp->invalid = true;
+	WRITE_ONCE(abo->mem.map_invalid, true);
+	list_add_tail(&mapp->node, &abo->mem.umap_list);
+	spin_unlock(&abo->mem.notifier_lock);
+
+	return abo;
+
+release_obj:
+	drm_gem_object_release(to_gobj(abo));
+	mutex_destroy(&abo->lock);
+	kfree(abo);
+	return ERR_PTR(ret);
+}
+
 int amdxdna_drm_create_bo_ioctl(struct drm_device *dev, void *data, struct drm_file *filp)
 {
 	struct amdxdna_dev *xdna = to_xdna_dev(dev);
@@ -690,14 +949,26 @@ int amdxdna_drm_create_bo_ioctl(struct drm_device *dev, void *data, struct drm_f
 	struct amdxdna_gem_obj *abo;
 	int ret;
 
-	if (args->flags || args->vaddr || !args->size)
+	if (!args->size)
+		return -EINVAL;
+
+	if (args->vaddr && (args->type != AMDXDNA_BO_SHMEM || args->flags))
+		return -EINVAL;
+
+	if (args->flags & ~AMDXDNA_BO_FLAGS_HUGE_PAGE)
+		return -EINVAL;
+
+	if ((args->flags & AMDXDNA_BO_FLAGS_HUGE_PAGE) && args->type != AMDXDNA_BO_SHMEM)
 		return -EINVAL;
 
 	XDNA_DBG(xdna, "BO arg type %d vaddr 0x%llx size 0x%llx flags 0x%llx",
 		 args->type, args->vaddr, args->size, args->flags);
 	switch (args->type) {
 	case AMDXDNA_BO_SHMEM:
-		abo = amdxdna_drm_alloc_shmem(dev, args, filp);
+		if (args->vaddr)
+			abo = amdxdna_drm_create_userptr_bo(dev, args, filp);
+		else
+			abo = amdxdna_drm_alloc_shmem(dev, args, filp);
 		break;
 	case AMDXDNA_BO_DEV_HEAP:
 		abo = amdxdna_drm_create_dev_heap(dev, args, filp);
@@ -745,7 +1016,7 @@ int amdxdna_gem_pin_nolock(struct amdxdna_gem_obj *abo)
 	struct amdxdna_dev *xdna = to_xdna_dev(to_gobj(abo)->dev);
 	int ret;
 
-	if (is_import_bo(abo))
+	if (is_import_bo(abo) || is_userptr_bo(abo))
 		return 0;
 
 	switch (abo->type) {
@@ -780,7 +1051,7 @@ int amdxdna_gem_pin(struct amdxdna_gem_obj *abo)
 
 void amdxdna_gem_unpin(struct amdxdna_gem_obj *abo)
 {
-	if (is_import_bo(abo))
+	if (is_import_bo(abo) || is_userptr_bo(abo))
 		return;
 
 	if (abo->type == AMDXDNA_BO_DEV)
@@ -833,7 +1104,7 @@ int amdxdna_drm_get_bo_info_ioctl(struct drm_device *dev, void *data, struct drm
 	args->vaddr = abo->mem.userptr;
 	args->xdna_addr = abo->mem.dev_addr;
 
-	if (abo->type != AMDXDNA_BO_DEV)
+	if (abo->type != AMDXDNA_BO_DEV && !is_userptr_bo(abo))
 		args->map_offset = drm_vma_node_offset_addr(&gobj->vma_node);
 	else
 		args->map_offset = AMDXDNA_INVALID_ADDR;
@@ -845,6 +1116,19 @@ int amdxdna_drm_get_bo_info_ioctl(struct drm_device *dev, void *data, struct drm
 	return ret;
 }
 
+/* Tests redirect these to check how a range is split */
+static void amdxdna_clflush_virt_range(void *addr, unsigned long length)
+{
+	KUNIT_STATIC_STUB_REDIRECT(amdxdna_clflush_virt_range, addr, length);
+	drm_clflush_virt_range(addr, length);
+}
+
+static void amdxdna_clflush_pages(struct page *pages[], unsigned long num_pages)
+{
+	KUNIT_STATIC_STUB_REDIRECT(amdxdna_clflush_pages, pages, num_pages);
+	drm_clflush_pages(pages, num_pages);
+}
+
 static void
 amdxdna_drm_clflush(struct amdxdna_gem_obj *abo, u32 start, u32 size)
 {
@@ -875,25 +1159,153 @@ amdxdna_drm_clflush(struct amdxdna_gem_obj *abo, u32 start, u32 size)
 	addr = page_to_virt(pages[start_page]);
 	addr = (void *)((u64)addr + start_page_off);
 	if (start_page == end_page) {
-		drm_clflush_virt_range(addr, size);
+		amdxdna_clflush_virt_range(addr, size);
 		return;
 	}
 
 	/* There are multiple pages */
 	if (start_page_off)
-		drm_clflush_virt_range(addr, PAGE_SIZE - start_page_off);
+		amdxdna_clflush_virt_range(addr, PAGE_SIZE - start_page_off);
 	else
-		drm_clflush_pages(&pages[0], 1);
+		amdxdna_clflush_pages(&pages[start_page], 1);
 
 	pages_in_middle = end_page - start_page - 1;
 	if (pages_in_middle)
-		drm_clflush_pages(&pages[1], pages_in_middle);
+		amdxdna_clflush_pages(&pages[start_page + 1], pages_in_middle);
 
 	addr = page_to_virt(pages[end_page]);
 	if (end_page_size < PAGE_SIZE)
-		drm_clflush_virt_range(addr, end_page_size);
+		amdxdna_clflush_virt_range(addr, end_page_size);
 	else
-		drm_clflush_pages(&pages[end_page], 1);
+		amdxdna_clflush_pages(&pages[end_page], 1);
+}
+
+static int
+amdxdna_userptr_clflush(struct amdxdna_gem_obj *abo, u64 start, u64 size)
+{
+	struct amdxdna_dev *xdna = to_xdna_dev(to_gobj(abo)->dev);
+	struct hmm_range range = { 0 };
+	struct amdxdna_umap *mapp;
+	unsigned long timeout;
+	unsigned long i, npages;
+	struct mm_struct *mm;
+	int ret;
+
+	/* Userptr BO has exactly one umap which lives until BO is freed */
+	mapp = list_first_entry_or_null(&abo->mem.umap_list, struct amdxdna_umap, node);
+	if (!mapp)
+		return -EINVAL;
+
+	mm = mapp->notifier.mm;
+	if (!mmget_not_zero(mm))
+		return -EFAULT;
+
+	range.notifier = &mapp->notifier;
+	range.start = round_down(abo->mem.userptr + start, PAGE_SIZE);
+	range.end = PAGE_ALIGN(abo->mem.userptr + start + size);
+	range.default_flags = HMM_PFN_REQ_FAULT;
+	npages = (range.end - range.start) >> PAGE_SHIFT;
+	range.hmm_pfns = kvcalloc(npages, sizeof(*range.hmm_pfns), GFP_KERNEL);
+	if (!range.hmm_pfns) {
+		ret = -ENOMEM;
+		goto put_mm;
+	}
+
+	timeout = jiffies + msecs_to_jiffies(HMM_RANGE_DEFAULT_TIMEOUT);
+again:
+	range.notifier_seq = mmu_interval_read_begin(&mapp->notifier);
+	mmap_read_lock(mm);
+	ret = hmm_range_fault(&range);
+	mmap_read_unlock(mm);
+	if (ret) {
+		if (ret == -EBUSY && !time_after(jiffies, timeout))
+			goto again;
+		XDNA_ERR(xdna, "Fault userptr range failed, ret %d", ret);
+		goto free_pfns;
+	}
+
+	for (i = 0; i < npages; i++) {
+		struct page *page = hmm_pfn_to_page(range.hmm_pfns[i]);
+
+		drm_clflush_pages(&page, 1);
+	}
+
+	/* Flushing stale pages is harmless, redo it if the range changed */
+	spin_lock(&abo->mem.notifier_lock);
+	if (mmu_interval_read_retry(&mapp->notifier, range.notifier_seq)) {
+		spin_unlock(&abo->mem.notifier_lock);
+		if (time_after(jiffies, timeout)) {
+			ret = -ETIME;
+			goto free_pfns;
+		}
+		goto again;
+	}
+	spin_unlock(&abo->mem.notifier_lock);
+
+free_pfns:
+	kvfree(range.hmm_pfns);
+put_mm:
+	mmput(mm);
+	return ret;
+}
+
+static int amdxdna_gem_sync_range(struct amdxdna_gem_obj *abo, u64 offset, u64 size)
+{
+	struct amdxdna_dev *xdna = to_xdna_dev(to_gobj(abo)->dev);
+	bool pinned;
+	int ret;
+
+	if (offset > to_gobj(abo)->size || size > to_gobj(abo)->size - offset)
+		return -EINVAL;
+
+	if (is_userptr_bo(abo))
+		return amdxdna_userptr_clflush(abo, offset, size);
+
+	/* BO pinned by command submission stays pinned until it is freed */
+	pinned = READ_ONCE(abo->flags) & BO_SUBMIT_PINNED;
+	if (!pinned) {
+		ret = amdxdna_gem_pin(abo);
+		if (ret) {
+			XDNA_ERR(xdna, "Pin BO failed, ret %d", ret);
+			return ret;
+		}
+	}
+
+	/* For import bo, still sync whole BO */
+	if (is_import_bo(abo))
+		drm_clflush_sg(abo->base.sgt);
+	else
+		amdxdna_drm_clflush(abo, offset, size);
+
+	if (!pinned)
+		amdxdna_gem_unpin(abo);
+
+	return 0;
+}
+
+static int amdxdna_gem_sync_dev(struct amdxdna_client *client, u32 bo_hdl,
+				u32 *hwctx_hdl, u64 *seq)
+{
+	struct amdxdna_dev *xdna = client->xdna;
+	u32 hdl;
+	int ret;
+
+	hdl = amdxdna_gem_get_assigned_hwctx(client, bo_hdl);
+	if (hdl == AMDXDNA_INVALID_CTX_HANDLE ||
+	    (*hwctx_hdl != AMDXDNA_INVALID_CTX_HANDLE && *hwctx_hdl != hdl)) {
+		XDNA_ERR(xdna, "Sync failed, bo %d hwctx %d", bo_hdl, hdl);
+		return -EINVAL;
+	}
+
+	ret = amdxdna_cmd_submit(client, OP_SYNC_BO, AMDXDNA_INVALID_BO_HANDLE,
+				 &bo_hdl, 1, NULL, NULL, 0, hdl, seq);
+	if (ret) {
+		XDNA_ERR(xdna, "Submit command failed");
+		return ret;
+	}
+
+	*hwctx_hdl = hdl;
+	return 0;
 }
 
 /*
@@ -909,9 +1321,9 @@ int amdxdna_drm_sync_bo_ioctl(struct drm_device *dev,
 	struct amdxdna_client *client = filp->driver_priv;
 	struct amdxdna_dev *xdna = to_xdna_dev(dev);
 	struct amdxdna_drm_sync_bo *args = data;
+	u32 hwctx_hdl = AMDXDNA_INVALID_CTX_HANDLE;
 	struct amdxdna_gem_obj *abo;
 	struct drm_gem_object *gobj;
-	u32 hwctx_hdl;
 	int ret;
 
 	gobj = drm_gem_object_lookup(filp, args->handle);
@@ -921,43 +1333,17 @@ int amdxdna_drm_sync_bo_ioctl(struct drm_device *dev,
 	}
 	abo = to_xdna_obj(gobj);
 
-	if (gobj->size < args->offset + args->size) {
-		ret = -EINVAL;
-		goto put_obj;
-	}
-
-	ret = amdxdna_gem_pin(abo);
-	if (ret) {
-		XDNA_ERR(xdna, "Pin BO %d failed, ret %d", args->handle, ret);
+	ret = amdxdna_gem_sync_range(abo, args->offset, args->size);
+	if (ret)
 		goto put_obj;
-	}
-
-	/* For import bo, still sync whole BO */
-	if (is_import_bo(abo))
-		drm_clflush_sg(abo->base.sgt);
-	else
-		amdxdna_drm_clflush(abo, args->offset, args->size);
-
-	amdxdna_gem_unpin(abo);
 
 	if (abo->assigned_hwctx != AMDXDNA_INVALID_CTX_HANDLE &&
 	    args->direction == SYNC_DIRECT_FROM_DEVICE) {
 		u64 seq;
 
-		hwctx_hdl = amdxdna_gem_get_assigned_hwctx(client, args->handle);
-		if (hwctx_hdl == AMDXDNA_INVALID_CTX_HANDLE ||
-		    args->direction != SYNC_DIRECT_FROM_DEVICE) {
-			XDNA_ERR(xdna, "Sync failed, dir %d", args->direction);
-			ret = -EINVAL;
-			goto put_obj;
-		}
-
-		ret = amdxdna_cmd_submit(client, OP_SYNC_BO, AMDXDNA_INVALID_BO_HANDLE,
-					 &args->handle, 1, NULL, NULL, 0, hwctx_hdl, &seq);
-		if (ret) {
-			XDNA_ERR(xdna, "Submit command failed");
+		ret = amdxdna_gem_sync_dev(client, args->handle, &hwctx_hdl, &seq);
+		if (ret)
 			goto put_obj;
-		}
 
 		ret = amdxdna_cmd_wait(client, hwctx_hdl, seq, 3000 /* ms */);
 	}
@@ -971,6 +1357,84 @@ put_obj:
 	return ret;
 }
 
+/*
+ * Vectored version of sync bo ioctl. All ranges are synced with one call and
+ * device sync commands are optionally left for user to wait on.
+ */
+int amdxdna_drm_sync_bo_vec_ioctl(struct drm_device *dev,
+				  void *data, struct drm_file *filp)
+{
+	struct amdxdna_client *client = filp->driver_priv;
+	struct amdxdna_dev *xdna = to_xdna_dev(dev);
+	struct amdxdna_drm_sync_bo_vec *args = data;
+	u32 hwctx_hdl = AMDXDNA_INVALID_CTX_HANDLE;
+	struct amdxdna_drm_sync_bo_range *ranges;
+	struct amdxdna_gem_obj *abo;
+	struct drm_gem_object *gobj;
+	u64 seq = 0;
+	int ret = 0;
+	u32 i;
+
+	if (args->flags & ~AMDXDNA_SYNC_BO_VEC_ASYNC ||
+	    args->direction > SYNC_DIRECT_FROM_DEVICE) {
+		XDNA_DBG(xdna, "Invalid flags 0x%x or direction %d",
+			 args->flags, args->direction);
+		return -EINVAL;
+	}
+
+	if (!args->count || args->count > AMDXDNA_SYNC_BO_VEC_MAX) {
+		XDNA_DBG(xdna, "Invalid range count %d", args->count);
+		return -EINVAL;
+	}
+
+	ranges = kvmalloc_array(args->count, sizeof(*ranges), GFP_KERNEL);
+	if (!ranges)
+		return -ENOMEM;
+
+	if (copy_from_user(ranges, u64_to_user_ptr(args->ranges),
+			   args->count * sizeof(*ranges))) {
+		ret = -EFAULT;
+		goto free_ranges;
+	}
+
+	for (i = 0; i < args->count; i++) {
+		if (ranges[i].pad) {
+			ret = -EINVAL;
+			break;
+		}
+
+		gobj = drm_gem_object_lookup(filp, ranges[i].handle);
+		if (!gobj) {
+			XDNA_ERR(xdna, "Lookup GEM object %d failed", ranges[i].handle);
+			ret = -ENOENT;
+			break;
+		}
+		abo = to_xdna_obj(gobj);
+
+		ret = amdxdna_gem_sync_range(abo, ranges[i].offset, ranges[i].size);
+		if (!ret && abo->assigned_hwctx != AMDXDNA_INVALID_CTX_HANDLE &&
+		    args->direction == SYNC_DIRECT_FROM_DEVICE)
+			ret = amdxdna_gem_sync_dev(client, ranges[i].handle, &hwctx_hdl, &seq);
+		drm_gem_object_put(gobj);
+		if (ret)
+			break;
+	}
+
+	/* Device sync commands on one hardware context complete in order */
+	args->hwctx = hwctx_hdl;
+	args->seq = seq;
+	if (!ret && hwctx_hdl != AMDXDNA_INVALID_CTX_HANDLE &&
+	    !(args->flags & AMDXDNA_SYNC_BO_VEC_ASYNC))
+		ret = amdxdna_cmd_wait(client, hwctx_hdl, seq, 3000 /* ms */);
+
+	XDNA_DBG(xdna, "Sync %d ranges, dir %d, hwctx %d seq %lld, ret %d",
+		 i, args->direction, hwctx_hdl, seq, ret);
+
+free_ranges:
+	kvfree(ranges);
+	return ret;
+}
+
 u32 amdxdna_gem_get_assigned_hwctx(struct amdxdna_client *client, u32 bo_hdl)
 {
 	struct amdxdna_gem_obj *abo = amdxdna_gem_get_obj(client, bo_hdl, AMDXDNA_BO_INVALID);
@@ -1027,3 +1491,7 @@ void amdxdna_gem_clear_assigned_hwctx(struct amdxdna_client *client, u32 bo_hdl)
 
 	amdxdna_gem_put_obj(abo);
 }
+
+#ifdef AMDXDNA_KUNIT
+#include "tests/amdxdna_gem_test.c"
+#endif
@@ -10,7 +10,9 @@
 #include <drm/drm_gem.h>
 #include <drm/drm_gem_shmem_helper.h>
 #include <linux/hmm.h>
+#include <linux/seqlock.h>
 
+struct amdxdna_dev;
 
 struct amdxdna_umap {
 	struct vm_area_struct		*vma;
@@ -21,6 +23,9 @@ struct amdxdna_umap {
 	struct list_head		node;
 	struct kref			refcnt;
 	bool				invalid;
+	/* Invalidated sub-range, only meaningful when invalid is set */
+	unsigned long			invalid_start;
+	unsigned long			invalid_end;
 };
 
 struct amdxdna_mem {
@@ -32,6 +37,9 @@ struct amdxdna_mem {
 	u32				nr_pages;
 	struct list_head		umap_list;
 	bool				map_invalid;
+	spinlock_t			notifier_lock; /* protect umap_list, invalid states */
+	seqcount_spinlock_t		notifier_seq; /* bumped on invalidation */
+	atomic_t			submit_cnt; /* submissions validated the BO */
 #ifdef AMDXDNA_DEVEL
 	struct sg_table			*sgt;
 	u64				dma_addr; /* IOVA DMA address */
@@ -39,6 +47,7 @@ struct amdxdna_mem {
 };
 
 #define BO_SUBMIT_PINNED	BIT(0)
+#define BO_USERPTR		BIT(1)
 struct amdxdna_gem_obj {
 	struct drm_gem_shmem_object	base;
 	struct amdxdna_client		*client;
@@ -56,6 +65,7 @@ struct amdxdna_gem_obj {
 
 #define to_gobj(obj)    (&(obj)->base.base)
 #define is_import_bo(obj) (to_gobj(obj)->import_attach)
+#define is_userptr_bo(obj) ((obj)->flags & BO_USERPTR)
 
 static inline struct amdxdna_gem_obj *to_xdna_obj(struct drm_gem_object *gobj)
 {
@@ -69,6 +79,11 @@ static inline void amdxdna_gem_put_obj(struct amdxdna_gem_obj *abo)
 	drm_gem_object_put(to_gobj(abo));
 }
 void amdxdna_umap_put(struct amdxdna_umap *mapp);
+bool amdxdna_gem_validate_begin(struct amdxdna_gem_obj *abo);
+void amdxdna_gem_validate_end(struct amdxdna_gem_obj *abo);
+
+void amdxdna_gemfs_init(struct amdxdna_dev *xdna);
+void amdxdna_gemfs_fini(struct amdxdna_dev *xdna);
 
 struct drm_gem_object *
 amdxdna_gem_create_object_cb(struct drm_device *dev, size_t size);
@@ -90,5 +105,6 @@ void amdxdna_gem_clear_assigned_hwctx(struct amdxdna_client *client, u32 bo_hdl)
 int amdxdna_drm_create_bo_ioctl(struct drm_device *dev, void *data, struct drm_file *filp);
 int amdxdna_drm_get_bo_info_ioctl(struct drm_device *dev, void *data, struct drm_file *filp);
 int amdxdna_drm_sync_bo_ioctl(struct drm_device *dev, void *data, struct drm_file *filp);
+int amdxdna_drm_sync_bo_vec_ioctl(struct drm_device *dev, void *data, struct drm_file *filp);
 
 #endif /* _AMDXDNA_GEM_H_ */
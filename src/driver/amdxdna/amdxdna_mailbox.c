@@ -86,6 +86,39 @@ struct mailbox {
 };
 
 #if defined(CONFIG_DEBUG_FS)
+#define MB_STATS_OCC_BUCKETS		8  /* X2I ring occupancy, in 1/8 of the ring */
+#define MB_STATS_BATCH_BUCKETS		8  /* messages per RX pass, log2 */
+#define MB_STATS_LAT_BUCKETS		16 /* response latency, log2 us */
+#define MB_STATS_OPCODES		16 /* the last slot takes all other opcodes */
+#define MB_STATS_OPCODE_OTHER		U32_MAX
+
+struct mailbox_lat_stats {
+	u32				opcode;
+	u64				count;
+	u64				total_ns;
+	u64				max_ns;
+	u64				hist[MB_STATS_LAT_BUCKETS];
+};
+
+/*
+ * Channel statistics. TX counters are atomic since senders of a channel are
+ * not serialized by the mailbox. RX counters are only updated by the RX
+ * worker or polld, whichever serves the channel, so they are plain.
+ * Readers may see a slightly inconsistent set, which is fine for debugfs.
+ */
+struct mailbox_chann_stats {
+	atomic64_t			tx_msgs;
+	atomic64_t			tx_bytes;
+	atomic64_t			tx_nospc;
+	atomic64_t			x2i_occ[MB_STATS_OCC_BUCKETS];
+	atomic_t			x2i_occ_max;
+	u64				rx_msgs;
+	u64				rx_bytes;
+	u64				rx_batch[MB_STATS_BATCH_BUCKETS];
+	u32				rx_batch_max;
+	struct mailbox_lat_stats	lat[MB_STATS_OPCODES];
+};
+
 struct mailbox_res_record {
 	enum xdna_mailbox_channel_type	type;
 	struct list_head		re_entry;
@@ -93,6 +126,8 @@ struct mailbox_res_record {
 	struct xdna_mailbox_chann_res	re_i2x;
 	int				re_irq;
 	int				active;
+	/* Kept with the record, so it adds up across channel re-creation */
+	struct mailbox_chann_stats	stats;
 };
 #endif /* CONFIG_DEBUG_FS */
 
@@ -147,6 +182,9 @@ struct mailbox_msg {
 	void			*handle;
 	int			(*notify_cb)(void *handle, const u32 *data, size_t size);
 	size_t			pkg_size; /* package size in bytes */
+#if defined(CONFIG_DEBUG_FS)
+	u64			tx_ns;
+#endif
 	struct mailbox_pkg	pkg;
 };
 
@@ -279,6 +317,83 @@ static void mailbox_release_msg(struct mailbox_channel *mb_chann,
 	kfree(mb_msg);
 }
 
+#if defined(CONFIG_DEBUG_FS)
+static void mailbox_stats_tx(struct mailbox_channel *mb_chann,
+			     struct mailbox_msg *mb_msg, u32 head)
+{
+	struct mailbox_chann_stats *stats = &mb_chann->record->stats;
+	u32 ringbuf_size = mailbox_get_ringbuf_size(mb_chann, CHAN_RES_X2I);
+	u32 tail = mb_chann->x2i_tail;
+	u32 occ, max;
+
+	/* Bytes firmware has not consumed yet, the tombstone gap not counted */
+	occ = tail >= head ? tail - head : ringbuf_size - head + tail;
+	atomic64_inc(&stats->tx_msgs);
+	atomic64_add(mb_msg->pkg_size, &stats->tx_bytes);
+	atomic64_inc(&stats->x2i_occ[min_t(u32, occ * MB_STATS_OCC_BUCKETS / ringbuf_size,
+					   MB_STATS_OCC_BUCKETS - 1)]);
+
+	max = atomic_read(&stats->x2i_occ_max);
+	while (occ > max) {
+		if (atomic_try_cmpxchg(&stats->x2i_occ_max, &max, occ))
+			break;
+	}
+}
+
+static void mailbox_stats_nospc(struct mailbox_channel *mb_chann)
+{
+	atomic64_inc(&mb_chann->record->stats.tx_nospc);
+}
+
+static void mailbox_stats_rx(struct mailbox_channel *mb_chann,
+			     struct mailbox_msg *mb_msg, u32 size)
+{
+	struct mailbox_chann_stats *stats = &mb_chann->record->stats;
+	u32 opcode = mb_msg->pkg.header.opcode;
+	struct mailbox_lat_stats *lat;
+	u64 ns, us;
+	int i;
+
+	stats->rx_msgs++;
+	stats->rx_bytes += size;
+
+	for (i = 0; i < MB_STATS_OPCODES - 1; i++) {
+		lat = &stats->lat[i];
+		if (!lat->count)
+			lat->opcode = opcode;
+		if (lat->opcode == opcode)
+			break;
+	}
+	lat = &stats->lat[i];
+	if (i == MB_STATS_OPCODES - 1)
+		lat->opcode = MB_STATS_OPCODE_OTHER;
+
+	ns = ktime_get_ns() - mb_msg->tx_ns;
+	us = ns / NSEC_PER_USEC;
+	lat->count++;
+	lat->total_ns += ns;
+	lat->max_ns = max(lat->max_ns, ns);
+	lat->hist[us ? min_t(int, ilog2(us) + 1, MB_STATS_LAT_BUCKETS - 1) : 0]++;
+}
+
+static void mailbox_stats_rx_batch(struct mailbox_channel *mb_chann, u32 cnt)
+{
+	struct mailbox_chann_stats *stats = &mb_chann->record->stats;
+
+	if (!cnt)
+		return;
+	stats->rx_batch[min_t(int, ilog2(cnt), MB_STATS_BATCH_BUCKETS - 1)]++;
+	stats->rx_batch_max = max(stats->rx_batch_max, cnt);
+}
+#else
+static inline void mailbox_stats_tx(struct mailbox_channel *mb_chann,
+				    struct mailbox_msg *mb_msg, u32 head) {}
+static inline void mailbox_stats_nospc(struct mailbox_channel *mb_chann) {}
+static inline void mailbox_stats_rx(struct mailbox_channel *mb_chann,
+				    struct mailbox_msg *mb_msg, u32 size) {}
+static inline void mailbox_stats_rx_batch(struct mailbox_channel *mb_chann, u32 cnt) {}
+#endif /* CONFIG_DEBUG_FS */
+
 static int
 mailbox_send_msg(struct mailbox_channel *mb_chann, struct mailbox_msg *mb_msg)
 {
@@ -311,7 +426,12 @@ mailbox_send_msg(struct mailbox_channel *mb_chann, struct mailbox_msg *mb_msg)
 
 	write_addr = mb_chann->mb->res.ringbuf_base + start_addr + tail;
 	memcpy_toio((void *)write_addr, &mb_msg->pkg, mb_msg->pkg_size);
+#if defined(CONFIG_DEBUG_FS)
+	/* Response may come back before mailbox_send_msg() returns */
+	mb_msg->tx_ns = ktime_get_ns();
+#endif
 	mailbox_set_tailptr(mb_chann, tail + mb_msg->pkg_size);
+	mailbox_stats_tx(mb_chann, mb_msg, head);
 
 	trace_mbox_set_tail(MAILBOX_NAME, mb_chann->msix_irq,
 			    mb_msg->pkg.header.opcode,
@@ -320,6 +440,7 @@ mailbox_send_msg(struct mailbox_channel *mb_chann, struct mailbox_msg *mb_msg)
 	return 0;
 
 no_space:
+	mailbox_stats_nospc(mb_chann);
 	return -ENOSPC;
 }
 
@@ -345,6 +466,7 @@ mailbox_get_resp(struct mailbox_channel *mb_chann, struct xdna_msg_header *heade
 
 	MB_DBG(mb_chann, "opcode 0x%x size %d id 0x%x",
 	       header->opcode, header->total_size, header->id);
+	mailbox_stats_rx(mb_chann, mb_msg, sizeof(*header) + header->total_size);
 	ret = mb_msg->notify_cb(mb_msg->handle, data, header->total_size);
 	if (unlikely(ret))
 		MB_ERR(mb_chann, "Size %d opcode 0x%x ret %d",
@@ -438,6 +560,7 @@ static int mailbox_get_msg(struct mailbox_channel *mb_chann)
 static void mailbox_rx_worker(struct work_struct *rx_work)
 {
 	struct mailbox_channel *mb_chann;
+	u32 cnt = 0;
 	int ret;
 
 	mb_chann = container_of(rx_work, struct mailbox_channel, rx_work);
@@ -456,6 +579,8 @@ static void mailbox_rx_worker(struct work_struct *rx_work)
 		ret = mailbox_get_msg(mb_chann);
 		if (ret == -ENOENT)
 			break;
+		if (!ret)
+			cnt++;
 
 		/* Other error means device doesn't look good, disable irq. */
 		if (unlikely(ret)) {
@@ -465,6 +590,7 @@ static void mailbox_rx_worker(struct work_struct *rx_work)
 			break;
 		}
 	}
+	mailbox_stats_rx_batch(mb_chann, cnt);
 }
 
 static irqreturn_t mailbox_irq_handler(int irq, void *p)
@@ -510,6 +636,7 @@ static void mailbox_timer(struct timer_list *t)
 
 static void mailbox_polld_handle_chann(struct mailbox_channel *mb_chann)
 {
+	u32 cnt = 0;
 	u32 iohub;
 	int ret;
 
@@ -538,7 +665,10 @@ static void mailbox_polld_handle_chann(struct mailbox_channel *mb_chann)
 	 */
 	do {
 		ret = mailbox_get_msg(mb_chann);
+		if (!ret)
+			cnt++;
 	} while (!ret);
+	mailbox_stats_rx_batch(mb_chann, cnt);
 
 	if (ret == -ENOENT)
 		return;
@@ -801,6 +931,71 @@ int xdna_mailbox_ringbuf_show(struct mailbox *mb, struct seq_file *m)
 	vfree(buf);
 	return 0;
 }
+
+static void xdna_mailbox_hist_show(struct seq_file *m, const char *name,
+				   const u64 *hist, int n)
+{
+	int last = n - 1;
+	int i;
+
+	while (last > 0 && !hist[last])
+		last--;
+	seq_printf(m, "  %s:", name);
+	for (i = 0; i <= last; i++)
+		seq_printf(m, " %llu", hist[i]);
+	seq_puts(m, "\n");
+}
+
+int xdna_mailbox_stats_show(struct mailbox *mb, struct seq_file *m)
+{
+	u64 occ[MB_STATS_OCC_BUCKETS];
+	struct mailbox_res_record *record;
+	struct mailbox_chann_stats *stats;
+	struct mailbox_lat_stats *lat;
+	int i;
+
+	mutex_lock(&mb->mbox_lock);
+	list_for_each_entry(record, &mb->res_records, re_entry) {
+		stats = &record->stats;
+		seq_printf(m, "mbox %d type %d alive %d x2i size 0x%x\n",
+			   record->re_irq, record->type, record->active,
+			   record->re_x2i.rb_size);
+		seq_printf(m, "  tx msgs %lld bytes %lld nospc %lld\n",
+			   atomic64_read(&stats->tx_msgs),
+			   atomic64_read(&stats->tx_bytes),
+			   atomic64_read(&stats->tx_nospc));
+		seq_printf(m, "  rx msgs %llu bytes %llu\n",
+			   READ_ONCE(stats->rx_msgs), READ_ONCE(stats->rx_bytes));
+
+		for (i = 0; i < MB_STATS_OCC_BUCKETS; i++)
+			occ[i] = atomic64_read(&stats->x2i_occ[i]);
+		seq_printf(m, "  x2i occupancy max 0x%x\n",
+			   atomic_read(&stats->x2i_occ_max));
+		xdna_mailbox_hist_show(m, "x2i occupancy (1/8 ring)", occ,
+				       MB_STATS_OCC_BUCKETS);
+		seq_printf(m, "  rx batch max %u\n", READ_ONCE(stats->rx_batch_max));
+		xdna_mailbox_hist_show(m, "rx batch (log2)", stats->rx_batch,
+				       MB_STATS_BATCH_BUCKETS);
+
+		for (i = 0; i < MB_STATS_OPCODES; i++) {
+			lat = &stats->lat[i];
+			if (!READ_ONCE(lat->count))
+				continue;
+			if (lat->opcode == MB_STATS_OPCODE_OTHER)
+				seq_puts(m, "  opcode other");
+			else
+				seq_printf(m, "  opcode 0x%x", lat->opcode);
+			seq_printf(m, " count %llu avg %llu us max %llu us\n", lat->count,
+				   div64_u64(lat->total_ns, lat->count) / NSEC_PER_USEC,
+				   lat->max_ns / NSEC_PER_USEC);
+			xdna_mailbox_hist_show(m, "latency (log2 us)", lat->hist,
+					       MB_STATS_LAT_BUCKETS);
+		}
+	}
+	mutex_unlock(&mb->mbox_lock);
+
+	return 0;
+}
 #endif /* CONFIG_DEBUG_FS */
 
 struct mailbox_channel *
@@ -1036,3 +1231,7 @@ done_release_record:
 	mutex_destroy(&mb->mbox_lock);
 	kfree(mb);
 }
+
+#ifdef AMDXDNA_KUNIT
+#include "tests/amdxdna_mailbox_test.c"
+#endif
@@ -155,6 +155,20 @@ int xdna_mailbox_info_show(struct mailbox *mailbox,
  */
 int xdna_mailbox_ringbuf_show(struct mailbox *mailbox,
 			      struct seq_file *m);
+
+/*
+ * xdna_mailbox_stats_show() -- Show per channel message statistics for debug
+ *
+ * @mailbox: the handle return from xdna_mailbox_create()
+ * @m: the seq_file handle
+ *
+ * Counters, X2I ring occupancy, RX batch sizes and response latency by
+ * opcode. They are kept since the mailbox was created.
+ *
+ * Return: if success, return 0; otherwise return error code
+ */
+int xdna_mailbox_stats_show(struct mailbox *mailbox,
+			    struct seq_file *m);
 #endif
 
 #endif /* _AIE2_MAILBOX_ */
@@ -65,6 +65,7 @@ amdxdna_get_dev_info(struct pci_dev *pdev)
 
 static int amdxdna_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 {
+	static struct lock_class_key submit_key;
 	struct device *dev = &pdev->dev;
 	struct amdxdna_dev *xdna;
 	int ret;
@@ -82,13 +83,16 @@ static int amdxdna_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 #else
 	devm_mutex_init(dev, &xdna->dev_lock);
 #endif
-	init_rwsem(&xdna->notifier_lock);
+	init_waitqueue_head(&xdna->notifier_waitq);
+	lockdep_init_map(&xdna->submit_lockdep_map, "amdxdna_submit", &submit_key, 0);
 	INIT_LIST_HEAD(&xdna->client_list);
+	spin_lock_init(&xdna->rpm_stats.lock);
 	pci_set_drvdata(pdev, xdna);
 
 	if (IS_ENABLED(CONFIG_LOCKDEP)) {
 		fs_reclaim_acquire(GFP_KERNEL);
-		might_lock(&xdna->notifier_lock);
+		lock_map_acquire(&xdna->submit_lockdep_map);
+		lock_map_release(&xdna->submit_lockdep_map);
 		fs_reclaim_release(GFP_KERNEL);
 	}
 
@@ -99,6 +103,8 @@ static int amdxdna_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 	if (!xdna->notifier_wq)
 		return -ENOMEM;
 
+	amdxdna_gemfs_init(xdna);
+
 	mutex_lock(&xdna->dev_lock);
 	ret = xdna->dev_info->ops->init(xdna);
 	mutex_unlock(&xdna->dev_lock);
@@ -140,10 +146,9 @@ static int amdxdna_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 failed_sysfs_fini:
 	amdxdna_sysfs_fini(xdna);
 failed_dev_fini:
-	mutex_lock(&xdna->dev_lock);
 	xdna->dev_info->ops->fini(xdna);
-	mutex_unlock(&xdna->dev_lock);
 destroy_notifier_wq:
+	amdxdna_gemfs_fini(xdna);
 	destroy_workqueue(xdna->notifier_wq);
 	return ret;
 }
@@ -176,9 +181,10 @@ static void amdxdna_remove(struct pci_dev *pdev)
 		client = list_first_entry_or_null(&xdna->client_list,
 						  struct amdxdna_client, node);
 	}
+	mutex_unlock(&xdna->dev_lock);
 
 	xdna->dev_info->ops->fini(xdna);
-	mutex_unlock(&xdna->dev_lock);
+	amdxdna_gemfs_fini(xdna);
 #ifdef AMDXDNA_DEVEL
 	ida_destroy(&xdna->pdi_ida);
 #endif
@@ -238,16 +244,45 @@ static int amdxdna_pmops_resume(struct device *dev)
 	return 0;
 }
 
+static void amdxdna_rpm_account_resume(struct amdxdna_dev *xdna, ktime_t start)
+{
+	struct amdxdna_rpm_stats *stats = &xdna->rpm_stats;
+	ktime_t now = ktime_get();
+	u64 elapsed, idle_ms;
+	int bucket = 0;
+
+	elapsed = ktime_to_ns(ktime_sub(now, start));
+	idle_ms = ktime_ms_delta(start, stats->suspend_time);
+	while (bucket < AMDXDNA_RPM_IDLE_BUCKETS - 1 && idle_ms >= 10) {
+		idle_ms /= 10;
+		bucket++;
+	}
+
+	spin_lock(&stats->lock);
+	stats->resumes++;
+	stats->resume_ns += elapsed;
+	stats->resume_max_ns = max(stats->resume_max_ns, elapsed);
+	stats->idle_hist[bucket]++;
+	spin_unlock(&stats->lock);
+}
+
 static int amdxdna_rpmops_suspend(struct device *dev)
 {
 	struct amdxdna_dev *xdna = pci_get_drvdata(to_pci_dev(dev));
 	int ret;
 
+	/* Clients may be open, they resume the device before using it */
 	mutex_lock(&xdna->dev_lock);
-	WARN_ON(!list_empty(&xdna->client_list));
 	ret = amdxdna_dev_suspend_nolock(xdna);
 	mutex_unlock(&xdna->dev_lock);
 
+	if (!ret) {
+		spin_lock(&xdna->rpm_stats.lock);
+		xdna->rpm_stats.suspends++;
+		xdna->rpm_stats.suspend_time = ktime_get();
+		spin_unlock(&xdna->rpm_stats.lock);
+	}
+
 	XDNA_DBG(xdna, "Runtime suspend done ret: %d", ret);
 	return ret;
 }
@@ -255,11 +290,15 @@ static int amdxdna_rpmops_suspend(struct device *dev)
 static int amdxdna_rpmops_resume(struct device *dev)
 {
 	struct amdxdna_dev *xdna = pci_get_drvdata(to_pci_dev(dev));
+	ktime_t start;
 	int ret;
 
+	start = ktime_get();
 	mutex_lock(&xdna->dev_lock);
 	ret = amdxdna_dev_resume_nolock(xdna);
 	mutex_unlock(&xdna->dev_lock);
+	if (!ret)
+		amdxdna_rpm_account_resume(xdna, start);
 
 	XDNA_DBG(xdna, "Runtime resume done ret: %d", ret);
 	return ret;
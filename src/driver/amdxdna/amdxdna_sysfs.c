@@ -31,10 +31,50 @@ static ssize_t fw_version_show(struct device *dev, struct device_attribute *attr
 }
 static DEVICE_ATTR_RO(fw_version);
 
+static ssize_t rpm_stats_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct amdxdna_dev *xdna = dev_get_drvdata(dev);
+	struct amdxdna_rpm_stats *stats = &xdna->rpm_stats;
+	u64 suspends, resumes, resume_ns, resume_max_ns;
+	u64 async_resumes, waits, wait_ns, wait_max_ns;
+	u64 idle_hist[AMDXDNA_RPM_IDLE_BUCKETS];
+	ssize_t len;
+	int i;
+
+	spin_lock(&stats->lock);
+	suspends = stats->suspends;
+	resumes = stats->resumes;
+	resume_ns = stats->resume_ns;
+	resume_max_ns = stats->resume_max_ns;
+	async_resumes = stats->async_resumes;
+	waits = stats->waits;
+	wait_ns = stats->wait_ns;
+	wait_max_ns = stats->wait_max_ns;
+	memcpy(idle_hist, stats->idle_hist, sizeof(idle_hist));
+	spin_unlock(&stats->lock);
+
+	len = sysfs_emit(buf, "suspends %llu\n", suspends);
+	len += sysfs_emit_at(buf, len, "resumes %llu avg_us %llu max_us %llu\n", resumes,
+			     resumes ? div64_u64(resume_ns, resumes) / NSEC_PER_USEC : 0,
+			     resume_max_ns / NSEC_PER_USEC);
+	len += sysfs_emit_at(buf, len, "async_resumes %llu\n", async_resumes);
+	len += sysfs_emit_at(buf, len, "waits %llu avg_us %llu max_us %llu\n", waits,
+			     waits ? div64_u64(wait_ns, waits) / NSEC_PER_USEC : 0,
+			     wait_max_ns / NSEC_PER_USEC);
+	len += sysfs_emit_at(buf, len, "suspended_ms");
+	for (i = 0; i < AMDXDNA_RPM_IDLE_BUCKETS; i++)
+		len += sysfs_emit_at(buf, len, " %llu", idle_hist[i]);
+	len += sysfs_emit_at(buf, len, "\n");
+
+	return len;
+}
+static DEVICE_ATTR_RO(rpm_stats);
+
 static struct attribute *amdxdna_attrs[] = {
 	&dev_attr_device_type.attr,
 	&dev_attr_vbnv.attr,
 	&dev_attr_fw_version.attr,
+	&dev_attr_rpm_stats.attr,
 	NULL,
 };
 
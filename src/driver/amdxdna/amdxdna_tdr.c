@@ -23,9 +23,8 @@ static void amdxdna_tdr_work(struct work_struct *work)
 	struct amdxdna_hwctx *hwctx;
 	struct amdxdna_dev *xdna;
 	unsigned long hwctx_id;
-	bool active = false;
-	int idle_cnt = 0;
-	int ctx_cnt = 0;
+	u32 active_cols = 0;
+	u32 hang_cols = 0;
 	int idx;
 
 	xdna = tdr_to_xdna_dev(tdr);
@@ -42,31 +41,53 @@ static void amdxdna_tdr_work(struct work_struct *work)
 
 			XDNA_DBG(xdna, "%s submitted %lld completed %lld last %lld",
 				 hwctx->name, submitted, completed, last);
-			ctx_cnt++;
-			if (submitted == completed) {
-				idle_cnt++;
+			if (submitted == completed || last == completed)
+				continue;
+
+			hwctx->tdr_last_completed = completed;
+			active_cols |= amdxdna_hwctx_col_map(hwctx);
+		}
+		srcu_read_unlock(&client->hwctx_srcu, idx);
+	}
+
+	/*
+	 * A context with outstanding cmds which did not make progress is hung,
+	 * unless it shares columns with an active context and waits for its turn.
+	 */
+	list_for_each_entry(client, &xdna->client_list, node) {
+		idx = srcu_read_lock(&client->hwctx_srcu);
+		amdxdna_for_each_hwctx(client, hwctx_id, hwctx) {
+			u32 col_map;
+
+			if (hwctx->status != HWCTX_STATE_READY ||
+			    hwctx->submitted == hwctx->completed)
 				continue;
-			}
 
-			if (last != completed) {
-				hwctx->tdr_last_completed = completed;
-				active = true;
-				break;
+			col_map = amdxdna_hwctx_col_map(hwctx);
+			if (hwctx->tdr_timedout) {
+				/* Job deadline missed, no matter other contexts */
+				hwctx->tdr_timedout = false;
+				XDNA_WARN(xdna, "%s job seq %lld missed deadline, columns 0x%x",
+					  hwctx->name, hwctx->tdr_stalled_seq, col_map);
+			} else if (col_map & active_cols) {
+				continue;
 			} else {
-				// Mark ready ctx to be dead so to ignore it next time
-				hwctx->status = HWCTX_STATE_DEAD;
+				hwctx->tdr_stalled_seq = hwctx->completed;
+				XDNA_WARN(xdna, "%s isn't making progress at job seq %lld, columns 0x%x",
+					  hwctx->name, hwctx->tdr_stalled_seq, col_map);
 			}
+			// Mark ready ctx to be dead so to ignore it next time
+			hwctx->status = HWCTX_STATE_DEAD;
+			hang_cols |= col_map;
 		}
 		srcu_read_unlock(&client->hwctx_srcu, idx);
-		if (active)
-			break;
 	}
 	mutex_unlock(&xdna->dev_lock);
 
-	/* Detecting hang when all ctx with outstanding cmds do not make progress. */
-	if (ctx_cnt != idle_cnt && !active) {
-		XDNA_WARN(xdna, "Device isn't making progress... Count %d", ++tdr->tdr_counter);
-		xdna->dev_info->ops->recover(xdna, tdr_dump_ctx);
+	/* Only recover the contexts on the hung columns, leave others running */
+	if (hang_cols) {
+		XDNA_WARN(xdna, "Columns 0x%x hung... Count %d", hang_cols, ++tdr->tdr_counter);
+		xdna->dev_info->ops->recover(xdna, hang_cols, tdr_dump_ctx);
 	}
 }
 
@@ -83,6 +104,7 @@ void amdxdna_tdr_start(struct amdxdna_tdr *tdr)
 {
 	struct amdxdna_dev *xdna = tdr_to_xdna_dev(tdr);
 
+	spin_lock_init(&tdr->lock);
 	if (!xdna->dev_info->ops->recover) {
 		XDNA_DBG(xdna, "Not support recovery, watchdog NOT started");
 		return;
@@ -102,12 +124,37 @@ void amdxdna_tdr_start(struct amdxdna_tdr *tdr)
 	XDNA_DBG(xdna, "Check activities in every %d secs", timeout_in_sec);
 }
 
+/*
+ * Ask TDR worker to check contexts immediately, e.g. a job missed its
+ * deadline. Returns false if TDR is not started.
+ */
+bool amdxdna_tdr_request(struct amdxdna_tdr *tdr)
+{
+	unsigned long flags;
+	bool started;
+
+	spin_lock_irqsave(&tdr->lock, flags);
+	started = tdr->started;
+	if (started)
+		queue_work(system_long_wq, &tdr->tdr_work);
+	spin_unlock_irqrestore(&tdr->lock, flags);
+
+	return started;
+}
+
 void amdxdna_tdr_stop(struct amdxdna_tdr *tdr)
 {
 	struct amdxdna_dev *xdna = tdr_to_xdna_dev(tdr);
+	unsigned long flags;
 
-	if (!tdr->started)
+	spin_lock_irqsave(&tdr->lock, flags);
+	if (!tdr->started) {
+		spin_unlock_irqrestore(&tdr->lock, flags);
 		return;
+	}
+	/* Requests check started under the lock, none queues the work after this */
+	tdr->started = 0;
+	spin_unlock_irqrestore(&tdr->lock, flags);
 
 	timer_delete_sync(&tdr->timer);
 	cancel_work_sync(&tdr->tdr_work);
@@ -18,10 +18,13 @@ struct amdxdna_tdr {
 	struct timer_list	timer;
 	struct work_struct	tdr_work;
 	int			tdr_counter;
+	/* Protect started against amdxdna_tdr_request() */
+	spinlock_t		lock;
 	int			started;
 };
 
 void amdxdna_tdr_start(struct amdxdna_tdr *tdr);
 void amdxdna_tdr_stop(struct amdxdna_tdr *tdr);
+bool amdxdna_tdr_request(struct amdxdna_tdr *tdr);
 
 #endif /* _AMDXDNA_TDR_H_ */
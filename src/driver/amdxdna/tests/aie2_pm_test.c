@@ -0,0 +1,251 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2024, Advanced Micro Devices, Inc.
+ */
+
+/*
+ * DPM governor tests, included at the end of aie2_pm.c. A job trace is
+ * replayed through aie2_gov_next_level() with the default dpm_gov_* tunables.
+ */
+
+#include "amdxdna_kunit.h"
+
+#define GOV_TEST_MAX_SAMPLES	64
+
+/* An opc free clock table, job duration scales with hclk */
+static const struct dpm_clk_freq gov_test_clk[] = {
+	{ 400, 400 }, { 800, 800 }, { 1200, 1200 }, { 1600, 1600 },
+};
+
+#define GOV_TEST_MAX_LEVEL	(ARRAY_SIZE(gov_test_clk) - 1)
+
+struct gov_test_job {
+	u32	start_us;
+	u32	duration_us;
+	u32	level;		/* DPM level duration was recorded at */
+};
+
+struct gov_test_params {
+	uint	sample_ms;
+	uint	up_pct;
+	uint	down_pct;
+	uint	down_hold;
+	uint	latency_us;
+};
+
+static void gov_test_set_params(const struct gov_test_params *p)
+{
+	dpm_gov_sample_ms = p->sample_ms;
+	dpm_gov_up_pct = p->up_pct;
+	dpm_gov_down_pct = p->down_pct;
+	dpm_gov_down_hold = p->down_hold;
+	dpm_gov_latency_us = p->latency_us;
+}
+
+static int gov_test_init(struct kunit *test)
+{
+	static const struct gov_test_params dft = { 100, 80, 30, 5, 0 };
+	struct gov_test_params *saved;
+
+	saved = kunit_kzalloc(test, sizeof(*saved), GFP_KERNEL);
+	if (!saved)
+		return -ENOMEM;
+
+	*saved = (struct gov_test_params) { dpm_gov_sample_ms, dpm_gov_up_pct,
+		dpm_gov_down_pct, dpm_gov_down_hold, dpm_gov_latency_us };
+	test->priv = saved;
+	gov_test_set_params(&dft);
+	return 0;
+}
+
+static void gov_test_exit(struct kunit *test)
+{
+	gov_test_set_params(test->priv);
+}
+
+/*
+ * Jobs run one at a time on a single partition in trace order, a job waits
+ * for the previous one to finish. Job duration scales with the clock of the
+ * level the job starts at. One sample is taken per sampling period of trace
+ * time. Returns the number of samples.
+ */
+static int gov_test_replay(const struct gov_test_job *jobs, u32 njobs,
+			   struct aie2_gov_sample *out, u32 max_samples)
+{
+	const struct dpm_clk_freq *clk = gov_test_clk;
+	u64 win_start = 0, win_end, period_us, t_free = 0;
+	u64 cur_start = 0, cur_end = 0, cur_submit = 0;
+	u64 busy_us = 0, lat_sum_us = 0, begin, dur;
+	u32 level = 0, low_cnt = 0, lat_cnt = 0;
+	struct aie2_gov_sample *sample;
+	bool cur_counted = true;
+	u32 i, n = 0;
+
+	for (i = 0; i < njobs; i++) {
+		if (jobs[i].level > GOV_TEST_MAX_LEVEL)
+			return -EINVAL;
+		if (i && jobs[i].start_us < jobs[i - 1].start_us)
+			return -EINVAL;
+	}
+
+	period_us = aie2_gov_sample_ms() * USEC_PER_MSEC;
+	win_end = period_us;
+	i = 0;
+	while (n < max_samples) {
+		begin = (i < njobs) ? max_t(u64, jobs[i].start_us, t_free) : U64_MAX;
+		if (begin < win_end) {
+			/* Previous job is done by now, account the rest of it */
+			if (cur_end > win_start)
+				busy_us += cur_end - max(cur_start, win_start);
+			if (!cur_counted) {
+				lat_sum_us += cur_end - cur_submit;
+				lat_cnt++;
+			}
+
+			dur = div_u64((u64)jobs[i].duration_us * clk[jobs[i].level].hclk,
+				      clk[level].hclk);
+			cur_submit = jobs[i].start_us;
+			cur_start = begin;
+			cur_end = begin + dur;
+			cur_counted = false;
+			t_free = cur_end;
+			i++;
+			continue;
+		}
+
+		if (i == njobs && win_start >= t_free)
+			break;
+
+		/* Close the window */
+		if (cur_end > win_start)
+			busy_us += min(cur_end, win_end) - max(cur_start, win_start);
+		if (!cur_counted && cur_end <= win_end) {
+			lat_sum_us += cur_end - cur_submit;
+			lat_cnt++;
+			cur_counted = true;
+		}
+
+		sample = &out[n++];
+		sample->util = min_t(u64, div64_u64(busy_us * 100, period_us), 100);
+		sample->latency_us = lat_cnt ? div64_u64(lat_sum_us, lat_cnt) : 0;
+		level = aie2_gov_next_level(level, &low_cnt, 0, GOV_TEST_MAX_LEVEL,
+					    sample->util, sample->latency_us);
+		sample->level = level;
+
+		busy_us = 0;
+		lat_sum_us = 0;
+		lat_cnt = 0;
+		win_start = win_end;
+		win_end += period_us;
+	}
+
+	return n;
+}
+
+/*
+ * A 1s job keeps the partition busy for 10 samples, the level goes up one per
+ * sample. The 1us job at 3s leaves 20 idle samples in between, the level goes
+ * down one per dpm_gov_down_hold samples.
+ */
+static void gov_test_up_down(struct kunit *test)
+{
+	static const struct gov_test_job jobs[] = {
+		{ 0, 1000000, 0 },
+		{ 3000000, 1, 0 },
+	};
+	struct aie2_gov_sample out[GOV_TEST_MAX_SAMPLES];
+	int n, i;
+
+	n = gov_test_replay(jobs, ARRAY_SIZE(jobs), out, ARRAY_SIZE(out));
+	KUNIT_ASSERT_EQ(test, n, 31);
+
+	for (i = 0; i < 10; i++) {
+		KUNIT_EXPECT_EQ_MSG(test, out[i].util, 100, "sample %d", i);
+		KUNIT_EXPECT_EQ_MSG(test, out[i].level, min(i + 1, 3), "sample %d", i);
+	}
+	KUNIT_EXPECT_EQ(test, out[9].latency_us, 1000000);
+
+	for (i = 10; i < n; i++)
+		KUNIT_EXPECT_EQ_MSG(test, out[i].util, 0, "sample %d", i);
+	KUNIT_EXPECT_EQ(test, out[13].level, 3);
+	KUNIT_EXPECT_EQ(test, out[14].level, 2);
+	KUNIT_EXPECT_EQ(test, out[19].level, 1);
+	KUNIT_EXPECT_EQ(test, out[24].level, 0);
+	KUNIT_EXPECT_EQ(test, out[30].level, 0);
+}
+
+/* A 100ms job recorded at the top level takes 4 times longer at level 0 */
+static void gov_test_clock_scale(struct kunit *test)
+{
+	static const struct gov_test_job jobs[] = {
+		{ 0, 100000, GOV_TEST_MAX_LEVEL },
+	};
+	struct aie2_gov_sample out[GOV_TEST_MAX_SAMPLES];
+	int n, i;
+
+	n = gov_test_replay(jobs, ARRAY_SIZE(jobs), out, ARRAY_SIZE(out));
+	KUNIT_ASSERT_EQ(test, n, 4);
+	for (i = 0; i < n; i++)
+		KUNIT_EXPECT_EQ_MSG(test, out[i].util, 100, "sample %d", i);
+	KUNIT_EXPECT_EQ(test, out[3].latency_us, 400000);
+}
+
+/* Missing the latency target raises the level even at low utilization */
+static void gov_test_latency(struct kunit *test)
+{
+	static const struct gov_test_params slo = { 100, 80, 30, 5, 1000 };
+	static const struct gov_test_job jobs[] = {
+		{ 0, 2000, 0 },
+		{ 100000, 2000, 0 },
+		{ 200000, 2000, 0 },
+	};
+	struct aie2_gov_sample out[GOV_TEST_MAX_SAMPLES];
+	int n, i;
+
+	gov_test_set_params(&slo);
+	n = gov_test_replay(jobs, ARRAY_SIZE(jobs), out, ARRAY_SIZE(out));
+	KUNIT_ASSERT_EQ(test, n, 3);
+	for (i = 0; i < n; i++) {
+		KUNIT_EXPECT_LT_MSG(test, out[i].util, 30, "sample %d", i);
+		KUNIT_EXPECT_GT_MSG(test, out[i].latency_us, 0, "sample %d", i);
+	}
+	/* The first job misses the target, at level 1 the jobs take 1ms and meet it */
+	KUNIT_EXPECT_EQ(test, out[0].level, 1);
+	KUNIT_EXPECT_EQ(test, out[1].level, 1);
+	KUNIT_EXPECT_EQ(test, out[2].level, 1);
+}
+
+static void gov_test_bad_trace(struct kunit *test)
+{
+	static const struct gov_test_job bad_level[] = {
+		{ 0, 100, GOV_TEST_MAX_LEVEL + 1 },
+	};
+	static const struct gov_test_job bad_order[] = {
+		{ 200, 100, 0 },
+		{ 100, 100, 0 },
+	};
+	struct aie2_gov_sample out[GOV_TEST_MAX_SAMPLES];
+
+	KUNIT_EXPECT_EQ(test, gov_test_replay(bad_level, ARRAY_SIZE(bad_level), out,
+					      ARRAY_SIZE(out)), -EINVAL);
+	KUNIT_EXPECT_EQ(test, gov_test_replay(bad_order, ARRAY_SIZE(bad_order), out,
+					      ARRAY_SIZE(out)), -EINVAL);
+	KUNIT_EXPECT_EQ(test, gov_test_replay(NULL, 0, out, ARRAY_SIZE(out)), 0);
+}
+
+static struct kunit_case gov_test_cases[] = {
+	KUNIT_CASE(gov_test_up_down),
+	KUNIT_CASE(gov_test_clock_scale),
+	KUNIT_CASE(gov_test_latency),
+	KUNIT_CASE(gov_test_bad_trace),
+	{}
+};
+
+static struct kunit_suite gov_test_suite = {
+	.name = "amdxdna_dpm_gov",
+	.init = gov_test_init,
+	.exit = gov_test_exit,
+	.test_cases = gov_test_cases,
+};
+
+kunit_test_suite(gov_test_suite);
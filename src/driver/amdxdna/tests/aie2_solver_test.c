@@ -0,0 +1,501 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2024, Advanced Micro Devices, Inc.
+ */
+
+/*
+ * Partition allocation and DPM level tests, included at the end of
+ * aie2_solver.c. They run on private solver instances with stub actions.
+ */
+
+#include <linux/hash.h>
+
+#include "amdxdna_kunit.h"
+
+static u32 xrs_test_dpm_level;
+static u32 xrs_test_migrations;
+
+static int xrs_test_load(struct amdxdna_hwctx *hwctx, struct xrs_action_load *action)
+{
+	return 0;
+}
+
+static int xrs_test_unload(struct amdxdna_hwctx *hwctx)
+{
+	return 0;
+}
+
+static int xrs_test_set_dpm(struct drm_device *ddev, u32 level)
+{
+	xrs_test_dpm_level = level;
+	return 0;
+}
+
+static int xrs_test_migrate(struct amdxdna_hwctx *hwctx, struct xrs_action_load *action)
+{
+	xrs_test_migrations++;
+	return 0;
+}
+
+static struct xrs_action_ops xrs_test_actions = {
+	.load_hwctx = xrs_test_load,
+	.unload_hwctx = xrs_test_unload,
+	.set_dft_dpm_level = xrs_test_set_dpm,
+	.migrate_hwctx = xrs_test_migrate,
+};
+
+static void xrs_test_fini(void *data)
+{
+	struct solver_state *xrs = data;
+	struct solver_node *node, *tmp;
+
+	list_for_each_entry_safe(node, tmp, &xrs->rgp.node_list, list)
+		remove_solver_node(&xrs->rgp, node);
+}
+
+static struct solver_state *xrs_test_init_clks(struct kunit *test, u32 total_col, u32 flags,
+						const u32 *clks, u32 nclks)
+{
+	struct init_config cfg = { 0 };
+	struct solver_state *xrs;
+
+	xrs = kunit_kzalloc(test, sizeof(*xrs), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, xrs);
+
+	cfg.total_col = total_col;
+	cfg.sys_eff_factor = 1;
+	cfg.clk_list.num_levels = nclks;
+	memcpy(cfg.clk_list.cu_clk_list, clks, nclks * sizeof(*clks));
+	cfg.flags = flags;
+	cfg.ddev = &amdxdna_kunit_xdna(test)->ddev;
+	cfg.actions = &xrs_test_actions;
+	xrs_state_init(xrs, &cfg);
+	KUNIT_ASSERT_EQ(test, kunit_add_action_or_reset(test, xrs_test_fini, xrs), 0);
+
+	return xrs;
+}
+
+static struct solver_state *xrs_test_init(struct kunit *test, u32 total_col, u32 flags)
+{
+	static const u32 clk = 1000;
+
+	return xrs_test_init_clks(test, total_col, flags, &clk, 1);
+}
+
+static int xrs_test_alloc_at(struct solver_state *xrs, u64 rid, u32 ncols,
+			     u32 *start_cols, u32 cols_len)
+{
+	struct alloc_requests req = { 0 };
+
+	req.rid = rid;
+	req.cdo.start_cols = start_cols;
+	req.cdo.cols_len = cols_len;
+	req.cdo.ncols = ncols;
+
+	return xrs_allocate_resource(xrs, &req, NULL);
+}
+
+/* Allocate @ncols starting at any column */
+static int xrs_test_alloc(struct solver_state *xrs, u64 rid, u32 ncols)
+{
+	u32 start_cols[XRS_MAX_COL];
+	u32 i, len;
+
+	len = ncols <= xrs->cfg.total_col ? xrs->cfg.total_col - ncols + 1 : 1;
+	for (i = 0; i < len; i++)
+		start_cols[i] = i;
+
+	return xrs_test_alloc_at(xrs, rid, ncols, start_cols, len);
+}
+
+static u32 xrs_test_col(struct kunit *test, struct solver_state *xrs, u64 rid)
+{
+	struct solver_node *node = rg_search_node(&xrs->rgp, rid);
+
+	KUNIT_ASSERT_NOT_NULL_MSG(test, node, "rid %llu", rid);
+	return node->pt_node->start_col;
+}
+
+static u32 xrs_test_used_cols(struct solver_state *xrs)
+{
+	return bitmap_weight(xrs->rgp.resbit, XRS_MAX_COL);
+}
+
+static void solver_test_first_fit(struct kunit *test)
+{
+	struct solver_state *xrs = xrs_test_init(test, 8, 0);
+	struct xrs_partition_info info[8];
+	u64 rid;
+
+	for (rid = 1; rid <= 4; rid++)
+		KUNIT_ASSERT_EQ(test, xrs_test_alloc(xrs, rid, 2), 0);
+	for (rid = 1; rid <= 4; rid++)
+		KUNIT_EXPECT_EQ(test, xrs_test_col(test, xrs, rid), 2 * (rid - 1));
+	KUNIT_EXPECT_EQ(test, xrs_test_used_cols(xrs), 8);
+
+	/* Full, and nothing of the same width to share */
+	KUNIT_EXPECT_EQ(test, xrs_test_alloc(xrs, 5, 1), -ENODEV);
+
+	KUNIT_ASSERT_EQ(test, xrs_release_resource(xrs, 2), 0);
+	KUNIT_EXPECT_EQ(test, xrs_test_used_cols(xrs), 6);
+	KUNIT_ASSERT_EQ(test, xrs_test_alloc(xrs, 5, 1), 0);
+	KUNIT_EXPECT_EQ(test, xrs_test_col(test, xrs, 5), 2);
+	KUNIT_EXPECT_EQ(test, xrs_get_partitions(xrs, info, ARRAY_SIZE(info)), 4);
+	KUNIT_EXPECT_EQ(test, xrs_test_used_cols(xrs), 7);
+}
+
+/*
+ * Columns:  0 1 2 3 4 5 6 7
+ * Rid:      - - - 2 3 3 4 -
+ * First fit puts one column at 0, best fit in the single free column 7.
+ */
+static void solver_test_fit_policy(struct kunit *test, u32 flags, u32 expect)
+{
+	struct solver_state *xrs = xrs_test_init(test, 8, flags);
+
+	KUNIT_ASSERT_EQ(test, xrs_test_alloc(xrs, 1, 3), 0);
+	KUNIT_ASSERT_EQ(test, xrs_test_alloc(xrs, 2, 1), 0);
+	KUNIT_ASSERT_EQ(test, xrs_test_alloc(xrs, 3, 2), 0);
+	KUNIT_ASSERT_EQ(test, xrs_test_alloc(xrs, 4, 1), 0);
+	KUNIT_ASSERT_EQ(test, xrs_test_col(test, xrs, 4), 6);
+	KUNIT_ASSERT_EQ(test, xrs_release_resource(xrs, 1), 0);
+
+	KUNIT_ASSERT_EQ(test, xrs_test_alloc(xrs, 5, 1), 0);
+	KUNIT_EXPECT_EQ(test, xrs_test_col(test, xrs, 5), expect);
+	/* What is left of the hole still takes a 2 columns request */
+	KUNIT_ASSERT_EQ(test, xrs_test_alloc(xrs, 6, 2), 0);
+}
+
+static void solver_test_best_fit(struct kunit *test)
+{
+	solver_test_fit_policy(test, 0, 0);
+	solver_test_fit_policy(test, XRS_FLAG_BEST_FIT, 7);
+}
+
+static void solver_test_share(struct kunit *test)
+{
+	struct solver_state *xrs = xrs_test_init(test, 4, 0);
+	struct xrs_partition_info info[4];
+
+	KUNIT_ASSERT_EQ(test, xrs_test_alloc(xrs, 1, 4), 0);
+	KUNIT_ASSERT_EQ(test, xrs_test_alloc(xrs, 2, 4), 0);
+	KUNIT_ASSERT_EQ(test, xrs_get_partitions(xrs, info, ARRAY_SIZE(info)), 1);
+	KUNIT_EXPECT_EQ(test, info[0].nshared, 2);
+	KUNIT_EXPECT_EQ(test, xrs_test_alloc(xrs, 3, 2), -ENODEV);
+
+	/* The partition goes with its last sharer */
+	KUNIT_ASSERT_EQ(test, xrs_release_resource(xrs, 1), 0);
+	KUNIT_ASSERT_EQ(test, xrs_get_partitions(xrs, info, ARRAY_SIZE(info)), 1);
+	KUNIT_EXPECT_EQ(test, info[0].nshared, 1);
+	KUNIT_EXPECT_EQ(test, xrs_test_used_cols(xrs), 4);
+	KUNIT_ASSERT_EQ(test, xrs_release_resource(xrs, 2), 0);
+	KUNIT_EXPECT_EQ(test, xrs_get_partitions(xrs, info, ARRAY_SIZE(info)), 0);
+	KUNIT_EXPECT_EQ(test, xrs_test_used_cols(xrs), 0);
+
+	/* Without load callback, the partition with fewer sharers is picked */
+	KUNIT_ASSERT_EQ(test, xrs_test_alloc(xrs, 1, 2), 0);
+	KUNIT_ASSERT_EQ(test, xrs_test_alloc(xrs, 2, 2), 0);
+	KUNIT_ASSERT_EQ(test, xrs_test_alloc(xrs, 3, 2), 0);
+	KUNIT_ASSERT_EQ(test, xrs_test_alloc(xrs, 4, 2), 0);
+	KUNIT_EXPECT_EQ(test, xrs_test_col(test, xrs, 3), 0);
+	KUNIT_EXPECT_EQ(test, xrs_test_col(test, xrs, 4), 2);
+}
+
+/*
+ * Columns:  0 1 2 3
+ * Rid:      1 - 2 -
+ * Rid 2 may start at 2 or 3. A 2 columns request only fits once it is moved.
+ */
+static void solver_test_compact_layout(struct kunit *test, struct solver_state *xrs)
+{
+	u32 cols1[] = { 0 };
+	u32 cols2[] = { 2, 3 };
+
+	KUNIT_ASSERT_EQ(test, xrs_test_alloc_at(xrs, 1, 1, cols1, ARRAY_SIZE(cols1)), 0);
+	KUNIT_ASSERT_EQ(test, xrs_test_alloc_at(xrs, 2, 1, cols2, ARRAY_SIZE(cols2)), 0);
+	KUNIT_ASSERT_EQ(test, xrs_test_col(test, xrs, 2), 2);
+}
+
+static void solver_test_compact(struct kunit *test)
+{
+	struct solver_state *xrs;
+
+	xrs = xrs_test_init(test, 4, 0);
+	solver_test_compact_layout(test, xrs);
+	KUNIT_EXPECT_EQ(test, xrs_test_alloc(xrs, 3, 2), -ENODEV);
+	KUNIT_EXPECT_EQ(test, xrs_test_col(test, xrs, 2), 2);
+
+	xrs = xrs_test_init(test, 4, XRS_FLAG_COMPACT);
+	solver_test_compact_layout(test, xrs);
+	KUNIT_EXPECT_EQ(test, xrs_test_alloc(xrs, 3, 2), 0);
+	KUNIT_EXPECT_EQ(test, xrs_test_col(test, xrs, 1), 0);
+	KUNIT_EXPECT_EQ(test, xrs_test_col(test, xrs, 2), 3);
+	KUNIT_EXPECT_EQ(test, xrs_test_col(test, xrs, 3), 1);
+	KUNIT_EXPECT_EQ(test, xrs_test_used_cols(xrs), 4);
+}
+
+static void solver_test_bad_request(struct kunit *test)
+{
+	struct solver_state *xrs = xrs_test_init(test, 4, 0);
+
+	KUNIT_EXPECT_EQ(test, xrs_test_alloc(xrs, 1, 5), -EINVAL);
+	KUNIT_ASSERT_EQ(test, xrs_test_alloc(xrs, 1, 1), 0);
+	KUNIT_EXPECT_EQ(test, xrs_test_alloc(xrs, 1, 1), -EEXIST);
+	KUNIT_EXPECT_EQ(test, xrs_release_resource(xrs, 2), -ENODEV);
+	KUNIT_EXPECT_EQ(test, xrs_test_used_cols(xrs), 1);
+}
+
+/*
+ * DPM level after each step of an allocate/release/QoS update trace. The clock
+ * list is picked so that an opc of 1000 gives GOPs equal to the clock in MHz.
+ */
+enum xrs_test_op {
+	XRS_TEST_ALLOC,
+	XRS_TEST_RELEASE,
+	XRS_TEST_QOS,
+	XRS_TEST_IDLE,
+	XRS_TEST_BUSY,
+};
+
+struct xrs_test_step {
+	enum xrs_test_op	op;
+	u64			rid;
+	u32			gops;
+	u32			fps;
+	u32			expect;		/* Expected DPM level after step */
+};
+
+static const struct xrs_test_step xrs_dpm_trace[] = {
+	{ XRS_TEST_ALLOC,   1, 1, 500,  1 },
+	{ XRS_TEST_ALLOC,   2, 1, 1000, 2 },
+	/* Release the most demanding session, level goes down */
+	{ XRS_TEST_RELEASE, 2, 0, 0,    1 },
+	/* No QoS, max level */
+	{ XRS_TEST_ALLOC,   3, 0, 0,    3 },
+	{ XRS_TEST_RELEASE, 1, 0, 0,    3 },
+	/* Idle, lowest level */
+	{ XRS_TEST_RELEASE, 3, 0, 0,    0 },
+	{ XRS_TEST_ALLOC,   1, 1, 500,  1 },
+	{ XRS_TEST_QOS,     1, 1, 1500, 3 },
+	{ XRS_TEST_QOS,     1, 1, 100,  0 },
+	{ XRS_TEST_ALLOC,   2, 1, 1000, 2 },
+	{ XRS_TEST_RELEASE, 2, 0, 0,    0 },
+	{ XRS_TEST_RELEASE, 1, 0, 0,    0 },
+	/* Idle sessions do not hold the level up */
+	{ XRS_TEST_ALLOC,   1, 1, 500,  1 },
+	{ XRS_TEST_ALLOC,   2, 1, 1000, 2 },
+	{ XRS_TEST_IDLE,    2, 0, 0,    1 },
+	{ XRS_TEST_IDLE,    1, 0, 0,    0 },
+	{ XRS_TEST_BUSY,    2, 0, 0,    2 },
+	{ XRS_TEST_RELEASE, 2, 0, 0,    0 },
+	{ XRS_TEST_BUSY,    1, 0, 0,    1 },
+	{ XRS_TEST_RELEASE, 1, 0, 0,    0 },
+};
+
+static void solver_test_dpm(struct kunit *test)
+{
+	static const u32 clks[] = { 400, 800, 1200, 1600 };
+	u32 start_cols[] = { 0, 1, 2, 3 };
+	const struct xrs_test_step *step;
+	struct alloc_requests req;
+	struct solver_state *xrs;
+	int i, ret = 0;
+
+	xrs = xrs_test_init_clks(test, ARRAY_SIZE(start_cols), 0, clks, ARRAY_SIZE(clks));
+	for (i = 0; i < ARRAY_SIZE(xrs_dpm_trace); i++) {
+		step = &xrs_dpm_trace[i];
+
+		memset(&req, 0, sizeof(req));
+		req.rid = step->rid;
+		req.cdo.start_cols = start_cols;
+		req.cdo.cols_len = ARRAY_SIZE(start_cols);
+		req.cdo.ncols = 1;
+		req.cdo.qos_cap.opc = 1000;
+		req.rqos.gops = step->gops;
+		req.rqos.fps = step->fps;
+
+		switch (step->op) {
+		case XRS_TEST_ALLOC:
+			ret = xrs_allocate_resource(xrs, &req, NULL);
+			break;
+		case XRS_TEST_RELEASE:
+			ret = xrs_release_resource(xrs, step->rid);
+			break;
+		case XRS_TEST_QOS:
+			ret = xrs_update_qos(xrs, step->rid, &req.rqos);
+			break;
+		case XRS_TEST_IDLE:
+		case XRS_TEST_BUSY:
+			ret = xrs_set_idle(xrs, step->rid, step->op == XRS_TEST_IDLE);
+			break;
+		}
+
+		KUNIT_ASSERT_EQ_MSG(test, ret, 0, "step %d op %d", i, step->op);
+		KUNIT_ASSERT_EQ_MSG(test, xrs_test_dpm_level, step->expect, "step %d", i);
+	}
+}
+
+#define XRS_TRACE_ALLOC		0
+#define XRS_TRACE_RELEASE	1
+
+struct xrs_trace_step {
+	u32	op;		/* XRS_TRACE_ALLOC or XRS_TRACE_RELEASE */
+	u32	ncols;		/* # columns to allocate */
+	u64	rid;
+};
+
+struct xrs_trace_stats {
+	u32	allocs;
+	u32	rejects;
+	u32	shared;		/* Allocations sharing a partition */
+	u32	migrations;	/* Contexts moved by compaction */
+	u32	invalid;	/* Skipped allocation steps */
+};
+
+/*
+ * Replay an allocation trace on an empty solver and empty it again. Every
+ * context is idle, so it can always be moved when XRS_FLAG_COMPACT is set. A
+ * request can start at any column. Allocating a rid in use, or a bad column
+ * count, is counted as invalid and releasing an unknown rid is ignored.
+ */
+static void xrs_test_replay(struct solver_state *xrs, const struct xrs_trace_step *steps,
+			    u32 nsteps, struct xrs_trace_stats *stats)
+{
+	u32 total_col = xrs->cfg.total_col;
+	const struct xrs_trace_step *step;
+	struct solver_node *node;
+	u32 i;
+
+	memset(stats, 0, sizeof(*stats));
+	xrs_test_migrations = 0;
+	for (i = 0; i < nsteps; i++) {
+		step = &steps[i];
+		if (step->op == XRS_TRACE_RELEASE) {
+			if (rg_search_node(&xrs->rgp, step->rid))
+				xrs_release_resource(xrs, step->rid);
+			continue;
+		}
+
+		if (!step->ncols || step->ncols > total_col || rg_search_node(&xrs->rgp, step->rid)) {
+			stats->invalid++;
+			continue;
+		}
+
+		stats->allocs++;
+		if (xrs_test_alloc(xrs, step->rid, step->ncols)) {
+			stats->rejects++;
+			continue;
+		}
+
+		node = rg_search_node(&xrs->rgp, step->rid);
+		if (node->pt_node->nshared > 1)
+			stats->shared++;
+	}
+	stats->migrations = xrs_test_migrations;
+
+	xrs_test_fini(xrs);
+}
+
+/*
+ * Replay a trace with every placement policy. Best fit never rejects more
+ * than first fit on this trace, and compaction never rejects more than best
+ * fit alone.
+ */
+static void solver_test_replay(struct kunit *test)
+{
+	static const struct xrs_trace_step steps[] = {
+		{ XRS_TRACE_ALLOC, 3, 1 }, { XRS_TRACE_ALLOC, 1, 2 },
+		{ XRS_TRACE_ALLOC, 2, 3 }, { XRS_TRACE_ALLOC, 1, 4 },
+		{ XRS_TRACE_RELEASE, 0, 1 },
+		{ XRS_TRACE_ALLOC, 1, 5 }, { XRS_TRACE_ALLOC, 2, 6 },
+		{ XRS_TRACE_RELEASE, 0, 3 },
+		{ XRS_TRACE_ALLOC, 3, 7 }, { XRS_TRACE_ALLOC, 4, 8 },
+		/* Invalid steps */
+		{ XRS_TRACE_ALLOC, 0, 9 }, { XRS_TRACE_ALLOC, 9, 9 }, { XRS_TRACE_ALLOC, 1, 2 },
+		{ XRS_TRACE_RELEASE, 0, 100 },
+	};
+	struct xrs_trace_stats first, best, compact;
+
+	xrs_test_replay(xrs_test_init(test, 8, 0), steps, ARRAY_SIZE(steps), &first);
+	xrs_test_replay(xrs_test_init(test, 8, XRS_FLAG_BEST_FIT), steps,
+			ARRAY_SIZE(steps), &best);
+	xrs_test_replay(xrs_test_init(test, 8, XRS_FLAG_BEST_FIT | XRS_FLAG_COMPACT), steps,
+			ARRAY_SIZE(steps), &compact);
+	kunit_info(test, "rejects: first fit %u, best fit %u, compact %u, moved %u\n",
+		   first.rejects, best.rejects, compact.rejects, compact.migrations);
+
+	KUNIT_EXPECT_EQ(test, first.allocs, 8);
+	KUNIT_EXPECT_EQ(test, first.invalid, 3);
+	KUNIT_EXPECT_EQ(test, first.migrations, 0);
+	KUNIT_EXPECT_EQ(test, best.migrations, 0);
+	KUNIT_EXPECT_LE(test, best.rejects, first.rejects);
+	KUNIT_EXPECT_LE(test, compact.rejects, best.rejects);
+}
+
+/*
+ * Allocation churn on an 8 columns array. Up to 6 contexts live at a time,
+ * of 1 to 4 columns, so both placement and sharing are exercised.
+ */
+#define XRS_BENCH_ALLOCS	2048
+#define XRS_BENCH_LIVE		6
+
+static void solver_bench_churn(struct kunit *test)
+{
+	static const u32 policies[] = {
+		0, XRS_FLAG_BEST_FIT, XRS_FLAG_BEST_FIT | XRS_FLAG_COMPACT
+	};
+	u64 round_ns[AMDXDNA_KUNIT_BENCH_ROUNDS];
+	struct xrs_trace_stats stats;
+	struct xrs_trace_step *steps;
+	struct solver_state *xrs;
+	u32 i, n = 0, round, p;
+	char name[48];
+	u64 start;
+
+	steps = kunit_kcalloc(test, 2 * XRS_BENCH_ALLOCS, sizeof(*steps), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, steps);
+	for (i = 0; i < XRS_BENCH_ALLOCS; i++) {
+		steps[n].op = XRS_TRACE_ALLOC;
+		steps[n].ncols = hash_32(i, 2) + 1;
+		steps[n++].rid = i;
+		if (i < XRS_BENCH_LIVE)
+			continue;
+		steps[n].op = XRS_TRACE_RELEASE;
+		steps[n++].rid = i - XRS_BENCH_LIVE;
+	}
+	for (i = XRS_BENCH_ALLOCS - XRS_BENCH_LIVE; i < XRS_BENCH_ALLOCS; i++) {
+		steps[n].op = XRS_TRACE_RELEASE;
+		steps[n++].rid = i;
+	}
+
+	for (p = 0; p < ARRAY_SIZE(policies); p++) {
+		xrs = xrs_test_init(test, 8, policies[p]);
+		for (round = 0; round < AMDXDNA_KUNIT_BENCH_ROUNDS; round++) {
+			start = ktime_get_ns();
+			xrs_test_replay(xrs, steps, n, &stats);
+			round_ns[round] = ktime_get_ns() - start;
+		}
+
+		snprintf(name, sizeof(name), "flags 0x%x, %u rejects", policies[p], stats.rejects);
+		amdxdna_kunit_bench_report(test, name, n, round_ns);
+	}
+}
+
+static struct kunit_case solver_test_cases[] = {
+	KUNIT_CASE(solver_test_first_fit),
+	KUNIT_CASE(solver_test_best_fit),
+	KUNIT_CASE(solver_test_share),
+	KUNIT_CASE(solver_test_compact),
+	KUNIT_CASE(solver_test_bad_request),
+	KUNIT_CASE(solver_test_dpm),
+	KUNIT_CASE(solver_test_replay),
+	KUNIT_CASE_SLOW(solver_bench_churn),
+	{}
+};
+
+static struct kunit_suite solver_test_suite = {
+	.name = "amdxdna_solver",
+	.test_cases = solver_test_cases,
+};
+
+kunit_test_suite(solver_test_suite);
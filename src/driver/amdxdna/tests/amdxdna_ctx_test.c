@@ -0,0 +1,255 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2024, Advanced Micro Devices, Inc.
+ */
+
+/*
+ * BO locking tests, included at the end of amdxdna_ctx.c. Jobs reference
+ * bare GEM objects, only their reservation objects are set up.
+ */
+
+#include <linux/delay.h>
+#include <linux/kthread.h>
+
+#include "amdxdna_kunit.h"
+
+struct ctx_test_env {
+	struct amdxdna_client	client;
+	struct amdxdna_hwctx	hwctx;
+	struct drm_gem_object	*objs;
+	u32			nobjs;
+};
+
+static void ctx_test_env_fini(void *data)
+{
+	struct ctx_test_env *env = data;
+	u32 i;
+
+	for (i = 0; i < env->nobjs; i++)
+		dma_resv_fini(env->objs[i].resv);
+}
+
+static struct ctx_test_env *ctx_test_env_init(struct kunit *test, u32 nobjs)
+{
+	struct ctx_test_env *env;
+	u32 i;
+
+	env = kunit_kzalloc(test, sizeof(*env), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, env);
+	env->objs = kunit_kcalloc(test, nobjs, sizeof(*env->objs), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, env->objs);
+
+	env->client.xdna = amdxdna_kunit_xdna(test);
+	env->hwctx.client = &env->client;
+	env->nobjs = nobjs;
+	for (i = 0; i < nobjs; i++) {
+		env->objs[i].resv = &env->objs[i]._resv;
+		dma_resv_init(env->objs[i].resv);
+	}
+	KUNIT_ASSERT_EQ(test, kunit_add_action_or_reset(test, ctx_test_env_fini, env), 0);
+
+	return env;
+}
+
+/* A job referencing objs[idx[0]], objs[idx[1]] ... */
+static struct amdxdna_sched_job *
+ctx_test_job(struct kunit *test, struct ctx_test_env *env, const u32 *idx, u32 cnt)
+{
+	struct amdxdna_sched_job *job;
+	u32 i;
+
+	job = kunit_kzalloc(test, struct_size(job, bos, cnt), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, job);
+
+	job->bo_cnt = cnt;
+	job->hwctx = &env->hwctx;
+	for (i = 0; i < cnt; i++) {
+		KUNIT_ASSERT_LT(test, idx[i], env->nobjs);
+		job->bos[i].obj = &env->objs[idx[i]];
+	}
+
+	return job;
+}
+
+static void ctx_test_expect_unlocked(struct kunit *test, struct ctx_test_env *env)
+{
+	u32 i;
+
+	for (i = 0; i < env->nobjs; i++)
+		KUNIT_EXPECT_FALSE_MSG(test, dma_resv_is_locked(env->objs[i].resv), "obj %u", i);
+}
+
+static void ctx_test_lock_all(struct kunit *test)
+{
+	struct ctx_test_env *env = ctx_test_env_init(test, 8);
+	static const u32 idx[] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+	struct amdxdna_sched_job *job;
+	struct ww_acquire_ctx ctx;
+	u32 i;
+
+	job = ctx_test_job(test, env, idx, ARRAY_SIZE(idx));
+	KUNIT_ASSERT_EQ(test, amdxdna_lock_objects(job, &ctx), 0);
+	for (i = 0; i < job->bo_cnt; i++) {
+		KUNIT_EXPECT_TRUE(test, job->bos[i].locked);
+		KUNIT_EXPECT_TRUE(test, dma_resv_is_locked(job->bos[i].obj->resv));
+	}
+
+	amdxdna_unlock_objects(job, &ctx);
+	for (i = 0; i < job->bo_cnt; i++)
+		KUNIT_EXPECT_FALSE(test, job->bos[i].locked);
+	ctx_test_expect_unlocked(test, env);
+}
+
+/* A BO given twice is locked once, the second reference is not marked */
+static void ctx_test_lock_duplicate(struct kunit *test)
+{
+	struct ctx_test_env *env = ctx_test_env_init(test, 3);
+	static const u32 idx[] = { 0, 1, 0, 2, 1 };
+	static const bool expect[] = { true, true, false, true, false };
+	struct amdxdna_sched_job *job;
+	struct ww_acquire_ctx ctx;
+	u32 i;
+
+	job = ctx_test_job(test, env, idx, ARRAY_SIZE(idx));
+	KUNIT_ASSERT_EQ(test, amdxdna_lock_objects(job, &ctx), 0);
+	for (i = 0; i < job->bo_cnt; i++)
+		KUNIT_EXPECT_EQ_MSG(test, job->bos[i].locked, expect[i], "bo %u", i);
+
+	amdxdna_unlock_objects(job, &ctx);
+	ctx_test_expect_unlocked(test, env);
+}
+
+#define CTX_TEST_HOLD_MS	50
+
+struct ctx_test_holder {
+	struct drm_gem_object	*obj;
+	struct drm_gem_object	*first;
+	struct completion	locked;
+	struct completion	done;
+	bool			backed_off;
+};
+
+/*
+ * Holds @obj with an older acquire context than the job's, then checks the
+ * job dropped @first while it waits for @obj.
+ */
+static int ctx_test_holder_fn(void *data)
+{
+	struct ctx_test_holder *h = data;
+	struct ww_acquire_ctx ctx;
+	int ret;
+
+	ww_acquire_init(&ctx, &reservation_ww_class);
+	ret = dma_resv_lock(h->obj->resv, &ctx);
+	WARN_ON(ret);
+	complete(&h->locked);
+
+	msleep(CTX_TEST_HOLD_MS);
+	if (dma_resv_trylock(h->first->resv)) {
+		h->backed_off = true;
+		dma_resv_unlock(h->first->resv);
+	}
+
+	dma_resv_unlock(h->obj->resv);
+	ww_acquire_fini(&ctx);
+	complete(&h->done);
+	return 0;
+}
+
+/*
+ * The job is younger, so it gets -EDEADLK on the held BO, backs off, sleeps
+ * on it and then takes the rest again.
+ */
+static void ctx_test_lock_contended(struct kunit *test)
+{
+	struct ctx_test_env *env = ctx_test_env_init(test, 8);
+	static const u32 idx[] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+	struct ctx_test_holder *holder;
+	struct amdxdna_sched_job *job;
+	struct task_struct *task;
+	struct ww_acquire_ctx ctx;
+	s64 elapsed;
+	ktime_t start;
+	int ret;
+	u32 i;
+
+	job = ctx_test_job(test, env, idx, ARRAY_SIZE(idx));
+	holder = kunit_kzalloc(test, sizeof(*holder), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, holder);
+	holder->obj = &env->objs[5];
+	holder->first = &env->objs[0];
+	init_completion(&holder->locked);
+	init_completion(&holder->done);
+
+	task = kthread_run(ctx_test_holder_fn, holder, "amdxdna_kunit");
+	KUNIT_ASSERT_FALSE(test, IS_ERR(task));
+
+	/* No assertion until the holder is done, it uses the test memory */
+	wait_for_completion(&holder->locked);
+	start = ktime_get();
+	ret = amdxdna_lock_objects(job, &ctx);
+	elapsed = ktime_ms_delta(ktime_get(), start);
+	wait_for_completion(&holder->done);
+
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	KUNIT_EXPECT_TRUE(test, holder->backed_off);
+	KUNIT_EXPECT_GE(test, elapsed, CTX_TEST_HOLD_MS / 2);
+	for (i = 0; i < job->bo_cnt; i++)
+		KUNIT_EXPECT_TRUE(test, job->bos[i].locked);
+
+	amdxdna_unlock_objects(job, &ctx);
+	ctx_test_expect_unlocked(test, env);
+}
+
+/* Uncontended lock and unlock of a job */
+static void ctx_bench_lock_job(struct kunit *test, u32 cnt, u32 iters)
+{
+	struct ctx_test_env *env = ctx_test_env_init(test, cnt);
+	u64 round_ns[AMDXDNA_KUNIT_BENCH_ROUNDS];
+	struct amdxdna_sched_job *job;
+	struct ww_acquire_ctx ctx;
+	u32 *idx, i, round;
+	char name[32];
+	u64 start;
+
+	idx = kunit_kcalloc(test, cnt, sizeof(*idx), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, idx);
+	for (i = 0; i < cnt; i++)
+		idx[i] = i;
+	job = ctx_test_job(test, env, idx, cnt);
+
+	for (round = 0; round < AMDXDNA_KUNIT_BENCH_ROUNDS; round++) {
+		start = ktime_get_ns();
+		for (i = 0; i < iters; i++) {
+			KUNIT_ASSERT_EQ(test, amdxdna_lock_objects(job, &ctx), 0);
+			amdxdna_unlock_objects(job, &ctx);
+		}
+		round_ns[round] = ktime_get_ns() - start;
+		cond_resched();
+	}
+
+	snprintf(name, sizeof(name), "%u BOs", cnt);
+	amdxdna_kunit_bench_report(test, name, iters, round_ns);
+}
+
+static void ctx_bench_lock(struct kunit *test)
+{
+	ctx_bench_lock_job(test, 1, 100000);
+	ctx_bench_lock_job(test, 16, 10000);
+	ctx_bench_lock_job(test, 64, 2000);
+}
+
+static struct kunit_case ctx_test_cases[] = {
+	KUNIT_CASE(ctx_test_lock_all),
+	KUNIT_CASE(ctx_test_lock_duplicate),
+	KUNIT_CASE(ctx_test_lock_contended),
+	KUNIT_CASE_SLOW(ctx_bench_lock),
+	{}
+};
+
+static struct kunit_suite ctx_test_suite = {
+	.name = "amdxdna_ctx",
+	.test_cases = ctx_test_cases,
+};
+
+kunit_test_suite(ctx_test_suite);
@@ -0,0 +1,224 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2024, Advanced Micro Devices, Inc.
+ */
+
+/*
+ * BO cache flush tests, included at the end of amdxdna_gem.c. The BO is a
+ * bare amdxdna_gem_obj over separately allocated pages. Range split tests
+ * redirect the flush helpers to record what would be flushed.
+ */
+
+#include "amdxdna_kunit.h"
+
+#define GEM_TEST_PAGES		8
+
+struct gem_test_bo {
+	struct amdxdna_gem_obj	*abo;
+	struct page		**pages;
+	u32			npages;
+};
+
+struct gem_test_flush {
+	struct gem_test_bo	*bo;
+	u32			calls;
+	/* Flushed bytes [lo, hi) of each page, hi is 0 if not flushed */
+	u32			lo[GEM_TEST_PAGES];
+	u32			hi[GEM_TEST_PAGES];
+};
+
+static void gem_test_bo_fini(void *data)
+{
+	struct gem_test_bo *bo = data;
+	u32 i;
+
+	for (i = 0; i < bo->npages; i++) {
+		if (bo->pages[i])
+			__free_page(bo->pages[i]);
+	}
+}
+
+static struct gem_test_bo *gem_test_bo_init(struct kunit *test, u32 npages)
+{
+	struct gem_test_bo *bo;
+	u32 i;
+
+	bo = kunit_kzalloc(test, sizeof(*bo), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, bo);
+	bo->abo = kunit_kzalloc(test, sizeof(*bo->abo), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, bo->abo);
+	bo->pages = kunit_kcalloc(test, npages, sizeof(*bo->pages), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, bo->pages);
+	bo->npages = npages;
+	KUNIT_ASSERT_EQ(test, kunit_add_action_or_reset(test, gem_test_bo_fini, bo), 0);
+
+	for (i = 0; i < npages; i++) {
+		bo->pages[i] = alloc_page(GFP_KERNEL);
+		KUNIT_ASSERT_NOT_NULL(test, bo->pages[i]);
+	}
+
+	bo->abo->type = AMDXDNA_BO_DEV;
+	bo->abo->mem.pages = bo->pages;
+	bo->abo->mem.nr_pages = npages;
+	bo->abo->mem.size = (size_t)npages << PAGE_SHIFT;
+	to_gobj(bo->abo)->dev = &amdxdna_kunit_xdna(test)->ddev;
+
+	return bo;
+}
+
+static void gem_test_record(struct kunit *test, u32 idx, u32 lo, u32 hi)
+{
+	struct gem_test_flush *fl = test->priv;
+
+	KUNIT_ASSERT_LT(test, idx, fl->bo->npages);
+	KUNIT_EXPECT_EQ_MSG(test, fl->hi[idx], 0, "page %u flushed twice", idx);
+	fl->lo[idx] = lo;
+	fl->hi[idx] = hi;
+}
+
+static void gem_test_stub_virt_range(void *addr, unsigned long length)
+{
+	struct kunit *test = kunit_get_current_test();
+	struct gem_test_flush *fl = test->priv;
+	void *page_addr;
+	u32 i, off;
+
+	fl->calls++;
+	for (i = 0; i < fl->bo->npages; i++) {
+		page_addr = page_to_virt(fl->bo->pages[i]);
+		if (addr < page_addr || addr >= page_addr + PAGE_SIZE)
+			continue;
+
+		/* Pages are not virtually contiguous, a range must not cross one */
+		off = addr - page_addr;
+		KUNIT_EXPECT_LE(test, off + length, PAGE_SIZE);
+		gem_test_record(test, i, off, off + length);
+		return;
+	}
+
+	KUNIT_FAIL(test, "flush of %lu bytes out of the BO", length);
+}
+
+static void gem_test_stub_pages(struct page *pages[], unsigned long num_pages)
+{
+	struct kunit *test = kunit_get_current_test();
+	struct gem_test_flush *fl = test->priv;
+	long idx = pages - fl->bo->pages;
+	unsigned long i;
+
+	fl->calls++;
+	KUNIT_ASSERT_GE(test, idx, 0);
+	for (i = 0; i < num_pages; i++)
+		gem_test_record(test, idx + i, 0, PAGE_SIZE);
+}
+
+/*
+ * Every page of the range flushed once, exactly its part of the range, in
+ * at most 3 calls: the first page, the middle pages and the last page.
+ */
+static void gem_test_check(struct kunit *test, struct gem_test_flush *fl, int n,
+			   u32 start, u32 size)
+{
+	u32 end = start + size;
+	u32 pstart, lo, hi, i;
+
+	KUNIT_EXPECT_LE_MSG(test, fl->calls, 3, "range %d", n);
+	for (i = 0; i < fl->bo->npages; i++) {
+		pstart = i * PAGE_SIZE;
+		lo = max(start, pstart);
+		hi = min(end, pstart + (u32)PAGE_SIZE);
+		if (lo >= hi) {
+			KUNIT_EXPECT_EQ_MSG(test, fl->hi[i], 0, "range %d page %u", n, i);
+			continue;
+		}
+
+		KUNIT_EXPECT_EQ_MSG(test, fl->lo[i], lo - pstart, "range %d page %u", n, i);
+		KUNIT_EXPECT_EQ_MSG(test, fl->hi[i], hi - pstart, "range %d page %u", n, i);
+	}
+}
+
+static void gem_test_clflush_split(struct kunit *test)
+{
+	static const struct {
+		u32	start;
+		u32	size;
+	} ranges[] = {
+		{ 0, 64 },
+		{ 100, 200 },
+		{ PAGE_SIZE - 4, 4 },
+		{ 0, PAGE_SIZE },
+		{ PAGE_SIZE - 64, 128 },
+		{ 0, 3 * PAGE_SIZE },
+		{ 2 * PAGE_SIZE, 2 * PAGE_SIZE },
+		{ 3 * PAGE_SIZE, PAGE_SIZE + 4 },
+		{ PAGE_SIZE + 8, 3 * PAGE_SIZE },
+		{ PAGE_SIZE + 100, 2 * PAGE_SIZE - 100 },
+		{ 0, GEM_TEST_PAGES * PAGE_SIZE },
+		{ 4, GEM_TEST_PAGES * PAGE_SIZE - 8 },
+	};
+	struct gem_test_bo *bo = gem_test_bo_init(test, GEM_TEST_PAGES);
+	struct gem_test_flush *fl;
+	int i;
+
+	fl = kunit_kzalloc(test, sizeof(*fl), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, fl);
+	test->priv = fl;
+	kunit_activate_static_stub(test, amdxdna_clflush_virt_range, gem_test_stub_virt_range);
+	kunit_activate_static_stub(test, amdxdna_clflush_pages, gem_test_stub_pages);
+
+	for (i = 0; i < ARRAY_SIZE(ranges); i++) {
+		memset(fl, 0, sizeof(*fl));
+		fl->bo = bo;
+		amdxdna_drm_clflush(bo->abo, ranges[i].start, ranges[i].size);
+		gem_test_check(test, fl, i, ranges[i].start, ranges[i].size);
+	}
+}
+
+/* Real flushes of a 1MB BO, for the cost of the split against the flush */
+static void gem_bench_clflush(struct kunit *test)
+{
+	static const struct {
+		u32	start;
+		u32	size;
+	} ranges[] = {
+		{ 0, 64 },
+		{ 0, PAGE_SIZE },
+		{ 64, PAGE_SIZE },
+		{ 0, 16 * PAGE_SIZE },
+		{ 0, 256 * PAGE_SIZE },
+		{ 64, 256 * PAGE_SIZE - 128 },
+	};
+	struct gem_test_bo *bo = gem_test_bo_init(test, 256);
+	u64 round_ns[AMDXDNA_KUNIT_BENCH_ROUNDS];
+	u32 i, it, iters, round;
+	char name[48];
+	u64 start;
+
+	for (i = 0; i < ARRAY_SIZE(ranges); i++) {
+		/* About 64MB flushed a round */
+		iters = clamp_t(u32, SZ_64M / ranges[i].size, 16, 100000);
+		for (round = 0; round < AMDXDNA_KUNIT_BENCH_ROUNDS; round++) {
+			start = ktime_get_ns();
+			for (it = 0; it < iters; it++)
+				amdxdna_drm_clflush(bo->abo, ranges[i].start, ranges[i].size);
+			round_ns[round] = ktime_get_ns() - start;
+			cond_resched();
+		}
+
+		snprintf(name, sizeof(name), "0x%x bytes at 0x%x", ranges[i].size, ranges[i].start);
+		amdxdna_kunit_bench_report(test, name, iters, round_ns);
+	}
+}
+
+static struct kunit_case gem_test_cases[] = {
+	KUNIT_CASE(gem_test_clflush_split),
+	KUNIT_CASE_SLOW(gem_bench_clflush),
+	{}
+};
+
+static struct kunit_suite gem_test_suite = {
+	.name = "amdxdna_gem",
+	.test_cases = gem_test_cases,
+};
+
+kunit_test_suite(gem_test_suite);
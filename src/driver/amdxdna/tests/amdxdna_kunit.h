@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Copyright (C) 2024, Advanced Micro Devices, Inc.
+ */
+
+#ifndef _AMDXDNA_KUNIT_H_
+#define _AMDXDNA_KUNIT_H_
+
+#include <kunit/device.h>
+#include <kunit/test.h>
+#include <linux/ktime.h>
+#include <linux/version.h>
+
+#include "amdxdna_drm.h"
+
+#if KERNEL_VERSION(6, 8, 0) > LINUX_VERSION_CODE
+#error "amdxdna KUnit suites need kernel 6.8 or newer"
+#endif
+
+/*
+ * Shared bits of the driver KUnit suites. A suite is a tests/<file>_test.c
+ * included at the end of <file>.c when built with AMDXDNA_KUNIT=y, so it can
+ * reach the static functions it tests.
+ */
+
+/* Rounds of a microbenchmark. The best one is reported with the average */
+#define AMDXDNA_KUNIT_BENCH_ROUNDS	5
+
+/*
+ * amdxdna_kunit_xdna() - A zeroed device for the driver log macros, backed
+ *                        by a KUnit device released with the test.
+ */
+static inline struct amdxdna_dev *amdxdna_kunit_xdna(struct kunit *test)
+{
+	static atomic_t id = ATOMIC_INIT(0);
+	struct amdxdna_dev *xdna;
+	struct device *dev;
+	char name[64];
+
+	xdna = kunit_kzalloc(test, sizeof(*xdna), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, xdna);
+
+	/* Device names must be unique, a test may want more than one */
+	snprintf(name, sizeof(name), "%s.%d", test->name, atomic_inc_return(&id));
+	dev = kunit_device_register(test, name);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, dev);
+	xdna->ddev.dev = dev;
+
+	return xdna;
+}
+
+/*
+ * amdxdna_kunit_bench_report() - Report per iteration time of a benchmark.
+ *
+ * @test:	The running test
+ * @name:	What was measured
+ * @iters:	Iterations of each round
+ * @round_ns:	Time of each round, AMDXDNA_KUNIT_BENCH_ROUNDS entries
+ *
+ * Benchmarks never fail. Compare the numbers of a change against its parent
+ * on the same machine.
+ */
+static inline void amdxdna_kunit_bench_report(struct kunit *test, const char *name,
+					      u32 iters, const u64 *round_ns)
+{
+	u64 best = U64_MAX, total = 0;
+	int i;
+
+	for (i = 0; i < AMDXDNA_KUNIT_BENCH_ROUNDS; i++) {
+		best = min(best, round_ns[i]);
+		total += round_ns[i];
+	}
+
+	kunit_info(test, "%s: %u iters, best %llu ns/iter, avg %llu ns/iter\n", name, iters,
+		   div_u64(best, iters), div_u64(total, iters * AMDXDNA_KUNIT_BENCH_ROUNDS));
+}
+
+#endif /* _AMDXDNA_KUNIT_H_ */
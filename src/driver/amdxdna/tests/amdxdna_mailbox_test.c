@@ -0,0 +1,398 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2024, Advanced Micro Devices, Inc.
+ */
+
+/*
+ * Mailbox ring tests, included at the end of amdxdna_mailbox.c.
+ *
+ * The mailbox registers and both rings are plain kernel memory. The test
+ * plays firmware: it consumes the X2I ring and echoes every message back on
+ * the I2X ring, with the same tombstone rule as the host. There is no IRQ,
+ * the test drives the RX side by calling mailbox_get_msg() itself.
+ */
+
+#include "amdxdna_kunit.h"
+
+#define MB_TEST_X2I_HEAD	0x0
+#define MB_TEST_X2I_TAIL	0x4
+#define MB_TEST_I2X_HEAD	0x8
+#define MB_TEST_I2X_TAIL	0xc
+#define MB_TEST_IOHUB		0x10
+#define MB_TEST_REGS_SIZE	0x20
+
+struct mb_test_env {
+	struct kunit		*test;
+	struct mailbox		mb;
+	struct mailbox_channel	chann;
+	void			*regs;
+	u8			*x2i;
+	u8			*i2x;
+	u32			rb_size;
+
+	/* Firmware side */
+	u32			i2x_tail;
+	u32			x2i_tombstones;
+	u32			i2x_tombstones;
+};
+
+struct mb_test_resp {
+	u32	seq;
+	u32	size;
+	int	calls;
+	bool	bad;
+};
+
+static void mb_test_env_fini(void *data)
+{
+	struct mb_test_env *env = data;
+	struct mailbox_msg *mb_msg;
+	unsigned long msg_id;
+
+	/* Not notified, the handles may be gone with an aborted test */
+	xa_for_each(&env->chann.chan_xa, msg_id, mb_msg)
+		kfree(mb_msg);
+	xa_destroy(&env->chann.chan_xa);
+}
+
+static struct mb_test_env *mb_test_env_init(struct kunit *test, u32 rb_size)
+{
+	struct xdna_mailbox_chann_res *res;
+	struct mb_test_env *env;
+	u8 *ring;
+
+	env = kunit_kzalloc(test, sizeof(*env), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, env);
+	env->regs = kunit_kzalloc(test, MB_TEST_REGS_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, env->regs);
+	ring = kunit_kzalloc(test, 2 * rb_size, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ring);
+
+	env->test = test;
+	env->rb_size = rb_size;
+	env->x2i = ring;
+	env->i2x = ring + rb_size;
+
+	env->mb.dev = amdxdna_kunit_xdna(test)->ddev.dev;
+	env->mb.res.ringbuf_base = (u64)ring;
+	env->mb.res.ringbuf_size = 2 * rb_size;
+	env->mb.res.mbox_base = (u64)env->regs;
+	env->mb.res.mbox_size = MB_TEST_REGS_SIZE;
+	env->mb.res.name = "kunit";
+
+	env->chann.mb = &env->mb;
+	env->chann.type = MB_CHANNEL_USER_NORMAL;
+	env->chann.iohub_int_addr = MB_TEST_IOHUB;
+	res = &env->chann.res[CHAN_RES_X2I];
+	res->rb_start_addr = 0;
+	res->rb_size = rb_size;
+	res->mb_head_ptr_reg = MB_TEST_X2I_HEAD;
+	res->mb_tail_ptr_reg = MB_TEST_X2I_TAIL;
+	res = &env->chann.res[CHAN_RES_I2X];
+	res->rb_start_addr = rb_size;
+	res->rb_size = rb_size;
+	res->mb_head_ptr_reg = MB_TEST_I2X_HEAD;
+	res->mb_tail_ptr_reg = MB_TEST_I2X_TAIL;
+	xa_init_flags(&env->chann.chan_xa, XA_FLAGS_ALLOC | XA_FLAGS_LOCK_IRQ);
+#if defined(CONFIG_DEBUG_FS)
+	env->chann.record = kunit_kzalloc(test, sizeof(*env->chann.record), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, env->chann.record);
+#endif
+	KUNIT_ASSERT_EQ(test, kunit_add_action_or_reset(test, mb_test_env_fini, env), 0);
+
+	return env;
+}
+
+/* Firmware posts a message on the I2X ring */
+static int mb_test_fw_post(struct mb_test_env *env, const struct xdna_msg_header *header,
+			   const void *payload)
+{
+	u32 size = sizeof(*header) + header->total_size;
+	u32 head = readl(env->regs + MB_TEST_I2X_HEAD);
+	u32 tail = env->i2x_tail;
+
+	if (tail < head && tail + size >= head)
+		return -ENOSPC;
+
+	if (tail >= head && tail + size > env->rb_size - sizeof(u32)) {
+		if (size >= head)
+			return -ENOSPC;
+
+		writel(TOMBSTONE, env->i2x + tail);
+		env->i2x_tombstones++;
+		tail = 0;
+	}
+
+	memcpy(env->i2x + tail, header, sizeof(*header));
+	memcpy(env->i2x + tail + sizeof(*header), payload, header->total_size);
+	env->i2x_tail = tail + size;
+	writel(env->i2x_tail, env->regs + MB_TEST_I2X_TAIL);
+	return 0;
+}
+
+/* Firmware consumes the X2I ring and echoes each message. Return # echoed */
+static int mb_test_fw_echo(struct mb_test_env *env)
+{
+	u32 head = readl(env->regs + MB_TEST_X2I_HEAD);
+	u32 tail = readl(env->regs + MB_TEST_X2I_TAIL);
+	struct xdna_msg_header header;
+	int cnt = 0;
+
+	while (head != tail) {
+		if (readl(env->x2i + head) == TOMBSTONE) {
+			env->x2i_tombstones++;
+			head = 0;
+			continue;
+		}
+
+		memcpy(&header, env->x2i + head, sizeof(header));
+		KUNIT_ASSERT_EQ(env->test, FIELD_GET(MSG_BODY_SZ, header.sz_ver),
+				header.total_size);
+		if (mb_test_fw_post(env, &header, env->x2i + head + sizeof(header)))
+			break;
+
+		head += sizeof(header) + header.total_size;
+		cnt++;
+	}
+	writel(head, env->regs + MB_TEST_X2I_HEAD);
+
+	return cnt;
+}
+
+/* Host RX pass. Return # messages consumed */
+static int mb_test_host_rx(struct mb_test_env *env)
+{
+	int cnt = 0;
+	int ret;
+
+	while (!(ret = mailbox_get_msg(&env->chann)))
+		cnt++;
+
+	KUNIT_EXPECT_EQ(env->test, ret, -ENOENT);
+	return cnt;
+}
+
+static u32 mb_test_word(u32 seq, u32 i)
+{
+	return (seq << 16) | i;
+}
+
+static int mb_test_notify(void *handle, const u32 *data, size_t size)
+{
+	struct mb_test_resp *resp = handle;
+	u32 i;
+
+	resp->calls++;
+	if (!data) {
+		resp->bad = true;
+		return 0;
+	}
+
+	if (size != resp->size)
+		resp->bad = true;
+	for (i = 0; !resp->bad && i < size / sizeof(u32); i++) {
+		if (data[i] != mb_test_word(resp->seq, i))
+			resp->bad = true;
+	}
+
+	return 0;
+}
+
+static int mb_test_send(struct mb_test_env *env, struct mb_test_resp *resp, u32 seq, u32 size)
+{
+	struct xdna_mailbox_msg msg = { 0 };
+	u32 payload[64];
+	u32 i;
+
+	KUNIT_ASSERT_LE(env->test, size, sizeof(payload));
+	for (i = 0; i < size / sizeof(u32); i++)
+		payload[i] = mb_test_word(seq, i);
+
+	memset(resp, 0, sizeof(*resp));
+	resp->seq = seq;
+	resp->size = size;
+
+	msg.opcode = 0x100 + (seq & 0xf);
+	msg.handle = resp;
+	msg.notify_cb = mb_test_notify;
+	msg.send_data = (u8 *)payload;
+	msg.send_size = size;
+
+	return xdna_mailbox_send_msg(&env->chann, &msg, 0);
+}
+
+static void mb_test_check_resp(struct kunit *test, struct mb_test_resp *resp)
+{
+	KUNIT_EXPECT_EQ_MSG(test, resp->calls, 1, "seq %u", resp->seq);
+	KUNIT_EXPECT_FALSE_MSG(test, resp->bad, "seq %u", resp->seq);
+}
+
+static void mailbox_test_echo(struct kunit *test)
+{
+	struct mb_test_env *env = mb_test_env_init(test, SZ_4K);
+	struct mb_test_resp resp;
+
+	KUNIT_ASSERT_EQ(test, mb_test_send(env, &resp, 1, 16), 0);
+	KUNIT_EXPECT_EQ(test, readl(env->regs + MB_TEST_X2I_TAIL),
+			sizeof(struct xdna_msg_header) + 16);
+	KUNIT_EXPECT_EQ(test, resp.calls, 0);
+
+	KUNIT_EXPECT_EQ(test, mb_test_fw_echo(env), 1);
+	KUNIT_EXPECT_EQ(test, mb_test_host_rx(env), 1);
+	mb_test_check_resp(test, &resp);
+	KUNIT_EXPECT_EQ(test, readl(env->regs + MB_TEST_I2X_HEAD), env->i2x_tail);
+	KUNIT_EXPECT_TRUE(test, mailbox_channel_no_msg(&env->chann));
+}
+
+/*
+ * Up to 3 messages of at most 48 bytes in flight on a 256 bytes ring always
+ * fit, wherever the ring pointers are. Sizes vary so that both rings wrap at
+ * many different offsets.
+ */
+static void mailbox_test_wrap(struct kunit *test)
+{
+	struct mb_test_env *env = mb_test_env_init(test, 256);
+	struct mb_test_resp resp[3];
+	u32 seq = 0, round, size, n, i;
+
+	for (round = 0; round < 200; round++) {
+		n = round % 3 + 1;
+		for (i = 0; i < n; i++, seq++) {
+			size = 4 * (seq * 7 % 8 + 1);
+			KUNIT_ASSERT_EQ_MSG(test, mb_test_send(env, &resp[i], seq, size), 0,
+					    "seq %u", seq);
+		}
+
+		KUNIT_ASSERT_EQ(test, mb_test_fw_echo(env), n);
+		KUNIT_ASSERT_EQ(test, mb_test_host_rx(env), n);
+		for (i = 0; i < n; i++)
+			mb_test_check_resp(test, &resp[i]);
+	}
+
+	KUNIT_EXPECT_GT(test, env->x2i_tombstones, 0);
+	KUNIT_EXPECT_GT(test, env->i2x_tombstones, 0);
+	KUNIT_EXPECT_TRUE(test, mailbox_channel_no_msg(&env->chann));
+}
+
+/*
+ * 32 bytes messages on a 256 bytes ring. The last 4 bytes are for the
+ * tombstone, and a message cannot wrap onto the unread one at offset 0, so 7
+ * fit in an empty ring.
+ */
+static void mailbox_test_full(struct kunit *test)
+{
+	struct mb_test_env *env = mb_test_env_init(test, 256);
+	struct mb_test_resp resp[8];
+	u32 i;
+
+	for (i = 0; i < 7; i++)
+		KUNIT_ASSERT_EQ(test, mb_test_send(env, &resp[i], i, 16), 0);
+	KUNIT_EXPECT_EQ(test, mb_test_send(env, &resp[i], i, 16), -ENOSPC);
+	KUNIT_EXPECT_EQ(test, mb_test_fw_echo(env), 7);
+	KUNIT_EXPECT_EQ(test, mb_test_host_rx(env), 7);
+	for (i = 0; i < 7; i++)
+		mb_test_check_resp(test, &resp[i]);
+	/* The failed send did not leave a message ID behind */
+	KUNIT_EXPECT_TRUE(test, mailbox_channel_no_msg(&env->chann));
+
+	/* Drained, the next one goes over the tombstone to offset 0 */
+	KUNIT_ASSERT_EQ(test, mb_test_send(env, &resp[7], 7, 16), 0);
+	KUNIT_EXPECT_EQ(test, readl(env->x2i + 7 * 32), TOMBSTONE);
+	KUNIT_EXPECT_EQ(test, mb_test_fw_echo(env), 1);
+	KUNIT_EXPECT_EQ(test, mb_test_host_rx(env), 1);
+	mb_test_check_resp(test, &resp[7]);
+#if defined(CONFIG_DEBUG_FS)
+	KUNIT_EXPECT_EQ(test, atomic64_read(&env->chann.record->stats.tx_nospc), 1);
+	KUNIT_EXPECT_EQ(test, atomic64_read(&env->chann.record->stats.tx_msgs), 8);
+	KUNIT_EXPECT_EQ(test, env->chann.record->stats.rx_msgs, 8);
+#endif
+}
+
+static void mailbox_test_bad_resp(struct kunit *test)
+{
+	struct xdna_msg_header header = { 0 };
+	struct mb_test_env *env;
+	struct mb_test_resp resp;
+	u32 payload[2] = { 0 };
+
+	/* Unaligned size */
+	env = mb_test_env_init(test, 256);
+	KUNIT_ASSERT_EQ(test, mb_test_send(env, &resp, 1, 8), 0);
+	header.total_size = 6;
+	header.id = MAGIC_VAL;
+	KUNIT_ASSERT_EQ(test, mb_test_fw_post(env, &header, payload), 0);
+	env->i2x_tail = ALIGN(env->i2x_tail, sizeof(u32));
+	writel(env->i2x_tail, env->regs + MB_TEST_I2X_TAIL);
+	KUNIT_EXPECT_EQ(test, mailbox_get_msg(&env->chann), -EINVAL);
+	KUNIT_EXPECT_EQ(test, resp.calls, 0);
+
+	/* No message with this ID */
+	env = mb_test_env_init(test, 256);
+	KUNIT_ASSERT_EQ(test, mb_test_send(env, &resp, 1, 8), 0);
+	header.total_size = sizeof(payload);
+	header.id = MAGIC_VAL | 5;
+	KUNIT_ASSERT_EQ(test, mb_test_fw_post(env, &header, payload), 0);
+	KUNIT_EXPECT_EQ(test, mailbox_get_msg(&env->chann), -EINVAL);
+	KUNIT_EXPECT_EQ(test, resp.calls, 0);
+
+	/* Bad magic */
+	env = mb_test_env_init(test, 256);
+	KUNIT_ASSERT_EQ(test, mb_test_send(env, &resp, 1, 8), 0);
+	header.id = 0;
+	KUNIT_ASSERT_EQ(test, mb_test_fw_post(env, &header, payload), 0);
+	KUNIT_EXPECT_EQ(test, mailbox_get_msg(&env->chann), -EINVAL);
+	KUNIT_EXPECT_EQ(test, resp.calls, 0);
+}
+
+/*
+ * Send, firmware echo and host RX of @batch messages at a time. The firmware
+ * side is a memcpy, so this is mostly the host ring handling.
+ */
+static void mb_bench_echo(struct kunit *test, u32 size, u32 batch, u32 iters)
+{
+	struct mb_test_env *env = mb_test_env_init(test, SZ_16K);
+	u64 round_ns[AMDXDNA_KUNIT_BENCH_ROUNDS];
+	struct mb_test_resp resp[16];
+	u32 seq = 0, round, it, i;
+	char name[48];
+	u64 start;
+
+	KUNIT_ASSERT_LE(test, batch, ARRAY_SIZE(resp));
+	for (round = 0; round < AMDXDNA_KUNIT_BENCH_ROUNDS; round++) {
+		start = ktime_get_ns();
+		for (it = 0; it < iters; it++) {
+			for (i = 0; i < batch; i++, seq++)
+				KUNIT_ASSERT_EQ(test, mb_test_send(env, &resp[i], seq, size), 0);
+			KUNIT_ASSERT_EQ(test, mb_test_fw_echo(env), batch);
+			KUNIT_ASSERT_EQ(test, mb_test_host_rx(env), batch);
+		}
+		round_ns[round] = ktime_get_ns() - start;
+		cond_resched();
+	}
+
+	snprintf(name, sizeof(name), "%u bytes, batch of %u", size, batch);
+	amdxdna_kunit_bench_report(test, name, iters * batch, round_ns);
+}
+
+static void mailbox_bench_echo(struct kunit *test)
+{
+	mb_bench_echo(test, 32, 1, 10000);
+	mb_bench_echo(test, 32, 16, 1000);
+	mb_bench_echo(test, 240, 16, 1000);
+}
+
+static struct kunit_case mailbox_test_cases[] = {
+	KUNIT_CASE(mailbox_test_echo),
+	KUNIT_CASE(mailbox_test_wrap),
+	KUNIT_CASE(mailbox_test_full),
+	KUNIT_CASE(mailbox_test_bad_resp),
+	KUNIT_CASE_SLOW(mailbox_bench_echo),
+	{}
+};
+
+static struct kunit_suite mailbox_test_suite = {
+	.name = "amdxdna_mailbox",
+	.test_cases = mailbox_test_cases,
+};
+
+kunit_test_suite(mailbox_test_suite);
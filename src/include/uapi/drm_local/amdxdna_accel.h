@@ -52,6 +52,8 @@ enum amdxdna_drm_ioctl_id {
 	DRM_AMDXDNA_GET_INFO,
 	DRM_AMDXDNA_SET_STATE,
 	DRM_AMDXDNA_WAIT_CMD,
+	DRM_AMDXDNA_SYNC_BO_VEC,
+	DRM_AMDXDNA_RESUME,
 };
 
 enum amdxdna_device_type {
@@ -163,6 +165,8 @@ enum amdxdna_drm_config_hwctx_param {
 	DRM_AMDXDNA_HWCTX_CONFIG_CU,
 	DRM_AMDXDNA_HWCTX_ASSIGN_DBG_BUF,
 	DRM_AMDXDNA_HWCTX_REMOVE_DBG_BUF,
+	/* param_val points to struct amdxdna_qos_info */
+	DRM_AMDXDNA_HWCTX_CONFIG_QOS,
 };
 
 /**
@@ -202,10 +206,18 @@ enum amdxdna_bo_type {
 	AMDXDNA_BO_DMA,
 };
 
+/*
+ * AMDXDNA_BO_FLAGS_HUGE_PAGE: Request transparent huge page backing for
+ *			       AMDXDNA_BO_SHMEM. Driver silently falls back
+ *			       to normal pages if huge pages are unavailable.
+ */
+#define AMDXDNA_BO_FLAGS_HUGE_PAGE	(1 << 0)
+
 /**
  * struct amdxdna_drm_create_bo - Create a buffer object.
- * @flags: Buffer flags. MBZ.
- * @vaddr: User VA of buffer if applied. MBZ.
+ * @flags: Buffer flags, see AMDXDNA_BO_FLAGS_*.
+ * @vaddr: Page aligned user VA to create user pointer AMDXDNA_BO_SHMEM from.
+ *	   0 to let driver allocate the memory. MBZ for other BO types.
  * @size: Size in bytes.
  * @type: Buffer type.
  * @handle: Returned DRM buffer object handle.
@@ -254,6 +266,47 @@ struct amdxdna_drm_sync_bo {
 	__u64 size;
 };
 
+/**
+ * struct amdxdna_drm_sync_bo_range - One buffer range of vectored sync.
+ * @handle: Buffer object handle.
+ * @pad: MBZ.
+ * @offset: Offset in the buffer to sync.
+ * @size: Size in bytes.
+ */
+struct amdxdna_drm_sync_bo_range {
+	__u32 handle;
+	__u32 pad;
+	__u64 offset;
+	__u64 size;
+};
+
+/**
+ * struct amdxdna_drm_sync_bo_vec - Sync ranges of multiple buffer objects.
+ * @ranges: Pointer to array of struct amdxdna_drm_sync_bo_range.
+ * @count: Number of ranges, up to AMDXDNA_SYNC_BO_VEC_MAX.
+ * @direction: Direction of sync, can be from device or to device.
+ * @flags: AMDXDNA_SYNC_BO_VEC_ASYNC to not wait for device sync.
+ * @hwctx: Returned hardware context handle which device sync is submitted to,
+ *         AMDXDNA_INVALID_CTX_HANDLE if no device sync is needed.
+ * @seq: Returned sequence number of the last device sync command. It is also
+ *       the timeline point on the syncobj of the hardware context.
+ *
+ * CPU cache is in sync when the ioctl returns. Buffers assigned to a hardware
+ * context also need device sync from device, all of them have to be assigned
+ * to the same hardware context.
+ */
+struct amdxdna_drm_sync_bo_vec {
+	__u64 ranges;
+	__u32 count;
+	__u32 direction;
+#define AMDXDNA_SYNC_BO_VEC_ASYNC	(1 << 0)
+	__u32 flags;
+	__u32 hwctx;
+	__u64 seq;
+};
+
+#define AMDXDNA_SYNC_BO_VEC_MAX		256
+
 enum amdxdna_cmd_type {
 	AMDXDNA_CMD_SUBMIT_EXEC_BUF = 0,
 	AMDXDNA_CMD_SUBMIT_DEPENDENCY,
@@ -439,6 +492,29 @@ struct amdxdna_drm_query_hwctx {
 	__u64 errors;
 };
 
+/**
+ * struct amdxdna_drm_query_hwctx_usage - The usage data for single context.
+ * @context_id: The ID for this context.
+ * @pad: Structure padding.
+ * @pid: The Process ID of the process that created this context.
+ * @busy_ns: Time with at least one command of this context on the device.
+ * @queue_depth_ns: Time integral of commands on the device, divided by elapsed
+ *                  time it is the average queue depth.
+ * @cycles: Busy time in NPU clock cycles.
+ * @jobs: The number of commands completed by this context.
+ *
+ * DRM_AMDXDNA_QUERY_HW_CONTEXT_USAGE returns an array of these, one per context.
+ */
+struct amdxdna_drm_query_hwctx_usage {
+	__u32 context_id;
+	__u32 pad;
+	__s64 pid;
+	__u64 busy_ns;
+	__u64 queue_depth_ns;
+	__u64 cycles;
+	__u64 jobs;
+};
+
 /**
  * struct amdxdna_drm_aie_mem - The data for AIE memory read/write
  * @col:   The AIE column index
@@ -481,6 +557,7 @@ enum amdxdna_power_mode_type {
 	POWER_MODE_MEDIUM,  /**< Set frequency to medium DPM */
 	POWER_MODE_HIGH,    /**< Set frequency to highest DPM */
 	POWER_MODE_TURBO,   /**< More power, more performance */
+	POWER_MODE_DYNAMIC, /**< DPM follows utilization, see dpm_gov_* params */
 };
 
 /**
@@ -531,6 +608,7 @@ enum amdxdna_drm_get_param {
 	DRM_AMDXDNA_GET_POWER_MODE,
 	DRM_AMDXDNA_QUERY_TELEMETRY,
 	DRM_AMDXDNA_GET_FORCE_PREEMPT_STATE,
+	DRM_AMDXDNA_QUERY_HW_CONTEXT_USAGE,
 };
 
 /**
@@ -585,6 +663,22 @@ struct amdxdna_drm_set_state {
 	__u64 buffer; /* in */
 };
 
+/**
+ * struct amdxdna_drm_resume - Resume the device for this client.
+ * @flags: AMDXDNA_RESUME_ASYNC to only start the resume and return.
+ * @pad: MBZ.
+ *
+ * Opening the device does not resume it, ioctls which need the hardware wait
+ * for the resume. This lets user space start it early and prepare buffers
+ * meanwhile.
+ */
+struct amdxdna_drm_resume {
+	__u32 flags;
+	__u32 pad;
+};
+
+#define AMDXDNA_RESUME_ASYNC	(1 << 0)
+
 #define DRM_IOCTL_AMDXDNA_CREATE_HWCTX \
 	DRM_IOWR(DRM_COMMAND_BASE + DRM_AMDXDNA_CREATE_HWCTX, \
 		 struct amdxdna_drm_create_hwctx)
@@ -617,6 +711,10 @@ struct amdxdna_drm_set_state {
 	DRM_IOWR(DRM_COMMAND_BASE + DRM_AMDXDNA_WAIT_CMD, \
 		 struct amdxdna_drm_wait_cmd)
 
+#define DRM_IOCTL_AMDXDNA_SYNC_BO_VEC \
+	DRM_IOWR(DRM_COMMAND_BASE + DRM_AMDXDNA_SYNC_BO_VEC, \
+		 struct amdxdna_drm_sync_bo_vec)
+
 #define DRM_IOCTL_AMDXDNA_GET_INFO \
 	DRM_IOWR(DRM_COMMAND_BASE + DRM_AMDXDNA_GET_INFO, \
 		 struct amdxdna_drm_get_info)
@@ -625,6 +723,10 @@ struct amdxdna_drm_set_state {
 	DRM_IOWR(DRM_COMMAND_BASE + DRM_AMDXDNA_SET_STATE, \
 		 struct amdxdna_drm_set_state)
 
+#define DRM_IOCTL_AMDXDNA_RESUME \
+	DRM_IOWR(DRM_COMMAND_BASE + DRM_AMDXDNA_RESUME, \
+		 struct amdxdna_drm_resume)
+
 #if defined(__cplusplus)
 } /* extern c end */
 #endif
@@ -8,9 +8,11 @@
 namespace {
 
 uint32_t
-alloc_drm_bo(const shim_xdna::pdev& dev, amdxdna_bo_type type, void* buf, size_t size)
+alloc_drm_bo(const shim_xdna::pdev& dev, amdxdna_bo_type type, void* buf, size_t size,
+  uint64_t flags)
 {
   amdxdna_drm_create_bo cbo = {
+    .flags = flags,
     .vaddr = reinterpret_cast<uintptr_t>(buf),
     .size = size,
     .type = static_cast<uint32_t>(type),
@@ -225,11 +227,24 @@ void
 bo::
 alloc_bo()
 {
-  uint32_t boh = alloc_drm_bo(m_pdev, m_type, NULL, m_aligned_size);
+  uint32_t boh;
+
+  try {
+    boh = alloc_drm_bo(m_pdev, m_type, m_userptr, m_aligned_size, m_drm_flags);
+  } catch (const xrt_core::system_error& ex) {
+    // Older driver does not know about BO flags, they are only hints.
+    if (ex.get_code() != EINVAL || !m_drm_flags)
+      throw;
+    shim_debug("Driver rejected BO flags 0x%lx, retry without them", m_drm_flags);
+    m_drm_flags = 0;
+    boh = alloc_drm_bo(m_pdev, m_type, m_userptr, m_aligned_size, m_drm_flags);
+  }
 
   amdxdna_drm_get_bo_info bo_info = {};
   get_drm_bo_info(m_pdev, boh, &bo_info);
   m_bo = std::make_unique<bo::drm_bo>(*this, bo_info);
+  stats_record_bo_alloc(m_type, m_aligned_size);
+  trace_log(TRACE_OP_BO_ALLOC, m_owner_ctx_id, boh, m_aligned_size, m_type);
 }
 
 void
@@ -241,12 +256,18 @@ import_bo()
   amdxdna_drm_get_bo_info bo_info = {};
   get_drm_bo_info(m_pdev, boh, &bo_info);
   m_bo = std::make_unique<bo::drm_bo>(*this, bo_info);
+  trace_log(TRACE_OP_BO_IMPORT, AMDXDNA_INVALID_CTX_HANDLE, boh, m_aligned_size, m_type);
 }
 
 void
 bo::
 free_bo()
 {
+  // Imported BOs are accounted by the process which allocated them
+  if (m_bo && m_import.get_export_handle() == -1)
+    stats_record_bo_free(m_type, m_aligned_size);
+  if (m_bo)
+    trace_log(TRACE_OP_BO_FREE, m_owner_ctx_id, m_bo->m_handle, 0);
   m_bo.reset();
 }
 
@@ -319,6 +340,27 @@ get_cmd_id() const
   return m_cmd_id;
 }
 
+void
+bo::
+set_submit_time()
+{
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  m_submit_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+uint64_t
+bo::
+take_submit_latency()
+{
+  // Only the first caller to see the command done gets the latency
+  auto start = m_submit_ns.exchange(0);
+  if (!start)
+    return 0;
+
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count() - start;
+}
+
 uint32_t
 bo::
 get_drm_bo_handle() const
@@ -10,9 +10,12 @@
 
 #include "shared.h"
 #include "shim_debug.h"
+#include "stats.h"
+#include "trace.h"
 
 #include "core/common/memalign.h"
 #include "core/common/shim/buffer_handle.h"
+#include "bo_flags.h"
 #include "drm_local/amdxdna_accel.h"
 #include <string>
 #include <atomic>
@@ -55,6 +58,12 @@ public:
   // For cmd BO only
   uint64_t
   get_cmd_id() const;
+  // For cmd BO only
+  void
+  set_submit_time();
+  // For cmd BO only, ns since submission, 0 if already taken
+  uint64_t
+  take_submit_latency();
 
   uint32_t
   get_drm_bo_handle() const;
@@ -111,11 +120,15 @@ protected:
   detach_from_ctx();
 
   const pdev& m_pdev;
+  // Application memory backing the BO, only for user ptr BO
+  void* m_userptr = nullptr;
   void* m_parent = nullptr;
   void* m_aligned = nullptr;
   size_t m_parent_size = 0;
   size_t m_aligned_size = 0;
   uint64_t m_flags = 0;
+  // Flags passed to driver when creating DRM BO, see AMDXDNA_BO_FLAGS_*
+  uint64_t m_drm_flags = 0;
   amdxdna_bo_type m_type = AMDXDNA_BO_INVALID;
   std::unique_ptr<drm_bo> m_bo;
   const shared m_import;
@@ -123,6 +136,8 @@ protected:
   // Command ID in the queue after command submission.
   // Only valid for cmd BO.
   uint64_t m_cmd_id = -1;
+  // Submission time for the stats, only valid for cmd BO.
+  std::atomic<uint64_t> m_submit_ns{0};
 
   // Used when exclusively assigned to a HW context. By default, BO is shared
   // among all HW contexts.
@@ -0,0 +1,20 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2024, Advanced Micro Devices, Inc. All rights reserved.
+
+#ifndef _BO_FLAGS_XDNA_H_
+#define _BO_FLAGS_XDNA_H_
+
+// Driver specific BO flags, shared with the tests which request them, so no
+// XRT dependency here.
+
+#include <cstdint>
+
+namespace shim_xdna {
+
+// Carried in the unused upper bits of xcl_bo_flags::extension. Requests huge
+// page backed host memory.
+const uint32_t XDNA_BO_EXT_HUGE_PAGE = (1U << 31);
+
+} // namespace shim_xdna
+
+#endif
@@ -6,6 +6,7 @@
 #include "hwctx.h"
 #include "fence.h"
 #include "smi.h"
+#include "stats.h"
 
 #include "core/common/query_requests.h"
 
@@ -453,6 +454,17 @@ struct firmware_version
   }
 };
 
+struct shim_stats
+{
+  using result_type = shim_xdna::query_shim_stats::result_type;
+
+  static result_type
+  get(const xrt_core::device* device, key_type)
+  {
+    return shim_xdna::stats_to_json();
+  }
+};
+
 struct default_value
 {
 
@@ -846,6 +858,7 @@ initialize_query_table()
   emplace_func1_request<query::xclbin_name,                    xclbin_name>();
   emplace_func1_request<query::xrt_smi_config,                 xrt_smi_config>();
   emplace_func0_request<query::firmware_version,               firmware_version>();
+  emplace_func0_request<shim_xdna::query_shim_stats,           shim_stats>();
 }
 
 struct X { X() { initialize_query_table(); }};
@@ -0,0 +1,286 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2024, Advanced Micro Devices, Inc. All rights reserved.
+
+#include "cert.h"
+#include "../shim_debug.h"
+
+#include <chrono>
+
+namespace {
+
+// Polls before the lead thread starts sleeping between write_index checks
+const uint32_t idle_spins = 1000;
+const auto idle_sleep = std::chrono::microseconds(20);
+// Level-1 indirect in the packet, level-2 for 8 column partitions
+const int max_indirect_level = 2;
+
+uint64_t
+to_addr(uint32_t high, uint32_t low)
+{
+  return (static_cast<uint64_t>(high) << 32) | low;
+}
+
+}
+
+namespace shim_xdna {
+
+void
+emu_delay(uint32_t us)
+{
+  auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(us);
+
+  // Sleeping is too coarse for short kernels, spin instead
+  if (us >= 100) {
+    std::this_thread::sleep_until(end);
+    return;
+  }
+  while (std::chrono::steady_clock::now() < end)
+    ;
+}
+
+cert_emu::
+cert_emu(volatile host_queue_header* hdr, volatile host_queue_packet* pkts,
+  uint32_t num_col, uint32_t service_us, xlate_fn xlate, notify_fn notify)
+  : m_hdr(hdr)
+  , m_pkts(pkts)
+  , m_service_us(service_us)
+  , m_xlate(std::move(xlate))
+  , m_notify(std::move(notify))
+  , m_completed(hdr->read_index)
+  , m_cols(num_col)
+{
+  for (uint32_t i = 0; i < num_col; i++)
+    m_cols[i].m_thread = std::thread(&cert_emu::run_col, this, i);
+  m_lead = std::thread(&cert_emu::run, this);
+  shim_debug("Created CERT emulator, %d columns, capacity %d", num_col, m_hdr->capacity);
+}
+
+cert_emu::
+~cert_emu()
+{
+  {
+    std::lock_guard<std::mutex> lk(m_col_lock);
+    m_stop = true;
+    m_col_cv.notify_all();
+  }
+  m_lead.join();
+  for (auto& c : m_cols)
+    c.m_thread.join();
+
+  auto s = get_stats();
+  shim_debug("Destroyed CERT emulator, packets %ld, exec_bufs %ld, errors %ld, busy %ld us",
+    s.m_packets, s.m_exec_bufs, s.m_errors, s.m_busy_ns / 1000);
+}
+
+cert_emu::stats
+cert_emu::
+get_stats() const
+{
+  std::lock_guard<std::mutex> lk(m_stats_lock);
+  return m_stats;
+}
+
+volatile host_queue_packet*
+cert_emu::
+next_packet()
+{
+  auto idx = m_completed.load(std::memory_order_relaxed);
+  auto pkt = &m_pkts[idx & (m_hdr->capacity - 1)];
+
+  // write_index moves when the slot is reserved, the type when it is filled
+  for (uint32_t idle = 0; !m_stop; idle++) {
+    if (m_hdr->write_index > idx &&
+      pkt->xrt_header.common_header.type == HOST_QUEUE_PACKET_TYPE_VENDOR_SPECIFIC) {
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return pkt;
+    }
+    if (idle < idle_spins)
+      std::this_thread::yield();
+    else
+      std::this_thread::sleep_for(idle_sleep);
+  }
+  return nullptr;
+}
+
+uint32_t
+cert_emu::
+exec(uint32_t col, volatile exec_buf* ebuf)
+{
+  const uint32_t column_index_rel = col;
+  auto ctrl = to_addr(ebuf->dpu_control_code_host_addr_high, ebuf->dpu_control_code_host_addr_low);
+  auto args = to_addr(ebuf->args_host_addr_high, ebuf->args_host_addr_low);
+
+  if (!ctrl || !m_xlate(ctrl, sizeof(uint32_t)))
+    return HSA_INVALID_PAGE;
+  if (ebuf->args_len && !m_xlate(args, ebuf->args_len))
+    return HSA_INVALID_PAGE;
+
+  // The control code is not interpreted, only its duration is modeled
+  emu_delay(m_service_us);
+  return HSA_PKT_SUCCESS;
+}
+
+void
+cert_emu::
+run_col(uint32_t col)
+{
+  std::unique_lock<std::mutex> lk(m_col_lock);
+  auto& c = m_cols[col];
+
+  for (;;) {
+    m_col_cv.wait(lk, [this, &c] { return m_stop || c.m_ebuf; });
+    if (!c.m_ebuf)
+      return;
+
+    auto ebuf = c.m_ebuf;
+    lk.unlock();
+    auto status = exec(col, ebuf);
+    lk.lock();
+
+    c.m_status = status;
+    c.m_ebuf = nullptr;
+    if (!--m_col_pending)
+      m_col_cv.notify_all();
+  }
+}
+
+uint32_t
+cert_emu::
+dispatch(const std::vector<volatile exec_buf*>& ebufs)
+{
+  std::unique_lock<std::mutex> lk(m_col_lock);
+
+  // The i-th exec_buf always goes to the i-th column of the partition
+  for (size_t i = 0; i < ebufs.size(); i++)
+    m_cols[i].m_ebuf = ebufs[i];
+  m_col_pending = ebufs.size();
+  m_col_cv.notify_all();
+  m_col_cv.wait(lk, [this] { return !m_col_pending; });
+
+  for (size_t i = 0; i < ebufs.size(); i++) {
+    if (m_cols[i].m_status != HSA_PKT_SUCCESS)
+      return m_cols[i].m_status;
+  }
+  return HSA_COMP_SUCCESS;
+}
+
+uint32_t
+cert_emu::
+collect(volatile common_header* hdr, volatile void* payload, int level,
+  std::vector<volatile exec_buf*>& ebufs)
+{
+  const auto esz = sizeof(host_indirect_packet_entry);
+
+  if (!hdr->indirect) {
+    if (hdr->count != sizeof(exec_buf))
+      return HSA_INVALID_PKT;
+    if (ebufs.size() == m_cols.size())
+      return HSA_INVALID_PKT;
+    ebufs.push_back(static_cast<volatile exec_buf*>(payload));
+    return HSA_PKT_SUCCESS;
+  }
+
+  // Indirect exec_buf only exists to spread a command across columns
+  if (level > max_indirect_level || !hdr->distribute ||
+    !hdr->count || hdr->count % esz)
+    return HSA_INVALID_PKT;
+
+  auto entry = static_cast<volatile host_indirect_packet_entry*>(payload);
+  for (uint32_t i = 0; i < hdr->count / esz; i++, entry++) {
+    const uint32_t column_index_rel = ebufs.size();
+    auto addr = to_addr(entry->host_addr_high, entry->host_addr_low);
+
+    auto next = static_cast<volatile common_header*>(m_xlate(addr, sizeof(common_header)));
+    if (!next || !m_xlate(addr, sizeof(common_header) + next->count))
+      return HSA_INVALID_PAGE;
+    if (next->type != HOST_QUEUE_PACKET_TYPE_VENDOR_SPECIFIC ||
+      next->opcode != hdr->opcode || !next->distribute)
+      return HSA_INVALID_PKT;
+
+    auto ret = collect(next, next + 1, level + 1, ebufs);
+    if (ret != HSA_PKT_SUCCESS)
+      return ret;
+  }
+  return HSA_PKT_SUCCESS;
+}
+
+uint32_t
+cert_emu::
+process(volatile host_queue_packet* pkt)
+{
+  const uint32_t column_index_rel = 0;
+  auto hdr = &pkt->xrt_header.common_header;
+  std::vector<volatile exec_buf*> ebufs;
+
+  switch (hdr->opcode) {
+  case HOST_QUEUE_PACKET_EXEC_BUF: {
+    if (!hdr->indirect && hdr->distribute)
+      return HSA_INVALID_PKT;
+    // Direct payload must fit in the slot, indirect payload is read from host
+    if (hdr->count > sizeof(pkt->data))
+      return HSA_INVALID_PKT;
+    auto ret = collect(hdr, pkt->data, 1, ebufs);
+    if (ret != HSA_PKT_SUCCESS)
+      return ret;
+    {
+      std::lock_guard<std::mutex> lk(m_stats_lock);
+      m_stats.m_exec_bufs += ebufs.size();
+    }
+    return dispatch(ebufs);
+  }
+  case HOST_QUEUE_PACKET_TEST:
+    return HSA_COMP_SUCCESS;
+  case HOST_QUEUE_PACKET_EXIT:
+    return HSA_EXIT_PKT;
+  default:
+    return HSA_INVALID_OPCODE;
+  }
+}
+
+void
+cert_emu::
+run()
+{
+  volatile host_queue_packet* pkt;
+
+  while ((pkt = next_packet())) {
+    auto start = std::chrono::steady_clock::now();
+    auto opcode = pkt->xrt_header.common_header.opcode;
+    auto ret = process(pkt);
+    bool err = (ret != HSA_COMP_SUCCESS);
+
+    auto sig = static_cast<volatile uint32_t*>(
+      m_xlate(pkt->xrt_header.completion_signal, sizeof(uint32_t)));
+    if (sig) {
+      std::atomic_thread_fence(std::memory_order_release);
+      *sig = ret;
+    } else {
+      shim_debug("CERT emulator: bad completion signal 0x%lx",
+        pkt->xrt_header.completion_signal);
+      err = true;
+    }
+
+    // Free the slot before moving read_index, producer checks both
+    pkt->xrt_header.common_header.type = HOST_QUEUE_PACKET_TYPE_INVALID;
+    std::atomic_thread_fence(std::memory_order_release);
+    auto idx = m_completed.load(std::memory_order_relaxed) + 1;
+    m_hdr->read_index = idx;
+    m_completed.store(idx, std::memory_order_release);
+
+    {
+      std::lock_guard<std::mutex> lk(m_stats_lock);
+      m_stats.m_packets++;
+      m_stats.m_errors += err;
+      m_stats.m_busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    }
+    m_notify();
+
+    if (opcode == HOST_QUEUE_PACKET_EXIT) {
+      shim_debug("CERT emulator: exit packet at %ld", idx - 1);
+      break;
+    }
+  }
+}
+
+} // namespace shim_xdna
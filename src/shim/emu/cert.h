@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2024, Advanced Micro Devices, Inc. All rights reserved.
+
+#ifndef CERT_EMU_XDNA_H
+#define CERT_EMU_XDNA_H
+
+#include "ert.h"
+#include "../umq/host_queue.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace shim_xdna {
+
+// Synthetic execution time, shared by the emulated engines
+void
+emu_delay(uint32_t us);
+
+// Userspace model of the CERT firmware consuming one UMQ host queue. The lead
+// thread polls write_index (the emulated doorbell cannot wake anybody up),
+// validates every packet, hands the exec_buf of each column in a distributed
+// packet to that column's thread, writes the completion signal once all
+// columns are done, frees the slot and bumps read_index. Each column spends
+// service_us on an exec_buf instead of running its control code.
+class cert_emu
+{
+public:
+  // Turns a device address found in a packet into a CPU pointer covering size
+  // bytes, or nullptr if no BO backs the whole range
+  using xlate_fn = std::function<void*(uint64_t addr, size_t size)>;
+  // Called after read_index moves
+  using notify_fn = std::function<void()>;
+
+  struct stats
+  {
+    uint64_t m_packets = 0;
+    uint64_t m_errors = 0;
+    uint64_t m_exec_bufs = 0;
+    uint64_t m_busy_ns = 0;
+  };
+
+  // Caller validates the header, pkts is where its data_address points to
+  cert_emu(volatile host_queue_header* hdr, volatile host_queue_packet* pkts,
+    uint32_t num_col, uint32_t service_us, xlate_fn xlate, notify_fn notify);
+  ~cert_emu();
+
+  // Number of packets retired, equals read_index
+  uint64_t
+  completed() const
+  { return m_completed.load(std::memory_order_acquire); }
+
+  stats
+  get_stats() const;
+
+private:
+  struct column
+  {
+    volatile exec_buf* m_ebuf = nullptr;
+    uint32_t m_status = HSA_PKT_SUCCESS;
+    std::thread m_thread;
+  };
+
+  volatile host_queue_packet*
+  next_packet();
+
+  uint32_t
+  process(volatile host_queue_packet* pkt);
+
+  uint32_t
+  collect(volatile common_header* hdr, volatile void* payload, int level,
+    std::vector<volatile exec_buf*>& ebufs);
+
+  uint32_t
+  dispatch(const std::vector<volatile exec_buf*>& ebufs);
+
+  uint32_t
+  exec(uint32_t col, volatile exec_buf* ebuf);
+
+  void
+  run();
+
+  void
+  run_col(uint32_t col);
+
+  volatile host_queue_header* m_hdr;
+  volatile host_queue_packet* m_pkts;
+  const uint32_t m_service_us;
+  xlate_fn m_xlate;
+  notify_fn m_notify;
+
+  std::atomic<uint64_t> m_completed{0};
+  std::atomic<bool> m_stop{false};
+  std::thread m_lead;
+
+  // Lead to column hand off
+  std::mutex m_col_lock;
+  std::condition_variable m_col_cv;
+  std::vector<column> m_cols;
+  uint32_t m_col_pending = 0;
+
+  mutable std::mutex m_stats_lock;
+  stats m_stats;
+};
+
+} // namespace shim_xdna
+
+#endif
@@ -0,0 +1,980 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2024, Advanced Micro Devices, Inc. All rights reserved.
+
+#include "npu.h"
+#include "ert.h"
+#include "../shim_debug.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <linux/kcmp.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+// Same as AIE2_DEVM_BASE in the driver
+const uint64_t dev_heap_base = 0x4000000;
+// Emulates NPU4, one column per four core tiles
+const uint16_t emu_cols = 8;
+const uint16_t emu_core_rows = 4;
+
+size_t
+page_align(size_t size)
+{
+  size_t pg = getpagesize();
+  return (size + pg - 1) & ~(pg - 1);
+}
+
+template <typename T>
+int
+copy_info(const amdxdna_drm_get_info* args, const T& val)
+{
+  if (args->buffer_size < sizeof(val))
+    return EINVAL;
+  std::memcpy(reinterpret_cast<void*>(args->buffer), &val, sizeof(val));
+  return 0;
+}
+
+}
+
+namespace shim_xdna {
+
+npu_emu::mem::
+mem(int fd, size_t size, uint64_t map_offset)
+  : m_fd(fd)
+  , m_size(size)
+  , m_map_offset(map_offset)
+{
+  struct stat st;
+
+  auto p = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+  if (p != MAP_FAILED)
+    m_kva = static_cast<char*>(p);
+  if (!fstat(m_fd, &st)) {
+    m_dev = st.st_dev;
+    m_ino = st.st_ino;
+  }
+}
+
+npu_emu::mem::
+~mem()
+{
+  if (m_kva)
+    ::munmap(m_kva, m_size);
+  ::close(m_fd);
+}
+
+npu_emu::syncobj::
+syncobj()
+  : m_efd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+{
+}
+
+npu_emu::syncobj::
+~syncobj()
+{
+  if (m_efd >= 0)
+    ::close(m_efd);
+}
+
+npu_emu::
+npu_emu(uint32_t exec_us)
+  : m_exec_us(exec_us)
+  , m_fd(eventfd(0, EFD_CLOEXEC))
+  , m_next_offset(page_align(1))
+{
+  shim_debug("Created NPU emulator, exec latency %d us", m_exec_us);
+}
+
+npu_emu::
+~npu_emu()
+{
+  std::vector<uint32_t> ids;
+
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    for (auto& c : m_ctxs)
+      ids.push_back(c.first);
+  }
+  for (auto id : ids) {
+    amdxdna_drm_destroy_hwctx arg = { .handle = id };
+    destroy_ctx(&arg);
+  }
+  if (m_fd >= 0)
+    ::close(m_fd);
+  shim_debug("Destroyed NPU emulator");
+}
+
+int
+npu_emu::
+ioctl(unsigned long cmd, void* arg)
+{
+  switch (cmd) {
+  case DRM_IOCTL_AMDXDNA_CREATE_HWCTX:
+    return create_ctx(static_cast<amdxdna_drm_create_hwctx*>(arg));
+  case DRM_IOCTL_AMDXDNA_DESTROY_HWCTX:
+    return destroy_ctx(static_cast<amdxdna_drm_destroy_hwctx*>(arg));
+  case DRM_IOCTL_AMDXDNA_CONFIG_HWCTX:
+    return config_ctx(static_cast<amdxdna_drm_config_hwctx*>(arg));
+  case DRM_IOCTL_AMDXDNA_CREATE_BO:
+    return create_bo(static_cast<amdxdna_drm_create_bo*>(arg));
+  case DRM_IOCTL_AMDXDNA_GET_BO_INFO:
+    return get_bo_info(static_cast<amdxdna_drm_get_bo_info*>(arg));
+  case DRM_IOCTL_AMDXDNA_SYNC_BO:
+    // CPU and the emulated device see the same memory
+    return 0;
+  case DRM_IOCTL_AMDXDNA_SYNC_BO_VEC: {
+    auto vec = static_cast<amdxdna_drm_sync_bo_vec*>(arg);
+    if (!vec->count || vec->count > AMDXDNA_SYNC_BO_VEC_MAX)
+      return EINVAL;
+    vec->hwctx = AMDXDNA_INVALID_CTX_HANDLE;
+    vec->seq = 0;
+    return 0;
+  }
+  case DRM_IOCTL_AMDXDNA_EXEC_CMD:
+    return exec_cmd(static_cast<amdxdna_drm_exec_cmd*>(arg));
+  case DRM_IOCTL_AMDXDNA_WAIT_CMD:
+    return wait_cmd(static_cast<amdxdna_drm_wait_cmd*>(arg));
+  case DRM_IOCTL_AMDXDNA_GET_INFO:
+    return get_info(static_cast<amdxdna_drm_get_info*>(arg));
+  case DRM_IOCTL_AMDXDNA_SET_STATE:
+    return set_state(static_cast<amdxdna_drm_set_state*>(arg));
+  case DRM_IOCTL_AMDXDNA_RESUME:
+    // Emulated device is always up
+    return 0;
+  case DRM_IOCTL_GEM_CLOSE:
+    return close_bo(static_cast<drm_gem_close*>(arg));
+  case DRM_IOCTL_PRIME_HANDLE_TO_FD:
+    return export_bo(static_cast<drm_prime_handle*>(arg));
+  case DRM_IOCTL_PRIME_FD_TO_HANDLE:
+    return import_bo(static_cast<drm_prime_handle*>(arg));
+  case DRM_IOCTL_SYNCOBJ_CREATE:
+    return create_syncobj(static_cast<drm_syncobj_create*>(arg));
+  case DRM_IOCTL_SYNCOBJ_DESTROY:
+    return destroy_syncobj(static_cast<drm_syncobj_destroy*>(arg));
+  case DRM_IOCTL_SYNCOBJ_QUERY:
+    return query_syncobj(static_cast<drm_syncobj_timeline_array*>(arg));
+  case DRM_IOCTL_SYNCOBJ_TIMELINE_SIGNAL:
+    return signal_syncobj(static_cast<drm_syncobj_timeline_array*>(arg));
+  case DRM_IOCTL_SYNCOBJ_TIMELINE_WAIT:
+    return wait_syncobj(static_cast<drm_syncobj_timeline_wait*>(arg));
+  case DRM_IOCTL_SYNCOBJ_HANDLE_TO_FD:
+    return export_syncobj(static_cast<drm_syncobj_handle*>(arg));
+  case DRM_IOCTL_SYNCOBJ_FD_TO_HANDLE:
+    return import_syncobj(static_cast<drm_syncobj_handle*>(arg));
+  }
+  return ENOTTY;
+}
+
+void*
+npu_emu::
+mmap(void* addr, size_t len, int prot, int flags, off_t offset)
+{
+  std::lock_guard<std::mutex> lk(m_lock);
+
+  auto it = m_offsets.find(offset);
+  auto m = it == m_offsets.end() ? nullptr : it->second.lock();
+  if (!m || len > m->m_size) {
+    errno = EINVAL;
+    return MAP_FAILED;
+  }
+
+  // Do not depend on RLIMIT_MEMLOCK, nothing is DMA'ed
+  auto p = ::mmap(addr, len, prot, flags & ~MAP_LOCKED, m->m_fd, 0);
+  if (p == MAP_FAILED)
+    return p;
+  if (m == m_heap)
+    m_heap_uva = reinterpret_cast<uintptr_t>(p);
+  m_maps[reinterpret_cast<uintptr_t>(p)] = len;
+  return p;
+}
+
+void
+npu_emu::
+munmap(void* addr, size_t len)
+{
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    m_maps.erase(reinterpret_cast<uintptr_t>(addr));
+  }
+  ::munmap(addr, len);
+}
+
+void*
+npu_emu::
+translate(uint64_t addr, size_t size)
+{
+  // Device addresses of host BOs are user VAs, the emulator shares them
+  auto it = m_maps.upper_bound(addr);
+  if (it == m_maps.begin())
+    return nullptr;
+  --it;
+  if (addr + size < addr || addr + size > it->first + it->second)
+    return nullptr;
+  return reinterpret_cast<void*>(addr);
+}
+
+uint32_t
+npu_emu::
+add_bo(std::unique_ptr<bo_obj> bo)
+{
+  auto hdl = m_next_handle++;
+  m_bos[hdl] = std::move(bo);
+  return hdl;
+}
+
+std::shared_ptr<npu_emu::mem>
+npu_emu::
+alloc_mem(int fd, size_t size)
+{
+  auto m = std::make_shared<mem>(fd, size, m_next_offset);
+
+  if (!m->m_kva)
+    return nullptr;
+  m_offsets[m->m_map_offset] = m;
+  m_next_offset += page_align(size);
+  return m;
+}
+
+int
+npu_emu::
+alloc_heap(size_t size, size_t* off)
+{
+  size_t cur = 0;
+
+  // First fit, good enough for the handful of BOs on the heap
+  size = page_align(size);
+  for (auto& used : m_heap_used) {
+    if (used.first - cur >= size)
+      break;
+    cur = used.first + used.second;
+  }
+  if (cur + size > m_heap->m_size)
+    return ENOMEM;
+
+  m_heap_used[cur] = size;
+  *off = cur;
+  return 0;
+}
+
+int
+npu_emu::
+create_bo(amdxdna_drm_create_bo* args)
+{
+  std::lock_guard<std::mutex> lk(m_lock);
+  auto bo = std::make_unique<bo_obj>();
+  bool is_heap = false;
+  int ret;
+
+  if (!args->size || (args->flags & ~static_cast<uint64_t>(AMDXDNA_BO_FLAGS_HUGE_PAGE)))
+    return EINVAL;
+
+  bo->m_type = static_cast<amdxdna_bo_type>(args->type);
+  bo->m_size = args->size;
+  switch (bo->m_type) {
+  case AMDXDNA_BO_SHMEM:
+    if (args->vaddr) {
+      // User pointer BO, the emulator runs in the same address space
+      bo->m_vaddr = args->vaddr;
+      bo->m_kva = reinterpret_cast<char*>(args->vaddr);
+      break;
+    }
+    [[fallthrough]];
+  case AMDXDNA_BO_DEV_HEAP:
+  case AMDXDNA_BO_CMD: {
+    if (args->vaddr)
+      return EINVAL;
+    is_heap = (bo->m_type == AMDXDNA_BO_DEV_HEAP);
+    if (is_heap && m_heap)
+      return EBUSY;
+
+    int fd = memfd_create("amdxdna_emu_bo", MFD_CLOEXEC);
+    if (fd < 0)
+      return errno;
+    if (ftruncate(fd, args->size)) {
+      ret = errno;
+      ::close(fd);
+      return ret;
+    }
+    bo->m_mem = alloc_mem(fd, args->size);
+    if (!bo->m_mem)
+      return ENOMEM;
+    bo->m_kva = bo->m_mem->m_kva;
+    if (is_heap) {
+      m_heap = bo->m_mem;
+      m_heap_uva = 0;
+      m_heap_used.clear();
+      bo->m_xdna_addr = dev_heap_base;
+    }
+    break;
+  }
+  case AMDXDNA_BO_DEV:
+    if (args->vaddr || !m_heap)
+      return EINVAL;
+    ret = alloc_heap(args->size, &bo->m_heap_off);
+    if (ret)
+      return ret;
+    bo->m_mem = m_heap;
+    bo->m_kva = m_heap->m_kva + bo->m_heap_off;
+    bo->m_xdna_addr = dev_heap_base + bo->m_heap_off;
+    break;
+  default:
+    return EINVAL;
+  }
+
+  args->handle = add_bo(std::move(bo));
+  if (is_heap)
+    m_heap_hdl = args->handle;
+  return 0;
+}
+
+int
+npu_emu::
+close_bo(drm_gem_close* args)
+{
+  std::lock_guard<std::mutex> lk(m_lock);
+
+  auto it = m_bos.find(args->handle);
+  if (it == m_bos.end())
+    return EINVAL;
+
+  auto m = std::move(it->second->m_mem);
+  if (it->second->m_type == AMDXDNA_BO_DEV && m == m_heap)
+    m_heap_used.erase(it->second->m_heap_off);
+  if (args->handle == m_heap_hdl) {
+    m_heap.reset();
+    m_heap_hdl = AMDXDNA_INVALID_BO_HANDLE;
+  }
+  m_bos.erase(it);
+  // Queued commands may still hold the memory, their entry just expires
+  if (m && m.use_count() == 1)
+    m_offsets.erase(m->m_map_offset);
+  return 0;
+}
+
+int
+npu_emu::
+get_bo_info(amdxdna_drm_get_bo_info* args)
+{
+  std::lock_guard<std::mutex> lk(m_lock);
+
+  if (args->ext || args->ext_flags)
+    return EINVAL;
+
+  auto it = m_bos.find(args->handle);
+  if (it == m_bos.end())
+    return ENOENT;
+
+  auto& bo = it->second;
+  args->xdna_addr = bo->m_xdna_addr;
+  if (bo->m_type == AMDXDNA_BO_DEV) {
+    args->map_offset = AMDXDNA_INVALID_ADDR;
+    args->vaddr = m_heap_uva ? m_heap_uva + bo->m_heap_off : 0;
+  } else if (!bo->m_mem) {
+    args->map_offset = AMDXDNA_INVALID_ADDR;
+    args->vaddr = bo->m_vaddr;
+  } else {
+    args->map_offset = bo->m_mem->m_map_offset;
+    args->vaddr = 0;
+  }
+  return 0;
+}
+
+int
+npu_emu::
+export_bo(drm_prime_handle* args)
+{
+  std::lock_guard<std::mutex> lk(m_lock);
+
+  auto it = m_bos.find(args->handle);
+  if (it == m_bos.end())
+    return ENOENT;
+  auto& bo = it->second;
+  if (!bo->m_mem || bo->m_type == AMDXDNA_BO_DEV)
+    return EINVAL;
+
+  args->fd = fcntl(bo->m_mem->m_fd, F_DUPFD_CLOEXEC, 0);
+  return args->fd < 0 ? errno : 0;
+}
+
+int
+npu_emu::
+import_bo(drm_prime_handle* args)
+{
+  std::lock_guard<std::mutex> lk(m_lock);
+  auto bo = std::make_unique<bo_obj>();
+  struct stat st;
+
+  if (fstat(args->fd, &st))
+    return errno;
+
+  for (auto& b : m_bos) {
+    auto& m = b.second->m_mem;
+    if (!m || b.second->m_type == AMDXDNA_BO_DEV)
+      continue;
+    if (m->m_dev == st.st_dev && m->m_ino == st.st_ino) {
+      *bo = *b.second;
+      args->handle = add_bo(std::move(bo));
+      return 0;
+    }
+  }
+
+  // Exported by another process
+  auto size = lseek(args->fd, 0, SEEK_END);
+  if (size <= 0)
+    return EINVAL;
+  int fd = fcntl(args->fd, F_DUPFD_CLOEXEC, 0);
+  if (fd < 0)
+    return errno;
+  bo->m_mem = alloc_mem(fd, size);
+  if (!bo->m_mem)
+    return ENOMEM;
+  bo->m_type = AMDXDNA_BO_SHMEM;
+  bo->m_size = size;
+  bo->m_kva = bo->m_mem->m_kva;
+  args->handle = add_bo(std::move(bo));
+  return 0;
+}
+
+int
+npu_emu::
+create_ctx(amdxdna_drm_create_hwctx* args)
+{
+  std::lock_guard<std::mutex> lk(m_lock);
+
+  if (args->ext || args->ext_flags)
+    return EINVAL;
+
+  auto c = std::make_unique<ctx>();
+  c->m_id = m_next_ctx++;
+  c->m_num_col = std::clamp<uint32_t>(args->num_tiles / emu_core_rows, 1, emu_cols);
+  if (args->umq_bo != AMDXDNA_INVALID_BO_HANDLE) {
+    auto ret = create_umq(c.get(), args->umq_bo);
+    if (ret)
+      return ret;
+    args->handle = c->m_id;
+    args->syncobj_handle = AMDXDNA_INVALID_FENCE_HANDLE;
+    args->umq_doorbell = c->m_doorbell->m_map_offset;
+    m_ctxs[c->m_id] = std::move(c);
+    return 0;
+  }
+  c->m_syncobj = std::make_shared<syncobj>();
+  c->m_syncobj_hdl = m_next_syncobj++;
+  m_syncobjs[c->m_syncobj_hdl] = c->m_syncobj;
+  c->m_thread = std::thread(&npu_emu::run, this, c.get());
+
+  args->handle = c->m_id;
+  args->syncobj_handle = c->m_syncobj_hdl;
+  args->umq_doorbell = 0;
+  m_ctxs[c->m_id] = std::move(c);
+  return 0;
+}
+
+int
+npu_emu::
+create_umq(ctx* c, uint32_t umq_bo)
+{
+  auto bo = m_bos.find(umq_bo);
+  if (bo == m_bos.end() || bo->second->m_type != AMDXDNA_BO_CMD ||
+    bo->second->m_size < sizeof(host_queue_header))
+    return EINVAL;
+
+  auto hdr = reinterpret_cast<volatile host_queue_header*>(bo->second->m_kva);
+  uint32_t cap = hdr->capacity;
+  if (!cap || (cap & (cap - 1)))
+    return EINVAL;
+  auto pkts = static_cast<volatile host_queue_packet*>(
+    translate(hdr->data_address, cap * sizeof(host_queue_packet)));
+  if (!pkts)
+    return EINVAL;
+
+  // Only written by the producer, nothing looks at it
+  int fd = memfd_create("amdxdna_emu_doorbell", MFD_CLOEXEC);
+  if (fd < 0)
+    return errno;
+  if (ftruncate(fd, getpagesize())) {
+    auto ret = errno;
+    ::close(fd);
+    return ret;
+  }
+  c->m_doorbell = alloc_mem(fd, getpagesize());
+  if (!c->m_doorbell)
+    return ENOMEM;
+
+  c->m_umq_mem = bo->second->m_mem;
+  c->m_cert = std::make_unique<cert_emu>(hdr, pkts, c->m_num_col, m_exec_us,
+    [this] (uint64_t addr, size_t size) {
+      std::lock_guard<std::mutex> lk(m_lock);
+      return translate(addr, size);
+    },
+    [this] {
+      // Waiters check progress under m_lock, do not let them miss this
+      std::lock_guard<std::mutex> lk(m_lock);
+      m_cv.notify_all();
+    });
+  return 0;
+}
+
+int
+npu_emu::
+destroy_ctx(amdxdna_drm_destroy_hwctx* args)
+{
+  std::unique_ptr<ctx> c;
+
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    auto it = m_ctxs.find(args->handle);
+    if (it == m_ctxs.end())
+      return EINVAL;
+    c = std::move(it->second);
+    m_ctxs.erase(it);
+    c->m_stop = true;
+    m_cv.notify_all();
+  }
+
+  // Like the driver, wait for submitted commands to finish
+  if (c->m_thread.joinable())
+    c->m_thread.join();
+  c->m_cert.reset();
+
+  std::lock_guard<std::mutex> lk(m_lock);
+  m_syncobjs.erase(c->m_syncobj_hdl);
+  return 0;
+}
+
+int
+npu_emu::
+config_ctx(amdxdna_drm_config_hwctx* args)
+{
+  std::lock_guard<std::mutex> lk(m_lock);
+
+  // CUs, debug BOs and QoS do not change how commands are emulated
+  if (m_ctxs.find(args->handle) == m_ctxs.end())
+    return EINVAL;
+  return 0;
+}
+
+int
+npu_emu::
+exec_cmd(amdxdna_drm_exec_cmd* args)
+{
+  std::lock_guard<std::mutex> lk(m_lock);
+  job j;
+
+  if (args->ext || args->ext_flags)
+    return EINVAL;
+
+  auto it = m_ctxs.find(args->hwctx);
+  // UMQ commands only go through the host queue
+  if (it == m_ctxs.end() || it->second->m_cert)
+    return EINVAL;
+  auto& c = it->second;
+
+  j.m_type = args->type;
+  switch (args->type) {
+  case AMDXDNA_CMD_SUBMIT_EXEC_BUF: {
+    if (args->cmd_count != 1)
+      return EINVAL;
+    auto bo = m_bos.find(static_cast<uint32_t>(args->cmd_handles));
+    if (bo == m_bos.end() || bo->second->m_type != AMDXDNA_BO_CMD)
+      return EINVAL;
+    j.m_cmd_mem = bo->second->m_mem;
+    j.m_cmd = bo->second->m_kva;
+    break;
+  }
+  case AMDXDNA_CMD_SUBMIT_DEPENDENCY: {
+    auto hdls = reinterpret_cast<const uint32_t*>(args->cmd_handles);
+    auto points = reinterpret_cast<const uint64_t*>(args->args);
+    if (args->cmd_count != args->arg_count)
+      return EINVAL;
+    for (uint32_t i = 0; i < args->cmd_count; i++) {
+      auto so = m_syncobjs.find(hdls[i]);
+      if (so == m_syncobjs.end())
+        return ENOENT;
+      j.m_fences.emplace_back(so->second, points[i]);
+    }
+    break;
+  }
+  case AMDXDNA_CMD_SUBMIT_SIGNAL: {
+    // Handle and point are passed by value
+    auto so = m_syncobjs.find(static_cast<uint32_t>(args->cmd_handles));
+    if (args->cmd_count != 1 || so == m_syncobjs.end())
+      return EINVAL;
+    so->second->m_submitted = std::max(so->second->m_submitted, args->args);
+    j.m_fences.emplace_back(so->second, args->args);
+    break;
+  }
+  default:
+    return EINVAL;
+  }
+
+  j.m_seq = ++c->m_submitted;
+  c->m_syncobj->m_submitted = j.m_seq;
+  c->m_jobs.push_back(std::move(j));
+  args->seq = c->m_submitted;
+  m_cv.notify_all();
+  return 0;
+}
+
+void
+npu_emu::
+run(ctx* c)
+{
+  std::unique_lock<std::mutex> lk(m_lock);
+
+  for (;;) {
+    m_cv.wait(lk, [c] { return c->m_stop || !c->m_jobs.empty(); });
+    if (c->m_jobs.empty())
+      return;
+
+    auto& j = c->m_jobs.front();
+    switch (j.m_type) {
+    case AMDXDNA_CMD_SUBMIT_DEPENDENCY:
+      m_cv.wait(lk, [c, &j] {
+        return c->m_stop || std::all_of(j.m_fences.begin(), j.m_fences.end(),
+          [](const auto& f) { return f.first->m_point >= f.second; });
+      });
+      break;
+    case AMDXDNA_CMD_SUBMIT_SIGNAL:
+      for (auto& f : j.m_fences)
+        signal(*f.first, f.second);
+      break;
+    default: {
+      lk.unlock();
+      emu_delay(m_exec_us);
+      // Publish whatever the "kernel" wrote before the state
+      std::atomic_thread_fence(std::memory_order_release);
+      reinterpret_cast<ert_packet*>(j.m_cmd)->state = ERT_CMD_STATE_COMPLETED;
+      lk.lock();
+      break;
+    }
+    }
+
+    c->m_completed = j.m_seq;
+    signal(*c->m_syncobj, j.m_seq);
+    c->m_jobs.pop_front();
+  }
+}
+
+int
+npu_emu::
+wait_cmd(amdxdna_drm_wait_cmd* args)
+{
+  std::unique_lock<std::mutex> lk(m_lock);
+
+  auto it = m_ctxs.find(args->hwctx);
+  if (it == m_ctxs.end())
+    return EINVAL;
+  auto c = it->second.get();
+
+  // UMQ seq is the slot index, done once read_index moves past it
+  auto done = [c, args] {
+    return c->m_cert ? c->m_cert->completed() > args->seq : c->m_completed >= args->seq;
+  };
+  if (!args->timeout) {
+    m_cv.wait(lk, done);
+    return 0;
+  }
+  return m_cv.wait_for(lk, std::chrono::milliseconds(args->timeout), done) ? 0 : ETIME;
+}
+
+int
+npu_emu::
+get_info(amdxdna_drm_get_info* args)
+{
+  std::lock_guard<std::mutex> lk(m_lock);
+
+  switch (args->param) {
+  case DRM_AMDXDNA_QUERY_AIE_STATUS: {
+    amdxdna_drm_query_aie_status status;
+    if (args->buffer_size < sizeof(status))
+      return EINVAL;
+    std::memcpy(&status, reinterpret_cast<void*>(args->buffer), sizeof(status));
+    std::memset(reinterpret_cast<void*>(status.buffer), 0, status.buffer_size);
+    status.cols_filled = 0;
+    return copy_info(args, status);
+  }
+  case DRM_AMDXDNA_QUERY_AIE_METADATA: {
+    amdxdna_drm_query_aie_metadata meta = {};
+    meta.col_size = 0x2000000;
+    meta.cols = emu_cols;
+    meta.rows = emu_core_rows + 2;
+    meta.version = { 2, 0 };
+    meta.core = { emu_core_rows, 2, 24, 16, 128 };
+    meta.mem = { 1, 1, 12, 64, 192 };
+    meta.shim = { 1, 0, 2, 16, 256 };
+    return copy_info(args, meta);
+  }
+  case DRM_AMDXDNA_QUERY_AIE_VERSION: {
+    amdxdna_drm_query_aie_version ver = { 2, 0 };
+    return copy_info(args, ver);
+  }
+  case DRM_AMDXDNA_QUERY_CLOCK_METADATA: {
+    amdxdna_drm_query_clock_metadata clk = {};
+    std::strncpy(reinterpret_cast<char*>(clk.mp_npu_clock.name), "MP-NPU Clock",
+      sizeof(clk.mp_npu_clock.name) - 1);
+    clk.mp_npu_clock.freq_mhz = 1267;
+    std::strncpy(reinterpret_cast<char*>(clk.h_clock.name), "H Clock",
+      sizeof(clk.h_clock.name) - 1);
+    clk.h_clock.freq_mhz = 1800;
+    return copy_info(args, clk);
+  }
+  case DRM_AMDXDNA_QUERY_SENSORS: {
+    amdxdna_drm_query_sensor sensor = {};
+    sensor.type = AMDXDNA_SENSOR_TYPE_POWER;
+    sensor.unitm = -3;
+    std::strncpy(reinterpret_cast<char*>(sensor.label), "Total Power", sizeof(sensor.label) - 1);
+    std::strncpy(reinterpret_cast<char*>(sensor.units), "mW", sizeof(sensor.units) - 1);
+    return copy_info(args, sensor);
+  }
+  case DRM_AMDXDNA_QUERY_HW_CONTEXTS: {
+    auto buf = reinterpret_cast<amdxdna_drm_query_hwctx*>(args->buffer);
+    uint32_t req_bytes = m_ctxs.size() * sizeof(*buf);
+    uint32_t i = 0;
+    int ret = 0;
+
+    for (auto& it : m_ctxs) {
+      if ((i + 1) * sizeof(*buf) > args->buffer_size) {
+        ret = EINVAL;
+        break;
+      }
+      auto& c = it.second;
+      buf[i] = {};
+      buf[i].context_id = c->m_id;
+      buf[i].start_col = 0;
+      buf[i].num_col = c->m_num_col;
+      buf[i].pid = getpid();
+      buf[i].command_submissions = c->m_submitted;
+      buf[i].command_completions = c->m_completed;
+      if (c->m_cert) {
+        buf[i].command_submissions =
+          reinterpret_cast<volatile host_queue_header*>(c->m_umq_mem->m_kva)->write_index;
+        buf[i].command_completions = c->m_cert->completed();
+      }
+      i++;
+    }
+    args->buffer_size = req_bytes;
+    return ret;
+  }
+  case DRM_AMDXDNA_QUERY_HW_CONTEXT_USAGE: {
+    auto buf = reinterpret_cast<amdxdna_drm_query_hwctx_usage*>(args->buffer);
+    uint32_t req_bytes = m_ctxs.size() * sizeof(*buf);
+    uint32_t i = 0;
+    int ret = 0;
+
+    for (auto& it : m_ctxs) {
+      if ((i + 1) * sizeof(*buf) > args->buffer_size) {
+        ret = EINVAL;
+        break;
+      }
+      auto& c = it.second;
+      buf[i] = {};
+      buf[i].context_id = c->m_id;
+      buf[i].pid = getpid();
+      buf[i].jobs = c->m_completed;
+      // Only the CERT model keeps busy time
+      if (c->m_cert) {
+        buf[i].jobs = c->m_cert->completed();
+        buf[i].busy_ns = c->m_cert->get_stats().m_busy_ns;
+      }
+      i++;
+    }
+    args->buffer_size = req_bytes;
+    return ret;
+  }
+  case DRM_AMDXDNA_QUERY_FIRMWARE_VERSION: {
+    amdxdna_drm_query_firmware_version fw = {};
+    return copy_info(args, fw);
+  }
+  case DRM_AMDXDNA_GET_POWER_MODE: {
+    amdxdna_drm_get_power_mode mode = {};
+    mode.power_mode = m_power_mode;
+    return copy_info(args, mode);
+  }
+  case DRM_AMDXDNA_GET_FORCE_PREEMPT_STATE: {
+    amdxdna_drm_get_force_preempt_state state = {};
+    return copy_info(args, state);
+  }
+  }
+  return EOPNOTSUPP;
+}
+
+int
+npu_emu::
+set_state(amdxdna_drm_set_state* args)
+{
+  std::lock_guard<std::mutex> lk(m_lock);
+
+  switch (args->param) {
+  case DRM_AMDXDNA_SET_POWER_MODE: {
+    amdxdna_drm_set_power_mode mode;
+    if (args->buffer_size < sizeof(mode))
+      return EINVAL;
+    std::memcpy(&mode, reinterpret_cast<void*>(args->buffer), sizeof(mode));
+    if (mode.power_mode > POWER_MODE_DYNAMIC)
+      return EINVAL;
+    m_power_mode = mode.power_mode;
+    return 0;
+  }
+  case DRM_AMDXDNA_SET_FORCE_PREEMPT:
+    return 0;
+  }
+  return EOPNOTSUPP;
+}
+
+void
+npu_emu::
+signal(syncobj& so, uint64_t point)
+{
+  uint64_t one = 1;
+
+  so.m_point = std::max(so.m_point, point);
+  so.m_submitted = std::max(so.m_submitted, point);
+  // Wake up whoever polls an exported fd, counter overflow does not matter
+  if (::write(so.m_efd, &one, sizeof(one)) < 0)
+    shim_debug("Emulated syncobj eventfd write failed, errno %d", errno);
+  m_cv.notify_all();
+}
+
+int
+npu_emu::
+create_syncobj(drm_syncobj_create* args)
+{
+  std::lock_guard<std::mutex> lk(m_lock);
+
+  auto so = std::make_shared<syncobj>();
+  if (so->m_efd < 0)
+    return errno;
+  args->handle = m_next_syncobj++;
+  m_syncobjs[args->handle] = so;
+  return 0;
+}
+
+int
+npu_emu::
+destroy_syncobj(drm_syncobj_destroy* args)
+{
+  std::lock_guard<std::mutex> lk(m_lock);
+
+  return m_syncobjs.erase(args->handle) ? 0 : EINVAL;
+}
+
+int
+npu_emu::
+query_syncobj(drm_syncobj_timeline_array* args)
+{
+  std::lock_guard<std::mutex> lk(m_lock);
+  auto hdls = reinterpret_cast<const uint32_t*>(args->handles);
+  auto points = reinterpret_cast<uint64_t*>(args->points);
+
+  for (uint32_t i = 0; i < args->count_handles; i++) {
+    auto so = m_syncobjs.find(hdls[i]);
+    if (so == m_syncobjs.end())
+      return EINVAL;
+    points[i] = so->second->m_point;
+  }
+  return 0;
+}
+
+int
+npu_emu::
+signal_syncobj(drm_syncobj_timeline_array* args)
+{
+  std::lock_guard<std::mutex> lk(m_lock);
+  auto hdls = reinterpret_cast<const uint32_t*>(args->handles);
+  auto points = reinterpret_cast<const uint64_t*>(args->points);
+
+  for (uint32_t i = 0; i < args->count_handles; i++) {
+    auto so = m_syncobjs.find(hdls[i]);
+    if (so == m_syncobjs.end())
+      return EINVAL;
+    signal(*so->second, points[i]);
+  }
+  return 0;
+}
+
+int
+npu_emu::
+wait_syncobj(drm_syncobj_timeline_wait* args)
+{
+  std::unique_lock<std::mutex> lk(m_lock);
+  auto hdls = reinterpret_cast<const uint32_t*>(args->handles);
+  auto points = reinterpret_cast<const uint64_t*>(args->points);
+  bool wait_all = args->flags & DRM_SYNCOBJ_WAIT_FLAGS_WAIT_ALL;
+  bool available = args->flags & DRM_SYNCOBJ_WAIT_FLAGS_WAIT_AVAILABLE;
+  fence_list fences;
+
+  for (uint32_t i = 0; i < args->count_handles; i++) {
+    auto so = m_syncobjs.find(hdls[i]);
+    if (so == m_syncobjs.end())
+      return EINVAL;
+    fences.emplace_back(so->second, points[i]);
+  }
+
+  auto done = [&] {
+    for (size_t i = 0; i < fences.size(); i++) {
+      auto& so = *fences[i].first;
+      bool ok = (available ? so.m_submitted : so.m_point) >= fences[i].second;
+      if (ok && !wait_all) {
+        args->first_signaled = i;
+        return true;
+      }
+      if (!ok && wait_all)
+        return false;
+    }
+    return wait_all;
+  };
+
+  // Absolute CLOCK_MONOTONIC like the kernel, steady_clock is the same clock
+  if (args->timeout_nsec == std::numeric_limits<int64_t>::max()) {
+    m_cv.wait(lk, done);
+    return 0;
+  }
+  std::chrono::steady_clock::time_point deadline{std::chrono::nanoseconds(args->timeout_nsec)};
+  return m_cv.wait_until(lk, deadline, done) ? 0 : ETIME;
+}
+
+int
+npu_emu::
+export_syncobj(drm_syncobj_handle* args)
+{
+  std::lock_guard<std::mutex> lk(m_lock);
+
+  if (args->flags)
+    return EINVAL;
+  auto so = m_syncobjs.find(args->handle);
+  if (so == m_syncobjs.end())
+    return EINVAL;
+  args->fd = fcntl(so->second->m_efd, F_DUPFD_CLOEXEC, 0);
+  return args->fd < 0 ? errno : 0;
+}
+
+int
+npu_emu::
+import_syncobj(drm_syncobj_handle* args)
+{
+  std::lock_guard<std::mutex> lk(m_lock);
+  auto pid = getpid();
+
+  if (args->flags)
+    return EINVAL;
+  // All eventfds share one inode, compare the open files instead
+  for (auto& so : m_syncobjs) {
+    if (syscall(SYS_kcmp, pid, pid, KCMP_FILE, args->fd, so.second->m_efd))
+      continue;
+    args->handle = m_next_syncobj++;
+    m_syncobjs[args->handle] = so.second;
+    return 0;
+  }
+  return EINVAL;
+}
+
+} // namespace shim_xdna
@@ -0,0 +1,202 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2024, Advanced Micro Devices, Inc. All rights reserved.
+
+#ifndef NPU_EMU_XDNA_H
+#define NPU_EMU_XDNA_H
+
+#include "cert.h"
+#include "drm_local/amdxdna_accel.h"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
+
+namespace shim_xdna {
+
+// Userspace model of the amdxdna driver and an NPU behind it. It takes the
+// ioctl(2) and mmap(2) calls the shim makes on the device node, so the shim
+// can run without the driver or silicon. BOs are memfd backed, every hardware
+// context has a thread which completes commands after a synthetic latency
+// without executing them, and syncobjs are timelines which also write an
+// eventfd on every signal. Syncobj fds can only be imported by the process
+// which exported them. A context created with a UMQ BO gets a cert_emu
+// draining its host queue instead.
+class npu_emu
+{
+public:
+  explicit npu_emu(uint32_t exec_us);
+  ~npu_emu();
+
+  // Stands in for the device node fd
+  int
+  get_fd() const
+  { return m_fd; }
+
+  // Returns 0 or errno
+  int
+  ioctl(unsigned long cmd, void* arg);
+
+  // Returns MAP_FAILED and sets errno on failure
+  void*
+  mmap(void* addr, size_t len, int prot, int flags, off_t offset);
+
+  void
+  munmap(void* addr, size_t len);
+
+private:
+  // memfd backing one or more BO handles
+  struct mem
+  {
+    int m_fd = -1;
+    size_t m_size = 0;
+    char* m_kva = nullptr;  // Emulator's own mapping
+    uint64_t m_map_offset = AMDXDNA_INVALID_ADDR;
+    // Identify the memfd when it comes back through import
+    dev_t m_dev = 0;
+    ino_t m_ino = 0;
+
+    mem(int fd, size_t size, uint64_t map_offset);
+    ~mem();
+  };
+
+  struct bo_obj
+  {
+    amdxdna_bo_type m_type = AMDXDNA_BO_INVALID;
+    std::shared_ptr<mem> m_mem;  // The heap for AMDXDNA_BO_DEV
+    char* m_kva = nullptr;
+    size_t m_size = 0;
+    size_t m_heap_off = 0;
+    uint64_t m_vaddr = 0;
+    uint64_t m_xdna_addr = AMDXDNA_INVALID_ADDR;
+  };
+
+  struct syncobj
+  {
+    uint64_t m_point = 0;      // Signaled
+    uint64_t m_submitted = 0;  // Has a pending signal
+    int m_efd = -1;
+
+    syncobj();
+    ~syncobj();
+  };
+
+  using fence_list = std::vector<std::pair<std::shared_ptr<syncobj>, uint64_t>>;
+
+  struct job
+  {
+    uint32_t m_type = AMDXDNA_CMD_SUBMIT_EXEC_BUF;
+    std::shared_ptr<mem> m_cmd_mem;  // Keeps m_cmd valid
+    char* m_cmd = nullptr;
+    fence_list m_fences;
+    uint64_t m_seq = 0;
+  };
+
+  struct ctx
+  {
+    uint32_t m_id = 0;
+    uint32_t m_num_col = 0;
+    uint32_t m_syncobj_hdl = AMDXDNA_INVALID_FENCE_HANDLE;
+    std::shared_ptr<syncobj> m_syncobj;
+    std::deque<job> m_jobs;
+    uint64_t m_submitted = 0;
+    uint64_t m_completed = 0;
+    bool m_stop = false;
+    std::thread m_thread;
+    // UMQ context only
+    std::shared_ptr<mem> m_umq_mem;
+    std::shared_ptr<mem> m_doorbell;
+    std::unique_ptr<cert_emu> m_cert;
+  };
+
+  int
+  create_bo(amdxdna_drm_create_bo* args);
+  int
+  close_bo(drm_gem_close* args);
+  int
+  get_bo_info(amdxdna_drm_get_bo_info* args);
+  int
+  export_bo(drm_prime_handle* args);
+  int
+  import_bo(drm_prime_handle* args);
+  int
+  create_ctx(amdxdna_drm_create_hwctx* args);
+  int
+  destroy_ctx(amdxdna_drm_destroy_hwctx* args);
+  int
+  exec_cmd(amdxdna_drm_exec_cmd* args);
+  int
+  wait_cmd(amdxdna_drm_wait_cmd* args);
+  int
+  get_info(amdxdna_drm_get_info* args);
+  int
+  set_state(amdxdna_drm_set_state* args);
+  int
+  config_ctx(amdxdna_drm_config_hwctx* args);
+  int
+  create_syncobj(drm_syncobj_create* args);
+  int
+  destroy_syncobj(drm_syncobj_destroy* args);
+  int
+  query_syncobj(drm_syncobj_timeline_array* args);
+  int
+  signal_syncobj(drm_syncobj_timeline_array* args);
+  int
+  wait_syncobj(drm_syncobj_timeline_wait* args);
+  int
+  export_syncobj(drm_syncobj_handle* args);
+  int
+  import_syncobj(drm_syncobj_handle* args);
+
+  // All below require m_lock
+  uint32_t
+  add_bo(std::unique_ptr<bo_obj> bo);
+  std::shared_ptr<mem>
+  alloc_mem(int fd, size_t size);
+  int
+  alloc_heap(size_t size, size_t* off);
+  void*
+  translate(uint64_t addr, size_t size);
+  int
+  create_umq(ctx* c, uint32_t umq_bo);
+  void
+  signal(syncobj& so, uint64_t point);
+
+  void
+  run(ctx* c);
+
+  const uint32_t m_exec_us;
+  int m_fd = -1;
+
+  std::mutex m_lock;
+  // Signaled on any progress, waiters recheck their own condition
+  std::condition_variable m_cv;
+
+  uint32_t m_next_handle = 1;
+  uint64_t m_next_offset;
+  std::map<uint32_t, std::unique_ptr<bo_obj>> m_bos;
+  std::map<uint64_t, std::weak_ptr<mem>> m_offsets;
+  // User mappings of BOs, start to length
+  std::map<uintptr_t, size_t> m_maps;
+
+  // Device memory heap, AMDXDNA_BO_DEV is carved from it
+  uint32_t m_heap_hdl = AMDXDNA_INVALID_BO_HANDLE;
+  std::shared_ptr<mem> m_heap;
+  uint64_t m_heap_uva = 0;
+  std::map<size_t, size_t> m_heap_used;
+
+  uint32_t m_next_syncobj = 1;
+  std::map<uint32_t, std::shared_ptr<syncobj>> m_syncobjs;
+
+  uint32_t m_next_ctx = 1;
+  std::map<uint32_t, std::unique_ptr<ctx>> m_ctxs;
+  uint8_t m_power_mode = POWER_MODE_DEFAULT;
+};
+
+} // namespace shim_xdna
+
+#endif
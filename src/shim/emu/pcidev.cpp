@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2024, Advanced Micro Devices, Inc. All rights reserved.
+
+#include "pcidev.h"
+#include "../stats.h"
+#include "../umq/device.h"
+
+#include "core/common/config_reader.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sys/mman.h>
+#include <vector>
+
+namespace {
+
+// What the PCI core and the driver show for an NPU4 in sysfs
+const std::vector<std::pair<const char*, const char*>> emu_sysfs_entries = {
+  { "vendor",             "0x1022" },
+  { "device",             "0x17f0" },
+  { "revision",           "0x10" },
+  { "subsystem_vendor",   "0x1022" },
+  { "subsystem_device",   "0x0000" },
+  { "link_width",         "0" },
+  { "link_width_max",     "0" },
+  { "link_speed",         "0" },
+  { "link_speed_max",     "0" },
+  { "vbnv",               "RyzenAI-npu4" },
+  { "device_type",        "0" }, // AMDXDNA_DEV_TYPE_KMQ
+};
+
+// Same for an NPU3, which only has UMQ
+const std::vector<std::pair<const char*, const char*>> emu_umq_sysfs_entries = {
+  { "vendor",             "0x1022" },
+  { "device",             "0x1569" },
+  { "revision",           "0x0" },
+  { "subsystem_vendor",   "0x1022" },
+  { "subsystem_device",   "0x0000" },
+  { "link_width",         "0" },
+  { "link_width_max",     "0" },
+  { "link_speed",         "0" },
+  { "link_speed_max",     "0" },
+  { "vbnv",               "RyzenAI-npu3" },
+  { "device_type",        "1" }, // AMDXDNA_DEV_TYPE_UMQ
+};
+
+bool
+emu_umq()
+{
+  static bool umq = xrt_core::config::detail::get_bool_value("Debug.xdna_emu_umq", false);
+  return umq;
+}
+
+uint32_t
+emu_exec_us()
+{
+  return xrt_core::config::detail::get_uint_value("Debug.xdna_emu_exec_us", 10);
+}
+
+}
+
+namespace shim_xdna {
+
+pdev_emu::
+pdev_emu(std::shared_ptr<const drv> driver, std::string sysfs_name)
+  : pdev_kmq(driver, std::move(sysfs_name))
+{
+  char dir[] = "/tmp/xdna_emu.XXXXXX";
+
+  if (!mkdtemp(dir))
+    shim_err(errno, "Failed to create emulated sysfs dir");
+  m_sysfs_dir = dir;
+  for (auto& e : emu_umq() ? emu_umq_sysfs_entries : emu_sysfs_entries)
+    std::ofstream(m_sysfs_dir + "/" + e.first) << e.second << std::endl;
+  shim_debug("Created emulated pcidev, sysfs at %s", m_sysfs_dir.c_str());
+}
+
+pdev_emu::
+~pdev_emu()
+{
+  std::error_code ec;
+  std::filesystem::remove_all(m_sysfs_dir, ec);
+  shim_debug("Destroying emulated pcidev");
+}
+
+std::shared_ptr<xrt_core::device>
+pdev_emu::
+create_device(xrt_core::device::handle_type handle, xrt_core::device::id_type id) const
+{
+  if (emu_umq())
+    return std::make_shared<device_umq>(*this, handle, id);
+  return pdev_kmq::create_device(handle, id);
+}
+
+bool
+pdev_emu::
+enabled()
+{
+  static bool emu = xrt_core::config::detail::get_bool_value("Debug.xdna_emulation", false);
+  return emu;
+}
+
+std::string
+pdev_emu::
+get_sysfs_path(const std::string& subdev, const std::string& entry)
+{
+  if (subdev.empty())
+    return m_sysfs_dir + "/" + entry;
+  return m_sysfs_dir + "/" + subdev + "/" + entry;
+}
+
+int
+pdev_emu::
+open_node() const
+{
+  m_npu = std::make_unique<npu_emu>(emu_exec_us());
+  return m_npu->get_fd();
+}
+
+void
+pdev_emu::
+close_node(int fd) const
+{
+  // Like closing the driver fd, frees everything left behind
+  m_npu.reset();
+}
+
+void
+pdev_emu::
+ioctl(unsigned long cmd, void* arg) const
+{
+  stats_ioctl_scope stats(cmd);
+  auto ret = m_npu->ioctl(cmd, arg);
+  if (ret)
+    shim_err(ret, "Emulated IOCTL 0x%lx failed", cmd);
+}
+
+void*
+pdev_emu::
+mmap(void *addr, size_t len, int prot, int flags, off_t offset) const
+{
+  void* ret = m_npu->mmap(addr, len, prot, flags, offset);
+
+  if (ret == MAP_FAILED)
+    shim_err(errno, "Emulated mmap(addr=%p, len=%ld, prot=%d, flags=%d, offset=%ld) failed",
+      addr, len, prot, flags, offset);
+  return ret;
+}
+
+void
+pdev_emu::
+munmap(void* addr, size_t len) const
+{
+  if (m_npu)
+    m_npu->munmap(addr, len);
+  else
+    ::munmap(addr, len);
+}
+
+} // namespace shim_xdna
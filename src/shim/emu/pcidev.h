@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2024, Advanced Micro Devices, Inc. All rights reserved.
+
+#ifndef PCIDEV_EMU_H
+#define PCIDEV_EMU_H
+
+#include "npu.h"
+#include "../kmq/pcidev.h"
+
+namespace shim_xdna {
+
+// KMQ device served by npu_emu instead of the driver. Only built into the
+// test shim (XDNA_SHIM_EMU) and enabled there by Debug.xdna_emulation in
+// xrt.ini, Debug.xdna_emu_exec_us sets the synthetic execution time of each
+// command. With Debug.xdna_emu_umq it shows up as an NPU3 UMQ device whose
+// host queues are drained by cert_emu.
+class pdev_emu : public pdev_kmq
+{
+public:
+  pdev_emu(std::shared_ptr<const drv> driver, std::string sysfs_name);
+  ~pdev_emu();
+
+  std::shared_ptr<xrt_core::device>
+  create_device(xrt_core::device::handle_type handle, xrt_core::device::id_type id) const override;
+
+  void
+  ioctl(unsigned long cmd, void* arg) const override;
+
+  void*
+  mmap(void *addr, size_t len, int prot, int flags, off_t offset) const override;
+
+  void
+  munmap(void* addr, size_t len) const override;
+
+  std::string
+  get_sysfs_path(const std::string& subdev, const std::string& entry) override;
+
+  static bool
+  enabled();
+
+  // Sysfs name of the emulated device, on a PCI domain no real device uses
+  static constexpr const char* sysfs_name = "ffff:00:00.0";
+
+private:
+  int
+  open_node() const override;
+
+  void
+  close_node(int fd) const override;
+
+  // Created on first open, like a driver client
+  mutable std::unique_ptr<npu_emu> m_npu;
+  // Stand-in for /sys/bus/pci/devices/<bdf>
+  std::string m_sysfs_dir;
+};
+
+} // namespace shim_xdna
+
+#endif
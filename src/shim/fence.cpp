@@ -2,6 +2,7 @@
 // Copyright (C) 2024, Advanced Micro Devices, Inc. All rights reserved.
 
 #include "fence.h"
+#include "trace.h"
 #include "drm_local/amdxdna_accel.h"
 #include <limits>
 
@@ -149,6 +150,7 @@ fence(const device& device)
   , m_syncobj_hdl(create_syncobj(m_pdev))
 {
   shim_debug("Fence allocated: %d@%d", m_syncobj_hdl, m_state);
+  trace_log(TRACE_OP_FENCE_CREATE, AMDXDNA_INVALID_CTX_HANDLE, m_syncobj_hdl, 0);
 }
 
 fence::
@@ -169,6 +171,7 @@ fence(const fence& f)
   , m_signaled{f.m_signaled}
 {
   shim_debug("Fence cloned: %d@%ld", m_syncobj_hdl, m_state);
+  trace_log(TRACE_OP_FENCE_CREATE, AMDXDNA_INVALID_CTX_HANDLE, m_syncobj_hdl, f.m_syncobj_hdl, 1);
 }
 
 fence::
@@ -225,6 +228,7 @@ wait(uint32_t timeout_ms) const
   auto st = signal_next_state();
   shim_debug("Waiting for command fence %d@%ld", m_syncobj_hdl, st);
   wait_syncobj_done(m_pdev, m_syncobj_hdl, st);
+  trace_log(TRACE_OP_FENCE_WAIT, AMDXDNA_INVALID_CTX_HANDLE, m_syncobj_hdl, st, 1);
 }
 
 void
@@ -234,6 +238,7 @@ submit_wait(const hw_ctx *ctx) const
   auto st = signal_next_state();
   shim_debug("Submitting wait for command fence %d@%ld", m_syncobj_hdl, st);
   submit_wait_syncobjs(m_pdev, ctx, &m_syncobj_hdl, &st, 1);
+  trace_log(TRACE_OP_FENCE_WAIT, ctx->get_slotidx(), m_syncobj_hdl, st);
 }
 
 uint64_t
@@ -255,6 +260,8 @@ signal() const
 {
   auto st = signal_next_state();
   shim_debug("Signaling command fence %d@%ld", m_syncobj_hdl, st);
+  // Logged first, a wait it releases must not show up before it in the trace
+  trace_log(TRACE_OP_FENCE_SIGNAL, AMDXDNA_INVALID_CTX_HANDLE, m_syncobj_hdl, st, 1);
   signal_syncobj(m_pdev, m_syncobj_hdl, st);
 }
 
@@ -264,6 +271,7 @@ submit_signal(const hw_ctx *ctx) const
 {
   auto st = signal_next_state();
   shim_debug("Submitting signal command fence %d@%ld", m_syncobj_hdl, st);
+  trace_log(TRACE_OP_FENCE_SIGNAL, ctx->get_slotidx(), m_syncobj_hdl, st);
   submit_signal_syncobj(m_pdev, ctx, m_syncobj_hdl, st);
 }
 
@@ -288,6 +296,8 @@ submit_wait(const pdev& dev, const hw_ctx *ctx, const std::vector<xrt_core::fenc
     i++;
   }
   submit_wait_syncobjs(dev, ctx, hdls, pts, i);
+  for (int j = 0; j < i; j++)
+    trace_log(TRACE_OP_FENCE_WAIT, ctx->get_slotidx(), hdls[j], pts[j]);
 }
 
 } // shim_xdna
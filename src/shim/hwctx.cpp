@@ -4,6 +4,7 @@
 #include "bo.h"
 #include "hwctx.h"
 #include "hwq.h"
+#include "trace.h"
 
 #include "core/common/xclbin_parser.h"
 #include "core/common/query_requests.h"
@@ -227,6 +228,7 @@ create_ctx_on_device()
   set_syncobj(arg.syncobj_handle);
 
   m_q->bind_hwctx(this);
+  trace_log(TRACE_OP_CTX_CREATE, m_handle, 0, 0);
 }
 
 void
@@ -236,6 +238,7 @@ delete_ctx_on_device()
   if (m_handle == AMDXDNA_INVALID_CTX_HANDLE)
     return;
 
+  trace_log(TRACE_OP_CTX_DESTROY, m_handle, 0, 0);
   m_q->unbind_hwctx();
   struct amdxdna_drm_destroy_hwctx arg = {};
   arg.handle = m_handle;
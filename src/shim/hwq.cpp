@@ -99,6 +99,7 @@ hw_q::
 bind_hwctx(const hw_ctx *ctx)
 {
   m_hwctx = ctx;
+  stats_add_ctx(m_hwctx->get_slotidx(), &m_exec_stats);
   shim_debug("Bond HW queue to HW context %d", m_hwctx->get_slotidx());
 }
 
@@ -107,6 +108,7 @@ hw_q::
 unbind_hwctx()
 {
   shim_debug("Unbond HW queue from HW context %d", m_hwctx->get_slotidx());
+  stats_remove_ctx(&m_exec_stats);
   m_hwctx = nullptr;
 }
 
@@ -121,9 +123,19 @@ void
 hw_q::
 submit_command(xrt_core::buffer_handle *cmd)
 {
+  static_cast<bo*>(cmd)->set_submit_time();
   issue_command(cmd);
 }
 
+void
+hw_q::
+record_done(xrt_core::buffer_handle *cmd) const
+{
+  auto ns = static_cast<bo*>(cmd)->take_submit_latency();
+  if (ns)
+    m_exec_stats.add(ns);
+}
+
 int
 hw_q::
 poll_command(xrt_core::buffer_handle *cmd) const
@@ -132,6 +144,9 @@ poll_command(xrt_core::buffer_handle *cmd) const
 
   if (cmdpkt->state >= ERT_CMD_STATE_COMPLETED) {
     XRT_TRACE_POINT_LOG(poll_command_done);
+    record_done(cmd);
+    trace_log(TRACE_OP_WAIT, m_hwctx->get_slotidx(), static_cast<bo*>(cmd)->get_drm_bo_handle(),
+      0, TRACE_WAIT_POLLED);
     return 1;
   }
   return 0;
@@ -143,7 +158,15 @@ wait_command(xrt_core::buffer_handle *cmd, uint32_t timeout_ms) const
 {
   if (poll_command(cmd))
       return 1;
-  return wait_cmd(m_pdev, m_hwctx, cmd, timeout_ms);
+  auto start = std::chrono::steady_clock::now();
+  auto ret = wait_cmd(m_pdev, m_hwctx, cmd, timeout_ms);
+  if (ret)
+    record_done(cmd);
+  auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - start).count();
+  trace_log(TRACE_OP_WAIT, m_hwctx->get_slotidx(), static_cast<bo*>(cmd)->get_drm_bo_handle(),
+    waited, ret ? TRACE_WAIT_DONE : TRACE_WAIT_TIMEOUT);
+  return ret;
 }
 
 void
@@ -7,6 +7,8 @@
 #include "fence.h"
 #include "hwctx.h"
 #include "shim_debug.h"
+#include "stats.h"
+#include "trace.h"
 
 #include "core/common/shim/hwqueue_handle.h"
 
@@ -49,6 +51,13 @@ public:
   uint32_t
   get_queue_bo();
 
+private:
+  void
+  record_done(xrt_core::buffer_handle *cmd) const;
+
+  // Submit to complete latency of commands seen done by poll or wait
+  mutable stats_hist m_exec_stats;
+
 protected:
   virtual void
   issue_command(xrt_core::buffer_handle *) = 0;
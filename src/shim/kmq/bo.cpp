@@ -3,6 +3,7 @@
 
 #include "bo.h"
 #include "core/common/config_reader.h"
+#include <atomic>
 #include <x86intrin.h>
 
 namespace {
@@ -25,6 +26,16 @@ flag_to_type(uint64_t bo_flags)
   return AMDXDNA_BO_INVALID;
 }
 
+uint64_t
+flag_to_drm_flags(uint64_t bo_flags, amdxdna_bo_type type)
+{
+  auto flags = xcl_bo_flags{bo_flags};
+  uint64_t drm_flags = 0;
+
+  if (type == AMDXDNA_BO_SHMEM && (flags.extension & shim_xdna::XDNA_BO_EXT_HUGE_PAGE))
+    drm_flags |= AMDXDNA_BO_FLAGS_HUGE_PAGE;
+  return drm_flags;
+}
 
 // flash cache line for non coherence memory
 inline void
@@ -48,18 +59,48 @@ clflush_data(const void *base, size_t offset, size_t len)
   } while (cur <= (const char *)lastline);
 }
 
+// Set once an older driver without DRM_IOCTL_AMDXDNA_SYNC_BO_VEC is found
+std::atomic<bool> no_sync_bo_vec{false};
+
 void
 sync_drm_bo(const shim_xdna::pdev& dev, uint32_t boh, xrt_core::buffer_handle::direction dir,
   size_t offset, size_t len)
 {
+  auto direction = (dir == xrt_core::buffer_handle::direction::host2device ?
+    SYNC_DIRECT_TO_DEVICE : SYNC_DIRECT_FROM_DEVICE);
+
+  if (!no_sync_bo_vec) {
+    // Single range vectored sync, driver waits for device sync if there is any
+    amdxdna_drm_sync_bo_range range = {
+      .handle = boh,
+      .offset = offset,
+      .size = len,
+    };
+    amdxdna_drm_sync_bo_vec svec = {
+      .ranges = reinterpret_cast<uintptr_t>(&range),
+      .count = 1,
+      .direction = direction,
+    };
+    try {
+      dev.ioctl(DRM_IOCTL_AMDXDNA_SYNC_BO_VEC, &svec);
+      return;
+    } catch (const xrt_core::system_error& ex) {
+      // Older driver does not know about the ioctl
+      if (ex.get_code() != ENOTTY && ex.get_code() != EINVAL)
+        throw;
+      shim_debug("Vectored BO sync failed, err=%d, retry with single BO sync", ex.get_code());
+    }
+  }
+
   amdxdna_drm_sync_bo sbo = {
     .handle = boh,
-    .direction = (dir == xrt_core::buffer_handle::direction::host2device ?
-      SYNC_DIRECT_TO_DEVICE : SYNC_DIRECT_FROM_DEVICE),
+    .direction = direction,
     .offset = offset,
     .size = len,
   };
   dev.ioctl(DRM_IOCTL_AMDXDNA_SYNC_BO, &sbo);
+  // Only cache it once the old ioctl took the same request
+  no_sync_bo_vec = true;
 }
 
 bool
@@ -80,8 +121,8 @@ namespace shim_xdna {
 
 bo_kmq::
 bo_kmq(const device& device, xrt_core::hwctx_handle::slot_id ctx_id,
-  size_t size, uint64_t flags)
-  : bo_kmq(device, ctx_id, size, flags, flag_to_type(flags))
+  void* userptr, size_t size, uint64_t flags)
+  : bo_kmq(device, ctx_id, userptr, size, flags, flag_to_type(flags))
 {
   if (m_type == AMDXDNA_BO_INVALID)
     shim_err(EINVAL, "Invalid BO flags: 0x%lx", flags);
@@ -89,20 +130,32 @@ bo_kmq(const device& device, xrt_core::hwctx_handle::slot_id ctx_id,
 
 bo_kmq::
 bo_kmq(const device& device, size_t size, amdxdna_bo_type type)
-  : bo_kmq(device, AMDXDNA_INVALID_CTX_HANDLE, size, 0, type)
+  : bo_kmq(device, AMDXDNA_INVALID_CTX_HANDLE, nullptr, size, 0, type)
 {
 }
 
 bo_kmq::
 bo_kmq(const device& device, xrt_core::hwctx_handle::slot_id ctx_id,
-  size_t size, uint64_t flags, amdxdna_bo_type type)
+  void* userptr, size_t size, uint64_t flags, amdxdna_bo_type type)
   : bo(device, ctx_id, size, flags, type)
 {
   size_t align = 0;
 
+  if (userptr) {
+    // Driver wraps user memory as SHMEM BO without copying it.
+    if (m_type != AMDXDNA_BO_SHMEM)
+      shim_err(EINVAL, "User ptr BO must be host only BO, type=%d", m_type);
+    auto pg = static_cast<uintptr_t>(getpagesize());
+    if (reinterpret_cast<uintptr_t>(userptr) % pg || size % pg)
+      shim_err(EINVAL, "User ptr BO must be page aligned, userptr=%p size=%ld", userptr, size);
+    m_userptr = userptr;
+  }
+
   if (m_type == AMDXDNA_BO_DEV_HEAP)
     align = 64 * 1024 * 1024; // Device mem heap must align at 64MB boundary.
 
+  if (!m_userptr)
+    m_drm_flags = flag_to_drm_flags(flags, m_type);
   alloc_bo();
   mmap_bo(align);
 
@@ -148,6 +201,9 @@ void
 bo_kmq::
 sync(direction dir, size_t size, size_t offset)
 {
+  stats_record_sync(dir == direction::host2device, size);
+  trace_log(TRACE_OP_BO_SYNC, m_owner_ctx_id, get_drm_bo_handle(), size,
+    dir == direction::host2device);
   if (is_driver_sync()) {
     sync_drm_bo(m_pdev, get_drm_bo_handle(), dir, offset, size);
     return;
@@ -14,7 +14,7 @@ namespace shim_xdna {
 class bo_kmq : public bo {
 public:
   bo_kmq(const device& device, xrt_core::hwctx_handle::slot_id ctx_id,
-    size_t size, uint64_t flags);
+    void* userptr, size_t size, uint64_t flags);
 
   bo_kmq(const device& device, xrt_core::shared_handle::export_handle ehdl);
 
@@ -36,7 +36,7 @@ public:
 
 private:
   bo_kmq(const device& device, xrt_core::hwctx_handle::slot_id ctx_id,
-    size_t size, uint64_t flags, amdxdna_bo_type type);
+    void* userptr, size_t size, uint64_t flags, amdxdna_bo_type type);
 
   // Only for AMDXDNA_BO_CMD type
   std::map<size_t, uint32_t> m_args_map;
@@ -37,10 +37,8 @@ alloc_bo(void* userptr, xrt_core::hwctx_handle::slot_id ctx_id,
   auto f = xcl_bo_flags{flags};
   if (f.boflags == 0)
     shim_not_supported_err("unsupported buffer type: none flag");
-  if (userptr)
-    shim_not_supported_err("User ptr BO");
 
-  return std::make_unique<bo_kmq>(*this, ctx_id, size, flags);
+  return std::make_unique<bo_kmq>(*this, ctx_id, userptr, size, flags);
 }
 
 std::unique_ptr<xrt_core::buffer_handle>
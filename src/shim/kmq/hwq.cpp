@@ -38,6 +38,7 @@ issue_command(xrt_core::buffer_handle *cmd_bo)
     .arg_count = static_cast<uint32_t>(boh->get_arg_bo_handles(arg_bo_hdls, max_arg_bos)),
   };
   m_pdev.ioctl(DRM_IOCTL_AMDXDNA_EXEC_CMD, &ecmd);
+  trace_log(TRACE_OP_SUBMIT, ecmd.hwctx, cmd_bo_hdl, ecmd.seq, 0, arg_bo_hdls, ecmd.arg_count);
 
   auto id = ecmd.seq;
   boh->set_cmd_id(id);
@@ -5,6 +5,7 @@
 #include "pcidev.h"
 #include "pcidrv.h"
 #include "shim_debug.h"
+#include "stats.h"
 #include "drm_local/amdxdna_accel.h"
 #include "core/common/trace.h"
 
@@ -30,10 +31,14 @@ namespace {
       return "DRM_IOCTL_AMDXDNA_EXEC_CMD";
     case DRM_IOCTL_AMDXDNA_WAIT_CMD:
       return "DRM_IOCTL_AMDXDNA_WAIT_CMD";
+    case DRM_IOCTL_AMDXDNA_SYNC_BO_VEC:
+      return "DRM_IOCTL_AMDXDNA_SYNC_BO_VEC";
     case DRM_IOCTL_AMDXDNA_GET_INFO:
       return "DRM_IOCTL_AMDXDNA_GET_INFO";
     case DRM_IOCTL_AMDXDNA_SET_STATE:
       return "DRM_IOCTL_AMDXDNA_SET_STATE";
+    case DRM_IOCTL_AMDXDNA_RESUME:
+      return "DRM_IOCTL_AMDXDNA_RESUME";
     case DRM_IOCTL_GEM_CLOSE:
       return "DRM_IOCTL_GEM_CLOSE";
     case DRM_IOCTL_PRIME_HANDLE_TO_FD:
@@ -93,13 +98,22 @@ open() const
   const std::lock_guard<std::mutex> lock(m_lock);
 
   if (m_dev_users == 0) {
-    fd = xrt_core::pci::dev::open("", O_RDWR);
+    fd = open_node();
     if (fd < 0)
       shim_err(EINVAL, "Failed to open KMQ device");
     else
       shim_debug("Device opened, fd=%d", fd);
     // Publish the fd for other threads to use.
     m_dev_fd = fd;
+
+    // Let the device resume while we prepare buffers, the first ioctl which
+    // needs it waits. Drivers without this ioctl resume the device at open.
+    amdxdna_drm_resume rarg = { .flags = AMDXDNA_RESUME_ASYNC };
+    try {
+      ioctl(DRM_IOCTL_AMDXDNA_RESUME, &rarg);
+    } catch (const xrt_core::system_error& e) {
+      shim_debug("Async resume not supported: %s", e.what());
+    }
   }
   ++m_dev_users;
 
@@ -120,17 +134,32 @@ close() const
     // Stop new users of the fd from other threads.
     fd = m_dev_fd;
     m_dev_fd = -1;
-    // Kernel will wait for existing users to quit.
-    ::close(fd);
+    close_node(fd);
     shim_debug("Device closed, fd=%d", fd);
   }
 }
 
+int
+pdev::
+open_node() const
+{
+  return xrt_core::pci::dev::open("", O_RDWR);
+}
+
+void
+pdev::
+close_node(int fd) const
+{
+  // Kernel will wait for existing users to quit.
+  ::close(fd);
+}
+
 void
 pdev::
 ioctl(unsigned long cmd, void* arg) const
 {
   XRT_TRACE_POINT_SCOPE2(ioctl, cmd, arg);
+  stats_ioctl_scope stats(cmd);
   if (xrt_core::pci::dev::ioctl(m_dev_fd, cmd, arg) == -1)
     shim_err(errno, "%s IOCTL failed", ioctl_cmd2name(cmd).c_str());
 }
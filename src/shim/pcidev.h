@@ -28,13 +28,13 @@ public:
   { shim_not_supported_err(__func__); }
 
 public:
-  void
+  virtual void
   ioctl(unsigned long cmd, void* arg) const;
 
-  void*
+  virtual void*
   mmap(void *addr, size_t len, int prot, int flags, off_t offset) const;
 
-  void
+  virtual void
   munmap(void* addr, size_t len) const;
 
   void
@@ -49,6 +49,12 @@ private:
   virtual void
   on_last_close() const {}
 
+  // Open and close the device node, overridden by pdev_emu which has no node.
+  virtual int
+  open_node() const;
+  virtual void
+  close_node(int fd) const;
+
   mutable int m_dev_fd = -1;
   mutable int m_dev_users = 0;
   mutable std::mutex m_lock;
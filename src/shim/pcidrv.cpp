@@ -3,6 +3,9 @@
 //
 #include "kmq/pcidev.h"
 #include "umq/pcidev.h"
+#ifdef XDNA_SHIM_EMU
+#include "emu/pcidev.h"
+#endif
 #include "drm_local/amdxdna_accel.h"
 #include "pcidev.h"
 #include "pcidrv.h"
@@ -70,6 +73,22 @@ is_user() const
   return true;
 }
 
+void
+drv::
+scan_devices(std::vector<std::shared_ptr<xrt_core::pci::dev>>& ready_list,
+  std::vector<std::shared_ptr<xrt_core::pci::dev>>& nonready_list) const
+{
+#ifdef XDNA_SHIM_EMU
+  if (pdev_emu::enabled()) {
+    // Emulated device only, no driver or silicon needed
+    auto driver = std::static_pointer_cast<const drv>(shared_from_this());
+    ready_list.push_back(std::make_shared<pdev_emu>(driver, pdev_emu::sysfs_name));
+    return;
+  }
+#endif
+  xrt_core::pci::drv::scan_devices(ready_list, nonready_list);
+}
+
 std::shared_ptr<xrt_core::pci::dev>
 drv::
 create_pcidev(const std::string& sysfs) const
@@ -9,6 +9,7 @@
 #include "core/pcie/linux/pcidrv.h"
 
 #include <string>
+#include <vector>
 
 namespace shim_xdna {
 
@@ -30,6 +31,10 @@ public:
   std::string
   sysfs_dev_node_dir() const override;
 
+  void
+  scan_devices(std::vector<std::shared_ptr<xrt_core::pci::dev>>& ready_list,
+    std::vector<std::shared_ptr<xrt_core::pci::dev>>& nonready_list) const override;
+
 private:
   std::shared_ptr<xrt_core::pci::dev>
   create_pcidev(const std::string& sysfs) const override;
@@ -0,0 +1,283 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2024, Advanced Micro Devices, Inc. All rights reserved.
+
+#include "stats.h"
+
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+
+namespace {
+
+using namespace shim_xdna;
+
+// IOCTLs counted on their own, the rest share the last slot
+const struct {
+  unsigned long m_cmd;
+  const char* m_name;
+} stats_ioctls[] = {
+  { DRM_IOCTL_AMDXDNA_CREATE_HWCTX,     "create_hwctx" },
+  { DRM_IOCTL_AMDXDNA_DESTROY_HWCTX,    "destroy_hwctx" },
+  { DRM_IOCTL_AMDXDNA_CONFIG_HWCTX,     "config_hwctx" },
+  { DRM_IOCTL_AMDXDNA_CREATE_BO,        "create_bo" },
+  { DRM_IOCTL_AMDXDNA_GET_BO_INFO,      "get_bo_info" },
+  { DRM_IOCTL_AMDXDNA_SYNC_BO,          "sync_bo" },
+  { DRM_IOCTL_AMDXDNA_SYNC_BO_VEC,      "sync_bo_vec" },
+  { DRM_IOCTL_AMDXDNA_EXEC_CMD,         "exec_cmd" },
+  { DRM_IOCTL_AMDXDNA_WAIT_CMD,         "wait_cmd" },
+  { DRM_IOCTL_AMDXDNA_GET_INFO,         "get_info" },
+  { DRM_IOCTL_AMDXDNA_SET_STATE,        "set_state" },
+  { DRM_IOCTL_AMDXDNA_RESUME,           "resume" },
+  { DRM_IOCTL_GEM_CLOSE,                "gem_close" },
+  { DRM_IOCTL_PRIME_HANDLE_TO_FD,       "prime_handle_to_fd" },
+  { DRM_IOCTL_PRIME_FD_TO_HANDLE,       "prime_fd_to_handle" },
+  { DRM_IOCTL_SYNCOBJ_CREATE,           "syncobj_create" },
+  { DRM_IOCTL_SYNCOBJ_DESTROY,          "syncobj_destroy" },
+  { DRM_IOCTL_SYNCOBJ_QUERY,            "syncobj_query" },
+  { DRM_IOCTL_SYNCOBJ_TIMELINE_SIGNAL,  "syncobj_timeline_signal" },
+  { DRM_IOCTL_SYNCOBJ_TIMELINE_WAIT,    "syncobj_timeline_wait" },
+};
+const size_t stats_ioctl_slots = std::size(stats_ioctls) + 1;
+
+const char* stats_bo_types[] = {
+  "invalid", "shmem", "dev_heap", "dev", "cmd", "dma",
+};
+
+struct thread_stats
+{
+  stats_hist m_ioctl[stats_ioctl_slots];
+  std::atomic<uint64_t> m_bo_allocs[AMDXDNA_BO_DMA + 1] = {};
+  std::atomic<uint64_t> m_bo_alloc_bytes[AMDXDNA_BO_DMA + 1] = {};
+  std::atomic<uint64_t> m_bo_free_bytes[AMDXDNA_BO_DMA + 1] = {};
+  std::atomic<uint64_t> m_sync_bytes[2] = {}; // from device, to device
+
+  void
+  add_to(thread_stats& dst) const
+  {
+    for (size_t i = 0; i < stats_ioctl_slots; i++)
+      m_ioctl[i].add_to(dst.m_ioctl[i]);
+    for (int i = 0; i <= AMDXDNA_BO_DMA; i++) {
+      dst.m_bo_allocs[i] += m_bo_allocs[i].load(std::memory_order_relaxed);
+      dst.m_bo_alloc_bytes[i] += m_bo_alloc_bytes[i].load(std::memory_order_relaxed);
+      dst.m_bo_free_bytes[i] += m_bo_free_bytes[i].load(std::memory_order_relaxed);
+    }
+    for (int i = 0; i < 2; i++)
+      dst.m_sync_bytes[i] += m_sync_bytes[i].load(std::memory_order_relaxed);
+  }
+};
+
+struct stats_registry
+{
+  std::mutex m_lock;
+  std::set<const thread_stats*> m_threads;
+  // Counters of threads which are gone
+  thread_stats m_exited;
+  std::map<const stats_hist*, uint32_t> m_ctxs;
+};
+
+stats_registry&
+registry()
+{
+  // Never freed, threads may exit after static objects are destroyed
+  static auto r = new stats_registry;
+  return *r;
+}
+
+// Registers the thread's counters on first use, folds them into the exited
+// counters when the thread ends
+struct thread_stats_holder
+{
+  thread_stats m_stats;
+
+  thread_stats_holder()
+  {
+    std::lock_guard<std::mutex> lk(registry().m_lock);
+    registry().m_threads.insert(&m_stats);
+  }
+
+  ~thread_stats_holder()
+  {
+    std::lock_guard<std::mutex> lk(registry().m_lock);
+    m_stats.add_to(registry().m_exited);
+    registry().m_threads.erase(&m_stats);
+  }
+};
+
+thread_stats&
+local_stats()
+{
+  thread_local thread_stats_holder h;
+  return h.m_stats;
+}
+
+inline void
+bump(std::atomic<uint64_t>& v, uint64_t n)
+{
+  v.fetch_add(n, std::memory_order_relaxed);
+}
+
+size_t
+ioctl_slot(unsigned long cmd)
+{
+  size_t i = 0;
+
+  for (; i < std::size(stats_ioctls); i++) {
+    if (stats_ioctls[i].m_cmd == cmd)
+      break;
+  }
+  return i;
+}
+
+void
+hist_to_json(std::ostringstream& os, const stats_hist& h)
+{
+  auto count = h.m_count.load(std::memory_order_relaxed);
+  auto total = h.m_total_ns.load(std::memory_order_relaxed);
+  int last = stats_hist_buckets - 1;
+
+  while (last > 0 && !h.m_buckets[last].load(std::memory_order_relaxed))
+    last--;
+  os << "\"count\": " << count
+     << ", \"avg_us\": " << (count ? total / count / 1000 : 0)
+     << ", \"max_us\": " << h.m_max_ns.load(std::memory_order_relaxed) / 1000
+     << ", \"hist_log2_us\": [";
+  for (int i = 0; i <= last; i++)
+    os << (i ? ", " : "") << h.m_buckets[i].load(std::memory_order_relaxed);
+  os << "]";
+}
+
+}
+
+namespace shim_xdna {
+
+void
+stats_hist::
+add(uint64_t ns)
+{
+  auto us = ns / 1000;
+  int b = 0;
+
+  while (us > 1 && b < stats_hist_buckets - 1) {
+    us >>= 1;
+    b++;
+  }
+  bump(m_count, 1);
+  bump(m_total_ns, ns);
+  bump(m_buckets[b], 1);
+
+  auto max = m_max_ns.load(std::memory_order_relaxed);
+  while (ns > max && !m_max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+    ;
+}
+
+void
+stats_hist::
+add_to(stats_hist& dst) const
+{
+  bump(dst.m_count, m_count.load(std::memory_order_relaxed));
+  bump(dst.m_total_ns, m_total_ns.load(std::memory_order_relaxed));
+  for (int i = 0; i < stats_hist_buckets; i++)
+    bump(dst.m_buckets[i], m_buckets[i].load(std::memory_order_relaxed));
+
+  auto ns = m_max_ns.load(std::memory_order_relaxed);
+  if (ns > dst.m_max_ns.load(std::memory_order_relaxed))
+    dst.m_max_ns.store(ns, std::memory_order_relaxed);
+}
+
+void
+stats_record_ioctl(unsigned long cmd, uint64_t ns)
+{
+  local_stats().m_ioctl[ioctl_slot(cmd)].add(ns);
+}
+
+void
+stats_record_bo_alloc(amdxdna_bo_type type, size_t size)
+{
+  auto& s = local_stats();
+
+  if (type > AMDXDNA_BO_DMA)
+    type = AMDXDNA_BO_INVALID;
+  bump(s.m_bo_allocs[type], 1);
+  bump(s.m_bo_alloc_bytes[type], size);
+}
+
+void
+stats_record_bo_free(amdxdna_bo_type type, size_t size)
+{
+  if (type > AMDXDNA_BO_DMA)
+    type = AMDXDNA_BO_INVALID;
+  bump(local_stats().m_bo_free_bytes[type], size);
+}
+
+void
+stats_record_sync(bool to_device, size_t size)
+{
+  bump(local_stats().m_sync_bytes[to_device], size);
+}
+
+void
+stats_add_ctx(uint32_t ctx_id, const stats_hist* hist)
+{
+  std::lock_guard<std::mutex> lk(registry().m_lock);
+  registry().m_ctxs[hist] = ctx_id;
+}
+
+void
+stats_remove_ctx(const stats_hist* hist)
+{
+  std::lock_guard<std::mutex> lk(registry().m_lock);
+  registry().m_ctxs.erase(hist);
+}
+
+std::string
+stats_to_json()
+{
+  auto& r = registry();
+  thread_stats total;
+  std::ostringstream os;
+  bool first = true;
+
+  std::lock_guard<std::mutex> lk(r.m_lock);
+  r.m_exited.add_to(total);
+  for (auto t : r.m_threads)
+    t->add_to(total);
+
+  os << "{\n  \"ioctls\": [";
+  for (size_t i = 0; i < stats_ioctl_slots; i++) {
+    if (!total.m_ioctl[i].m_count)
+      continue;
+    os << (first ? "\n" : ",\n") << "    { \"name\": \""
+       << (i < std::size(stats_ioctls) ? stats_ioctls[i].m_name : "other") << "\", ";
+    hist_to_json(os, total.m_ioctl[i]);
+    os << " }";
+    first = false;
+  }
+
+  os << "\n  ],\n  \"bos\": [";
+  first = true;
+  for (int i = 0; i <= AMDXDNA_BO_DMA; i++) {
+    if (!total.m_bo_allocs[i])
+      continue;
+    os << (first ? "\n" : ",\n") << "    { \"type\": \"" << stats_bo_types[i]
+       << "\", \"allocs\": " << total.m_bo_allocs[i]
+       << ", \"alloc_bytes\": " << total.m_bo_alloc_bytes[i]
+       << ", \"free_bytes\": " << total.m_bo_free_bytes[i] << " }";
+    first = false;
+  }
+
+  os << "\n  ],\n  \"sync_bytes\": { \"to_device\": " << total.m_sync_bytes[1]
+     << ", \"from_device\": " << total.m_sync_bytes[0] << " },\n  \"contexts\": [";
+  first = true;
+  for (auto& c : r.m_ctxs) {
+    os << (first ? "\n" : ",\n") << "    { \"id\": " << c.second << ", ";
+    hist_to_json(os, *c.first);
+    os << " }";
+    first = false;
+  }
+  os << "\n  ]\n}\n";
+  return os.str();
+}
+
+} // namespace shim_xdna
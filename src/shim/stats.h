@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2024, Advanced Micro Devices, Inc. All rights reserved.
+
+#ifndef _STATS_XDNA_H_
+#define _STATS_XDNA_H_
+
+#include "core/common/query_requests.h"
+#include "drm_local/amdxdna_accel.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace shim_xdna {
+
+// Bucket i counts latencies in [2^i, 2^(i+1)) us, bucket 0 also takes
+// anything below 1 us and the last bucket anything above.
+const int stats_hist_buckets = 24;
+
+// Latency histogram, all updates are relaxed atomics so it can be bumped from
+// any thread and read while being bumped.
+struct stats_hist
+{
+  std::atomic<uint64_t> m_count{0};
+  std::atomic<uint64_t> m_total_ns{0};
+  std::atomic<uint64_t> m_max_ns{0};
+  std::atomic<uint64_t> m_buckets[stats_hist_buckets] = {};
+
+  void
+  add(uint64_t ns);
+
+  void
+  add_to(stats_hist& dst) const;
+};
+
+// Always on counters of the shim hot paths, for the whole process. Each
+// thread bumps its own copy of the per call counters, which are only summed
+// up when somebody asks, so threads never share a cache line on the hot path.
+// Command latency is kept per HW context instead, in its HW queue.
+void
+stats_record_ioctl(unsigned long cmd, uint64_t ns);
+
+void
+stats_record_bo_alloc(amdxdna_bo_type type, size_t size);
+
+void
+stats_record_bo_free(amdxdna_bo_type type, size_t size);
+
+void
+stats_record_sync(bool to_device, size_t size);
+
+// A HW queue publishes its command latency histogram while bound to a context
+void
+stats_add_ctx(uint32_t ctx_id, const stats_hist* hist);
+
+void
+stats_remove_ctx(const stats_hist* hist);
+
+// All counters in JSON, for tools to print
+std::string
+stats_to_json();
+
+// Times one ioctl, failed ones included
+class stats_ioctl_scope
+{
+public:
+  stats_ioctl_scope(unsigned long cmd)
+    : m_cmd(cmd)
+    , m_start(std::chrono::steady_clock::now())
+  {}
+
+  ~stats_ioctl_scope()
+  {
+    auto d = std::chrono::steady_clock::now() - m_start;
+    stats_record_ioctl(m_cmd, std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+  }
+
+private:
+  unsigned long m_cmd;
+  std::chrono::steady_clock::time_point m_start;
+};
+
+// Query request for the counters above. XRT has no key for it yet, so it uses
+// one well above the range XRT assigns, which only the XDNA shim answers.
+struct query_shim_stats : xrt_core::query::request
+{
+  using result_type = std::string;
+  static const xrt_core::query::key_type key = static_cast<xrt_core::query::key_type>(0x10000);
+  static const char* name() { return "xdna_shim_stats"; }
+
+  static std::string
+  to_string(const result_type& value)
+  { return value; }
+
+  std::any
+  get(const xrt_core::device*) const override = 0;
+};
+
+} // namespace shim_xdna
+
+#endif // _STATS_XDNA_H_
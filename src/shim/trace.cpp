@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2024, Advanced Micro Devices, Inc. All rights reserved.
+
+#include "trace.h"
+#include "shim_debug.h"
+
+#include "core/common/config_reader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <unistd.h>
+
+namespace {
+
+using namespace shim_xdna;
+
+class trace_writer
+{
+public:
+  trace_writer()
+  {
+    auto prefix = xrt_core::config::detail::get_string_value("Debug.xdna_trace", "");
+    if (prefix.empty())
+      return;
+
+    auto path = prefix + "." + std::to_string(getpid());
+    m_file = std::fopen(path.c_str(), "wb");
+    if (!m_file) {
+      shim_debug("Failed to open trace file %s: %s", path.c_str(), std::strerror(errno));
+      return;
+    }
+    // Records are small, let stdio batch them into large writes
+    std::setvbuf(m_file, nullptr, _IOFBF, 1 << 20);
+
+    trace_file_header h = {};
+    std::memcpy(h.magic, trace_magic, sizeof(h.magic));
+    h.version = trace_version;
+    h.record_size = sizeof(trace_record);
+    h.pid = getpid();
+    h.start_realtime_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+    std::fwrite(&h, sizeof(h), 1, m_file);
+
+    m_start = std::chrono::steady_clock::now();
+    m_enabled = true;
+    shim_debug("Capturing shim trace to %s", path.c_str());
+  }
+
+  bool
+  enabled() const
+  {
+    return m_enabled.load(std::memory_order_relaxed);
+  }
+
+  void
+  write(trace_record& r, const uint32_t* args)
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+
+    if (!m_file)
+      return;
+    // Stamped under the lock so the file is in time order
+    r.ts_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - m_start).count();
+    std::fwrite(&r, sizeof(r), 1, m_file);
+    if (r.nargs)
+      std::fwrite(args, sizeof(*args), r.nargs, m_file);
+  }
+
+  void
+  flush()
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+
+    if (m_file)
+      std::fflush(m_file);
+  }
+
+private:
+  std::mutex m_lock;
+  std::FILE* m_file = nullptr;
+  std::atomic<bool> m_enabled{false};
+  std::chrono::steady_clock::time_point m_start;
+};
+
+trace_writer&
+writer()
+{
+  // Never freed, BOs may be freed after static objects are destroyed. The
+  // file is flushed at exit, anything logged after that is flushed when
+  // exit() closes the open streams.
+  static auto w = [] {
+    auto p = new trace_writer;
+    if (p->enabled())
+      std::atexit([] { writer().flush(); });
+    return p;
+  }();
+  return *w;
+}
+
+}
+
+namespace shim_xdna {
+
+void
+trace_log(trace_op op, uint32_t ctx, uint64_t a, uint64_t b, uint8_t flags,
+  const uint32_t* args, size_t nargs)
+{
+  auto& w = writer();
+
+  if (!w.enabled())
+    return;
+
+  trace_record r = {};
+  r.op = op;
+  r.flags = flags;
+  r.nargs = static_cast<uint16_t>(std::min<size_t>(nargs, std::numeric_limits<uint16_t>::max()));
+  r.ctx = ctx;
+  r.a = a;
+  r.b = b;
+  w.write(r, args);
+}
+
+} // namespace shim_xdna
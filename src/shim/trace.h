@@ -0,0 +1,22 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2024, Advanced Micro Devices, Inc. All rights reserved.
+
+#ifndef _TRACE_XDNA_H_
+#define _TRACE_XDNA_H_
+
+#include "trace_format.h"
+
+#include <cstddef>
+
+namespace shim_xdna {
+
+// Capture of shim operations, to be replayed by shim_replay. It is off unless
+// Debug.xdna_trace in xrt.ini names a file prefix, each process then writes
+// <prefix>.<pid>. Only sizes, handles and timing are recorded, never data.
+void
+trace_log(trace_op op, uint32_t ctx, uint64_t a, uint64_t b, uint8_t flags = 0,
+  const uint32_t* args = nullptr, size_t nargs = 0);
+
+} // namespace shim_xdna
+
+#endif // _TRACE_XDNA_H_
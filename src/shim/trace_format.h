@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2024, Advanced Micro Devices, Inc. All rights reserved.
+
+#ifndef _TRACE_FORMAT_XDNA_H_
+#define _TRACE_FORMAT_XDNA_H_
+
+// On disk format of the shim operation trace. Shared by the shim, which
+// writes it, and by shim_replay, which reads it, so no XRT dependency here.
+//
+// A trace file is one trace_file_header followed by trace_records. A submit
+// record is followed by nargs uint32_t arg BO handles. Handles are the DRM
+// handles of the capturing process, they only link records together.
+
+#include <cstdint>
+
+namespace shim_xdna {
+
+const char trace_magic[8] = { 'X', 'D', 'N', 'A', 'T', 'R', 'C', '\0' };
+const uint32_t trace_version = 1;
+
+struct trace_file_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  int32_t pid;
+  uint32_t reserved;
+  // Wall clock at capture start, for reference only
+  uint64_t start_realtime_ns;
+};
+
+//                          ctx        a            b           flags
+enum trace_op : uint8_t {
+  TRACE_OP_CTX_CREATE = 1,  // slot
+  TRACE_OP_CTX_DESTROY,     // slot
+  TRACE_OP_BO_ALLOC,        // owner      BO handle    size        BO type
+  TRACE_OP_BO_IMPORT,       //            BO handle    size        BO type
+  TRACE_OP_BO_FREE,         //            BO handle
+  TRACE_OP_BO_SYNC,         // owner      BO handle    size        1: to device
+  TRACE_OP_SUBMIT,          // slot       cmd BO       seq
+  TRACE_OP_WAIT,            // slot       cmd BO       ns waited   trace_wait_*
+  TRACE_OP_FENCE_CREATE,    //            syncobj      source      1: clone of b
+  TRACE_OP_FENCE_SIGNAL,    // slot       syncobj      point       1: by host
+  TRACE_OP_FENCE_WAIT,      // slot       syncobj      point       1: by host
+  TRACE_OP_MAX
+};
+
+enum trace_wait_flag : uint8_t {
+  TRACE_WAIT_DONE = 0,
+  TRACE_WAIT_TIMEOUT,
+  // Seen done by a poll, without blocking
+  TRACE_WAIT_POLLED,
+};
+
+struct trace_record
+{
+  // When the operation returned, since capture start
+  uint64_t ts_ns;
+  uint8_t op;
+  uint8_t flags;
+  uint16_t nargs;
+  uint32_t ctx;
+  uint64_t a;
+  uint64_t b;
+};
+
+static_assert(sizeof(trace_record) == 32, "trace record size is part of the format");
+
+} // namespace shim_xdna
+
+#endif // _TRACE_FORMAT_XDNA_H_
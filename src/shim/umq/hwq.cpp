@@ -421,6 +421,7 @@ issue_command(xrt_core::buffer_handle *cmd_bo)
   uint64_t comp = boh->get_properties().paddr + offsetof(ert_start_kernel_cmd, header);
 
   auto id = issue_exec_buf(ffs(cmd->cu_mask) - 1, dpu_data, comp);
+  trace_log(TRACE_OP_SUBMIT, m_hwctx->get_slotidx(), boh->get_drm_bo_handle(), id);
   boh->set_cmd_id(id);
   shim_debug("Submitted command (%ld)", id);
 }
@@ -0,0 +1,24 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2024, Advanced Micro Devices, Inc. All rights reserved.
+
+#ifndef _XDNA_TEST_PERCENTILE_H_
+#define _XDNA_TEST_PERCENTILE_H_
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// Nearest rank percentile, p in [0, 1], of a sorted non-empty sample
+template <typename T>
+T
+percentile(const std::vector<T>& sorted, double p)
+{
+  auto idx = static_cast<size_t>(std::ceil(p * sorted.size()));
+  return sorted[std::clamp<size_t>(idx, 1, sorted.size()) - 1];
+}
+
+}
+
+#endif // _XDNA_TEST_PERCENTILE_H_
@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2024, Advanced Micro Devices, Inc. All rights reserved.
+
+// Converts an io test data directory (mc_code.txt, ddr_range.txt, ifm.bin and
+// param.bin) to the binary io pack shim_test loads in its place.
+
+#include "io_pack.h"
+
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+namespace {
+
+void
+usage(const std::string& prog)
+{
+  std::cout << "\nUsage: " << prog << " [options] <data_dir>\n";
+  std::cout << "Options:\n";
+  std::cout << "\t" << "-h" << ": print this help message\n";
+  std::cout << "\t" << "-o <file>" << ": write the pack to file, default is <data_dir>/" << io_pack_file << "\n";
+  std::cout << std::endl;
+}
+
+}
+
+int
+main(int argc, char **argv)
+{
+  std::string program = std::filesystem::path(argv[0]).filename();
+  std::string out;
+
+  int option;
+  while ((option = getopt(argc, argv, ":ho:")) != -1) {
+    switch (option) {
+    case 'h':
+      usage(program);
+      return 0;
+    case 'o':
+      out = optarg;
+      break;
+    case '?':
+      std::cout << "Unknown option: " << static_cast<char>(optopt) << std::endl;
+      return 1;
+    case ':':
+      std::cout << "Missing value for option: " << argv[optind-1] << std::endl;
+      return 1;
+    default:
+      usage(program);
+      return 1;
+    }
+  }
+
+  if (optind != argc - 1) {
+    usage(program);
+    return 1;
+  }
+
+  std::string data_path = std::string(argv[optind]) + "/";
+  if (out.empty())
+    out = data_path + io_pack_file;
+
+  try {
+    write_io_pack(data_path, out);
+
+    // Read it back the way shim_test does
+    io_pack pack(out);
+    auto tp = pack.config();
+    std::cout << "Wrote " << out << ": "
+      << pack.section_size(IO_PACK_INSTRUCTION) / sizeof(uint32_t) << " instruction words, "
+      << pack.section_size(IO_PACK_INPUT) << " ifm bytes, "
+      << pack.section_size(IO_PACK_PARAMETERS) << " param bytes, "
+      << "ofm_size " << OFM_SIZE(tp) << std::endl;
+  } catch (const std::exception& ex) {
+    std::cout << "Failed to convert " << data_path << ": " << ex.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+// vim: ts=2 sw=2 expandtab
@@ -0,0 +1,476 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2024, Advanced Micro Devices, Inc. All rights reserved.
+//
+// WARNING: This file contains benchmarks calling XRT's SHIM layer APIs directly.
+// These APIs are XRT's internal APIs and are not meant for any external XRT
+// user to call. We can't provide any support if you use APIs here and run into issues.
+
+#include "dev_info.h"
+#include "hwctx.h"
+#include "bo.h"
+#include "io.h"
+#include "percentile.h"
+
+#include "core/common/query_requests.h"
+#include "core/common/system.h"
+#include "core/common/device.h"
+#include "core/common/shim/fence_handle.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include <libgen.h>
+#include <unistd.h>
+
+// Used by dev_info.cpp to locate xclbin and workspace
+std::string cur_path;
+std::string xclbin_path;
+
+namespace {
+
+using namespace xrt_core;
+using clk = std::chrono::steady_clock;
+using ns_t = std::chrono::nanoseconds;
+
+// One benchmarked operation. Only run() is timed, setup() and teardown() are
+// called around it on every iteration when the operation consumes its input.
+struct bench_op {
+  std::function<void()> setup;
+  std::function<void()> run;
+  std::function<void()> teardown;
+};
+
+struct bench_case {
+  const std::string name;
+  bool (*dev_filter)(device *dev);
+  // Objects needed by the operation are owned by the returned closures
+  std::function<bench_op(device *dev)> init;
+};
+
+struct bench_config {
+  uint64_t min_time_ms = 500;
+  uint64_t min_iters = 10;
+  uint64_t max_iters = 100000;
+  uint64_t warmup_iters = 10;
+};
+
+struct bench_result {
+  std::string name;
+  uint64_t iters;
+  double ops_per_sec;
+  double mean_ns;
+  uint64_t min_ns;
+  uint64_t p50_ns;
+  uint64_t p90_ns;
+  uint64_t p99_ns;
+  uint64_t p999_ns;
+  uint64_t max_ns;
+};
+
+// Device filters
+
+bool
+any_dev(device *dev)
+{
+  return true;
+}
+
+bool
+kmq_dev(device *dev)
+{
+  auto device_id = device_query<query::pcie_device>(dev);
+  return device_id == npu1_device_id || device_id == npu2_device_id;
+}
+
+// BO flavors and sizes to sweep
+
+const std::vector<std::pair<const char *, uint32_t>> bo_types = {
+  { "host_only", XCL_BO_FLAGS_HOST_ONLY },
+  { "cacheable", XCL_BO_FLAGS_CACHEABLE },
+  { "execbuf", XCL_BO_FLAGS_EXECBUF },
+};
+
+const std::vector<size_t> bo_sizes = { 0x1000, 0x10000, 0x100000, 0x1000000 };
+
+// Command BOs are small and kernel mapped, only exercise sizes they are used with
+const size_t max_execbuf_size = 0x10000;
+
+std::string
+size2str(size_t size)
+{
+  if (size >= 0x100000)
+    return std::to_string(size >> 20) + "M";
+  return std::to_string(size >> 10) + "K";
+}
+
+// Benchmark bodies
+
+bench_op
+bo_alloc_free(device *dev, uint32_t flags, size_t size)
+{
+  auto boflags = get_bo_flags(flags, 0);
+
+  return { nullptr, [=] { dev->alloc_bo(nullptr, size, boflags); }, nullptr };
+}
+
+bench_op
+bo_map(device *dev, size_t size)
+{
+  auto boh = std::make_shared<std::unique_ptr<buffer_handle>>();
+
+  // Map and fault in every page of a fresh BO
+  return {
+    [=] { *boh = dev->alloc_bo(nullptr, size, get_bo_flags(XCL_BO_FLAGS_HOST_ONLY, 0)); },
+    [=] {
+      auto p = static_cast<volatile char *>((*boh)->map(buffer_handle::map_type::write));
+      for (size_t off = 0; off < size; off += getpagesize())
+        p[off] = 0;
+    },
+    [=] { boh->reset(); },
+  };
+}
+
+bench_op
+bo_sync(device *dev, buffer_handle::direction dir, size_t size)
+{
+  std::shared_ptr<bo> tbo = std::make_shared<bo>(dev, size, XCL_BO_FLAGS_HOST_ONLY);
+
+  return { nullptr, [=] { tbo->get()->sync(dir, size, 0); }, nullptr };
+}
+
+class submit_wait_ctx {
+public:
+  submit_wait_ctx(device *dev)
+    : m_boset(dev, get_xclbin_workspace(dev) + "/data/")
+    , m_hwctx(dev)
+  {
+    // All zero control code makes a no-op kernel
+    auto ibo = m_boset.get_bos()[IO_TEST_BO_INSTRUCTION].tbo;
+    std::memset(ibo->map(), 0, ibo->size());
+
+    m_hwq = m_hwctx.get()->get_hw_queue();
+    std::string ip_name;
+    for (auto& ip : get_xclbin_ip_name2index(dev)) {
+      if (std::regex_match(ip.first, std::regex("DPU.*"))) {
+        ip_name = ip.first;
+        break;
+      }
+    }
+    if (ip_name.empty())
+      throw std::runtime_error("Cannot find any kernel name matched DPU.*");
+    m_boset.init_cmd(m_hwctx.get()->open_cu_context(ip_name), false);
+    m_boset.sync_before_run();
+    m_cbo = m_boset.get_bos()[IO_TEST_BO_CMD].tbo.get();
+    m_cmd = reinterpret_cast<ert_start_kernel_cmd *>(m_cbo->map());
+  }
+
+  void
+  run()
+  {
+    m_cmd->state = ERT_CMD_STATE_NEW;
+    m_hwq->submit_command(m_cbo->get());
+    m_hwq->wait_command(m_cbo->get(), 0);
+    if (m_cmd->state != ERT_CMD_STATE_COMPLETED)
+      throw std::runtime_error(std::string("Command failed, state=") + std::to_string(m_cmd->state));
+  }
+
+private:
+  io_test_bo_set m_boset;
+  hw_ctx m_hwctx;
+  hwqueue_handle *m_hwq;
+  bo *m_cbo;
+  ert_start_kernel_cmd *m_cmd;
+};
+
+bench_op
+submit_wait(device *dev)
+{
+  auto ctx = std::make_shared<submit_wait_ctx>(dev);
+
+  return { nullptr, [=] { ctx->run(); }, nullptr };
+}
+
+bench_op
+fence_create_destroy(device *dev)
+{
+  return { nullptr, [=] { dev->create_fence(fence_handle::access_mode::local); }, nullptr };
+}
+
+bench_op
+fence_signal_wait(device *dev)
+{
+  // A fence handle is either signaled or waited on, use two for the same syncobj
+  std::shared_ptr<fence_handle> sfence = dev->create_fence(fence_handle::access_mode::local);
+  auto share = sfence->share();
+  std::shared_ptr<fence_handle> wfence = dev->import_fence(getpid(), share->get_export_handle());
+
+  return { nullptr, [=] { sfence->signal(); wfence->wait(0); }, nullptr };
+}
+
+template <typename QueryRequestType>
+bench_op
+query_lookup(device *dev)
+{
+  return { nullptr, [=] { device_query<QueryRequestType>(dev); }, nullptr };
+}
+
+std::vector<bench_case>
+build_bench_list()
+{
+  std::vector<bench_case> list;
+
+  for (auto& [tname, flags] : bo_types) {
+    for (auto size : bo_sizes) {
+      if (flags == XCL_BO_FLAGS_EXECBUF && size > max_execbuf_size)
+        continue;
+      auto f = flags;
+      list.push_back({ std::string("bo_alloc_free/") + tname + "/" + size2str(size), any_dev,
+        [=] (device *dev) { return bo_alloc_free(dev, f, size); } });
+    }
+  }
+  for (auto size : bo_sizes) {
+    list.push_back({ "bo_map/" + size2str(size), any_dev,
+      [=] (device *dev) { return bo_map(dev, size); } });
+  }
+  for (auto size : bo_sizes) {
+    list.push_back({ "bo_sync/h2d/" + size2str(size), any_dev,
+      [=] (device *dev) { return bo_sync(dev, buffer_handle::direction::host2device, size); } });
+    list.push_back({ "bo_sync/d2h/" + size2str(size), any_dev,
+      [=] (device *dev) { return bo_sync(dev, buffer_handle::direction::device2host, size); } });
+  }
+  list.push_back({ "submit_wait/noop", kmq_dev, submit_wait });
+  list.push_back({ "fence/create_destroy", any_dev, fence_create_destroy });
+  list.push_back({ "fence/signal_wait", any_dev, fence_signal_wait });
+  list.push_back({ "query/device_class", any_dev, query_lookup<query::device_class> });
+  list.push_back({ "query/pcie_vendor", any_dev, query_lookup<query::pcie_vendor> });
+  list.push_back({ "query/rom_vbnv", any_dev, query_lookup<query::rom_vbnv> });
+  list.push_back({ "query/aie_tiles_stats", any_dev, query_lookup<query::aie_tiles_stats> });
+  list.push_back({ "query/firmware_version", any_dev, query_lookup<query::firmware_version> });
+  return list;
+}
+
+// Runner and reporting
+
+uint64_t
+run_once(bench_op& op)
+{
+  if (op.setup)
+    op.setup();
+  auto start = clk::now();
+  op.run();
+  auto end = clk::now();
+  if (op.teardown)
+    op.teardown();
+  return std::chrono::duration_cast<ns_t>(end - start).count();
+}
+
+bench_result
+run_bench(const bench_case& bc, device *dev, const bench_config& cfg)
+{
+  auto op = bc.init(dev);
+  std::vector<uint64_t> samples;
+
+  for (uint64_t i = 0; i < cfg.warmup_iters; i++)
+    run_once(op);
+
+  samples.reserve(cfg.max_iters);
+  auto deadline = clk::now() + std::chrono::milliseconds(cfg.min_time_ms);
+  while (samples.size() < cfg.max_iters &&
+    (samples.size() < cfg.min_iters || clk::now() < deadline))
+    samples.push_back(run_once(op));
+
+  std::sort(samples.begin(), samples.end());
+  uint64_t total = 0;
+  for (auto s : samples)
+    total += s;
+
+  bench_result r;
+  r.name = bc.name;
+  r.iters = samples.size();
+  r.mean_ns = static_cast<double>(total) / samples.size();
+  r.ops_per_sec = total ? samples.size() * 1e9 / total : 0;
+  r.min_ns = samples.front();
+  r.p50_ns = percentile(samples, 0.5);
+  r.p90_ns = percentile(samples, 0.9);
+  r.p99_ns = percentile(samples, 0.99);
+  r.p999_ns = percentile(samples, 0.999);
+  r.max_ns = samples.back();
+  return r;
+}
+
+void
+print_header()
+{
+  std::cout << std::left << std::setw(32) << "benchmark" << std::right
+            << std::setw(10) << "iters" << std::setw(14) << "ops/sec"
+            << std::setw(12) << "p50(ns)" << std::setw(12) << "p90(ns)"
+            << std::setw(12) << "p99(ns)" << std::setw(12) << "p999(ns)" << std::endl;
+}
+
+void
+print_result(const bench_result& r)
+{
+  std::ios_base::fmtflags f(std::cout.flags());
+
+  std::cout << std::left << std::setw(32) << r.name << std::right
+            << std::setw(10) << r.iters
+            << std::setw(14) << std::fixed << std::setprecision(0) << r.ops_per_sec
+            << std::setw(12) << r.p50_ns << std::setw(12) << r.p90_ns
+            << std::setw(12) << r.p99_ns << std::setw(12) << r.p999_ns << std::endl;
+  std::cout.flags(f);
+}
+
+void
+write_json(const std::string& path, device::id_type id, device *dev,
+  const bench_config& cfg, const std::vector<bench_result>& results)
+{
+  std::ofstream out(path);
+  if (!out)
+    throw std::runtime_error("Failed to open " + path);
+
+  auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+  out << "{\n";
+  out << "  \"context\": {\n";
+  out << "    \"date\": " << now << ",\n";
+  out << "    \"device_index\": " << id << ",\n";
+  out << "    \"vbnv\": \"" << device_query<query::rom_vbnv>(dev) << "\",\n";
+  out << "    \"pcie_device\": " << device_query<query::pcie_device>(dev) << ",\n";
+  out << "    \"min_time_ms\": " << cfg.min_time_ms << ",\n";
+  out << "    \"max_iters\": " << cfg.max_iters << "\n";
+  out << "  },\n";
+  out << "  \"benchmarks\": [";
+  for (size_t i = 0; i < results.size(); i++) {
+    auto& r = results[i];
+    out << (i ? "," : "") << "\n    {\n";
+    out << "      \"name\": \"" << r.name << "\",\n";
+    out << "      \"iterations\": " << r.iters << ",\n";
+    out << std::fixed << std::setprecision(1);
+    out << "      \"ops_per_sec\": " << r.ops_per_sec << ",\n";
+    out << "      \"mean_ns\": " << r.mean_ns << ",\n";
+    out << "      \"min_ns\": " << r.min_ns << ",\n";
+    out << "      \"p50_ns\": " << r.p50_ns << ",\n";
+    out << "      \"p90_ns\": " << r.p90_ns << ",\n";
+    out << "      \"p99_ns\": " << r.p99_ns << ",\n";
+    out << "      \"p999_ns\": " << r.p999_ns << ",\n";
+    out << "      \"max_ns\": " << r.max_ns << "\n";
+    out << "    }";
+  }
+  out << "\n  ]\n}\n";
+  std::cout << "Results written to " << path << std::endl;
+}
+
+void
+usage(const std::string& prog)
+{
+  std::cout << "\nUsage: " << prog << " [options]\n";
+  std::cout << "Options:\n";
+  std::cout << "\t" << "-h" << ": print this help message\n";
+  std::cout << "\t" << "-l" << ": list all benchmarks\n";
+  std::cout << "\t" << "-d <index>" << ": device index, default 0\n";
+  std::cout << "\t" << "-f <regex>" << ": only run benchmarks whose name matches\n";
+  std::cout << "\t" << "-t <ms>" << ": minimum time per benchmark, default 500\n";
+  std::cout << "\t" << "-n <iters>" << ": maximum iterations per benchmark, default 100000\n";
+  std::cout << "\t" << "-o <json_path>" << ": also write results as JSON\n";
+  std::cout << "\t" << "-x <xclbin_path>" << ": run benchmarks with specified xclbin file\n";
+  std::cout << "\nSet Debug.xdna_emulation=true in xrt.ini and run the copy in bins/emu/bin to run on the emulated device.\n";
+  std::cout << std::endl;
+}
+
+}
+
+int
+main(int argc, char **argv)
+{
+  std::string program = std::filesystem::path(argv[0]).filename();
+  auto bench_list = build_bench_list();
+  device::id_type dev_id = 0;
+  std::string filter = ".*";
+  std::string json_path;
+  bench_config cfg;
+
+  int option;
+  while ((option = getopt(argc, argv, ":hld:f:t:n:o:x:")) != -1) {
+    switch (option) {
+    case 'h':
+      usage(program);
+      return 0;
+    case 'l':
+      for (auto& b : bench_list)
+        std::cout << b.name << std::endl;
+      return 0;
+    case 'd':
+      dev_id = std::stoul(optarg);
+      break;
+    case 'f':
+      filter = optarg;
+      break;
+    case 't':
+      cfg.min_time_ms = std::stoull(optarg);
+      break;
+    case 'n':
+      cfg.max_iters = std::max<uint64_t>(std::stoull(optarg), 1);
+      cfg.min_iters = std::min(cfg.min_iters, cfg.max_iters);
+      break;
+    case 'o':
+      json_path = optarg;
+      break;
+    case 'x': {
+      std::ifstream xclbin(optarg);
+      if (!xclbin) {
+        std::cout << "Failed to open xclbin file: " << optarg << std::endl;
+        return 1;
+      }
+      xclbin_path = optarg;
+      break;
+    }
+    case '?':
+      std::cout << "Unknown option: " << static_cast<char>(optopt) << std::endl;
+      return 1;
+    case ':':
+      std::cout << "Missing value for option: " << argv[optind-1] << std::endl;
+      return 1;
+    default:
+      usage(program);
+      return 1;
+    }
+  }
+
+  cur_path = dirname(argv[0]);
+  setenv("XILINX_XRT", (cur_path + "/../").c_str(), true);
+
+  std::vector<bench_result> results;
+  int failed = 0;
+  try {
+    auto dev = get_userpf_device(dev_id);
+    std::regex re(filter);
+
+    print_header();
+    for (auto& b : bench_list) {
+      if (!std::regex_search(b.name, re) || !b.dev_filter(dev.get()))
+        continue;
+      try {
+        results.push_back(run_bench(b, dev.get(), cfg));
+        print_result(results.back());
+      } catch (const std::exception& ex) {
+        std::cout << b.name << " failed: " << ex.what() << std::endl;
+        failed++;
+      }
+    }
+    if (!json_path.empty())
+      write_json(json_path, dev_id, dev.get(), cfg, results);
+  } catch (const std::exception& ex) {
+    std::cout << ex.what() << std::endl;
+    return 1;
+  }
+  return failed ? 1 : 0;
+}
+
+// vim: ts=2 sw=2 expandtab
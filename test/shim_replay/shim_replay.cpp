@@ -0,0 +1,615 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2024, Advanced Micro Devices, Inc. All rights reserved.
+//
+// WARNING: This file contains a tool calling XRT's SHIM layer APIs directly.
+// These APIs are XRT's internal APIs and are not meant for any external XRT
+// user to call. We can't provide any support if you use APIs here and run into issues.
+
+#include "dev_info.h"
+#include "hwctx.h"
+#include "bo.h"
+#include "exec_buf.h"
+#include "trace_format.h"
+#include "percentile.h"
+
+#include "core/common/system.h"
+#include "core/common/device.h"
+#include "core/common/shim/fence_handle.h"
+#include "drm_local/amdxdna_accel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <regex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <libgen.h>
+#include <unistd.h>
+
+// Used by dev_info.cpp to locate xclbin and workspace
+std::string cur_path;
+std::string xclbin_path;
+
+namespace {
+
+using namespace xrt_core;
+using clk = std::chrono::steady_clock;
+using ns_t = std::chrono::nanoseconds;
+using shim_xdna::trace_record;
+
+struct trace_entry {
+  trace_record rec;
+  std::vector<uint32_t> args;
+};
+
+struct trace_file {
+  shim_xdna::trace_file_header header;
+  std::vector<trace_entry> ops;
+};
+
+struct replay_config {
+  // 1.0 keeps the recorded gaps between operations, 0 replays flat out
+  double speed = 1.0;
+  bool verbose = false;
+};
+
+const char *
+op_name(uint8_t op)
+{
+  static const char *names[] = {
+    "invalid", "ctx_create", "ctx_destroy", "bo_alloc", "bo_import", "bo_free",
+    "bo_sync", "submit", "wait", "fence_create", "fence_signal", "fence_wait",
+  };
+  static_assert(std::size(names) == shim_xdna::TRACE_OP_MAX);
+
+  return op < std::size(names) ? names[op] : "unknown";
+}
+
+trace_file
+read_trace(const std::string& path)
+{
+  std::ifstream in(path, std::ios::binary);
+  trace_file t;
+
+  if (!in)
+    throw std::runtime_error("Failed to open " + path);
+  if (!in.read(reinterpret_cast<char *>(&t.header), sizeof(t.header)) ||
+    std::memcmp(t.header.magic, shim_xdna::trace_magic, sizeof(t.header.magic)))
+    throw std::runtime_error(path + " is not a shim trace");
+  if (t.header.version != shim_xdna::trace_version ||
+    t.header.record_size != sizeof(trace_record))
+    throw std::runtime_error(path + " has unsupported trace version " +
+      std::to_string(t.header.version));
+
+  trace_entry op;
+  while (in.read(reinterpret_cast<char *>(&op.rec), sizeof(op.rec))) {
+    op.args.resize(op.rec.nargs);
+    if (op.rec.nargs &&
+      !in.read(reinterpret_cast<char *>(op.args.data()), op.rec.nargs * sizeof(uint32_t)))
+      break;
+    t.ops.push_back(op);
+  }
+  if (in.bad())
+    throw std::runtime_error("Failed to read " + path);
+  // A capturing process killed before exit leaves a partial record behind
+  if (in.gcount())
+    std::cout << "Ignoring truncated record at the end of " << path << std::endl;
+  return t;
+}
+
+void
+dump_trace(const trace_file& t)
+{
+  std::cout << "pid " << t.header.pid << ", " << t.ops.size() << " records" << std::endl;
+  for (auto& op : t.ops) {
+    auto& r = op.rec;
+    std::cout << std::setw(14) << r.ts_ns << "  " << std::left << std::setw(13) << op_name(r.op)
+              << std::right << " ctx " << r.ctx << " a " << r.a << " b " << r.b
+              << " flags " << static_cast<int>(r.flags);
+    for (size_t i = 0; i < op.args.size(); i++)
+      std::cout << (i ? "," : " args ") << op.args[i];
+    std::cout << std::endl;
+  }
+}
+
+// Re-issues a trace with synthetic buffers of the recorded sizes. Every
+// command is a no-op DPU kernel with the recorded number of arg BOs, so the
+// host, driver and scheduling costs are reproduced, not the device work.
+class replayer {
+public:
+  replayer(device *dev, const trace_file& t, const replay_config& cfg)
+    : m_dev(dev)
+    , m_trace(t)
+    , m_cfg(cfg)
+    , m_filler(std::make_shared<bo>(dev, filler_size))
+  {
+    find_replayable_fences();
+  }
+
+  ~replayer()
+  {
+    // Freeing a BO still used by a command blocks in the driver till it is done
+    m_cmds.clear();
+    m_bos.clear();
+    m_fences.clear();
+    m_ctxs.clear();
+  }
+
+  void
+  run()
+  {
+    auto start = clk::now();
+
+    for (auto& op : m_trace.ops) {
+      if (m_cfg.speed > 0)
+        std::this_thread::sleep_until(start + ns_t(static_cast<uint64_t>(op.rec.ts_ns / m_cfg.speed)));
+      try {
+        if (replay(op))
+          m_replayed[op.rec.op]++;
+        else
+          m_skipped[op.rec.op]++;
+      } catch (const std::exception& ex) {
+        if (m_cfg.verbose)
+          std::cout << op_name(op.rec.op) << " at " << op.rec.ts_ns << " failed: " << ex.what() << std::endl;
+        m_failed[op.rec.op]++;
+      }
+    }
+    for (auto& c : m_cmds)
+      wait_cmd(c.second);
+    m_elapsed = clk::now() - start;
+  }
+
+  void
+  report()
+  {
+    auto recorded = m_trace.ops.empty() ? 0 : m_trace.ops.back().rec.ts_ns;
+    auto replayed = std::chrono::duration_cast<ns_t>(m_elapsed).count();
+
+    std::cout << std::left << std::setw(16) << "op" << std::right << std::setw(12) << "replayed"
+              << std::setw(12) << "skipped" << std::setw(12) << "failed" << std::endl;
+    for (int i = 1; i < shim_xdna::TRACE_OP_MAX; i++) {
+      if (!m_replayed[i] && !m_skipped[i] && !m_failed[i])
+        continue;
+      std::cout << std::left << std::setw(16) << op_name(i) << std::right
+                << std::setw(12) << m_replayed[i] << std::setw(12) << m_skipped[i]
+                << std::setw(12) << m_failed[i] << std::endl;
+    }
+
+    std::cout << "Recorded duration: " << recorded / 1000 << " us" << std::endl;
+    std::cout << "Replayed duration: " << replayed / 1000 << " us" << std::endl;
+    if (m_latencies.empty())
+      return;
+
+    std::sort(m_latencies.begin(), m_latencies.end());
+    std::cout << "Commands completed: " << m_latencies.size() << ", "
+              << std::fixed << std::setprecision(1)
+              << (replayed ? m_latencies.size() * 1e9 / replayed : 0) << " cmds/s" << std::endl;
+    // Commands are reaped when the trace waits on them, after any pacing
+    // sleep in between, so this is an upper bound on completion latency
+    std::cout << "Submit to reaped (us): p50 " << percentile(m_latencies, 0.5) / 1000
+              << " p90 " << percentile(m_latencies, 0.9) / 1000
+              << " p99 " << percentile(m_latencies, 0.99) / 1000
+              << " max " << m_latencies.back() / 1000 << std::endl;
+  }
+
+private:
+  struct replay_ctx {
+    std::unique_ptr<hw_ctx> hwctx;
+    hwqueue_handle *hwq;
+    cuidx_type cu_idx;
+    // All zero control code makes a no-op kernel
+    std::shared_ptr<bo> instr;
+  };
+
+  struct replay_cmd {
+    std::shared_ptr<bo> cbo;
+    hwqueue_handle *hwq = nullptr;
+    clk::time_point submitted;
+  };
+
+  // A shim fence is either signaled or waited on, each recorded fence is
+  // replayed with two handles of the same sync object
+  struct replay_fence {
+    std::shared_ptr<fence_handle> signal;
+    std::shared_ptr<fence_handle> wait;
+  };
+
+  static constexpr size_t filler_size = 0x1000;
+  static constexpr size_t instr_size = 0x1000;
+
+  device *m_dev;
+  const trace_file& m_trace;
+  const replay_config m_cfg;
+  std::shared_ptr<bo> m_filler;
+  std::map<uint32_t, replay_ctx> m_ctxs;
+  std::map<uint64_t, std::shared_ptr<bo>> m_bos;
+  std::map<uint64_t, replay_cmd> m_cmds;
+  std::map<uint64_t, std::shared_ptr<replay_fence>> m_fences;
+  std::set<uint64_t> m_replayable_fences;
+  uint64_t m_replayed[shim_xdna::TRACE_OP_MAX] = {};
+  uint64_t m_skipped[shim_xdna::TRACE_OP_MAX] = {};
+  uint64_t m_failed[shim_xdna::TRACE_OP_MAX] = {};
+  // Submit to wait return of each command
+  std::vector<uint64_t> m_latencies;
+  clk::duration m_elapsed{};
+
+  // Fences imported from other processes are signaled there, waiting on them
+  // here would hang. Only replay fences created and signaled in the trace.
+  void
+  find_replayable_fences()
+  {
+    std::map<uint64_t, uint64_t> root;
+    std::set<uint64_t> created;
+
+    for (auto& op : m_trace.ops) {
+      auto& r = op.rec;
+      if (r.op == shim_xdna::TRACE_OP_FENCE_CREATE) {
+        if (r.flags && root.count(r.b))
+          root[r.a] = root[r.b];
+        else if (!r.flags)
+          created.insert(root[r.a] = r.a);
+      } else if (r.op == shim_xdna::TRACE_OP_FENCE_SIGNAL && root.count(r.a)) {
+        if (created.count(root[r.a]))
+          m_replayable_fences.insert(root[r.a]);
+      }
+    }
+  }
+
+  std::shared_ptr<bo>
+  find_bo(uint64_t handle)
+  {
+    auto it = m_bos.find(handle);
+    return it == m_bos.end() ? nullptr : it->second;
+  }
+
+  replay_ctx *
+  find_ctx(uint32_t slot)
+  {
+    auto it = m_ctxs.find(slot);
+    return it == m_ctxs.end() ? nullptr : &it->second;
+  }
+
+  void
+  wait_cmd(replay_cmd& c)
+  {
+    if (!c.hwq)
+      return;
+    c.hwq->wait_command(c.cbo->get(), 0);
+    auto cmd = reinterpret_cast<ert_start_kernel_cmd *>(c.cbo->map());
+    if (cmd->state != ERT_CMD_STATE_COMPLETED)
+      std::cout << "Command failed, state=" << cmd->state << std::endl;
+    m_latencies.push_back(std::chrono::duration_cast<ns_t>(clk::now() - c.submitted).count());
+    c.hwq = nullptr;
+  }
+
+  void
+  wait_ctx_cmds(const replay_ctx& ctx)
+  {
+    for (auto& c : m_cmds) {
+      if (c.second.hwq == ctx.hwq)
+        wait_cmd(c.second);
+    }
+  }
+
+  bool
+  create_ctx(const trace_record& r)
+  {
+    replay_ctx ctx;
+    std::string ip_name;
+
+    ctx.hwctx = std::make_unique<hw_ctx>(m_dev);
+    ctx.hwq = ctx.hwctx->get()->get_hw_queue();
+    for (auto& ip : get_xclbin_ip_name2index(m_dev)) {
+      if (std::regex_match(ip.first, std::regex("DPU.*"))) {
+        ip_name = ip.first;
+        break;
+      }
+    }
+    if (ip_name.empty())
+      throw std::runtime_error("Cannot find any kernel name matched DPU.*");
+    ctx.cu_idx = ctx.hwctx->get()->open_cu_context(ip_name);
+    ctx.instr = std::make_shared<bo>(m_dev, instr_size, XCL_BO_FLAGS_CACHEABLE);
+    std::memset(ctx.instr->map(), 0, instr_size);
+    ctx.instr->get()->sync(buffer_handle::direction::host2device, instr_size, 0);
+    m_ctxs[r.ctx] = std::move(ctx);
+    return true;
+  }
+
+  bool
+  alloc_bo(const trace_record& r)
+  {
+    uint32_t flags;
+
+    switch (r.flags) {
+    case AMDXDNA_BO_SHMEM:
+      flags = XCL_BO_FLAGS_HOST_ONLY;
+      break;
+    case AMDXDNA_BO_DEV:
+      flags = XCL_BO_FLAGS_CACHEABLE;
+      break;
+    case AMDXDNA_BO_CMD:
+      flags = XCL_BO_FLAGS_EXECBUF;
+      break;
+    default:
+      // Heap and other driver internal BOs come with the device or context
+      return false;
+    }
+    m_bos[r.a] = std::make_shared<bo>(m_dev, r.b, flags);
+    return true;
+  }
+
+  bool
+  free_bo(const trace_record& r)
+  {
+    auto it = m_cmds.find(r.a);
+    if (it != m_cmds.end()) {
+      wait_cmd(it->second);
+      m_cmds.erase(it);
+    }
+    return m_bos.erase(r.a);
+  }
+
+  bool
+  sync_bo(const trace_record& r)
+  {
+    auto b = find_bo(r.a);
+    if (!b)
+      return false;
+    b->get()->sync(r.flags ? buffer_handle::direction::host2device :
+      buffer_handle::direction::device2host, std::min<size_t>(r.b, b->size()), 0);
+    return true;
+  }
+
+  bo&
+  arg_bo(const std::vector<uint32_t>& args, size_t i)
+  {
+    auto b = i < args.size() ? find_bo(args[i]) : nullptr;
+    return b ? *b : *m_filler;
+  }
+
+  bool
+  submit(const trace_entry& op)
+  {
+    auto& r = op.rec;
+    auto ctx = find_ctx(r.ctx);
+    if (!ctx)
+      return false;
+
+    auto& c = m_cmds[r.a];
+    wait_cmd(c);
+    if (!c.cbo) {
+      c.cbo = find_bo(r.a);
+      if (!c.cbo)
+        c.cbo = m_bos[r.a] = std::make_shared<bo>(m_dev, filler_size, XCL_BO_FLAGS_EXECBUF);
+    }
+
+    // Same arg layout as the DPU kernel used by the I/O tests, with the
+    // recorded arg BOs in the data slots and the rest appended
+    exec_buf ebuf(*c.cbo, ERT_START_CU);
+    ebuf.set_cu_idx(ctx->cu_idx);
+    ebuf.add_arg_64(1);
+    for (size_t i = 0; i < 4; i++)
+      ebuf.add_arg_bo(arg_bo(op.args, i));
+    ebuf.add_arg_bo(*ctx->instr);
+    ebuf.add_arg_32(instr_size / sizeof(int32_t));
+    ebuf.add_arg_bo(arg_bo(op.args, 4));
+    for (size_t i = 5; i < op.args.size(); i++)
+      ebuf.add_arg_bo(arg_bo(op.args, i));
+
+    c.hwq = ctx->hwq;
+    c.submitted = clk::now();
+    c.hwq->submit_command(c.cbo->get());
+    return true;
+  }
+
+  bool
+  wait(const trace_record& r)
+  {
+    // A timed out wait is retried by the application, replay the final one
+    if (r.flags == shim_xdna::TRACE_WAIT_TIMEOUT)
+      return false;
+    auto it = m_cmds.find(r.a);
+    if (it == m_cmds.end() || !it->second.hwq)
+      return false;
+    wait_cmd(it->second);
+    return true;
+  }
+
+  bool
+  create_fence(const trace_record& r)
+  {
+    if (r.flags) {
+      auto it = m_fences.find(r.b);
+      if (it == m_fences.end())
+        return false;
+      m_fences[r.a] = it->second;
+      return true;
+    }
+    if (!m_replayable_fences.count(r.a))
+      return false;
+
+    auto f = std::make_shared<replay_fence>();
+    f->signal = m_dev->create_fence(fence_handle::access_mode::local);
+    auto share = f->signal->share();
+    f->wait = m_dev->import_fence(getpid(), share->get_export_handle());
+    m_fences[r.a] = f;
+    return true;
+  }
+
+  bool
+  fence_op(const trace_record& r)
+  {
+    auto it = m_fences.find(r.a);
+    if (it == m_fences.end())
+      return false;
+
+    auto& f = *it->second;
+    bool signal = r.op == shim_xdna::TRACE_OP_FENCE_SIGNAL;
+    if (r.flags) {
+      if (signal)
+        f.signal->signal();
+      else
+        f.wait->wait(0);
+      return true;
+    }
+
+    auto ctx = find_ctx(r.ctx);
+    if (!ctx)
+      return false;
+    if (signal)
+      ctx->hwq->submit_signal(f.signal.get());
+    else
+      ctx->hwq->submit_wait(f.wait.get());
+    return true;
+  }
+
+  bool
+  replay(const trace_entry& op)
+  {
+    auto& r = op.rec;
+
+    switch (r.op) {
+    case shim_xdna::TRACE_OP_CTX_CREATE:
+      return create_ctx(r);
+    case shim_xdna::TRACE_OP_CTX_DESTROY: {
+      auto ctx = find_ctx(r.ctx);
+      if (!ctx)
+        return false;
+      wait_ctx_cmds(*ctx);
+      m_ctxs.erase(r.ctx);
+      return true;
+    }
+    case shim_xdna::TRACE_OP_BO_ALLOC:
+    case shim_xdna::TRACE_OP_BO_IMPORT:
+      return alloc_bo(r);
+    case shim_xdna::TRACE_OP_BO_FREE:
+      return free_bo(r);
+    case shim_xdna::TRACE_OP_BO_SYNC:
+      return sync_bo(r);
+    case shim_xdna::TRACE_OP_SUBMIT:
+      return submit(op);
+    case shim_xdna::TRACE_OP_WAIT:
+      return wait(r);
+    case shim_xdna::TRACE_OP_FENCE_CREATE:
+      return create_fence(r);
+    case shim_xdna::TRACE_OP_FENCE_SIGNAL:
+    case shim_xdna::TRACE_OP_FENCE_WAIT:
+      return fence_op(r);
+    default:
+      return false;
+    }
+  }
+};
+
+bool
+kmq_dev(device *dev)
+{
+  auto device_id = device_query<query::pcie_device>(dev);
+  return device_id == npu1_device_id || device_id == npu2_device_id;
+}
+
+void
+usage(const std::string& prog)
+{
+  std::cout << "\nUsage: " << prog << " [options] <trace_file>\n";
+  std::cout << "Options:\n";
+  std::cout << "\t" << "-h" << ": print this help message\n";
+  std::cout << "\t" << "-p" << ": print the trace and exit\n";
+  std::cout << "\t" << "-d <index>" << ": device index, default 0\n";
+  std::cout << "\t" << "-s <speed>" << ": replay speed relative to capture, 0 for as fast as possible, default 1\n";
+  std::cout << "\t" << "-v" << ": report operations which failed to replay\n";
+  std::cout << "\t" << "-x <xclbin_path>" << ": replay with specified xclbin file\n";
+  std::cout << "\nSet Debug.xdna_trace=<prefix> in xrt.ini to capture <prefix>.<pid> from an application.\n";
+  std::cout << "Set Debug.xdna_emulation=true in xrt.ini and run the copy in bins/emu/bin to replay on the emulated device.\n";
+  std::cout << std::endl;
+}
+
+}
+
+int
+main(int argc, char **argv)
+{
+  std::string program = std::filesystem::path(argv[0]).filename();
+  device::id_type dev_id = 0;
+  bool print_only = false;
+  replay_config cfg;
+
+  int option;
+  while ((option = getopt(argc, argv, ":hpd:s:vx:")) != -1) {
+    switch (option) {
+    case 'h':
+      usage(program);
+      return 0;
+    case 'p':
+      print_only = true;
+      break;
+    case 'd':
+      dev_id = std::stoul(optarg);
+      break;
+    case 's':
+      cfg.speed = std::max(std::stod(optarg), 0.0);
+      break;
+    case 'v':
+      cfg.verbose = true;
+      break;
+    case 'x': {
+      std::ifstream xclbin(optarg);
+      if (!xclbin) {
+        std::cout << "Failed to open xclbin file: " << optarg << std::endl;
+        return 1;
+      }
+      xclbin_path = optarg;
+      break;
+    }
+    case '?':
+      std::cout << "Unknown option: " << static_cast<char>(optopt) << std::endl;
+      return 1;
+    case ':':
+      std::cout << "Missing value for option: " << argv[optind-1] << std::endl;
+      return 1;
+    default:
+      usage(program);
+      return 1;
+    }
+  }
+  if (optind != argc - 1) {
+    usage(program);
+    return 1;
+  }
+
+  cur_path = dirname(argv[0]);
+  setenv("XILINX_XRT", (cur_path + "/../").c_str(), true);
+
+  try {
+    auto trace = read_trace(argv[optind]);
+    if (print_only) {
+      dump_trace(trace);
+      return 0;
+    }
+
+    auto dev = get_userpf_device(dev_id);
+    // Synthetic commands are KMQ exec bufs
+    if (!kmq_dev(dev.get())) {
+      std::cout << "Replay is only supported on KMQ devices" << std::endl;
+      return 1;
+    }
+    replayer r(dev.get(), trace, cfg);
+    r.run();
+    r.report();
+  } catch (const std::exception& ex) {
+    std::cout << ex.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+// vim: ts=2 sw=2 expandtab
@@ -6,11 +6,14 @@
 
 #include "core/common/shim/buffer_handle.h"
 #include "core/common/device.h"
+#include "bo_flags.h"
 
 namespace {
 
 using namespace xrt_core;
 
+using shim_xdna::XDNA_BO_EXT_HUGE_PAGE;
+
 uint64_t
 get_bo_flags(uint32_t flags, uint32_t ext_flags)
 {
@@ -3,6 +3,9 @@
 
 #include "dev_info.h"
 
+#include <cstdio>
+#include <filesystem>
+
 // Test program location, all workspace paths below are relative to it
 extern std::string cur_path;
 // Force to use xclbin pointed to by this path
@@ -228,3 +231,35 @@ get_xclbin_ip_name2index(device* dev, const char *xclbin_name)
 {
   return get_xclbin_info(dev, xclbin_name).ip_name2idx;
 }
+
+// Driver debugfs files of the device, e.g. /sys/kernel/debug/accel/0
+std::string
+get_debugfs_dir(device* dev)
+{
+  auto bdf = device_query<query::pcie_bdf>(dev);
+  char buf[100] = {};
+
+  snprintf(buf, sizeof(buf), "/sys/bus/pci/devices/%04x:%02x:%02x.%x/accel",
+    std::get<0>(bdf), std::get<1>(bdf), std::get<2>(bdf), std::get<3>(bdf));
+  std::string accel(buf);
+
+  for (auto& e : std::filesystem::directory_iterator(accel)) {
+    auto name = e.path().filename().string();
+    if (name.rfind("accel", 0) == 0)
+      return "/sys/kernel/debug/accel/" + name.substr(5);
+  }
+  throw std::runtime_error("no accel node under " + accel);
+}
+
+// Columns the driver placed a hardware context on, as a bitmap
+uint32_t
+get_hwctx_col_map(device* dev, const hwctx_handle* hwctx)
+{
+  auto id = std::to_string(hwctx->get_slotidx());
+
+  for (auto& p : device_query<query::aie_partition_info>(dev)) {
+    if (p.metadata.id == id)
+      return ((1U << p.num_cols) - 1) << p.start_col;
+  }
+  throw std::runtime_error("no partition info for hw context " + id);
+}
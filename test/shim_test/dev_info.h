@@ -33,5 +33,7 @@ std::string get_xclbin_name(device* dev);
 std::string get_xclbin_workspace(device* dev, const char *xclbin_name=nullptr);
 std::string get_xclbin_path(device* dev, const char *xclbin_name=nullptr);
 const std::map<const char*, cuidx_type>& get_xclbin_ip_name2index(device* dev, const char *xclbin_name=nullptr);
+std::string get_debugfs_dir(device* dev);
+uint32_t get_hwctx_col_map(device* dev, const hwctx_handle* hwctx);
 
 #endif // _SHIMTEST_DEV_INFO_H_
@@ -5,7 +5,9 @@
 #include "hwctx.h"
 #include "exec_buf.h"
 #include "io_config.h"
+#include "io_pack.h"
 
+#include <filesystem>
 #include <string>
 #include <regex>
 
@@ -48,13 +50,22 @@ init_sizes()
 
   m_bo_array[IO_TEST_BO_CMD].size = 0x1000;
 
-  auto instr_word_size = get_instr_size(m_local_data_path + instr_file);
-  m_bo_array[IO_TEST_BO_INSTRUCTION].size = instr_word_size * sizeof(int32_t);
+  // Prefer the io pack, sizes are in its header and nothing has to be parsed
+  std::tuple<int, int, int, int, int, int> tp;
+  auto pack_path = m_local_data_path + io_pack_file;
+  if (std::filesystem::exists(pack_path)) {
+    m_pack = std::make_shared<io_pack>(pack_path);
+    m_bo_array[IO_TEST_BO_INSTRUCTION].size = m_pack->section_size(IO_PACK_INSTRUCTION);
+    tp = m_pack->config();
+  } else {
+    m_instr_words = read_instr_words(m_local_data_path + instr_file);
+    m_bo_array[IO_TEST_BO_INSTRUCTION].size = m_instr_words.size() * sizeof(int32_t);
+    tp = parse_config_file(m_local_data_path + config_file);
+  }
   if (m_bo_array[IO_TEST_BO_INSTRUCTION].size == 0)
     throw std::runtime_error("instruction size cannot be 0");
 
   // Loading other sizes
-  auto tp = parse_config_file(m_local_data_path + config_file);
   m_bo_array[IO_TEST_BO_INPUT].size = IFM_SIZE(tp);
   m_bo_array[IO_TEST_BO_INPUT].init_offset = IFM_DIRTY_BYTES(tp);
   m_bo_array[IO_TEST_BO_PARAMETERS].size = PARAM_SIZE(tp);
@@ -90,11 +101,17 @@ void
 io_test_bo_set::
 init_args()
 {
+  if (m_pack) {
+    init_args_from_pack();
+    m_pack.reset();
+    return;
+  }
+
   for (int i = 0; i < IO_TEST_BO_MAX_TYPES; i++) {
     io_test_bo *ibo = &m_bo_array[i];
     switch(i) {
     case IO_TEST_BO_INSTRUCTION:
-      read_instructions_from_txt(m_local_data_path + instr_file, ibo->tbo->map());
+      std::memcpy(ibo->tbo->map(), m_instr_words.data(), m_instr_words.size() * sizeof(uint32_t));
       break;
     case IO_TEST_BO_INPUT:
       read_data_from_bin(m_local_data_path + ifm_file, ibo->init_offset,
@@ -107,6 +124,31 @@ init_args()
       break;
     }
   }
+  m_instr_words = {};
+}
+
+// Sections are copied straight from the mapped file into the BOs
+void
+io_test_bo_set::
+init_args_from_pack()
+{
+  for (int i = 0; i < IO_TEST_BO_MAX_TYPES; i++) {
+    io_test_bo *ibo = &m_bo_array[i];
+    auto p = reinterpret_cast<char *>(ibo->tbo->map());
+    switch(i) {
+    case IO_TEST_BO_INSTRUCTION:
+      m_pack->copy_section(IO_PACK_INSTRUCTION, p, ibo->tbo->size());
+      break;
+    case IO_TEST_BO_INPUT:
+      m_pack->copy_section(IO_PACK_INPUT, p + ibo->init_offset, ibo->tbo->size() - ibo->init_offset);
+      break;
+    case IO_TEST_BO_PARAMETERS:
+      m_pack->copy_section(IO_PACK_PARAMETERS, p, ibo->tbo->size());
+      break;
+    default:
+      break;
+    }
+  }
 }
 
 io_test_bo_set::
@@ -7,7 +7,11 @@
 #include "bo.h"
 
 #include "core/common/device.h"
+#include <cstdint>
 #include <memory>
+#include <vector>
+
+class io_pack;
 
 enum io_test_bo_type {
   IO_TEST_BO_CMD = 0,
@@ -65,6 +69,10 @@ private:
   std::array<io_test_bo, IO_TEST_BO_MAX_TYPES> m_bo_array;
   const std::string m_local_data_path;
   device *m_dev;
+  // Inputs loaded once by init_sizes() and dropped by init_args(), either
+  // the mapped io pack or the words parsed from the instruction text file
+  std::shared_ptr<io_pack> m_pack;
+  std::vector<uint32_t> m_instr_words;
 
   void
   init_sizes();
@@ -74,6 +82,9 @@ private:
 
   void
   init_args();
+
+  void
+  init_args_from_pack();
 };
 
 #endif // _SHIMTEST_IO_H_
@@ -4,11 +4,16 @@
 #ifndef _CONFIG_H_
 #define _CONFIG_H_
 
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <sstream>
 #include <string>
 #include <tuple>
+#include <unistd.h>
 #include <vector>
 
 namespace {
@@ -23,45 +28,30 @@ std::string config_file("ddr_range.txt");
 std::string ofm_format_file("ofm_format.txt");
 std::string dump_inter_file("dump_inter.bin");
 
-size_t get_instr_size(const std::string& fname)
+// Parse a DPU instruction text file, one hex word per line, '#' starts a comment line
+std::vector<uint32_t> read_instr_words(const std::string& fname)
 {
-    std::ifstream myfile(fname);
-    size_t ret = 0;
+    std::ifstream myfile(fname, std::ios::in | std::ios::binary);
 
     if (!myfile.is_open())
       throw std::runtime_error("cannot open instr file");
 
-    std::string line;
-    while (getline(myfile, line)) {
-      if (line.at(0) == '#')
-        continue;
-      ret++;
+    // Read it whole and parse in place, this is on the startup path of every BO set
+    std::string text{std::istreambuf_iterator<char>(myfile), std::istreambuf_iterator<char>()};
+    std::vector<uint32_t> words;
+    const char *p = text.c_str();
+    const char *end = p + text.size();
+
+    while (p < end) {
+      auto eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+      if (!eol)
+        eol = end;
+      if (eol > p && *p != '#')
+        words.push_back(std::strtoul(p, nullptr, 16));
+      p = eol + 1;
     }
-    myfile.close();
 
-    return ret;
-}
-
-// Copy DPU instructions from text file into a buffer
-void read_instructions_from_txt(const std::string& fname, int* buf)
-{
-    std::ifstream myfile(fname);
-    unsigned int value;
-    std::string line;
-    size_t ret = 0;
-
-    if (!myfile.is_open())
-      throw std::runtime_error("cannot open instr file");
-
-    while (getline(myfile, line)) {
-      if (line.at(0) == '#')
-        continue;
-
-      std::stringstream ss(line);
-      ss >> std::hex >> value;
-      *(buf++) = value;
-    }
-    myfile.close();
+    return words;
 }
 
 #define IFM_DIRTY_BYTES(t) std::get<0>(t)
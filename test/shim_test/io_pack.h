@@ -0,0 +1,255 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2024, Advanced Micro Devices, Inc. All rights reserved.
+
+#ifndef _SHIMTEST_IO_PACK_H_
+#define _SHIMTEST_IO_PACK_H_
+
+#include "io_config.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+
+// Binary container of one io test's inputs, made by io_pack from the text and
+// bin files in the test data directory. It is mapped read-only and each section
+// is copied as is into its BO, nothing is parsed when a BO set is created.
+//
+// Layout, all fields little endian:
+//   io_pack_header
+//   io_pack_section[nsections]
+//   section data, each starting on an IO_PACK_ALIGN boundary
+//
+// The format and io_pack are not in the anonymous namespace, a BO set keeps
+// its io_pack from sizing to filling its BOs.
+inline constexpr char io_pack_magic[8] = { 'X', 'D', 'N', 'A', 'I', 'O', 'P', 'K' };
+inline constexpr uint32_t io_pack_version = 1;
+// Sections can be mapped on their own at their file offset
+inline constexpr uint64_t IO_PACK_ALIGN = 4096;
+
+enum io_pack_section_type : uint32_t {
+  IO_PACK_INSTRUCTION = 0,  // DPU instruction words from mc_code.txt
+  IO_PACK_INPUT,            // ifm.bin
+  IO_PACK_PARAMETERS,       // param.bin
+  IO_PACK_MAX_SECTIONS
+};
+
+// Sizes from ddr_range.txt, as returned by parse_config_file()
+struct io_pack_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t nsections;
+  uint32_t ifm_addr;
+  uint32_t ifm_size;
+  uint32_t param_size;
+  uint32_t ofm_size;
+  uint32_t inter_size;
+  uint32_t mc_code_size;
+};
+
+struct io_pack_section {
+  uint32_t type;
+  uint32_t pad;
+  uint64_t offset;
+  uint64_t size;
+};
+
+class io_pack {
+public:
+  io_pack(const std::string& fname) : m_fname(fname)
+  {
+    m_fd = open(fname.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0)
+      throw std::runtime_error("cannot open io pack: " + fname);
+
+    struct stat st;
+    if (fstat(m_fd, &st) || static_cast<size_t>(st.st_size) < sizeof(io_pack_header)) {
+      close(m_fd);
+      throw std::runtime_error("bad io pack size: " + fname);
+    }
+    m_size = st.st_size;
+
+    auto p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, m_fd, 0);
+    if (p == MAP_FAILED) {
+      close(m_fd);
+      throw std::runtime_error("cannot map io pack: " + fname);
+    }
+    m_base = static_cast<const char *>(p);
+
+    try {
+      validate();
+    } catch (...) {
+      munmap(const_cast<char *>(m_base), m_size);
+      close(m_fd);
+      throw;
+    }
+  }
+
+  ~io_pack()
+  {
+    munmap(const_cast<char *>(m_base), m_size);
+    close(m_fd);
+  }
+
+  io_pack(const io_pack&) = delete;
+  io_pack& operator=(const io_pack&) = delete;
+
+  std::tuple<int, int, int, int, int, int>
+  config() const
+  {
+    auto h = header();
+    return std::make_tuple(h->ifm_addr, h->ifm_size, h->param_size, h->ofm_size,
+      h->inter_size, h->mc_code_size);
+  }
+
+  // Size in bytes of a section, 0 if the pack does not have it
+  size_t
+  section_size(io_pack_section_type type) const
+  {
+    auto s = find(type);
+    return s ? s->size : 0;
+  }
+
+  const void *
+  section_data(io_pack_section_type type) const
+  {
+    auto s = find(type);
+    if (!s)
+      throw std::runtime_error("no section " + std::to_string(type) + " in " + m_fname);
+    return m_base + s->offset;
+  }
+
+  // Copy at most size bytes of a section to buf, returns the bytes copied
+  size_t
+  copy_section(io_pack_section_type type, void *buf, size_t size) const
+  {
+    size = std::min(size, section_size(type));
+    std::memcpy(buf, section_data(type), size);
+    return size;
+  }
+
+private:
+  const io_pack_header *
+  header() const
+  {
+    return reinterpret_cast<const io_pack_header *>(m_base);
+  }
+
+  const io_pack_section *
+  sections() const
+  {
+    return reinterpret_cast<const io_pack_section *>(m_base + sizeof(io_pack_header));
+  }
+
+  const io_pack_section *
+  find(io_pack_section_type type) const
+  {
+    for (uint32_t i = 0; i < header()->nsections; i++) {
+      if (sections()[i].type == type)
+        return &sections()[i];
+    }
+    return nullptr;
+  }
+
+  void
+  validate() const
+  {
+    auto h = header();
+
+    if (std::memcmp(h->magic, io_pack_magic, sizeof(io_pack_magic)))
+      throw std::runtime_error("not an io pack: " + m_fname);
+    if (h->version != io_pack_version)
+      throw std::runtime_error("unsupported io pack version " + std::to_string(h->version));
+    if (h->nsections > IO_PACK_MAX_SECTIONS ||
+      sizeof(*h) + h->nsections * sizeof(io_pack_section) > m_size)
+      throw std::runtime_error("bad io pack section table: " + m_fname);
+
+    for (uint32_t i = 0; i < h->nsections; i++) {
+      auto& s = sections()[i];
+      if (s.offset % IO_PACK_ALIGN || s.offset > m_size || s.size > m_size - s.offset)
+        throw std::runtime_error("bad io pack section " + std::to_string(i) + ": " + m_fname);
+    }
+  }
+
+  std::string m_fname;
+  int m_fd = -1;
+  const char *m_base = nullptr;
+  size_t m_size = 0;
+};
+
+namespace {
+
+std::string io_pack_file("io_pack.bin");
+
+std::vector<char>
+read_whole_file(const std::string& fname)
+{
+  std::ifstream myfile(fname, std::ios::in | std::ios::binary | std::ios::ate);
+
+  if (!myfile.is_open())
+    throw std::runtime_error("cannot open file: " + fname);
+
+  std::vector<char> buf(myfile.tellg());
+  myfile.seekg(0);
+  myfile.read(buf.data(), buf.size());
+  return buf;
+}
+
+// Convert the text and bin inputs in data_path to an io pack
+void
+write_io_pack(const std::string& data_path, const std::string& fname)
+{
+  auto tp = parse_config_file(data_path + config_file);
+  std::vector<std::vector<char>> data(IO_PACK_MAX_SECTIONS);
+
+  auto words = read_instr_words(data_path + instr_file);
+  auto wbytes = reinterpret_cast<const char *>(words.data());
+  data[IO_PACK_INSTRUCTION].assign(wbytes, wbytes + words.size() * sizeof(uint32_t));
+  data[IO_PACK_INPUT] = read_whole_file(data_path + ifm_file);
+  data[IO_PACK_PARAMETERS] = read_whole_file(data_path + param_file);
+
+  io_pack_header h = {};
+  std::memcpy(h.magic, io_pack_magic, sizeof(io_pack_magic));
+  h.version = io_pack_version;
+  h.nsections = IO_PACK_MAX_SECTIONS;
+  h.ifm_addr = IFM_DIRTY_BYTES(tp);
+  h.ifm_size = IFM_SIZE(tp);
+  h.param_size = PARAM_SIZE(tp);
+  h.ofm_size = OFM_SIZE(tp);
+  h.inter_size = INTER_SIZE(tp);
+  h.mc_code_size = MC_CODE_SIZE(tp);
+
+  std::vector<io_pack_section> sec(IO_PACK_MAX_SECTIONS);
+  uint64_t off = sizeof(h) + sec.size() * sizeof(io_pack_section);
+  for (uint32_t i = 0; i < sec.size(); i++) {
+    off = (off + IO_PACK_ALIGN - 1) & ~(IO_PACK_ALIGN - 1);
+    sec[i] = { i, 0, off, data[i].size() };
+    off += data[i].size();
+  }
+
+  std::ofstream ofs(fname, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!ofs.is_open())
+    throw std::runtime_error("cannot create io pack: " + fname);
+
+  ofs.write(reinterpret_cast<const char *>(&h), sizeof(h));
+  ofs.write(reinterpret_cast<const char *>(sec.data()), sec.size() * sizeof(io_pack_section));
+  for (uint32_t i = 0; i < sec.size(); i++) {
+    std::vector<char> pad(sec[i].offset - static_cast<uint64_t>(ofs.tellp()));
+    ofs.write(pad.data(), pad.size());
+    ofs.write(data[i].data(), data[i].size());
+  }
+  if (!ofs)
+    throw std::runtime_error("failed to write io pack: " + fname);
+}
+
+}
+
+#endif // _SHIMTEST_IO_PACK_H_
@@ -2,14 +2,21 @@
 // Copyright (C) 2024, Advanced Micro Devices, Inc. All rights reserved.
 
 #include "io.h"
+#include "2proc.h"
 #include "hwctx.h"
 #include "speed.h"
 #include "dev_info.h"
 #include "io_param.h"
+#include "percentile.h"
 
 #include "core/common/device.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <functional>
 #include <string>
 #include <regex>
+#include <thread>
 
 using namespace xrt_core;
 using arg_type = const std::vector<uint64_t>;
@@ -243,6 +250,93 @@ io_test(device::id_type id, device* dev, int total_hwq_submit, int num_cmdlist,
   }
 }
 
+// Measure submission latency in parent while child keeps mapping and unmapping BOs
+class test_2proc_io_latency_map_churn : public test_2proc
+{
+public:
+  test_2proc_io_latency_map_churn(device::id_type id, unsigned int total)
+    : test_2proc(id), m_total(total)
+  {}
+
+private:
+  unsigned int m_total;
+
+  std::vector<long>
+  run_and_measure(io_test_bo_set& boset)
+  {
+    std::vector<long> lat;
+
+    for (unsigned int i = 0; i < m_total; i++) {
+      auto start = clk::now();
+      boset.run(true);
+      auto end = clk::now();
+      lat.push_back(std::chrono::duration_cast<us_t>(end - start).count());
+    }
+    return lat;
+  }
+
+  void
+  report(const char *name, std::vector<long>& lat)
+  {
+    std::sort(lat.begin(), lat.end());
+    long sum = 0;
+    for (auto l : lat)
+      sum += l;
+    msg("%s: %zu commands, average %ld us, p99 %ld us, max %ld us", name, lat.size(),
+      sum / static_cast<long>(lat.size()), percentile(lat, 0.99), lat.back());
+  }
+
+  void
+  run_test_parent() override
+  {
+    msg("test started...");
+
+    bool ready = false;
+    if (!recv_ipc_data(&ready, sizeof(ready)))
+      return;
+
+    auto dev = get_userpf_device(get_dev_id());
+    auto wrk = get_xclbin_workspace(dev.get());
+    io_test_bo_set boset{dev.get(), wrk + "/data/"};
+    auto ibo = boset.get_bos()[IO_TEST_BO_INSTRUCTION].tbo;
+    std::memset(ibo->map(), 0, ibo->size());
+
+    auto idle = run_and_measure(boset);
+    bool go = true;
+    send_ipc_data(&go, sizeof(go));
+    auto churn = run_and_measure(boset);
+    bool done = false;
+    recv_ipc_data(&done, sizeof(done));
+
+    report("Submit latency w/o map churn", idle);
+    report("Submit latency with map churn", churn);
+  }
+
+  void
+  run_test_child() override
+  {
+    msg("test started...");
+
+    auto dev = get_userpf_device(get_dev_id());
+    bool ready = true;
+    send_ipc_data(&ready, sizeof(ready));
+    bool go;
+    recv_ipc_data(&go, sizeof(go));
+
+    // Every BO free unmaps the BO and triggers mmu notifier invalidation
+    unsigned int churned = 0;
+    for (unsigned int i = 0; i < m_total; i++) {
+      bo tbo{dev.get(), 0x400000ul};
+      std::memset(tbo.map(), i, tbo.size());
+      churned++;
+    }
+    msg("Churned %u BO mappings", churned);
+
+    bool done = true;
+    send_ipc_data(&done, sizeof(done));
+  }
+};
+
 }
 
 void
@@ -326,3 +420,274 @@ TEST_noop_io_with_dup_bo(device::id_type id, std::shared_ptr<device> sdev, arg_t
   boset.run(true);
 }
 
+void
+TEST_io_latency_with_map_churn(device::id_type id, std::shared_ptr<device> sdev, arg_type& arg)
+{
+  unsigned int total = static_cast<unsigned int>(arg[0]);
+
+  // Can't fork with opened device.
+  sdev.reset();
+
+  test_2proc_io_latency_map_churn t2p(id, total);
+  t2p.run_test();
+}
+
+namespace {
+
+// Keep a healthy context running good commands while fault() breaks a victim
+// context placed on other columns. The healthy context must not notice.
+void
+io_test_isolation(device* dev, int victim_type,
+  const std::function<void(hw_ctx&, io_test_bo_set&)>& fault)
+{
+  auto wrk = get_xclbin_workspace(dev);
+  auto ip_name = find_first_match_ip_name(dev, "DPU.*");
+  if (ip_name.empty())
+    throw std::runtime_error("Cannot find any kernel name matched DPU.*");
+
+  io_test_parameter_init(IO_TEST_NO_PERF, IO_TEST_NORMAL_RUN, IO_TEST_IOCTL_WAIT);
+  auto good = alloc_and_init_bo_set(dev, wrk + "/data/");
+  hw_ctx hwctx{dev};
+  auto hwq = hwctx.get()->get_hw_queue();
+  good.init_cmd(hwctx.get()->open_cu_context(ip_name), false);
+  good.sync_before_run();
+
+  io_test_parameter_init(IO_TEST_NO_PERF, victim_type, IO_TEST_IOCTL_WAIT);
+  auto victim = alloc_and_init_bo_set(dev, wrk + "/data/");
+  hw_ctx victim_hwctx{dev};
+  victim.init_cmd(victim_hwctx.get()->open_cu_context(ip_name), false);
+  victim.sync_before_run();
+
+  // Isolation only holds for contexts on different columns
+  auto good_cols = get_hwctx_col_map(dev, hwctx.get());
+  auto victim_cols = get_hwctx_col_map(dev, victim_hwctx.get());
+  std::cout << "Healthy context on columns 0x" << std::hex << good_cols
+            << ", victim context on columns 0x" << victim_cols << std::dec << std::endl;
+  if (good_cols & victim_cols)
+    throw std::runtime_error("Healthy and victim contexts share columns");
+
+  auto cbo = good.get_bos()[IO_TEST_BO_CMD].tbo;
+  auto cpkt = reinterpret_cast<ert_start_kernel_cmd *>(cbo->map());
+  std::atomic<bool> stop{false};
+  std::atomic<int> good_runs{0};
+  uint32_t good_state = ERT_CMD_STATE_COMPLETED;
+  std::thread t([&] {
+    while (!stop) {
+      hwq->submit_command(cbo->get());
+      hwq->wait_command(cbo->get(), 0);
+      if (cpkt->state != ERT_CMD_STATE_COMPLETED) {
+        good_state = cpkt->state;
+        break;
+      }
+      cpkt->state = ERT_CMD_STATE_NEW;
+      good_runs++;
+    }
+  });
+
+  int runs_before = good_runs;
+  try {
+    fault(victim_hwctx, victim);
+  } catch (...) {
+    stop = true;
+    t.join();
+    throw;
+  }
+  int runs_during = good_runs - runs_before;
+  stop = true;
+  t.join();
+
+  std::cout << "Healthy context finished " << good_runs << " commands, "
+            << runs_during << " while victim was broken" << std::endl;
+  if (good_state != ERT_CMD_STATE_COMPLETED)
+    throw std::runtime_error(std::string("Healthy context command failed, state=") + std::to_string(good_state));
+  if (!runs_during)
+    throw std::runtime_error("Healthy context made no progress while victim was broken");
+  good.sync_after_run();
+  good.verify_result();
+}
+
+}
+
+void
+TEST_io_bad_run_isolation(device::id_type id, std::shared_ptr<device> sdev, arg_type& arg)
+{
+  io_test_isolation(sdev.get(), IO_TEST_BAD_RUN, [] (hw_ctx& hwctx, io_test_bo_set& boset) {
+    auto cbo = boset.get_bos()[IO_TEST_BO_CMD].tbo;
+    auto hwq = hwctx.get()->get_hw_queue();
+
+    hwq->submit_command(cbo->get());
+    hwq->wait_command(cbo->get(), 5000);
+    auto cpkt = reinterpret_cast<ert_start_kernel_cmd *>(cbo->map());
+    if (cpkt->state == ERT_CMD_STATE_COMPLETED)
+      throw std::runtime_error("Bad run did not fail");
+    std::cout << "Bad run failed as expected, state=" << cpkt->state << std::endl;
+  });
+}
+
+void
+TEST_io_simulated_hang_isolation(device::id_type id, std::shared_ptr<device> sdev, arg_type& arg)
+{
+  auto dev = sdev.get();
+  auto hang_ms = static_cast<uint32_t>(arg[0]);
+  auto hang_file = get_debugfs_dir(dev) + "/simulate_hang";
+
+  io_test_isolation(dev, IO_TEST_NORMAL_RUN, [&] (hw_ctx& hwctx, io_test_bo_set& boset) {
+    auto cbo = boset.get_bos()[IO_TEST_BO_CMD].tbo;
+    auto hwq = hwctx.get()->get_hw_queue();
+
+    // Driver stops scheduling on the victim columns until TDR recovers them
+    std::ofstream hang(hang_file);
+    hang << get_hwctx_col_map(dev, hwctx.get()) << std::endl;
+    if (!hang)
+      throw std::runtime_error("Failed to write " + hang_file);
+
+    // TDR must abort the hung command well before hang_ms
+    hwq->submit_command(cbo->get());
+    if (!hwq->wait_command(cbo->get(), hang_ms))
+      throw std::runtime_error("Hung context not recovered after " + std::to_string(hang_ms) + " ms");
+    auto state = reinterpret_cast<ert_start_kernel_cmd *>(cbo->map())->state;
+    if (state == ERT_CMD_STATE_COMPLETED)
+      throw std::runtime_error("Hung command completed, hang was not simulated");
+    std::cout << "Hung context recovered, state=" << state << std::endl;
+  });
+}
+
+namespace {
+
+const std::string park_ms_param("/sys/module/amdxdna/parameters/hwctx_park_ms");
+
+// Parks and unparks so far, from the hwctx_park debugfs file
+std::pair<uint64_t, uint64_t>
+get_park_counts(device* dev)
+{
+  std::ifstream ifs(get_debugfs_dir(dev) + "/hwctx_park");
+  std::string key;
+  uint64_t parks = 0, unparks = 0;
+
+  if (!(ifs >> key >> parks) || key != "parks" || !(ifs >> key >> unparks) || key != "unparks")
+    throw std::runtime_error("Failed to read hwctx_park stats");
+  return { parks, unparks };
+}
+
+// Set hwctx_park_ms for the scope, restore it after
+class park_ms_setting {
+public:
+  park_ms_setting(unsigned int ms)
+  {
+    std::ifstream ifs(park_ms_param);
+    if (!(ifs >> m_saved))
+      throw std::runtime_error("Failed to read " + park_ms_param);
+    if (m_saved)
+      return;
+    write(ms);
+    m_changed = true;
+  }
+
+  ~park_ms_setting()
+  {
+    if (m_changed)
+      write(m_saved);
+  }
+
+  unsigned int
+  get() const
+  {
+    std::ifstream ifs(park_ms_param);
+    unsigned int ms = 0;
+    ifs >> ms;
+    return ms;
+  }
+
+private:
+  void
+  write(unsigned int ms)
+  {
+    std::ofstream ofs(park_ms_param);
+    ofs << ms << std::endl;
+    if (!ofs)
+      throw std::runtime_error("Failed to write " + park_ms_param);
+  }
+
+  unsigned int m_saved = 0;
+  bool m_changed = false;
+};
+
+}
+
+void
+TEST_io_latency_after_idle(device::id_type id, std::shared_ptr<device> sdev, arg_type& arg)
+{
+  unsigned int idle_ms = static_cast<unsigned int>(arg[0]);
+  unsigned int rounds = static_cast<unsigned int>(arg[1]);
+  auto max_ratio = static_cast<long long>(arg[2]);
+  const unsigned int warm_runs = 100;
+  // Below this a ratio of no-op latencies is mostly noise
+  const long long min_bound_us = 200;
+  auto dev = sdev.get();
+  auto wrk = get_xclbin_workspace(dev);
+
+  // Park after a quarter of the idle time unless the driver is set up already
+  park_ms_setting park(idle_ms / 4);
+  auto park_ms = park.get();
+  idle_ms = std::max(idle_ms, park_ms * 2);
+  std::cout << "Driver park delay " << park_ms << " ms, idle for " << idle_ms << " ms" << std::endl;
+
+  io_test_parameter_init(IO_TEST_LATENCY_PERF, IO_TEST_NOOP_RUN, IO_TEST_IOCTL_WAIT);
+  auto boset = alloc_and_init_bo_set(dev, wrk + "/data/");
+  hw_ctx hwctx{dev};
+  auto hwq = hwctx.get()->get_hw_queue();
+  auto ip_name = find_first_match_ip_name(dev, "DPU.*");
+  if (ip_name.empty())
+    throw std::runtime_error("Cannot find any kernel name matched DPU.*");
+  auto cu_idx = hwctx.get()->open_cu_context(ip_name);
+  boset.init_cmd(cu_idx, false);
+  boset.sync_before_run();
+
+  auto& cbo = boset.get_bos()[IO_TEST_BO_CMD].tbo;
+  auto cpkt = reinterpret_cast<ert_start_kernel_cmd *>(cbo->map());
+  auto run_once = [&] {
+    auto start = clk::now();
+    hwq->submit_command(cbo->get());
+    hwq->wait_command(cbo->get(), 0);
+    auto end = clk::now();
+    if (cpkt->state != ERT_CMD_STATE_COMPLETED)
+      throw std::runtime_error(std::string("Command failed, state=") + std::to_string(cpkt->state));
+    cpkt->state = ERT_CMD_STATE_NEW;
+    return std::chrono::duration_cast<us_t>(end - start).count();
+  };
+
+  long long warm_us = 0;
+  for (unsigned int i = 0; i < warm_runs; i++)
+    warm_us += run_once();
+
+  auto before = get_park_counts(dev);
+  long long idle_us = 0, idle_max_us = 0;
+  for (unsigned int i = 0; i < rounds; i++) {
+    std::this_thread::sleep_for(ms_t(idle_ms));
+    auto us = run_once();
+    idle_us += us;
+    idle_max_us = std::max(idle_max_us, static_cast<long long>(us));
+  }
+
+  // Unpark runs from a work item, give the last one a moment to land
+  auto after = get_park_counts(dev);
+  for (int i = 0; i < 100 && after.second - before.second < rounds; i++) {
+    std::this_thread::sleep_for(ms_t(1));
+    after = get_park_counts(dev);
+  }
+
+  auto busy_avg = warm_us / warm_runs;
+  auto idle_avg = idle_us / rounds;
+  std::cout << "Average latency " << busy_avg << " us when busy, "
+            << idle_avg << " us (max " << idle_max_us << " us) for first command after idle"
+            << std::endl;
+  std::cout << after.first - before.first << " parks, "
+            << after.second - before.second << " unparks in " << rounds << " rounds" << std::endl;
+
+  if (after.first - before.first < rounds || after.second - before.second < rounds)
+    throw std::runtime_error("Context was not parked and unparked in every round");
+  auto bound = std::max(busy_avg * max_ratio, min_bound_us);
+  if (idle_avg > bound)
+    throw std::runtime_error("Latency after idle " + std::to_string(idle_avg) +
+      " us is above " + std::to_string(bound) + " us");
+}
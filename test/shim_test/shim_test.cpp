@@ -25,6 +25,7 @@
 #include <string>
 
 #include <libgen.h>
+#include <sys/mman.h>
 #include <sys/utsname.h>
 #include <unistd.h>
 
@@ -44,6 +45,10 @@ void TEST_export_import_bo(device::id_type, std::shared_ptr<device>, arg_type&);
 void TEST_export_import_bo_single_proc(device::id_type, std::shared_ptr<device>, arg_type&);
 void TEST_io(device::id_type, std::shared_ptr<device>, arg_type&);
 void TEST_io_latency(device::id_type, std::shared_ptr<device>, arg_type&);
+void TEST_io_latency_with_map_churn(device::id_type, std::shared_ptr<device>, arg_type&);
+void TEST_io_latency_after_idle(device::id_type, std::shared_ptr<device>, arg_type&);
+void TEST_io_bad_run_isolation(device::id_type, std::shared_ptr<device>, arg_type&);
+void TEST_io_simulated_hang_isolation(device::id_type, std::shared_ptr<device>, arg_type&);
 void TEST_io_throughput(device::id_type, std::shared_ptr<device>, arg_type&);
 void TEST_io_runlist_latency(device::id_type, std::shared_ptr<device>, arg_type&);
 void TEST_io_runlist_throughput(device::id_type, std::shared_ptr<device>, arg_type&);
@@ -144,6 +149,19 @@ dev_filter_is_aie2(device::id_type id, device* dev)
   return device_id == npu1_device_id || device_id == npu2_device_id;
 }
 
+// Needs root to write driver debugfs files
+bool
+dev_filter_is_aie2_debugfs(device::id_type id, device* dev)
+{
+  if (!dev_filter_is_aie2(id, dev))
+    return false;
+  try {
+    return access((get_debugfs_dir(dev) + "/simulate_hang").c_str(), W_OK) == 0;
+  } catch (const std::exception&) {
+    return false;
+  }
+}
+
 bool
 dev_filter_is_aie4(device::id_type id, device* dev)
 {
@@ -290,6 +308,44 @@ TEST_create_free_debug_bo(device::id_type id, std::shared_ptr<device> sdev, arg_
   }
 }
 
+// Debug BO is synced by driver, sync it range by range and check every range
+void
+TEST_sync_debug_bo_ranges(device::id_type id, std::shared_ptr<device> sdev, arg_type& arg)
+{
+  auto dev = sdev.get();
+  auto boflags = XRT_BO_FLAGS_CACHEABLE;
+  auto ext_boflags = XRT_BO_USE_DEBUG << 4;
+  auto size = static_cast<size_t>(arg[0]);
+  auto nranges = static_cast<size_t>(arg[1]);
+  auto rsize = size / nranges;
+
+  hw_ctx hwctx{dev};
+  auto bo = hwctx.get()->alloc_bo(size, get_bo_flags(boflags, ext_boflags));
+  auto dbg_p = static_cast<char *>(bo->map(buffer_handle::map_type::write));
+  std::memset(dbg_p, 0xff, size);
+
+  auto start = clk::now();
+  for (size_t i = 0; i < nranges; i++)
+    bo.get()->sync(buffer_handle::direction::device2host, rsize, i * rsize);
+  auto end = clk::now();
+  get_speed_and_print("sync debug bo", rsize * nranges, start, end);
+
+  for (size_t i = 0; i < nranges; i++) {
+    if (std::memcmp(dbg_p + i * rsize, std::string(rsize, 0xff).c_str(), rsize) != 0)
+      throw std::runtime_error("Debug buffer range " + std::to_string(i) + " is not synced");
+  }
+
+  // Range beyond the end of BO must be rejected
+  bool failed = false;
+  try {
+    bo.get()->sync(buffer_handle::direction::device2host, rsize, size);
+  } catch (const std::system_error& e) {
+    failed = true;
+  }
+  if (!failed)
+    throw std::runtime_error("Syncing out of range debug BO did not fail");
+}
+
 void
 get_and_show_bo_properties(device* dev, buffer_handle *boh)
 {
@@ -349,6 +405,64 @@ TEST_sync_bo_off_size(device::id_type id, std::shared_ptr<device> sdev, arg_type
   get_speed_and_print("sync", sync_size, start, end);
 }
 
+void
+TEST_create_free_userptr_bo(device::id_type id, std::shared_ptr<device> sdev, arg_type& arg)
+{
+  auto dev = sdev.get();
+  auto size = static_cast<size_t>(arg[0]);
+  auto flags = get_bo_flags(XCL_BO_FLAGS_HOST_ONLY, 0);
+
+  auto buf = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buf == MAP_FAILED)
+    throw std::runtime_error("Failed to mmap " + std::to_string(size) + " bytes");
+  std::memset(buf, 0xa5, size);
+
+  try {
+    auto boh = dev->alloc_bo(buf, size, flags);
+    auto p = boh->map(buffer_handle::map_type::write);
+    if (p != buf)
+      throw std::runtime_error("User ptr BO is not mapped at user address");
+    boh->sync(buffer_handle::direction::host2device, size, 0);
+    get_and_show_bo_properties(dev, boh.get());
+  } catch (...) {
+    ::munmap(buf, size);
+    throw;
+  }
+  // BO is gone, user memory should still be valid
+  if (static_cast<uint8_t*>(buf)[size - 1] != 0xa5)
+    throw std::runtime_error("User memory is corrupted after BO is freed");
+  ::munmap(buf, size);
+}
+
+void
+TEST_huge_page_bo_perf(device::id_type id, std::shared_ptr<device> sdev, arg_type& arg)
+{
+  auto size = static_cast<size_t>(arg[0]);
+  const std::vector<std::pair<const char *, uint32_t>> variants = {
+    { "normal page", 0 },
+    { "huge page", XDNA_BO_EXT_HUGE_PAGE },
+  };
+
+  for (auto& v : variants) {
+    std::cout << "\t" << v.first << " BO:" << std::endl;
+
+    auto start = clk::now();
+    bo bo{sdev.get(), size, XCL_BO_FLAGS_HOST_ONLY, v.second};
+    auto end = clk::now();
+    get_speed_and_print("alloc and map", size, start, end);
+
+    start = clk::now();
+    memset(bo.map(), 0, size);
+    end = clk::now();
+    get_speed_and_print("first touch", size, start, end);
+
+    start = clk::now();
+    bo.get()->sync(buffer_handle::direction::host2device, size, 0);
+    end = clk::now();
+    get_speed_and_print("sync", size, start, end);
+  }
+}
+
 void
 TEST_map_read_bo(device::id_type id, std::shared_ptr<device> sdev, arg_type& arg)
 {
@@ -561,6 +675,12 @@ std::vector<test_case> test_list {
   test_case{ "io test real kernel good run", {},
     TEST_POSITIVE, dev_filter_is_aie2, TEST_io, { IO_TEST_NORMAL_RUN, 1 }
   },
+  test_case{ "io test bad run does not disturb other context", {},
+    TEST_POSITIVE, dev_filter_is_aie2, TEST_io_bad_run_isolation, {}
+  },
+  test_case{ "io test simulated hang does not disturb other context", {},
+    TEST_POSITIVE, dev_filter_is_aie2_debugfs, TEST_io_simulated_hang_isolation, { 10000 }
+  },
   test_case{ "measure no-op kernel latency", {},
     TEST_POSITIVE, dev_filter_is_aie2, TEST_io_latency, { IO_TEST_NOOP_RUN, IO_TEST_IOCTL_WAIT, 32000 }
   },
@@ -573,6 +693,9 @@ std::vector<test_case> test_list {
   test_case{ "create and free large debug bo", {-1, -1},
     TEST_POSITIVE, dev_filter_is_aie2, TEST_create_free_debug_bo, { 0x100000 }
   },
+  test_case{ "sync debug bo by ranges", {-1, -1},
+    TEST_POSITIVE, dev_filter_is_aie2, TEST_sync_debug_bo_ranges, { 0x10000, 16 }
+  },
   test_case{ "multi-command io test real kernel good run", {},
     TEST_POSITIVE, dev_filter_is_aie2, TEST_io, { IO_TEST_NORMAL_RUN, 3 }
   },
@@ -633,6 +756,22 @@ std::vector<test_case> test_list {
   test_case{ "export import BO in single process", {-1, -1},
     TEST_POSITIVE, dev_filter_is_aie2, TEST_export_import_bo_single_proc, {}
   },
+  test_case{ "create_and_free_userptr_bo", {},
+    TEST_POSITIVE, dev_filter_is_aie2, TEST_create_free_userptr_bo, {0x400000}
+  },
+  test_case{ "create_userptr_bo unaligned size", {},
+    TEST_NEGATIVE, dev_filter_is_aie2, TEST_create_free_userptr_bo, {0x1004}
+  },
+  test_case{ "huge page input_output bo and test perf", {},
+    TEST_POSITIVE, dev_filter_xdna, TEST_huge_page_bo_perf, {0x10000000}
+  },
+  test_case{ "measure no-op kernel latency with map churn in another process", {},
+    TEST_POSITIVE, dev_filter_is_aie2, TEST_io_latency_with_map_churn, {2000}
+  },
+  // idle ms, rounds, max ratio of average latency after idle to busy
+  test_case{ "measure no-op kernel latency after idle", {},
+    TEST_POSITIVE, dev_filter_is_aie2_debugfs, TEST_io_latency_after_idle, {200, 10, 4}
+  },
 };
 
 // Test case executor implementation
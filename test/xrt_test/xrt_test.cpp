@@ -9,13 +9,19 @@
 #include "xrt/experimental/xrt_ext.h"
 #include "xrt/experimental/xrt_module.h"
 
+#include "percentile.h"
+
 #include <fstream>
 #include <algorithm>
 #include <filesystem>
+#include <iomanip>
 #include <libgen.h>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <stdlib.h>
 #include <string>
+#include <thread>
 #include <vector>
 #include <chrono>
 #include <regex>
@@ -61,7 +67,7 @@ usage(const std::string& prog)
 {
   std::cout << "\nUsage: " << prog << " [xclbin] [test case ID separated by space]\n";
   std::cout << "Examples:\n";
-  std::cout << "\t" << prog << " - run all test cases\n";
+  std::cout << "\t" << prog << " - run all test cases, except long running ones\n";
   std::cout << "\t" << prog << " [test case ID separated by space] - run specified test cases\n";
   std::cout << "\t" << prog << " /path/to/a/test.xclbin - run all test cases with test.xclbin\n";
   std::cout << "\n";
@@ -72,6 +78,7 @@ struct test_case { // Definition of one test case
   const char *description;
   void (*func)(int device_index, arg_type& arg);
   arg_type arg;
+  bool on_demand = false; // long running, only run when given by ID
 };
 
 // For overall test result evaluation
@@ -424,6 +431,210 @@ TEST_xrt_stress_hwctx(int device_index, arg_type& arg)
   }
 }
 
+// Kernels of different duration for the scaling sweep
+struct scaling_kernel {
+  const char *name;
+  const char *xclbin;
+  const char *elf;
+  const char *kname;
+  bool need_bos;
+};
+
+const std::vector<scaling_kernel> scaling_kernels = {
+  { "nop",   "npu3_workspace/nop.xclbin",   "npu3_workspace/nop.elf",   "dpu:{nop}",   false },
+  { "df_bw", "npu3_workspace/df_bw.xclbin", "npu3_workspace/df_bw.elf", "dpu:{df_bw}", true },
+};
+
+struct scaling_result {
+  const char *kernel;
+  unsigned hwctxs;
+  unsigned threads;
+  unsigned depth;
+  uint64_t runs;
+  double runs_per_sec;
+  double p50_us;
+  double p99_us;
+};
+
+// Keep depth runs in flight on one kernel, restart each run as soon as it is waited
+std::vector<double>
+scaling_submitter(const xrt::device& device, xrt::kernel& kernel, bool need_bos,
+  unsigned depth, uint64_t total)
+{
+  using clock = std::chrono::steady_clock;
+  const uint32_t bo_size = 12 * sizeof(uint32_t);
+  std::vector<std::unique_ptr<xrt_bo>> bos;
+  std::vector<xrt::run> runs;
+  std::vector<clock::time_point> starts(depth);
+  std::vector<double> lat;
+
+  for (unsigned i = 0; i < depth; i++) {
+    runs.emplace_back(kernel);
+    if (need_bos) {
+      bos.push_back(std::make_unique<xrt_bo>(device, bo_size, xrt::bo::flags::cacheable));
+      runs.back().set_arg(0, bos.back()->get());
+      bos.push_back(std::make_unique<xrt_bo>(device, bo_size, xrt::bo::flags::cacheable));
+      runs.back().set_arg(1, bos.back()->get());
+    }
+  }
+
+  lat.reserve(total);
+  uint64_t started = 0;
+  for (unsigned i = 0; i < depth && started < total; i++, started++) {
+    starts[i] = clock::now();
+    runs[i].start();
+  }
+  for (uint64_t done = 0; done < total; done++) {
+    auto i = done % depth;
+    auto state = runs[i].wait(600000 /* 600 sec, some simnow server are slow */);
+    if (state != ERT_CMD_STATE_COMPLETED)
+      throw std::runtime_error(std::string("bad command state: ") + std::to_string(state));
+    lat.push_back(std::chrono::duration<double, std::micro>(clock::now() - starts[i]).count());
+    if (started < total) {
+      starts[i] = clock::now();
+      runs[i].start();
+      started++;
+    }
+  }
+  return lat;
+}
+
+scaling_result
+scaling_run_one(const xrt::device& device, const scaling_kernel& k,
+  std::vector<xrt::kernel>& kernels, unsigned threads, unsigned depth, uint64_t runs)
+{
+  std::vector<std::thread> workers;
+  std::vector<std::vector<double>> lats(threads);
+  std::exception_ptr error;
+  std::mutex error_lock;
+
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned t = 0; t < threads; t++) {
+    workers.emplace_back([&, t] {
+      try {
+        // Threads are spread over contexts round robin
+        lats[t] = scaling_submitter(device, kernels[t % kernels.size()], k.need_bos, depth, runs);
+      } catch (...) {
+        std::lock_guard<std::mutex> lk(error_lock);
+        error = std::current_exception();
+      }
+    });
+  }
+  for (auto& w : workers)
+    w.join();
+  auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if (error)
+    std::rethrow_exception(error);
+
+  std::vector<double> all;
+  for (auto& l : lats)
+    all.insert(all.end(), l.begin(), l.end());
+  std::sort(all.begin(), all.end());
+
+  scaling_result r = { k.name, static_cast<unsigned>(kernels.size()), threads, depth };
+  r.runs = all.size();
+  r.runs_per_sec = all.size() / secs;
+  r.p50_us = percentile(all, 0.5);
+  r.p99_us = percentile(all, 0.99);
+  return r;
+}
+
+void
+scaling_print(const scaling_result& r)
+{
+  std::ios_base::fmtflags f(std::cout.flags());
+
+  std::cout << std::left << std::setw(8) << r.kernel << std::right
+            << std::setw(8) << r.hwctxs << std::setw(8) << r.threads << std::setw(8) << r.depth
+            << std::fixed << std::setprecision(0)
+            << std::setw(12) << r.runs_per_sec << std::setprecision(1)
+            << std::setw(12) << r.p50_us << std::setw(12) << r.p99_us << std::endl;
+  std::cout.flags(f);
+}
+
+/*
+ * Walk the thread axis of every (kernel, hwctx, depth) series and report the
+ * knee, the first step where throughput grows by less than 10%. If at that
+ * point each context runs slower than the best any configuration got out of
+ * one context of the same kernel, the NPU had room left and the submitters
+ * are held back on the host, e.g. by locks on the submission path.
+ */
+void
+scaling_report_knee(const std::vector<scaling_result>& res)
+{
+  // Only report the first knee of each series
+  bool reported = false;
+  for (size_t i = 1; i < res.size(); i++) {
+    auto& prev = res[i - 1];
+    auto& cur = res[i];
+    if (prev.kernel != cur.kernel || prev.hwctxs != cur.hwctxs || prev.depth != cur.depth) {
+      reported = false;
+      continue;
+    }
+    if (reported || cur.runs_per_sec >= prev.runs_per_sec * 1.1)
+      continue;
+    reported = true;
+
+    double best_per_ctx = 0;
+    for (auto& r : res) {
+      if (r.kernel == cur.kernel)
+        best_per_ctx = std::max(best_per_ctx, r.runs_per_sec / r.hwctxs);
+    }
+    bool host_bound = prev.runs_per_sec / prev.hwctxs < best_per_ctx * 0.9;
+    std::cout << "knee: " << cur.kernel << " hwctx=" << cur.hwctxs << " depth=" << cur.depth
+              << " stops scaling at " << prev.threads << " thread(s), "
+              << (host_bound ? "host side limited" : "device limited") << std::endl;
+  }
+}
+
+/* sweep submitter threads x hwctx x queue depth x kernel, report throughput and tail latency */
+void
+TEST_xrt_stress_scaling(int device_index, arg_type& arg)
+{
+  auto device = xrt::device{device_index};
+  unsigned max_threads = static_cast<unsigned>(arg[0]);
+  unsigned max_hwctx = static_cast<unsigned>(arg[1]);
+  unsigned max_depth = static_cast<unsigned>(arg[2]);
+  uint64_t runs = arg[3];
+  std::vector<scaling_result> res;
+
+  std::cout << std::left << std::setw(8) << "kernel" << std::right
+            << std::setw(8) << "hwctx" << std::setw(8) << "threads" << std::setw(8) << "depth"
+            << std::setw(12) << "runs/sec" << std::setw(12) << "p50(us)"
+            << std::setw(12) << "p99(us)" << std::endl;
+
+  for (auto& k : scaling_kernels) {
+    auto xclbin = xrt::xclbin(xclbinpath.empty() ? local_path(k.xclbin) : xclbinpath);
+    auto uuid = device.register_xclbin(xclbin);
+    xrt::elf elf{local_path(k.elf)};
+    xrt::module mod{elf};
+
+    for (unsigned nctx = 1; nctx <= max_hwctx; nctx *= 2) {
+      std::vector<xrt::hw_context> hwctxs;
+      std::vector<xrt::kernel> kernels;
+      try {
+        for (unsigned i = 0; i < nctx; i++) {
+          hwctxs.emplace_back(device, uuid);
+          kernels.push_back(xrt::ext::kernel{hwctxs.back(), mod, k.kname});
+        }
+      } catch (const std::exception& ex) {
+        // Out of columns, more contexts won't fit either
+        std::cout << k.name << ": can't create " << nctx << " hwctx, " << ex.what() << std::endl;
+        break;
+      }
+
+      for (unsigned depth = 1; depth <= max_depth; depth *= 4) {
+        for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+          res.push_back(scaling_run_one(device, k, kernels, threads, depth, runs));
+          scaling_print(res.back());
+        }
+      }
+    }
+  }
+
+  scaling_report_knee(res);
+}
+
 // List of all test cases
 std::vector<test_case> test_list {
   test_case{ "npu3 xrt vadd", TEST_xrt_umq_vadd, {} },
@@ -434,6 +645,8 @@ std::vector<test_case> test_list {
   test_case{ "npu3 xrt df_bw", TEST_xrt_umq_df_bw, {} },
   test_case{ "npu3 xrt stress - start", TEST_xrt_stress_start, {32} },
   test_case{ "npu3 xrt stress - hwctx", TEST_xrt_stress_hwctx, {2} }, //upto 2 now
+  // max threads, max hwctx, max queue depth, runs per thread
+  test_case{ "npu3 xrt stress - scaling", TEST_xrt_stress_scaling, {8, 4, 16, 128}, true },
 };
 
 }
@@ -479,6 +692,11 @@ run_all_test(std::set<int>& tests)
         tests.erase(i);
     }
     const auto& t = test_list[i];
+    if (all && t.on_demand) {
+      std::cout << "====== " << i << ": " << t.description << " skipped, run it by ID =====" << std::endl;
+      test_skipped++;
+      continue;
+    }
     run_test(i, t, device_index);
     std::cout << std::endl;
   }